@@ -0,0 +1,45 @@
+function data = ReadRecording(Name)
+    % Reads a binary recording of the ModularBCI driver (.mbci) into a table
+    % with the same Channel1..N columns (in uV) as the CSV exports, so that
+    % it can be used in place of readtable in main.m.
+    % Samples lost while recording are left as NaN.
+    fid = fopen(Name,'r','l');
+    magic = fread(fid,8,'*char')';
+    if ~startsWith(magic,'MBCIREC')
+        fclose(fid);
+        error('%s is not a ModularBCI recording',Name);
+    end
+
+    fseek(fid,16,'bof');
+    chunkSize = fread(fid,1,'uint32');
+    nChannel = fread(fid,1,'uint32');
+    fseek(fid,44,'bof');
+    unitsToMicroVolts = fread(fid,1,'single');
+    fseek(fid,56,'bof');
+    nSample = fread(fid,1,'uint64');
+    fseek(fid,72,'bof');
+    nChunk = fread(fid,1,'uint64');
+    indexOffset = fread(fid,1,'uint64');
+    if nChunk == 0
+        fclose(fid);
+        error('%s was not closed properly and has no index',Name);
+    end
+
+    % index entries: firstSample, time, chunk, type, nSample, payloadSize
+    fseek(fid,indexOffset,'bof');
+    index = fread(fid,[8 nChunk],'uint32=>double');
+    firstSample = index(1,:) + index(2,:)*2^32;
+    chunk = index(5,:);
+    type = index(6,:);
+    chunkSamples = index(7,:);
+
+    values = NaN(nSample,nChannel);
+    for i = find(type == 2)
+        fseek(fid,4096 + chunk(i)*chunkSize + 40,'bof');
+        block = fread(fid,[nChannel chunkSamples(i)],'int32')';
+        values(firstSample(i)+1:firstSample(i)+chunkSamples(i),:) = block*unitsToMicroVolts;
+    end
+    fclose(fid);
+
+    data = array2table(values,'VariableNames',compose('Channel%d',1:nChannel));
+end
@@ -1,6 +1,10 @@
 prompt = "Enter file\n";
 Name = input(prompt);
-data = readtable(Name);
+if endsWith(Name,'.mbci')
+    data = ReadRecording(Name);
+else
+    data = readtable(Name);
+end
 
 % if more than one trial uncomment the following section
 
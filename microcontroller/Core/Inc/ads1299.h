@@ -47,9 +47,9 @@ void ADS1299_SetBIAS_SENSP(uint8_t chan1, uint8_t chan2, uint8_t chan3,
 void ADS1299_SetBIAS_SENSN(uint8_t chan1, uint8_t chan2, uint8_t chan3,
 		uint8_t chan4, uint8_t chan5, uint8_t chan6, uint8_t chan7,
 		uint8_t chan8);
-void ADS1299_SetLOFF_SENSP(void);
-void ADS1299_SetLOFF_SENSN(void);
-void ADS1299_SetLOFF_FLIP(void);
+void ADS1299_SetLOFF_SENSP(uint8_t channels);
+void ADS1299_SetLOFF_SENSN(uint8_t channels);
+void ADS1299_SetLOFF_FLIP(uint8_t channels);
 void ADS1299_SetMISC1(uint8_t SRB1);
 void ADS1299_SetConfig4(uint8_t SINGLE_SHOT, uint8_t PD_LOFF_COMP);
 
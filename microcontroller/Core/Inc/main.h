@@ -54,6 +54,7 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+void UART_Rx_Idle_Callback(void);
 
 /* USER CODE END EFP */
 
@@ -63,6 +64,9 @@ void Error_Handler(void);
 #define DRDY_Pin GPIO_PIN_5
 #define DRDY_GPIO_Port GPIOC
 #define DRDY_EXTI_IRQn EXTI9_5_IRQn
+#define MARKER_Pin GPIO_PIN_13
+#define MARKER_GPIO_Port GPIOC
+#define MARKER_EXTI_IRQn EXTI15_10_IRQn
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
@@ -59,7 +59,7 @@ void ADS1299_SetConfig1(uint8_t DAISY_EN, uint8_t CLK_EN, uint8_t DR) {
 			DAISY_EN << 6 | //DAISY ON
 			CLK_EN << 5 | //Clock reference comes from Head
 			2 << 3 | //reserved
-			DR << 1; //DATA RATE = 250 SPS
+			DR; //DATA RATE
 
 	ADS_SPI_SENDREG(first_byte);
 	ADS_SPI_SENDREG(second_byte);
@@ -212,11 +212,12 @@ void ADS1299_SetBIAS_SENSN(uint8_t chan1, uint8_t chan2, uint8_t chan3,
 
 /**
  * @brief sets the LOFF_SENSPx connection
+ * @param channels bit n set -> lead-off detection (and excitation current) on IN(n+1)P
  */
-void ADS1299_SetLOFF_SENSP() {
+void ADS1299_SetLOFF_SENSP(uint8_t channels) {
 	uint8_t write_at_reg = ADS1299_cmd.wreg | 0xF; //write at register
 	uint8_t num_reg = 0; // number o registers to write -1
-	uint8_t regSENSP = 0x00; //LOFF_SENSP register reset is 0x00 ->set to 0xFF to enable LeadOFF
+	uint8_t regSENSP = channels; //LOFF_SENSP register reset is 0x00 ->set to 0xFF to enable LeadOFF
 
 	ADS_SPI_SENDREG(write_at_reg);
 	ADS_SPI_SENDREG(num_reg);
@@ -225,11 +226,12 @@ void ADS1299_SetLOFF_SENSP() {
 
 /**
  * @brief sets the LOFF_SENSNx connection
+ * @param channels bit n set -> lead-off detection (and excitation current) on IN(n+1)N
  */
-void ADS1299_SetLOFF_SENSN() {
+void ADS1299_SetLOFF_SENSN(uint8_t channels) {
 	uint8_t write_at_reg = ADS1299_cmd.wreg | 0x10; //write at register
 	uint8_t num_reg = 0; // number o registers to write -1
-	uint8_t regSENSN = 0x00; //LOFF_SENSN register reset is 0x00 ->set to 0xFF to enable LeadOFF
+	uint8_t regSENSN = channels; //LOFF_SENSN register reset is 0x00 ->set to 0xFF to enable LeadOFF
 
 	ADS_SPI_SENDREG(write_at_reg);
 	ADS_SPI_SENDREG(num_reg);
@@ -238,11 +240,12 @@ void ADS1299_SetLOFF_SENSN() {
 
 /**
  * @brief set bits to flip LOFF_SENSP and LOFF_SENSN (PullUp/PullDown of INxP and INxN)
+ * @param channels bit n set -> current direction of channel n+1 flipped
  */
-void ADS1299_SetLOFF_FLIP() {
+void ADS1299_SetLOFF_FLIP(uint8_t channels) {
 	uint8_t write_at_reg = ADS1299_cmd.wreg | 0x11; //write at register
 	uint8_t num_reg = 0; // number o registers to write -1
-	uint8_t regFLIP = 0x00; //LOFF_FLIP register reset is 0x00 ->set to 0xFF to enable LeadOFF_FLIP
+	uint8_t regFLIP = channels; //LOFF_FLIP register reset is 0x00 ->set to 0xFF to enable LeadOFF_FLIP
 
 	ADS_SPI_SENDREG(write_at_reg);
 	ADS_SPI_SENDREG(num_reg);
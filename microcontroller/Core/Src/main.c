@@ -22,6 +22,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include <math.h>
 
 /* USER CODE END Includes */
 
@@ -32,6 +33,47 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define ADS1299_CHANNELS_PER_DEVICE 8 //number of EEG channels of one ADS1299
+#define ADS1299_FRAME_SIZE 27 //3 status bytes followed by 8 channels of 24 bit data
+#define ADS1299_STATUS_SIZE 3 //size of the status word at the beginning of every frame
+#define ADS1299_VALUE_SIZE 3 //size of one channel value (24 bit)
+#define DEFAULT_CHANNEL_MASK 0xFF //channels 1-8 are powered on, as the host expects until it sends its mask
+#define MARKER_CODE_MASK 0x0F //markers are 4 bit codes sent in place of the ADS1299 GPIO bits (low nibble of the last status byte)
+#define MARKER_INPUT_CODE 1 //marker code of a falling edge on the marker input (PC13)
+#define MARKER_INPUT_HOLDOFF 20 //in ms, edges closer to the previous one are ignored (button bounce)
+#define AUX_FRAME_START 0xA5 //first byte of an auxiliary frame, never the first status byte of an EEG frame (0xC0)
+#define AUX_FRAME_LATENCY_PROBE 1 //auxiliary frame type of the latency probe reply
+#define COMMAND_FRAME_START 0xA5 //first byte of a command frame: start, command, argument size, arguments, XOR of the command, size and argument bytes
+#define COMMAND_MAX_SIZE 8 //longest argument of a command, a larger size marks a corrupted frame
+#define COMMAND_FRAME_TIMEOUT_MS 20 //idle time after which the rest of an incomplete frame is given up, longer than the gaps of the USB bridge within a frame
+#define UART_RX_RING_SIZE 256 //circular DMA buffer the commands are received into, a power of 2
+#define DEFAULT_DATA_RATE 6 //CONFIG1 DR code: 6->250SPS, each lower code doubles the rate
+#define DATA_RATE_MAX_CODE 6 //lowest data rate
+#define EEG_FRAME_START 0xC0 //first status byte of an EEG frame, the lead-off bits of the ADS1299 status word are not sent
+#define FRAME_CHECK_SHIFT 4 //the frame check is sent in the high nibble of the last status byte, above the marker
+#define AUX_FRAME_IMPEDANCE 2 //auxiliary frame type of the result of an impedance measurement
+#define IMPEDANCE_LOFF_CURRENT 0 //LOFF ILEAD_OFF code of the excitation current: 6nA
+#define IMPEDANCE_LOFF_FREQUENCY 3 //LOFF FLEAD_OFF code of the excitation: AC at f_DR/4
+#define IMPEDANCE_SETTLE_COUNT 8 //samples skipped after the excitation moved to the next channel
+#define IMPEDANCE_SAMPLE_COUNT 64 //samples the detector runs on per channel, a whole number of excitation periods
+#define AUX_FRAME_SELF_TEST 3 //auxiliary frame type of the self-test result of a channel
+#define AUX_FRAME_COMMAND_REPLY 4 //auxiliary frame type of the reply to a configuration or test command: command, COMMAND_ACCEPTED or COMMAND_REJECTED
+#define COMMAND_ACCEPTED 0
+#define COMMAND_REJECTED 1 //unknown command, wrong argument size or value, not accepted while streaming, or not supported by this setup
+#define SELF_TEST_CHANNEL_COUNT 32 //channels of 4 ADS1299
+#define SELF_TEST_SETTLE_COUNT 16 //samples skipped after the channel inputs switched
+#define SELF_TEST_SAMPLE_COUNT 256 //samples of each phase at 250SPS, doubled with each doubling of the data rate (about 1 s)
+#define SELF_TEST_AMPLITUDE 83886 //test signal amplitude in ADC codes: (VREFP - VREFN) / 2400 at gain 24, 2^23 / 100 whatever the reference
+#define SELF_TEST_FREQUENCY 1953 //test signal frequency in mHz: f_CLK / 2^20
+#define SELF_TEST_TOLERANCE 10 //in % of the expected amplitude and frequency
+#define SELF_TEST_NOISE_LIMIT 224 //RMS noise of a shorted input in ADC codes: 5uV input referred at gain 24
+#define SELF_TEST_AMPLITUDE_OK 1 //result flags
+#define SELF_TEST_FREQUENCY_OK 2
+#define SELF_TEST_NOISE_OK 4
+#define SELF_TEST_IDLE 0 //self-test phases
+#define SELF_TEST_LEARN 1 //test signal, its extremes give the threshold the edges are detected at
+#define SELF_TEST_SIGNAL 2 //test signal, amplitude and frequency
+#define SELF_TEST_SHORTED 3 //shorted inputs, noise
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -42,6 +84,7 @@
 /* Private variables ---------------------------------------------------------*/
 SPI_HandleTypeDef hspi1;
 DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_usart1_rx;
 
 UART_HandleTypeDef huart1;
 
@@ -57,19 +100,71 @@ static void MX_SPI1_Init(void);
 static void MX_USART1_UART_Init(void);
 /* USER CODE BEGIN PFP */
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+void Command_Receive_Start(void);
+void Command_Poll(void);
+void Command_Execute(uint8_t command, const uint8_t *arguments, uint8_t size);
+void Apply_Channel_Mask(void);
+uint16_t Pack_EEG_Frame(const volatile uint8_t *frame, uint8_t *packed);
+void Timestamp_Init(void);
+uint32_t Get_Timestamp(uint32_t cycles);
+uint8_t Frame_Check(const uint8_t *frame, uint16_t size);
+void Impedance_Start(void);
+void Impedance_Stop(void);
+void Impedance_Sample(const volatile uint8_t *frame);
+void Self_Test_Start(void);
+void Self_Test_Stop(void);
+void Self_Test_Sample(const volatile uint8_t *frame);
+void Set_Channel_Input(uint8_t MUX);
+void Send_Aux_Frame(uint8_t type, const uint8_t *payload, uint8_t size);
+void Send_Command_Reply(uint8_t command, uint8_t status);
+void Send_Latency_Probe_Reply(uint32_t drdy_cycles);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 uint8_t ext_flag = 0; //interrupt flag for the data ready signal (DRDY)
-uint8_t uart_rx_flag = 0; //flag which enables receiving commands over UART (start/stop UART transmission commands)
 volatile uint8_t data_buffer[108] = { 0 }; //buffer where the received data from the ADS1299 is stored
 uint8_t dummy_data_buffer[500] = { 0 }; //data that is needed so that the SPI HAl implementation does not transmit any data while receiving data
-uint8_t rx_data_uart = 0; //buffer for storing commands received over UART
-uint8_t uart_rx_data_parse_flag = 0; //flag which enables parsing of incoming UART commands
 uint8_t uart_tx_data_enable_flag = 0; //flag which enables EEG data transmission over UART
 uint8_t number_of_connected_ads1299 = 1; //TODO: change this for multi-device setup
+uint32_t channel_enable_mask = DEFAULT_CHANNEL_MASK; //bit n set -> channel n+1 is powered on and transmitted (8 bits per ADS1299)
+uint8_t data_rate = DEFAULT_DATA_RATE; //CONFIG1 DR code, the host checks the link can carry the frames at that rate
+uint8_t tx_data_buffer[108] = { 0 }; //buffer where the packed frame (status + enabled channels only) is stored before transmission
+uint8_t uart_rx_ring[UART_RX_RING_SIZE] = { 0 }; //written by the circular DMA whatever the main loop is busy with
+uint16_t uart_rx_tail = 0; //next byte of uart_rx_ring to parse
+volatile uint16_t uart_rx_idle_head = 0; //write position of the DMA when the line last went idle
+volatile uint8_t pending_marker = 0; //marker waiting for the next DRDY (0 if none)
+volatile uint8_t frame_marker = 0; //marker latched by the last DRDY, sent with the frame it signals
+volatile uint8_t drdy_sequence = 0; //incremented on every DRDY, so that the host counts the frames lost on the link
+uint32_t marker_input_tick = 0; //time of the last accepted edge on the marker input
+volatile uint32_t drdy_cycles = 0; //cycle counter at the last DRDY
+volatile uint32_t uart_rx_cycles = 0; //cycle counter at the end of the last burst of command bytes
+uint64_t timestamp_cycles = 0; //cycles since Timestamp_Init, extended to 64 bits by Get_Timestamp
+uint32_t timestamp_last_cycles = 0; //cycle counter at the last call of Get_Timestamp
+uint8_t latency_probe_pending = 0; //a latency probe waits for the next frame
+uint8_t latency_probe_tag = 0; //tag of the pending latency probe
+uint32_t latency_probe_rx_cycles = 0; //cycle counter when the pending latency probe was received
+uint8_t impedance_active = 0; //impedance mode: the excitation runs and the frames are streamed until every channel is measured
+uint32_t impedance_mask = 0; //channels left to measure (same bit layout as channel_enable_mask)
+uint8_t impedance_channel = 0; //channel being measured, 0 based
+uint16_t impedance_count = 0; //samples of impedance_channel since the excitation moved to it
+int32_t impedance_history[2] = { 0 }; //two previous samples of impedance_channel
+float impedance_state[2] = { 0 }; //Goertzel state s[n-1], s[n-2]
+uint8_t self_test_phase = 0; //SELF_TEST_... phase of the running self-test, SELF_TEST_IDLE if none
+uint32_t self_test_count = 0; //samples since the phase started
+uint32_t self_test_length = 0; //samples of a phase at the current data rate
+int32_t self_test_min[SELF_TEST_CHANNEL_COUNT] = { 0 }; //extremes of the test signal
+int32_t self_test_max[SELF_TEST_CHANNEL_COUNT] = { 0 };
+uint32_t self_test_amplitude[SELF_TEST_CHANNEL_COUNT] = { 0 }; //half the span of the extremes
+int32_t self_test_middle[SELF_TEST_CHANNEL_COUNT] = { 0 }; //between the extremes of the learning phase, the edges cross it
+uint8_t self_test_high[SELF_TEST_CHANNEL_COUNT] = { 0 }; //the test signal is in its high half
+uint16_t self_test_crossings[SELF_TEST_CHANNEL_COUNT] = { 0 }; //test signal edges
+uint32_t self_test_first_crossing[SELF_TEST_CHANNEL_COUNT] = { 0 }; //sample of the first edge
+uint32_t self_test_last_crossing[SELF_TEST_CHANNEL_COUNT] = { 0 }; //sample of the last edge
+int32_t self_test_offset[SELF_TEST_CHANNEL_COUNT] = { 0 }; //first sample of the shorted input, the noise sums are taken from it
+int64_t self_test_sum[SELF_TEST_CHANNEL_COUNT] = { 0 };
+int64_t self_test_square_sum[SELF_TEST_CHANNEL_COUNT] = { 0 };
 /* USER CODE END 0 */
 
 /**
@@ -94,6 +189,7 @@ int main(void) {
 	SystemClock_Config();
 
 	/* USER CODE BEGIN SysInit */
+	Timestamp_Init();
 
 	/* USER CODE END SysInit */
 
@@ -116,25 +212,18 @@ int main(void) {
 	HAL_Delay(5000); //set a startup delay of 5 seconds so that the ADS1299 has enough time on startup to configure itself
 
 	ADS1299_SDATAC(); //Important
-	ADS1299_SetConfig1(0, 1, 3); //daisy-chain, clock and data rate options
+	ADS1299_SetConfig1(0, 1, data_rate); //daisy-chain, clock and data rate options
 	ADS1299_SetConfig2(1, 0, 0); //test signal options
 	ADS1299_SetConfig3(1, 0, 1, 1, 1); //Bias and reference options
 	ADS1299_SetLOFF(0, 0, 0);
-	//set individual channel registers: channel-off ->(i, 1, 6, 0, 1), channel-on -> (i, 0, 6, 0, 0) // TODO: turn individual channels on or off
-	ADS1299_SetChannelRegister(1, 0, 6, 0, 0);
-	ADS1299_SetChannelRegister(2, 0, 6, 0, 0);
-	ADS1299_SetChannelRegister(3, 0, 6, 0, 0);
-	ADS1299_SetChannelRegister(4, 0, 6, 0, 0);
-	ADS1299_SetChannelRegister(5, 1, 6, 0, 1);
-	ADS1299_SetChannelRegister(6, 1, 6, 0, 1);
-	ADS1299_SetChannelRegister(7, 1, 6, 0, 1);
-	ADS1299_SetChannelRegister(8, 1, 6, 0, 1);
+	//set individual channel registers according to channel_enable_mask: channel-off ->(i, 1, 6, 0, 1), channel-on -> (i, 0, 6, 0, 0)
+	Apply_Channel_Mask();
 	//Bias channel calculations settings: TODO:should be changed based on the used channels  (1 channel for bias can be sufficient)
 	ADS1299_SetBIAS_SENSP(1, 0, 0, 0, 0, 0, 0, 0); //this determines which channels are used for bias calculations
 	ADS1299_SetBIAS_SENSN(1, 0, 0, 0, 0, 0, 0, 0); //this determines which channels are used for bias calculations
-	ADS1299_SetLOFF_SENSP();
-	ADS1299_SetLOFF_SENSN();
-	ADS1299_SetLOFF_FLIP();
+	ADS1299_SetLOFF_SENSP(0);
+	ADS1299_SetLOFF_SENSN(0);
+	ADS1299_SetLOFF_FLIP(0);
 	ADS1299_SetMISC1(1); //SRB1: enable referential mode
 	ADS1299_SetConfig4(0, 0); //single shot conversation and lead off PowerDown
 	//verify configuration
@@ -155,36 +244,43 @@ int main(void) {
 	/* Infinite loop */
 	/* USER CODE BEGIN WHILE */
 	ext_flag = RESET;
-	uart_rx_flag = RESET;
-	uart_rx_data_parse_flag = RESET;
+	Command_Receive_Start();
 	while (1) {
 		if (ext_flag) { //EEG data processing loop
+			//the next DRDY may come during the transfer, so the values it latched for this frame are copied together first
+			__disable_irq();
+			const uint32_t frame_drdy_cycles = drdy_cycles;
+			const uint8_t frame_sequence = drdy_sequence;
+			const uint8_t frame_marker_code = frame_marker & MARKER_CODE_MASK;
+			__enable_irq();
+			Get_Timestamp(frame_drdy_cycles); //keeps the 64 bit extension of the cycle counter current
 			//receive data EEG from the ModulareBCI board
 			HAL_SPI_TransmitReceive(&hspi1, dummy_data_buffer,
-					(uint8_t*) data_buffer, 27 * number_of_connected_ads1299,
+					(uint8_t*) data_buffer,
+					ADS1299_FRAME_SIZE * number_of_connected_ads1299,
 					HAL_MAX_DELAY);
 			if (uart_tx_data_enable_flag) {
-				//transmit EEG data to OpenVibe
-				HAL_UART_Transmit(&huart1, (uint8_t*) data_buffer,
-						27 * number_of_connected_ads1299, 100);
+				//transmit EEG data of the enabled channels only to OpenVibe
+				uint16_t tx_size = Pack_EEG_Frame(data_buffer, tx_data_buffer);
+				//the status word carries the sequence number, the marker and the check the host locks on the frames with
+				tx_data_buffer[0] = EEG_FRAME_START;
+				tx_data_buffer[1] = frame_sequence;
+				tx_data_buffer[2] = frame_marker_code;
+				tx_data_buffer[2] |= Frame_Check(tx_data_buffer, tx_size) << FRAME_CHECK_SHIFT;
+				HAL_UART_Transmit(&huart1, tx_data_buffer, tx_size, 100);
+				if (latency_probe_pending) { //the reply follows the first frame sent after the probe
+					Send_Latency_Probe_Reply(frame_drdy_cycles);
+				}
 			}
-			ext_flag = 0;
-		}
-		if (!uart_rx_flag) { //receiving commands over UART
-			uart_rx_flag = 1;
-			rx_data_uart = 0;
-			HAL_UART_Receive_IT(&huart1, &rx_data_uart, 1);
-		}
-		if (uart_rx_data_parse_flag) { //parse commands
-			if (rx_data_uart == 98) { //start data transmission over UART to computer
-				uart_tx_data_enable_flag = 1;
+			if (impedance_active) { //the results follow the frame completing their channel
+				Impedance_Sample(data_buffer);
 			}
-			if (rx_data_uart == 115) { //stop data transmission over UART to computer
-				uart_tx_data_enable_flag = 0;
+			if (self_test_phase != SELF_TEST_IDLE) { //the results follow the last frame of the test
+				Self_Test_Sample(data_buffer);
 			}
-			uart_rx_data_parse_flag = 0;
-			uart_rx_flag = 0;
+			ext_flag = 0;
 		}
+		Command_Poll(); //parses the command frames the DMA received meanwhile
 		/* USER CODE END WHILE */
 
 		/* USER CODE BEGIN 3 */
@@ -327,6 +423,9 @@ static void MX_DMA_Init(void) {
 	/* DMA1_Channel2_IRQn interrupt configuration */
 	HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 0, 0);
 	HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+	/* DMA1_Channel5_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
 
 }
 
@@ -359,22 +458,582 @@ static void MX_GPIO_Init(void) {
 	GPIO_InitStruct.Pull = GPIO_NOPULL;
 	HAL_GPIO_Init(DRDY_GPIO_Port, &GPIO_InitStruct);
 
+	/*Configure GPIO pin : MARKER_Pin */
+	GPIO_InitStruct.Pin = MARKER_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	HAL_GPIO_Init(MARKER_GPIO_Port, &GPIO_InitStruct);
+
 	/* EXTI interrupt init*/
 	HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
 	HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
 
+	HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+
 }
 
 /* USER CODE BEGIN 4 */
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
 	if (GPIO_Pin == DRDY_Pin) {
+		//the marker belongs to the first conversion completed after it
+		frame_marker = pending_marker;
+		pending_marker = 0;
+		drdy_cycles = DWT->CYCCNT;
+		drdy_sequence++;
 		ext_flag = 1;
+	} else if (GPIO_Pin == MARKER_Pin) {
+		uint32_t tick = HAL_GetTick();
+		if (tick - marker_input_tick >= MARKER_INPUT_HOLDOFF) {
+			pending_marker = MARKER_INPUT_CODE;
+			marker_input_tick = tick;
+		}
+	}
+}
+
+/**
+ * @brief restarts the reception after a line error, which makes the HAL abort the DMA
+ * @retval None
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+	if (huart->Instance == USART1) {
+		Command_Receive_Start();
+	}
+}
+
+/**
+ * @brief called from the USART1 interrupt when the line goes idle after a burst of bytes,
+ * one character time after the last one
+ * @retval None
+ */
+void UART_Rx_Idle_Callback(void) {
+	uart_rx_cycles = DWT->CYCCNT - SystemCoreClock / huart1.Init.BaudRate * 10;
+	uart_rx_idle_head = (UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx)) % UART_RX_RING_SIZE;
+}
+
+/**
+ * @brief starts receiving the commands into uart_rx_ring with the circular DMA, and the idle
+ * line interrupt that dates the end of each burst of command bytes
+ * @retval None
+ */
+void Command_Receive_Start(void) {
+	uart_rx_tail = 0;
+	uart_rx_idle_head = 0;
+	HAL_UART_Receive_DMA(&huart1, uart_rx_ring, UART_RX_RING_SIZE);
+	__HAL_UART_CLEAR_IDLEFLAG(&huart1);
+	__HAL_UART_ENABLE_IT(&huart1, UART_IT_IDLE);
+}
+
+/**
+ * @brief parses the command frames received since the last call and executes the valid ones.
+ * Bytes outside a frame are skipped, and a frame with a wrong size or checksum only costs its
+ * start byte, the parsing resuming right after it. An incomplete frame waits for its remaining
+ * bytes unless the line stayed idle for COMMAND_FRAME_TIMEOUT_MS after its last byte.
+ * @retval None
+ */
+void Command_Poll(void) {
+	const uint16_t head = (UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx)) % UART_RX_RING_SIZE;
+	while (uart_rx_tail != head) {
+		const uint16_t available = (head - uart_rx_tail) & (UART_RX_RING_SIZE - 1);
+		if (uart_rx_ring[uart_rx_tail] != COMMAND_FRAME_START) {
+			uart_rx_tail = (uart_rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+			continue;
+		}
+		const uint8_t size = available >= 3 ? uart_rx_ring[(uart_rx_tail + 2) & (UART_RX_RING_SIZE - 1)] : 0;
+		if (size > COMMAND_MAX_SIZE) {
+			uart_rx_tail = (uart_rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+			continue;
+		}
+		if (available < 4 + size) {
+			//the USB bridge may split a frame with an idle gap, its rest is only given up once the line stayed idle for the timeout
+			if (uart_rx_idle_head == head && DWT->CYCCNT - uart_rx_cycles > SystemCoreClock / 1000 * COMMAND_FRAME_TIMEOUT_MS) {
+				uart_rx_tail = (uart_rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+				continue;
+			}
+			return;
+		}
+
+		uint8_t frame[4 + COMMAND_MAX_SIZE];
+		uint8_t checksum = 0;
+		for (uint8_t i = 0; i < 4 + size; i++) {
+			frame[i] = uart_rx_ring[(uart_rx_tail + i) & (UART_RX_RING_SIZE - 1)];
+			checksum ^= i == 0 ? 0 : frame[i];
+		}
+		if (checksum != 0) { //the XOR of the command, size and arguments cancels the checksum byte
+			uart_rx_tail = (uart_rx_tail + 1) & (UART_RX_RING_SIZE - 1);
+			continue;
+		}
+		uart_rx_tail = (uart_rx_tail + 4 + size) & (UART_RX_RING_SIZE - 1);
+		Command_Execute(frame[1], frame + 3, size);
+	}
+}
+
+/**
+ * @brief executes a command received in a valid frame. Every command is answered with a command
+ * reply, rejected for an unknown command or a wrong argument size, so that the host knows whether
+ * the board runs with its settings, except the latency probe which has its own reply.
+ * @param command command byte
+ * @param arguments argument bytes
+ * @param size number of argument bytes
+ * @retval None
+ */
+void Command_Execute(uint8_t command, const uint8_t *arguments, uint8_t size) {
+	if (command == 98) { //start data transmission over UART to computer
+		if (impedance_active) {
+			Impedance_Stop();
+		}
+		if (self_test_phase != SELF_TEST_IDLE) {
+			Self_Test_Stop();
+		}
+		uart_tx_data_enable_flag = 1;
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+	} else if (command == 115) { //stop data transmission over UART to computer
+		if (impedance_active) {
+			Impedance_Stop();
+		}
+		if (self_test_phase != SELF_TEST_IDLE) {
+			Self_Test_Stop();
+		}
+		uart_tx_data_enable_flag = 0;
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+	} else if (command == 109) { //channel mask, one byte per ADS1299 (only accepted while not streaming)
+		if (size != number_of_connected_ads1299 || uart_tx_data_enable_flag) {
+			Send_Command_Reply(command, COMMAND_REJECTED);
+			return;
+		}
+		channel_enable_mask = 0;
+		for (uint8_t i = 0; i < size; i++) {
+			channel_enable_mask |= (uint32_t) arguments[i] << (8 * i);
+		}
+		ADS1299_SDATAC(); //registers can not be written in continuous read mode
+		Apply_Channel_Mask();
+		ADS1299_RDATAC();
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+	} else if (command == 114) { //data rate, the CONFIG1 DR code (only accepted while not streaming)
+		if (size != 1 || arguments[0] > DATA_RATE_MAX_CODE || uart_tx_data_enable_flag) {
+			Send_Command_Reply(command, COMMAND_REJECTED);
+			return;
+		}
+		data_rate = arguments[0];
+		ADS1299_SDATAC(); //registers can not be written in continuous read mode
+		ADS1299_SetConfig1(0, 1, data_rate);
+		ADS1299_RDATAC();
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+	} else if (command == 107 && size == 1) { //marker, latched into the next frame
+		pending_marker = arguments[0] & MARKER_CODE_MASK;
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+	} else if (command == 122) { //measure the impedances, one mask byte per ADS1299 (only accepted while not streaming, on a single ADS1299)
+		//the lead-off registers are only programmed on the first ADS1299
+		if (size != number_of_connected_ads1299 || number_of_connected_ads1299 != 1 || uart_tx_data_enable_flag) {
+			Send_Command_Reply(command, COMMAND_REJECTED);
+			return;
+		}
+		impedance_mask = 0;
+		for (uint8_t i = 0; i < size; i++) {
+			impedance_mask |= (uint32_t) arguments[i] << (8 * i);
+		}
+		impedance_mask &= channel_enable_mask; //the powered down channels are not read
+		if (!impedance_mask) {
+			Send_Command_Reply(command, COMMAND_REJECTED);
+			return;
+		}
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+		Impedance_Start();
+	} else if (command == 116) { //self-test of the enabled channels (only accepted while not streaming, on a single ADS1299)
+		//the channel registers are only programmed on the first ADS1299
+		if (size != 0 || number_of_connected_ads1299 != 1 || uart_tx_data_enable_flag || !channel_enable_mask) {
+			Send_Command_Reply(command, COMMAND_REJECTED);
+			return;
+		}
+		Send_Command_Reply(command, COMMAND_ACCEPTED);
+		Self_Test_Start();
+	} else if (command == 112 && size == 1) { //latency probe with its tag, answered after the next frame
+		latency_probe_tag = arguments[0];
+		//end of the frame: the idle line after it, or now when the loop parses it before the line goes idle
+		latency_probe_rx_cycles = uart_rx_idle_head == uart_rx_tail ? uart_rx_cycles : DWT->CYCCNT;
+		latency_probe_pending = 1;
+		if (!uart_tx_data_enable_flag) { //no frame to wait for
+			Send_Latency_Probe_Reply(DWT->CYCCNT);
+		}
+	} else { //unknown command or wrong argument size
+		Send_Command_Reply(command, COMMAND_REJECTED);
+	}
+}
+
+/**
+ * @brief powers the channels on or off according to channel_enable_mask.
+ * The ADS1299 has to be out of the continuous read mode (SDATAC) when this is called.
+ * @retval None
+ */
+void Apply_Channel_Mask(void) {
+	for (uint8_t channel = 1; channel <= ADS1299_CHANNELS_PER_DEVICE; channel++) {
+		if (channel_enable_mask & (1UL << (channel - 1))) {
+			ADS1299_SetChannelRegister(channel, 0, 6, 0, 0);
+		} else {
+			ADS1299_SetChannelRegister(channel, 1, 6, 0, 1);
+		}
+	}
+}
+
+/**
+ * @brief packs a frame read from the ADS1299 so that only the enabled channels are transmitted
+ * @param frame raw frame(s) as read over SPI (27 bytes per connected ADS1299)
+ * @param packed buffer receiving the status word of the first device followed by the enabled channel values
+ * @retval number of bytes written to packed
+ */
+uint16_t Pack_EEG_Frame(const volatile uint8_t *frame, uint8_t *packed) {
+	uint16_t size = 0;
+	for (uint8_t i = 0; i < ADS1299_STATUS_SIZE; i++) {
+		packed[size++] = frame[i];
+	}
+	for (uint8_t device = 0; device < number_of_connected_ads1299; device++) {
+		const volatile uint8_t *values = frame + device * ADS1299_FRAME_SIZE
+				+ ADS1299_STATUS_SIZE;
+		for (uint8_t channel = 0; channel < ADS1299_CHANNELS_PER_DEVICE; channel++) {
+			if (channel_enable_mask & (1UL << (device * ADS1299_CHANNELS_PER_DEVICE + channel))) {
+				packed[size++] = values[channel * ADS1299_VALUE_SIZE];
+				packed[size++] = values[channel * ADS1299_VALUE_SIZE + 1];
+				packed[size++] = values[channel * ADS1299_VALUE_SIZE + 2];
+			}
+		}
+	}
+	return size;
+}
+
+/**
+ * @brief starts the DWT cycle counter the timestamps of the latency probe are taken from
+ * @retval None
+ */
+void Timestamp_Init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	timestamp_cycles = 0;
+	timestamp_last_cycles = 0;
+}
+
+/**
+ * @brief converts a cycle counter value to a timestamp. Main loop only, called at least once per
+ * counter period (53 s at 80 MHz) for the 64 bit extension to hold.
+ * @param cycles DWT cycle counter value read less than one counter period ago
+ * @retval time in us since Timestamp_Init, wraps after 71 minutes
+ */
+uint32_t Get_Timestamp(uint32_t cycles) {
+	const uint32_t now = DWT->CYCCNT;
+	timestamp_cycles += (uint32_t) (now - timestamp_last_cycles);
+	timestamp_last_cycles = now;
+	return (uint32_t) ((timestamp_cycles - (uint32_t) (now - cycles)) / (SystemCoreClock / 1000000));
+}
+
+/**
+ * @brief computes the check of an EEG frame: CRC-4 (x^4 + x + 1, MSB first, initial value 0) of the
+ * sequence number, the marker nibble and the channel values. The check nibble itself is left out.
+ * @param frame packed frame, status word first
+ * @param size size of the packed frame
+ * @retval 4 bit check
+ */
+uint8_t Frame_Check(const uint8_t *frame, uint16_t size) {
+	//CRC of each nibble XORed with the CRC so far, two lookups per byte instead of 8 shifts
+	static const uint8_t table[16] = { 0x0, 0x3, 0x6, 0x5, 0xC, 0xF, 0xA, 0x9, 0xB, 0x8, 0xD, 0xE, 0x7, 0x4, 0x1, 0x2 };
+	uint8_t crc = 0;
+	for (uint16_t i = 1; i < size; i++) {
+		const uint8_t byte = i == 2 ? frame[i] & MARKER_CODE_MASK : frame[i];
+		crc = table[crc ^ (byte >> 4)];
+		crc = table[crc ^ (byte & 0x0F)];
 	}
+	return crc;
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
-	//uart_rx_flag = 0; //reset uart receive ongoing flag
-	uart_rx_data_parse_flag = 1; //enable message parsing
+/**
+ * @brief sends an auxiliary frame: AUX_FRAME_START, type, payload size, payload, then the
+ * XOR of the type, size and payload bytes. It never starts with the 0xC0 of the EEG frames.
+ * @param type auxiliary frame type (AUX_FRAME_...)
+ * @param payload payload bytes, little endian values
+ * @param size payload size
+ * @retval None
+ */
+void Send_Aux_Frame(uint8_t type, const uint8_t *payload, uint8_t size) {
+	uint8_t frame[4 + 255];
+	uint8_t checksum = type ^ size;
+	frame[0] = AUX_FRAME_START;
+	frame[1] = type;
+	frame[2] = size;
+	for (uint16_t i = 0; i < size; i++) {
+		frame[3 + i] = payload[i];
+		checksum ^= payload[i];
+	}
+	frame[3 + size] = checksum;
+	HAL_UART_Transmit(&huart1, frame, 4 + size, 100);
+}
+
+/**
+ * @brief answers a configuration or test command
+ * @param command command byte
+ * @param status COMMAND_ACCEPTED or COMMAND_REJECTED
+ * @retval None
+ */
+void Send_Command_Reply(uint8_t command, uint8_t status) {
+	const uint8_t payload[2] = { command, status };
+	Send_Aux_Frame(AUX_FRAME_COMMAND_REPLY, payload, sizeof(payload));
+}
+
+/**
+ * @brief answers the pending latency probe with its tag and the firmware timestamps (in us) of
+ * its reception, of the data ready of the frame it follows and of the start of the reply
+ * @param frame_drdy_cycles cycle counter at the data ready of the last frame sent
+ * @retval None
+ */
+void Send_Latency_Probe_Reply(uint32_t frame_drdy_cycles) {
+	const uint32_t times[3] = { Get_Timestamp(latency_probe_rx_cycles), Get_Timestamp(frame_drdy_cycles), Get_Timestamp(DWT->CYCCNT) };
+	uint8_t payload[1 + sizeof(times)];
+	payload[0] = latency_probe_tag;
+	for (uint8_t i = 0; i < 3; i++) {
+		payload[1 + 4 * i] = times[i] & 0xFF;
+		payload[2 + 4 * i] = (times[i] >> 8) & 0xFF;
+		payload[3 + 4 * i] = (times[i] >> 16) & 0xFF;
+		payload[4 + 4 * i] = (times[i] >> 24) & 0xFF;
+	}
+	Send_Aux_Frame(AUX_FRAME_LATENCY_PROBE, payload, sizeof(payload));
+	latency_probe_pending = 0;
+}
+
+/**
+ * @brief starts the impedance mode on the lowest channel of impedance_mask: a 6nA square wave
+ * current at f_DR/4 is driven into its positive input, the frames are streamed meanwhile.
+ * Single ADS1299 only, the 'z' command is rejected on a multi-device setup.
+ * @retval None
+ */
+void Impedance_Start(void) {
+	impedance_channel = 0;
+	while (!(impedance_mask & (1UL << impedance_channel))) {
+		impedance_channel++;
+	}
+	impedance_count = 0;
+	impedance_state[0] = 0;
+	impedance_state[1] = 0;
+	ADS1299_SDATAC(); //registers can not be written in continuous read mode
+	ADS1299_SetLOFF(0, IMPEDANCE_LOFF_CURRENT, IMPEDANCE_LOFF_FREQUENCY);
+	ADS1299_SetLOFF_SENSP(1 << (impedance_channel % ADS1299_CHANNELS_PER_DEVICE));
+	ADS1299_SetConfig4(0, 1);
+	ADS1299_RDATAC();
+	impedance_active = 1;
+	uart_tx_data_enable_flag = 1;
+}
+
+/**
+ * @brief ends the impedance mode: the excitation is switched off and the streaming stopped
+ * @retval None
+ */
+void Impedance_Stop(void) {
+	ADS1299_SDATAC(); //registers can not be written in continuous read mode
+	ADS1299_SetLOFF_SENSP(0);
+	ADS1299_SetLOFF(0, 0, 0);
+	ADS1299_SetConfig4(0, 0);
+	ADS1299_RDATAC();
+	impedance_active = 0;
+	impedance_mask = 0;
+	uart_tx_data_enable_flag = 0;
+}
+
+/**
+ * @brief runs the detector on the sample of the channel measured, then sends the amplitude of the
+ * excitation and moves to the next channel once IMPEDANCE_SAMPLE_COUNT samples are in. The
+ * Goertzel filter at f_DR/4 has a zero coefficient, s[n] = x[n] - s[n-2], and runs on
+ * x[n] - x[n-2], which removes the electrode offset and its drift and doubles the excitation.
+ * @param frame raw frame(s) as read over SPI (27 bytes per connected ADS1299)
+ * @retval None
+ */
+void Impedance_Sample(const volatile uint8_t *frame) {
+	const volatile uint8_t *value = frame + (impedance_channel / ADS1299_CHANNELS_PER_DEVICE) * ADS1299_FRAME_SIZE
+			+ ADS1299_STATUS_SIZE + (impedance_channel % ADS1299_CHANNELS_PER_DEVICE) * ADS1299_VALUE_SIZE;
+	const int32_t sample = (int32_t) ((uint32_t) value[0] << 24 | (uint32_t) value[1] << 16 | (uint32_t) value[2] << 8) >> 8;
+	if (impedance_count >= IMPEDANCE_SETTLE_COUNT + 2) {
+		const float state = (float) (sample - impedance_history[1]) - impedance_state[1];
+		impedance_state[1] = impedance_state[0];
+		impedance_state[0] = state;
+	}
+	impedance_history[1] = impedance_history[0];
+	impedance_history[0] = sample;
+	impedance_count++;
+	if (impedance_count < IMPEDANCE_SETTLE_COUNT + 2 + IMPEDANCE_SAMPLE_COUNT) {
+		return;
+	}
+
+	//peak amplitude in ADC codes: 2 |X| / N for the sine, halved for the doubling of x[n] - x[n-2]
+	const float magnitude = sqrtf(impedance_state[0] * impedance_state[0] + impedance_state[1] * impedance_state[1]);
+	const uint32_t amplitude = (uint32_t) (magnitude / IMPEDANCE_SAMPLE_COUNT + 0.5f);
+	const uint8_t payload[5] = { impedance_channel, amplitude & 0xFF, (amplitude >> 8) & 0xFF, (amplitude >> 16) & 0xFF, (amplitude >> 24) & 0xFF };
+	Send_Aux_Frame(AUX_FRAME_IMPEDANCE, payload, sizeof(payload));
+
+	impedance_mask &= ~(1UL << impedance_channel);
+	if (impedance_mask) {
+		Impedance_Start();
+	} else {
+		Impedance_Stop();
+	}
+}
+
+/**
+ * @brief starts the self-test of the enabled channels: the test signal of the ADS1299 is switched
+ * to their inputs, at twice the frequency of the startup setting, and the frames are streamed meanwhile.
+ * Single ADS1299 only, the 't' command is rejected on a multi-device setup.
+ * @retval None
+ */
+void Self_Test_Start(void) {
+	self_test_phase = SELF_TEST_LEARN;
+	self_test_count = 0;
+	self_test_length = (uint32_t) SELF_TEST_SAMPLE_COUNT << (DATA_RATE_MAX_CODE - data_rate);
+	ADS1299_SDATAC(); //registers can not be written in continuous read mode
+	ADS1299_SetConfig2(1, 0, 1);
+	Set_Channel_Input(5);
+	ADS1299_RDATAC();
+	uart_tx_data_enable_flag = 1;
+}
+
+/**
+ * @brief ends the self-test: the channels are set back to the channel mask, the test signal to its
+ * startup frequency, and the streaming stopped
+ * @retval None
+ */
+void Self_Test_Stop(void) {
+	ADS1299_SDATAC(); //registers can not be written in continuous read mode
+	ADS1299_SetConfig2(1, 0, 0);
+	Apply_Channel_Mask();
+	ADS1299_RDATAC();
+	self_test_phase = SELF_TEST_IDLE;
+	uart_tx_data_enable_flag = 0;
+}
+
+/**
+ * @brief takes a sample of the self-test. The first phase finds the extremes of the test signal,
+ * the second measures its amplitude from the extremes and its frequency from the edges crossing
+ * the middle of the first extremes (with a hysteresis of half the amplitude), and the third the
+ * RMS noise of the shorted inputs. Each enabled channel then gets an auxiliary frame: channel,
+ * SELF_TEST_..._OK flags, amplitude in codes (32 bits), frequency in mHz and noise in codes (16 bits).
+ * @param frame raw frame(s) as read over SPI (27 bytes per connected ADS1299)
+ * @retval None
+ */
+void Self_Test_Sample(const volatile uint8_t *frame) {
+	self_test_count++;
+	if (self_test_count <= SELF_TEST_SETTLE_COUNT) {
+		return;
+	}
+	const uint32_t index = self_test_count - SELF_TEST_SETTLE_COUNT - 1;
+	for (uint8_t channel = 0; channel < SELF_TEST_CHANNEL_COUNT; channel++) {
+		if (!(channel_enable_mask & (1UL << channel))) {
+			continue;
+		}
+		const volatile uint8_t *value = frame + (channel / ADS1299_CHANNELS_PER_DEVICE) * ADS1299_FRAME_SIZE
+				+ ADS1299_STATUS_SIZE + (channel % ADS1299_CHANNELS_PER_DEVICE) * ADS1299_VALUE_SIZE;
+		const int32_t sample = (int32_t) ((uint32_t) value[0] << 24 | (uint32_t) value[1] << 16 | (uint32_t) value[2] << 8) >> 8;
+		if (self_test_phase == SELF_TEST_SHORTED) {
+			if (index == 0) {
+				self_test_offset[channel] = sample;
+			}
+			const int64_t deviation = sample - self_test_offset[channel];
+			self_test_sum[channel] += deviation;
+			self_test_square_sum[channel] += deviation * deviation;
+			continue;
+		}
+		if (index == 0) {
+			self_test_min[channel] = sample;
+			self_test_max[channel] = sample;
+		}
+		if (self_test_phase == SELF_TEST_SIGNAL) {
+			const int32_t middle = self_test_middle[channel];
+			const int32_t hysteresis = (int32_t) (self_test_amplitude[channel] / 2); //of the learning phase until the end of this one
+			if (index == 0) {
+				self_test_high[channel] = sample > middle;
+				self_test_crossings[channel] = 0;
+			} else if (self_test_high[channel] ? sample < middle - hysteresis : sample > middle + hysteresis) {
+				self_test_high[channel] = !self_test_high[channel];
+				if (self_test_crossings[channel] == 0) {
+					self_test_first_crossing[channel] = index;
+				}
+				self_test_last_crossing[channel] = index;
+				self_test_crossings[channel]++;
+			}
+		}
+		if (sample < self_test_min[channel]) {
+			self_test_min[channel] = sample;
+		}
+		if (sample > self_test_max[channel]) {
+			self_test_max[channel] = sample;
+		}
+	}
+	if (index + 1 < self_test_length) {
+		return;
+	}
+
+	if (self_test_phase == SELF_TEST_LEARN) {
+		for (uint8_t channel = 0; channel < SELF_TEST_CHANNEL_COUNT; channel++) {
+			self_test_amplitude[channel] = (uint32_t) (self_test_max[channel] - self_test_min[channel]) / 2;
+			self_test_middle[channel] = self_test_min[channel] + (int32_t) self_test_amplitude[channel];
+		}
+		self_test_phase = SELF_TEST_SIGNAL;
+		self_test_count = SELF_TEST_SETTLE_COUNT; //the signal goes on, no settling
+		return;
+	}
+	if (self_test_phase == SELF_TEST_SIGNAL) {
+		for (uint8_t channel = 0; channel < SELF_TEST_CHANNEL_COUNT; channel++) {
+			self_test_amplitude[channel] = (uint32_t) (self_test_max[channel] - self_test_min[channel]) / 2;
+			self_test_sum[channel] = 0;
+			self_test_square_sum[channel] = 0;
+		}
+		ADS1299_SDATAC(); //registers can not be written in continuous read mode
+		Set_Channel_Input(1);
+		ADS1299_RDATAC();
+		self_test_phase = SELF_TEST_SHORTED;
+		self_test_count = 0;
+		return;
+	}
+
+	const uint32_t sampling = 250UL << (DATA_RATE_MAX_CODE - data_rate);
+	for (uint8_t channel = 0; channel < SELF_TEST_CHANNEL_COUNT; channel++) {
+		if (!(channel_enable_mask & (1UL << channel))) {
+			continue;
+		}
+		//half a period between two edges
+		const uint32_t span = self_test_last_crossing[channel] - self_test_first_crossing[channel];
+		const uint32_t frequency = self_test_crossings[channel] >= 2 && span != 0 ?
+				(uint32_t) ((uint64_t) (self_test_crossings[channel] - 1) * sampling * 1000 / (2 * span)) : 0;
+		const float mean = (float) self_test_sum[channel] / self_test_length;
+		const float variance = (float) self_test_square_sum[channel] / self_test_length - mean * mean;
+		const float noise = variance > 0 ? sqrtf(variance) : 0;
+		const uint32_t amplitude = self_test_amplitude[channel];
+		uint8_t flags = 0;
+		if (amplitude * 100ULL >= SELF_TEST_AMPLITUDE * (100ULL - SELF_TEST_TOLERANCE)
+				&& amplitude * 100ULL <= SELF_TEST_AMPLITUDE * (100ULL + SELF_TEST_TOLERANCE)) {
+			flags |= SELF_TEST_AMPLITUDE_OK;
+		}
+		if (frequency * 100ULL >= SELF_TEST_FREQUENCY * (100ULL - SELF_TEST_TOLERANCE)
+				&& frequency * 100ULL <= SELF_TEST_FREQUENCY * (100ULL + SELF_TEST_TOLERANCE)) {
+			flags |= SELF_TEST_FREQUENCY_OK;
+		}
+		if (noise <= SELF_TEST_NOISE_LIMIT) {
+			flags |= SELF_TEST_NOISE_OK;
+		}
+		const uint16_t noise_code = noise < 65535 ? (uint16_t) (noise + 0.5f) : 65535;
+		const uint16_t frequency_code = frequency < 65535 ? (uint16_t) frequency : 65535;
+		const uint8_t payload[10] = { channel, flags, amplitude & 0xFF, (amplitude >> 8) & 0xFF, (amplitude >> 16) & 0xFF, (amplitude >> 24) & 0xFF,
+				frequency_code & 0xFF, frequency_code >> 8, noise_code & 0xFF, noise_code >> 8 };
+		Send_Aux_Frame(AUX_FRAME_SELF_TEST, payload, sizeof(payload));
+	}
+	Self_Test_Stop();
+}
+
+/**
+ * @brief sets the input of the enabled channels: 0->normal electrode input, 1->shorted, 5->test signal.
+ * The ADS1299 has to be out of the continuous read mode (SDATAC) when this is called.
+ * @param MUX channel input code of the CHnSET registers
+ * @retval None
+ */
+void Set_Channel_Input(uint8_t MUX) {
+	for (uint8_t channel = 1; channel <= ADS1299_CHANNELS_PER_DEVICE; channel++) {
+		if (channel_enable_mask & (1UL << (channel - 1))) {
+			ADS1299_SetChannelRegister(channel, 0, 6, 0, MUX);
+		}
+	}
 }
 
 /* USER CODE END 4 */
@@ -52,6 +52,11 @@ OV_ADD_CONTRIB_DRIVER("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/openal
 OV_ADD_CONTRIB_DRIVER("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/openeeg-modulareeg")
 OV_ADD_CONTRIB_DRIVER("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/openbci")
 OV_ADD_CONTRIB_DRIVER("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/modularBCI")
+ADD_SUBDIRECTORY("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/modularBCI/tools" "./modularBCI-tools")
+OPTION(OV_MODULARBCI_FUZZ "Build the fuzz targets and the stress harness of the ModularBCI frame decoder" OFF)
+IF(OV_MODULARBCI_FUZZ)
+ADD_SUBDIRECTORY("${CMAKE_SOURCE_DIR}/contrib/plugins/server-drivers/modularBCI/fuzz" "./modularBCI-fuzz")
+ENDIF(OV_MODULARBCI_FUZZ)
 
 IF(WIN32 AND "${PLATFORM_TARGET}" STREQUAL "x64")
 	MESSAGE(STATUS "  SKIPPED fieldtrip on x64")
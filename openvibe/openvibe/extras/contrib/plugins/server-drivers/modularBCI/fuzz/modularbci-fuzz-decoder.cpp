@@ -0,0 +1,90 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Fuzz target of the frame decoder. The first byte of the input sets the enabled channels and the
+ * second the size of the reads the rest is pushed in. Whatever the bytes, the decoder must not
+ * read out of its buffer, keep a bounded buffer, and lock on the clean frames that follow them.
+ *
+ */
+#include "modularbci-fuzz-frames.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define FUZZ_CHECKED_FRAME_COUNT 4 // last clean frames that must come out of the decoder unchanged
+
+namespace
+{
+	void check(const bool condition, const char* what)
+	{
+		if (condition) { return; }
+		std::fprintf(stderr, "modularbci-fuzz-decoder: %s\n", what);
+		std::abort();
+	}
+
+	void drain(CModularBCIFrameDecoder& decoder, std::vector<int32_t>* samples)
+	{
+		for (auto event = decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = decoder.next())
+		{
+			if (event == CModularBCIFrameDecoder::Event_AuxFrame)
+			{
+				check(decoder.getAuxPayload().size() <= 255, "auxiliary payload larger than its size byte allows");
+				continue;
+			}
+			check(decoder.getMarker() <= 0x0F, "marker larger than 4 bits");
+			const int32_t* codes = decoder.getCodes();
+			for (size_t i = 0; i < decoder.getValueCount(); ++i) { check(codes[i] >= -0x800000 && codes[i] < 0x800000, "code larger than 24 bits"); }
+			if (samples) { samples->insert(samples->end(), codes, codes + decoder.getValueCount()); }
+		}
+	}
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, const size_t size)
+{
+	if (size < 2) { return 0; }
+	const size_t nValue    = 1 + data[0] % FUZZ_MAX_VALUE_COUNT;
+	const size_t chunkSize = 1 + data[1];
+	data += 2;
+	const size_t length = size - 2;
+
+	CModularBCIFrameDecoder decoder;
+	decoder.initialize(nValue);
+	const size_t frameSize = decoder.getFrameSize();
+	const size_t maxBuffer = 2 * chunkSize + 4096 + getRelockByteCount(frameSize);
+
+	for (size_t i = 0; i < length; i += chunkSize)
+	{
+		decoder.push(data + i, std::min(chunkSize, length - i));
+		drain(decoder, nullptr);
+		check(decoder.getBufferSize() <= maxBuffer, "buffer not bounded");
+	}
+
+	// clean frames, the last ones must be decoded exactly
+	CFuzzRandom random(length);
+	const size_t nFrame = getRelockByteCount(frameSize) / frameSize + FUZZ_CHECKED_FRAME_COUNT;
+	std::vector<int32_t> codes(nFrame * nValue);
+	std::vector<uint8_t> stream;
+	for (size_t i = 0; i < nFrame; ++i)
+	{
+		makeCodes(random, &codes[i * nValue], nValue);
+		appendSampleFrame(stream, &codes[i * nValue], nValue, uint8_t(i + 1), 0);
+	}
+	std::vector<int32_t> samples;
+	for (size_t i = 0; i < stream.size(); i += chunkSize)
+	{
+		decoder.push(&stream[i], std::min(chunkSize, stream.size() - i));
+		drain(decoder, &samples);
+		check(decoder.getBufferSize() <= maxBuffer, "buffer not bounded");
+	}
+	const size_t nChecked = FUZZ_CHECKED_FRAME_COUNT * nValue;
+	check(samples.size() >= nChecked, "no lock on the clean frames");
+	check(std::equal(codes.end() - nChecked, codes.end(), samples.end() - nChecked), "clean frames decoded wrong");
+	check(decoder.isLocked() && decoder.isSequenced(), "not locked on the clean frames");
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Stream generation shared by the fuzz targets and the stress harness of the frame decoder.
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIFrameDecoder.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define FUZZ_MAX_VALUE_COUNT 32  // enabled channels of four daisy-chained ADS1299
+#define FUZZ_MAX_AUX_SIZE    259 // auxiliary frame with the largest payload
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		// xorshift, deterministic so that a failure replays from its seed
+		class CFuzzRandom final
+		{
+		public:
+
+			explicit CFuzzRandom(const uint64_t seed) : m_state(seed == 0 ? 0x9E3779B97F4A7C15ULL : seed) { }
+
+			uint64_t next()
+			{
+				m_state ^= m_state << 13;
+				m_state ^= m_state >> 7;
+				m_state ^= m_state << 17;
+				return m_state;
+			}
+
+			uint32_t below(const uint32_t n) { return n == 0 ? 0 : uint32_t(this->next() % n); }
+
+		protected:
+
+			uint64_t m_state;
+		};
+
+		// a sample frame as the firmware sends it, with its sequence number and check
+		inline void appendSampleFrame(std::vector<uint8_t>& stream, const int32_t* codes, const size_t nValue, const uint8_t sequence, const uint8_t marker)
+		{
+			const size_t start = stream.size();
+			stream.push_back(SAMPLE_FRAME_START);
+			stream.push_back(sequence);
+			stream.push_back(marker & 0x0F);
+			for (size_t i = 0; i < nValue; ++i)
+			{
+				stream.push_back(uint8_t(uint32_t(codes[i]) >> 16));
+				stream.push_back(uint8_t(uint32_t(codes[i]) >> 8));
+				stream.push_back(uint8_t(uint32_t(codes[i])));
+			}
+			stream[start + 2] |= uint8_t(CModularBCIFrameDecoder::getFrameCheck(&stream[start], stream.size() - start) << 4);
+		}
+
+		inline void appendAuxFrame(std::vector<uint8_t>& stream, const uint8_t type, const uint8_t* payload, const uint8_t size)
+		{
+			uint8_t checksum = type ^ size;
+			stream.push_back(AUX_FRAME_START);
+			stream.push_back(type);
+			stream.push_back(size);
+			for (size_t i = 0; i < size; ++i)
+			{
+				stream.push_back(payload[i]);
+				checksum ^= payload[i];
+			}
+			stream.push_back(checksum);
+		}
+
+		// 24 bit codes, often the 0xC00000 of a negative full scale so that the values hold fake headers
+		inline void makeCodes(CFuzzRandom& random, int32_t* codes, const size_t nValue)
+		{
+			for (size_t i = 0; i < nValue; ++i)
+			{
+				const uint32_t code = random.below(4) == 0 ? 0xC00000 : uint32_t(random.next()) & 0xFFFFFF;
+				codes[i]            = int32_t(code << 8) >> 8;
+			}
+		}
+
+		// bytes of clean frames after which a decoder must be locked whatever came before:
+		// the rest of an auxiliary frame, the two frames missed before giving a wrong lock up, and the lookahead
+		inline size_t getRelockByteCount(const size_t frameSize) { return FUZZ_MAX_AUX_SIZE + (2 + 2 + 1) * frameSize + (2 * FUZZ_MAX_AUX_SIZE); }
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,101 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Runs a fuzz target without libFuzzer, for compilers that don't have it: every file given is
+ * run once (a corpus, or a crash libFuzzer saved), then -runs=n random inputs are: mutations of
+ * the files, random bytes, and streams of valid frames with corrupted, dropped and inserted bytes,
+ * which random bytes hardly ever form. Crashes are reported by the sanitizers the target is built
+ * with.
+ *
+ */
+#include "modularbci-fuzz-frames.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define FUZZ_MAX_INPUT_SIZE 4096 // as the default -max_len of libFuzzer
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int main(int argc, char** argv)
+{
+	uint64_t nRun = 0, seed = 1;
+	std::vector<std::vector<uint8_t>> inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strncmp(argv[i], "-runs=", 6) == 0) { nRun = std::strtoull(argv[i] + 6, nullptr, 10); }
+		else if (std::strncmp(argv[i], "-seed=", 6) == 0) { seed = std::strtoull(argv[i] + 6, nullptr, 10); }
+		else if (argv[i][0] == '-')
+		{
+			std::printf("Usage: %s [-runs=n] [-seed=n] [input files]\n", argv[0]);
+			return 1;
+		}
+		else
+		{
+			std::ifstream file(argv[i], std::ios::binary);
+			if (!file.is_open())
+			{
+				std::fprintf(stderr, "Can't open [%s]\n", argv[i]);
+				return 1;
+			}
+			inputs.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			LLVMFuzzerTestOneInput(inputs.back().data(), inputs.back().size());
+		}
+	}
+
+	CFuzzRandom random(seed);
+	std::vector<uint8_t> input;
+	for (uint64_t run = 0; run < nRun; ++run)
+	{
+		const uint32_t mode = random.below(3);
+		if (mode == 0 && !inputs.empty())
+		{
+			input = inputs[random.below(uint32_t(inputs.size()))];
+			for (uint32_t n = 1 + random.below(8); n != 0 && !input.empty(); --n) { input[random.below(uint32_t(input.size()))] ^= uint8_t(1 << random.below(8)); }
+		}
+		else if (mode == 1)
+		{
+			input.resize(random.below(FUZZ_MAX_INPUT_SIZE));
+			for (auto& byte : input) { byte = uint8_t(random.next()); }
+		}
+		else
+		{
+			// the two bytes the targets read their settings from, then frames
+			input.assign({ uint8_t(random.next()), uint8_t(random.next()) });
+			const size_t nValue = 1 + input[0] % FUZZ_MAX_VALUE_COUNT;
+			int32_t codes[FUZZ_MAX_VALUE_COUNT];
+			uint8_t payload[255], sequence = 0;
+			while (input.size() < FUZZ_MAX_INPUT_SIZE)
+			{
+				const size_t start = input.size();
+				if (random.below(8) == 0)
+				{
+					for (auto& byte : payload) { byte = uint8_t(random.next()); }
+					appendAuxFrame(input, uint8_t(random.below(3)), payload, uint8_t(random.below(2) == 0 ? 13 : random.below(256)));
+				}
+				else
+				{
+					makeCodes(random, codes, nValue);
+					appendSampleFrame(input, codes, nValue, sequence++, uint8_t(random.next()));
+				}
+				const uint32_t fault = random.below(32);
+				if (fault == 0) { input[start + random.below(uint32_t(input.size() - start))] ^= uint8_t(1 << random.below(8)); }
+				else if (fault == 1) { input.erase(input.begin() + start + random.below(uint32_t(input.size() - start))); }
+				else if (fault == 2) { input.insert(input.begin() + start + random.below(uint32_t(input.size() - start)), uint8_t(random.next())); }
+			}
+		}
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+	}
+	std::printf("%zu inputs and %llu random runs passed\n", inputs.size(), (unsigned long long)nRun);
+	return 0;
+}
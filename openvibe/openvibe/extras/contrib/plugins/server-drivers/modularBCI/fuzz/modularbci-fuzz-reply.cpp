@@ -0,0 +1,74 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Fuzz target of the replies of the firmware to the latency probe: the input is decoded like a
+ * board stream, and every auxiliary frame goes through the reply parser and the probe as in the
+ * acquisition loop, with probes sent and host times advanced from the sample frames. The probe
+ * must hold its counts and give finite, non negative delays.
+ *
+ */
+#include "modularbci-fuzz-frames.h"
+#include "ovasCModularBCILatencyProbe.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+namespace
+{
+	void check(const bool condition, const char* what)
+	{
+		if (condition) { return; }
+		std::fprintf(stderr, "modularbci-fuzz-reply: %s\n", what);
+		std::abort();
+	}
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, const size_t size)
+{
+	if (size < 1) { return 0; }
+	CModularBCIFrameDecoder decoder;
+	decoder.initialize(1 + data[0] % FUZZ_MAX_VALUE_COUNT);
+	CModularBCILatencyProbe probe;
+	probe.initialize();
+
+	// a sample frame advances the host clock by its first code, in us, and sends a probe when its marker says so
+	uint64_t time = 1000000;
+	decoder.push(data + 1, size - 1);
+	for (auto event = decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = decoder.next())
+	{
+		if (event == CModularBCIFrameDecoder::Event_Sample)
+		{
+			time += uint32_t(decoder.getCodes()[0]) & 0xFFFFF;
+			if (decoder.getMarker() & 1)
+			{
+				const uint8_t tag = probe.prepare(time);
+				probe.setWritten(tag, time + (decoder.getMarker() >> 1));
+			}
+			continue;
+		}
+		latency_probe_reply_t reply;
+		const std::vector<uint8_t>& payload = decoder.getAuxPayload();
+		if (decoder.getAuxType() == AUX_FRAME_LATENCY_PROBE && CModularBCILatencyProbe::parseReply(payload.data(), payload.size(), reply))
+		{
+			probe.onReply(reply, time);
+		}
+	}
+
+	check(probe.getReplyCount() <= probe.getSentCount(), "more replies than probes");
+	for (int i = 0; i < CModularBCILatencyProbe::Stage_Count; ++i)
+	{
+		const auto stage = CModularBCILatencyProbe::EStage(i);
+		for (const double value : { probe.getMean(stage), probe.getMax(stage), probe.getPercentile(stage, 50), probe.getPercentile(stage, 99) })
+		{
+			check(std::isfinite(value) && value >= 0, "delay not finite or negative");
+		}
+		check(probe.getPercentile(stage, 99) <= probe.getMax(stage), "percentile above the maximum");
+	}
+	return 0;
+}
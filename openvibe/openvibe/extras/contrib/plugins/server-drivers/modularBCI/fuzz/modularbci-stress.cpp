@@ -0,0 +1,264 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Stress harness of the frame decoder. Every scenario interleaves pathological segments (random
+ * garbage, truncated frames, floods of fake sample headers or of valid auxiliary frames, bit
+ * errors) with segments of clean frames, and pushes the whole stream at full speed in reads of
+ * random sizes, as the serial port returns them. For each scenario it checks that:
+ * - the throughput stays within a ratio of the one of a clean stream,
+ * - the buffer of the decoder stays bounded,
+ * - the decoder locks on every clean segment within a bounded number of bytes, and decodes its
+ *   frames unchanged from then on.
+ * The exit code is 1 when a check fails, so that the harness can run in a CI job.
+ *
+ */
+#include "modularbci-fuzz-frames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define STRESS_SEGMENT_SIZE      65536 // bytes of a pathological segment
+#define STRESS_CLEAN_FRAME_COUNT 256   // frames of a clean segment
+#define STRESS_READ_SIZE         4096  // largest read, the read buffer of a board reader
+#define STRESS_STREAM_SIZE       (8 * 1024 * 1024) // generated once per scenario, then pushed as many times as needed
+
+namespace
+{
+	typedef struct
+	{
+		size_t nValue     = 8;
+		double megabytes  = 64;  // pushed per scenario
+		double minRatio   = 0.1; // of the clean throughput
+		uint64_t seed     = 1;
+	} settings_t;
+
+	enum class EScenario { Clean, Garbage, Truncated, HeaderFlood, AuxFlood, BitErrors, Count };
+
+	const char* getScenarioName(const EScenario scenario)
+	{
+		switch (scenario)
+		{
+			case EScenario::Clean: return "clean";
+			case EScenario::Garbage: return "random garbage";
+			case EScenario::Truncated: return "truncated frames";
+			case EScenario::HeaderFlood: return "fake header flood";
+			case EScenario::AuxFlood: return "auxiliary frame flood";
+			case EScenario::BitErrors: return "bit errors";
+			default: return "";
+		}
+	}
+
+	void appendPathological(const EScenario scenario, CFuzzRandom& random, const size_t nValue, std::vector<uint8_t>& stream)
+	{
+		const size_t end = stream.size() + STRESS_SEGMENT_SIZE;
+		int32_t codes[FUZZ_MAX_VALUE_COUNT];
+		uint8_t payload[255]  = {};
+		uint8_t sequence      = uint8_t(random.next());
+		const size_t nHeader  = 1 + random.below(4);
+		while (stream.size() < end)
+		{
+			switch (scenario)
+			{
+				case EScenario::Garbage:
+					stream.push_back(uint8_t(random.next()));
+					break;
+				case EScenario::Truncated:
+				{
+					const size_t start = stream.size();
+					makeCodes(random, codes, nValue);
+					appendSampleFrame(stream, codes, nValue, sequence++, 0);
+					stream.resize(start + 1 + random.below(uint32_t(stream.size() - start - 1)));
+					break;
+				}
+				case EScenario::HeaderFlood:
+					// headers of older firmware, and sample frame starts every few bytes
+					for (size_t i = 0; i < nHeader; ++i) { stream.insert(stream.end(), { SAMPLE_FRAME_START, 0, 0 }); }
+					stream.push_back(SAMPLE_FRAME_START);
+					break;
+				case EScenario::AuxFlood:
+					appendAuxFrame(stream, uint8_t(random.below(256)), payload, uint8_t(random.below(256)));
+					break;
+				case EScenario::BitErrors:
+				{
+					const size_t start = stream.size();
+					makeCodes(random, codes, nValue);
+					appendSampleFrame(stream, codes, nValue, sequence++, 0);
+					stream[start + random.below(uint32_t(stream.size() - start))] ^= uint8_t(1 << random.below(8));
+					break;
+				}
+				default: break;
+			}
+		}
+	}
+
+	// frames with the index in the marker, the codes kept to check the decoded ones against
+	void appendClean(CFuzzRandom& random, const size_t nValue, std::vector<uint8_t>& stream, std::vector<int32_t>& codes)
+	{
+		codes.resize(STRESS_CLEAN_FRAME_COUNT * nValue);
+		const uint8_t sequence = uint8_t(random.next());
+		for (size_t i = 0; i < STRESS_CLEAN_FRAME_COUNT; ++i)
+		{
+			makeCodes(random, &codes[i * nValue], nValue);
+			appendSampleFrame(stream, &codes[i * nValue], nValue, uint8_t(sequence + i), uint8_t(i));
+		}
+	}
+
+	// reads of random sizes, none across the end of a segment so that the decoded samples are known to come from it
+	void appendReads(CFuzzRandom& random, const size_t begin, const size_t end, std::vector<size_t>& reads)
+	{
+		for (size_t i = begin; i < end; i += reads.back()) { reads.push_back(std::min<size_t>(1 + random.below(STRESS_READ_SIZE), end - i)); }
+	}
+
+	typedef struct
+	{
+		double seconds      = 0;
+		double megabytes    = 0;
+		size_t maxBuffer    = 0;
+		size_t maxRelock    = 0; // in bytes, longest from the start of a clean segment to the end of its first frame decoded
+		size_t nUnlocked    = 0; // clean segments without their last frames decoded unchanged
+		uint64_t nLock      = 0;
+		uint64_t nFalseLock = 0;
+	} result_t;
+
+	result_t run(const EScenario scenario, const settings_t& settings)
+	{
+		CFuzzRandom random(settings.seed + uint64_t(scenario));
+		std::vector<uint8_t> stream;
+		std::vector<size_t> reads, cleanReads; // reads of all the segments, reads of each clean segment
+		std::vector<std::vector<int32_t>> cleanCodes;
+		while (stream.size() < STRESS_STREAM_SIZE)
+		{
+			size_t begin = stream.size();
+			if (scenario != EScenario::Clean)
+			{
+				appendPathological(scenario, random, settings.nValue, stream);
+				appendReads(random, begin, stream.size(), reads);
+				begin = stream.size();
+			}
+			cleanCodes.emplace_back();
+			appendClean(random, settings.nValue, stream, cleanCodes.back());
+			appendReads(random, begin, stream.size(), reads);
+			cleanReads.push_back(reads.size());
+		}
+
+		// throughput first, without the checks, over as many passes as needed
+		result_t result;
+		const size_t nPass = std::max<size_t>(1, size_t(settings.megabytes * 1024 * 1024 / double(stream.size())));
+		CModularBCIFrameDecoder decoder;
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t pass = 0; pass < nPass; ++pass)
+		{
+			decoder.initialize(settings.nValue);
+			size_t position = 0;
+			for (const size_t size : reads)
+			{
+				decoder.push(&stream[position], size);
+				position += size;
+				while (decoder.next() != CModularBCIFrameDecoder::Event_None) { }
+			}
+		}
+		result.seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.megabytes = double(nPass * stream.size()) / (1024 * 1024);
+
+		// then the checks: the samples decoded during each clean segment must end with its frames, from the first one locked on
+		decoder.initialize(settings.nValue);
+		const size_t nValue = settings.nValue;
+		std::vector<int32_t> samples;
+		size_t position = 0, read = 0;
+		for (size_t segment = 0; segment < cleanCodes.size(); ++segment)
+		{
+			samples.clear();
+			for (; read < cleanReads[segment]; ++read)
+			{
+				decoder.push(&stream[position], reads[read]);
+				position += reads[read];
+				result.maxBuffer = std::max(result.maxBuffer, decoder.getBufferSize());
+				for (auto event = decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = decoder.next())
+				{
+					if (event == CModularBCIFrameDecoder::Event_Sample) { samples.insert(samples.end(), decoder.getCodes(), decoder.getCodes() + nValue); }
+				}
+			}
+
+			const std::vector<int32_t>& codes = cleanCodes[segment];
+			size_t nMatched                   = 0;
+			while (nMatched < STRESS_CLEAN_FRAME_COUNT && (nMatched + 1) * nValue <= samples.size()
+				   && std::equal(codes.end() - (nMatched + 1) * nValue, codes.end() - nMatched * nValue, samples.end() - (nMatched + 1) * nValue)) { nMatched++; }
+			if (nMatched == 0) { result.nUnlocked++; }
+			else { result.maxRelock = std::max(result.maxRelock, (STRESS_CLEAN_FRAME_COUNT - nMatched + 1) * decoder.getFrameSize()); }
+		}
+		result.nLock      = decoder.getLockCount();
+		result.nFalseLock = decoder.getFalseLockCount();
+		return result;
+	}
+
+	bool parse(const int argc, char** argv, settings_t& settings)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string key = argv[i];
+			if (i + 1 >= argc) { return false; }
+			const char* value = argv[++i];
+			if (key == "--channels") { settings.nValue = size_t(std::atoi(value)); }
+			else if (key == "--megabytes") { settings.megabytes = std::atof(value); }
+			else if (key == "--min-ratio") { settings.minRatio = std::atof(value); }
+			else if (key == "--seed") { settings.seed = std::strtoull(value, nullptr, 10); }
+			else { return false; }
+		}
+		return settings.nValue >= 1 && settings.nValue <= FUZZ_MAX_VALUE_COUNT && settings.megabytes > 0;
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	settings_t settings;
+	if (!parse(argc, argv, settings))
+	{
+		std::printf("Usage: openvibe-modularbci-stress [--channels n] [--megabytes n] [--min-ratio r] [--seed n]\n"
+					"  --channels   enabled channels, 1 to %d (default %zu)\n"
+					"  --megabytes  bytes pushed per scenario (default %.0f)\n"
+					"  --min-ratio  lowest throughput of a scenario, as a ratio of the clean one (default %.2f)\n"
+					"  --seed       of the generated streams (default %llu)\n",
+					FUZZ_MAX_VALUE_COUNT, settings.nValue, settings.megabytes, settings.minRatio, (unsigned long long)settings.seed);
+		return 1;
+	}
+
+	CModularBCIFrameDecoder decoder;
+	decoder.initialize(settings.nValue);
+	const size_t frameSize = decoder.getFrameSize();
+	const size_t maxBuffer = STRESS_READ_SIZE + 4096 + getRelockByteCount(frameSize);
+	const size_t maxRelock = getRelockByteCount(frameSize);
+
+	std::printf("%zu channels, %zu byte frames, locks within %zu bytes, buffer within %zu bytes\n", settings.nValue, frameSize, maxRelock, maxBuffer);
+	std::printf("%-22s %10s %8s %10s %10s %8s %8s %s\n", "scenario", "MB/s", "ratio", "buffer", "lock (B)", "locks", "false", "failed");
+	double cleanRate = 0;
+	bool isPassed    = true;
+	for (int i = 0; i < int(EScenario::Count); ++i)
+	{
+		const auto scenario   = EScenario(i);
+		const result_t result = run(scenario, settings);
+		const double rate     = result.megabytes / result.seconds;
+		if (scenario == EScenario::Clean) { cleanRate = rate; }
+		const double ratio = rate / cleanRate;
+
+		std::string failures;
+		if (ratio < settings.minRatio) { failures += " throughput"; }
+		if (result.maxBuffer > maxBuffer) { failures += " buffer"; }
+		if (result.maxRelock > maxRelock || result.nUnlocked != 0) { failures += " lock"; }
+		isPassed = isPassed && failures.empty();
+
+		std::printf("%-22s %10.1f %8.2f %10zu %10zu %8llu %8llu %s\n", getScenarioName(scenario), rate, ratio, result.maxBuffer, result.maxRelock,
+					(unsigned long long)result.nLock, (unsigned long long)result.nFalseLock, failures.empty() ? "-" : failures.c_str() + 1);
+	}
+	std::printf(isPassed ? "Passed\n" : "FAILED\n");
+	return isPassed ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Round trip of the command frames through a terminal set up like the serial port of the driver:
+ * frames holding 0x0A (channel mask, marker code, checksum) and every other byte value are written
+ * to a pseudo terminal and must come out of it unchanged and pass the frame check of the firmware.
+ * The exit code is 1 when a frame does not, so that the test can run in a CI job.
+ *
+ */
+#include "ovasCModularBCISerialPort.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined TARGET_OS_Linux
+#include <pty.h>
+#include <unistd.h>
+#include <sys/select.h>
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define TEST_READ_TIMEOUT 1000 // in ms
+
+namespace
+{
+	// the checks of Command_Poll in the firmware, the command and arguments of a valid frame
+	bool parseCommandFrame(const std::string& frame, char& command, std::string& arguments)
+	{
+		if (frame.size() < 4 || uint8_t(frame[0]) != COMMAND_FRAME_START || uint8_t(frame[2]) > 8 || frame.size() != 4 + size_t(uint8_t(frame[2])))
+		{
+			return false;
+		}
+		uint8_t checksum = 0;
+		for (size_t i = 1; i + 1 < frame.size(); ++i) { checksum ^= uint8_t(frame[i]); }
+		if (checksum != uint8_t(frame.back())) { return false; }
+		command   = frame[1];
+		arguments = frame.substr(3, frame.size() - 4);
+		return true;
+	}
+
+#if defined TARGET_OS_Linux
+	// what the board side of the link receives for a frame written on the driver side
+	std::string transfer(const int driverFd, const int boardFd, const std::string& frame)
+	{
+		if (::write(driverFd, frame.data(), frame.size()) != ssize_t(frame.size())) { return std::string(); }
+		std::string received;
+		char buffer[64];
+		while (true)
+		{
+			fd_set readSet;
+			FD_ZERO(&readSet);
+			FD_SET(boardFd, &readSet);
+			struct timeval timeout = { 0, TEST_READ_TIMEOUT * 1000 };
+			if (received.size() >= frame.size()) { timeout.tv_usec = 10000; } // more than sent would be translated bytes
+			if (::select(boardFd + 1, &readSet, nullptr, nullptr, &timeout) <= 0) { return received; }
+			const ssize_t length = ::read(boardFd, buffer, sizeof(buffer));
+			if (length <= 0) { return received; }
+			received.append(buffer, size_t(length));
+		}
+	}
+#endif
+}  // namespace
+
+int main()
+{
+#if defined TARGET_OS_Linux
+	int boardFd = -1, driverFd = -1;
+	if (::openpty(&boardFd, &driverFd, nullptr, nullptr, nullptr) != 0)
+	{
+		std::printf("Could not open a pseudo terminal\n");
+		return 1;
+	}
+
+	// the driver side as openPort sets it, the board side reads the bytes as they were put on the line
+	if (!CModularBCISerialPort::setRawPort(driverFd, 128000))
+	{
+		std::printf("Could not set the pseudo terminal up like the serial port\n");
+		return 1;
+	}
+
+	std::vector<std::pair<char, std::string>> commands = {
+		{ 'm', std::string(1, '\x0A') },                       // channel mask
+		{ 'm', std::string("\x0A\x0D\x0A\x00", 4) },           // daisy channel masks
+		{ 'k', std::string(1, char(10)) },                     // marker code 10
+		{ 'p', std::string(1, char('p' ^ 1 ^ 0x0A)) },         // probe tag with a checksum of 0x0A
+		{ 'b', std::string() }
+	};
+	for (int value = 0; value < 256; ++value) { commands.emplace_back('k', std::string(1, char(value))); }
+
+	size_t nFailed = 0;
+	for (const auto& command : commands)
+	{
+		const std::string frame    = CModularBCISerialPort::getCommandFrame(command.first, command.second);
+		const std::string received = transfer(driverFd, boardFd, frame);
+		char parsedCommand         = 0;
+		std::string parsedArguments;
+		if (received != frame || !parseCommandFrame(received, parsedCommand, parsedArguments) || parsedCommand != command.first
+			|| parsedArguments != command.second)
+		{
+			std::printf("Frame of command '%c' with %zu argument bytes: %zu bytes sent, %zu received\n", command.first, command.second.size(),
+						frame.size(), received.size());
+			nFailed++;
+		}
+	}
+	::close(driverFd);
+	::close(boardFd);
+
+	std::printf("%zu of %zu command frames passed the serial port unchanged\n", commands.size() - nFailed, commands.size());
+	return nFailed == 0 ? 0 : 1;
+#else
+	std::printf("Pseudo terminals are only tested on Linux\n");
+	return 0;
+#endif
+}
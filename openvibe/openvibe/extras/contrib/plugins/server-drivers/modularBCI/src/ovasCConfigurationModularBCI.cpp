@@ -10,8 +10,11 @@
  *
  */
 #include "ovasCConfigurationModularBCI.h"
+#include "ovasCModularBCILinkPlanner.h"
 #include <algorithm>
 #include <string>
+#include <cstdlib>
+#include <cstdio>
 
 #if defined TARGET_OS_Windows
 #include <windows.h>
@@ -80,12 +83,48 @@ bool CConfigurationModularBCI::isTTYFile(const CString& filename)
 #endif
 }
 
+uint32_t CConfigurationModularBCI::getEnabledChannelCount(const uint32_t channelMask, const int nEEGChannel)
+{
+	uint32_t count = 0;
+	for (int i = 0; i < nEEGChannel && i < 32; ++i) { if (channelMask & (1U << i)) { count++; } }
+	return count;
+}
+
+std::vector<uint32_t> CConfigurationModularBCI::getEnabledChannels(const uint32_t channelMask, const int nEEGChannel)
+{
+	std::vector<uint32_t> res;
+	for (int i = 0; i < nEEGChannel && i < 32; ++i) { if (channelMask & (1U << i)) { res.push_back(uint32_t(i)); } }
+	return res;
+}
+
+std::string CConfigurationModularBCI::channelMaskToString(const uint32_t channelMask)
+{
+	char buffer[16];
+	::sprintf(buffer, "0x%08X", channelMask);
+	return buffer;
+}
+
+bool CConfigurationModularBCI::parseChannelMask(const std::string& text, uint32_t& channelMask)
+{
+	// accepts decimal, or hexadecimal with the 0x prefix
+	if (text.empty()) { return false; }
+	char* end                 = nullptr;
+	const unsigned long value = ::strtoul(text.c_str(), &end, 0);
+	if (end == text.c_str() || *end != '\0' || value == 0 || value > 0xFFFFFFFFUL) { return false; }
+	channelMask = uint32_t(value);
+	return true;
+}
+
 static void checkbutton_daisy_module_cb(GtkToggleButton* button, CConfigurationModularBCI* data)
 {
 	data->checkbuttonDaisyModuleCB(gtk_toggle_button_get_active(button) ? CConfigurationModularBCI::EDaisyStatus::Active
 									   : CConfigurationModularBCI::EDaisyStatus::Inactive);
 }
 
+static void entry_channel_mask_cb(GtkEntry* /*entry*/, CConfigurationModularBCI* data) { data->entryChannelMaskCB(); }
+static void combobox_data_rate_cb(GtkComboBox* /*combo*/, CConfigurationModularBCI* data) { data->entryChannelMaskCB(); }
+static void button_link_suggestion_cb(GtkButton* /*button*/, CConfigurationModularBCI* data) { data->buttonLinkSuggestionCB(); }
+
 CConfigurationModularBCI::CConfigurationModularBCI(const char* gtkBuilderFilename, uint32_t& usbIdx)
 	: CConfigurationBuilder(gtkBuilderFilename), m_usbIdx(usbIdx) { m_listStore = gtk_list_store_new(1, G_TYPE_STRING); }
 
@@ -115,7 +154,25 @@ bool CConfigurationModularBCI::preConfigure()
 	GtkToggleButton* buttonDaisyModule = GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "checkbutton_daisy_module"));
 	gtk_toggle_button_set_active(buttonDaisyModule, m_daisyModule ? true : false);
 
+	GtkEntry* entryChannelMask = GTK_ENTRY(gtk_builder_get_object(m_builder, "entry_channel_mask"));
+	gtk_entry_set_text(entryChannelMask, channelMaskToString(m_channelMask).c_str());
+
+	// the data rates of the ADS1299
+	GtkComboBox* comboBoxDataRate = GTK_COMBO_BOX(gtk_builder_get_object(m_builder, "combobox_data_rate"));
+	GtkListStore* listStoreDataRate = gtk_list_store_new(1, G_TYPE_STRING);
+	gtk_combo_box_set_model(comboBoxDataRate, GTK_TREE_MODEL(listStoreDataRate));
+	g_object_unref(listStoreDataRate);
+	const std::vector<uint32_t>& rates = CModularBCILinkPlanner::getSamplingRates();
+	for (size_t i = 0; i < rates.size(); ++i)
+	{
+		gtk_combo_box_append_text(comboBoxDataRate, (std::to_string(rates[i]) + " Hz").c_str());
+		if (rates[i] == m_sampling || i == 0) { gtk_combo_box_set_active(comboBoxDataRate, gint(i)); }
+	}
+
 	::g_signal_connect(::gtk_builder_get_object(m_builder, "checkbutton_daisy_module"), "toggled", G_CALLBACK(checkbutton_daisy_module_cb), this);
+	::g_signal_connect(::gtk_builder_get_object(m_builder, "entry_channel_mask"), "changed", G_CALLBACK(entry_channel_mask_cb), this);
+	::g_signal_connect(::gtk_builder_get_object(m_builder, "combobox_data_rate"), "changed", G_CALLBACK(combobox_data_rate_cb), this);
+	::g_signal_connect(::gtk_builder_get_object(m_builder, "button_link_suggestion"), "clicked", G_CALLBACK(button_link_suggestion_cb), this);
 	this->checkbuttonDaisyModuleCB(m_daisyModule ? EDaisyStatus::Active : EDaisyStatus::Inactive);
 
 	GtkComboBox* comboBox = GTK_COMBO_BOX(gtk_builder_get_object(m_builder, "combobox_device"));
@@ -189,6 +246,17 @@ bool CConfigurationModularBCI::postConfigure()
 
 		GtkToggleButton* buttonDaisyModule = GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "checkbutton_daisy_module"));
 		m_daisyModule                      = gtk_toggle_button_get_active(buttonDaisyModule) ? true : false;
+
+		// an invalid mask keeps the previous one, as does a mask enabling none of the channels of the board
+		GtkEntry* entryChannelMask = GTK_ENTRY(gtk_builder_get_object(m_builder, "entry_channel_mask"));
+		uint32_t channelMask       = m_channelMask;
+		if (parseChannelMask(gtk_entry_get_text(entryChannelMask), channelMask)
+			&& getEnabledChannelCount(channelMask, getDaisyInformation(m_daisyModule ? EDaisyStatus::Active : EDaisyStatus::Inactive).nEEGChannel) != 0)
+		{
+			m_channelMask = channelMask;
+		}
+
+		m_sampling = this->getSelectedSampling();
 	}
 
 	if (!CConfigurationBuilder::postConfigure()) { return false; }
@@ -199,16 +267,79 @@ void CConfigurationModularBCI::checkbuttonDaisyModuleCB(const EDaisyStatus statu
 {
 	const daisy_Info_t info = this->getDaisyInformation(status);
 
-	std::string buffer = std::to_string(info.nEEGChannel) + " EEG Channels";
+	// only the channels enabled in the mask are streamed
+	uint32_t channelMask = m_channelMask;
+	parseChannelMask(gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(m_builder, "entry_channel_mask"))), channelMask);
+	const uint32_t nEEGChannel = getEnabledChannelCount(channelMask, info.nEEGChannel);
+
+	std::string buffer = std::to_string(nEEGChannel) + " of " + std::to_string(info.nEEGChannel) + " EEG Channels";
 	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(m_builder, "label_status_eeg_channel_count")), buffer.c_str());
 
 	buffer = std::to_string(info.nAccChannel) + " Accelerometer Channels";
 	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(m_builder, "label_status_acc_channel_count")), buffer.c_str());
 
-	buffer = std::to_string(info.sampling) + " Hz Sampling Rate";
+	const uint32_t sampling = this->getSelectedSampling();
+	buffer                  = std::to_string(sampling) + " Hz Sampling Rate";
 	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(m_builder, "label_status_sampling_rate")), buffer.c_str());
 
-	gtk_spin_button_set_value(GTK_SPIN_BUTTON(gtk_builder_get_object(m_builder, "spinbutton_number_of_channels")), info.nEEGChannel + info.nAccChannel);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(gtk_builder_get_object(m_builder, "spinbutton_number_of_channels")), nEEGChannel + info.nAccChannel);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(gtk_builder_get_object(m_builder, "combobox_sampling_frequency")), sampling);
+
+	// what the link has to carry, the settings are refused when the board would miss frames
+	const CModularBCILinkPlanner::plan_t plan = CModularBCILinkPlanner::plan(nEEGChannel, sampling, m_baudRate, m_readBatch);
+	char text[256];
+	::sprintf(text, "%.0f bytes/s, %.0f%% of the %u baud link, %.1f ms latency%s", plan.bytesPerSecond, plan.utilization * 100, m_baudRate,
+			  plan.latency * 1000, nEEGChannel == 0 ? " - no EEG channel enabled" : plan.isFeasible ? "" : " - too much for the link");
+	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(m_builder, "label_status_link")), text);
+
+	uint32_t suggestedChannelMask = 0, suggestedSampling = 0;
+	const bool hasSuggestion      = this->getLinkSuggestion(suggestedChannelMask, suggestedSampling);
+	buffer                        = hasSuggestion ? "Use " + std::to_string(getEnabledChannelCount(suggestedChannelMask, info.nEEGChannel)) + " Channels ("
+										+ channelMaskToString(suggestedChannelMask) + ") at " + std::to_string(suggestedSampling) + " Hz"
+									: "Settings Fit the Link";
+	gtk_button_set_label(GTK_BUTTON(gtk_builder_get_object(m_builder, "button_link_suggestion")), buffer.c_str());
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(m_builder, "button_link_suggestion")), hasSuggestion);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(m_builder, "button_apply")), plan.isFeasible && nEEGChannel != 0);
+}
+
+void CConfigurationModularBCI::buttonLinkSuggestionCB() const
+{
+	uint32_t channelMask = 0, sampling = 0;
+	if (!this->getLinkSuggestion(channelMask, sampling)) { return; }
+
+	// both changes call back into the status update
+	const std::vector<uint32_t>& rates = CModularBCILinkPlanner::getSamplingRates();
+	gtk_combo_box_set_active(GTK_COMBO_BOX(gtk_builder_get_object(m_builder, "combobox_data_rate")),
+							 gint(std::find(rates.begin(), rates.end(), sampling) - rates.begin()));
+	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(m_builder, "entry_channel_mask")), channelMaskToString(channelMask).c_str());
+}
+
+uint32_t CConfigurationModularBCI::getSelectedSampling() const
+{
+	const std::vector<uint32_t>& rates = CModularBCILinkPlanner::getSamplingRates();
+	const gint index                   = gtk_combo_box_get_active(GTK_COMBO_BOX(gtk_builder_get_object(m_builder, "combobox_data_rate")));
+	return index >= 0 && size_t(index) < rates.size() ? rates[size_t(index)] : m_sampling;
+}
+
+bool CConfigurationModularBCI::getLinkSuggestion(uint32_t& channelMask, uint32_t& sampling) const
+{
+	GtkToggleButton* buttonDaisyModule = GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "checkbutton_daisy_module"));
+	const daisy_Info_t info            = getDaisyInformation(gtk_toggle_button_get_active(buttonDaisyModule) ? EDaisyStatus::Active : EDaisyStatus::Inactive);
+	uint32_t currentChannelMask        = m_channelMask;
+	parseChannelMask(gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(m_builder, "entry_channel_mask"))), currentChannelMask);
+	const uint32_t currentSampling = this->getSelectedSampling();
+
+	if (CModularBCILinkPlanner::plan(getEnabledChannelCount(currentChannelMask, info.nEEGChannel), currentSampling, m_baudRate, m_readBatch).isFeasible)
+	{
+		return false;
+	}
+	return CModularBCILinkPlanner::suggest(currentChannelMask, info.nEEGChannel, currentSampling, m_baudRate, m_readBatch, channelMask, sampling);
+}
+
+void CConfigurationModularBCI::entryChannelMaskCB() const
+{
+	GtkToggleButton* buttonDaisyModule = GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "checkbutton_daisy_module"));
+	this->checkbuttonDaisyModuleCB(gtk_toggle_button_get_active(buttonDaisyModule) ? EDaisyStatus::Active : EDaisyStatus::Inactive);
 }
 
 CConfigurationModularBCI::daisy_Info_t CConfigurationModularBCI::getDaisyInformation(const EDaisyStatus status)
@@ -15,6 +15,8 @@
 
 #include <gtk/gtk.h>
 #include <map>
+#include <string>
+#include <vector>
 
 namespace OpenViBE
 {
@@ -41,6 +43,12 @@ namespace OpenViBE
 			static CString getTTYFileName(uint32_t ttyNumber);
 			static bool isTTYFile(const CString& filename);
 
+			// channel mask helpers: bit n set -> EEG channel n+1 is powered on and streamed by the board
+			static uint32_t getEnabledChannelCount(uint32_t channelMask, int nEEGChannel);
+			static std::vector<uint32_t> getEnabledChannels(uint32_t channelMask, int nEEGChannel); // zero based board channel of each acquired channel
+			static std::string channelMaskToString(uint32_t channelMask);
+			static bool parseChannelMask(const std::string& text, uint32_t& channelMask);
+
 			CConfigurationModularBCI(const char* gtkBuilderFilename, uint32_t& usbIdx);
 			~CConfigurationModularBCI() override;
 
@@ -55,13 +63,24 @@ namespace OpenViBE
 			uint32_t getFlushBoardReplyTimeout() const { return m_flushBoardReplyTimeout; }
 			void setDaisyModule(const bool module) { m_daisyModule = module; }
 			bool getDaisyModule() const { return m_daisyModule; }
+			void setChannelMask(const uint32_t mask) { m_channelMask = mask; }
+			uint32_t getChannelMask() const { return m_channelMask; }
+			void setSampling(const uint32_t sampling) { m_sampling = sampling; }
+			uint32_t getSampling() const { return m_sampling; }
+			void setBaudRate(const uint32_t baudRate) { m_baudRate = baudRate; } // of the link, for the planner only
+			void setReadBatch(const uint32_t batch) { m_readBatch = batch; }     // frames the driver reads at once, for the planner only
 
 			void checkbuttonDaisyModuleCB(EDaisyStatus status) const;
+			void entryChannelMaskCB() const;
+			void buttonLinkSuggestionCB() const; // applies the cheapest feasible settings to the dialog
 
 			static daisy_Info_t getDaisyInformation(EDaisyStatus status);
 
 		protected:
 
+			uint32_t getSelectedSampling() const;
+			bool getLinkSuggestion(uint32_t& channelMask, uint32_t& sampling) const; // false when the dialog settings fit the link or nothing does
+
 			std::map<int, int> m_comboSlotsIndexToSerialPort;
 			uint32_t& m_usbIdx;
 			GtkListStore* m_listStore = nullptr;
@@ -70,6 +89,10 @@ namespace OpenViBE
 			uint32_t m_readBoardReplyTimeout  = 0;
 			uint32_t m_flushBoardReplyTimeout = 0;
 			bool m_daisyModule                = false;
+			uint32_t m_channelMask            = 0xFFFFFFFF;
+			uint32_t m_sampling               = DEFAULT_SAMPLING;
+			uint32_t m_baudRate               = 0;
+			uint32_t m_readBatch              = 1;
 		};
 	}  // namespace AcquisitionServer
 }  // namespace OpenViBE
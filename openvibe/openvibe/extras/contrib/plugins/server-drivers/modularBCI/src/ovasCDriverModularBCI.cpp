@@ -12,6 +12,8 @@
 
 #include "ovasCDriverModularBCI.h"
 #include "ovasCConfigurationModularBCI.h"
+#include "ovasCModularBCILinkPlanner.h"
+#include "ovasCModularBCISerialPort.h"
 
 #include <toolkit/ovtk_all.h>
 #include <system/ovCTime.h>
@@ -20,7 +22,10 @@
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <cstdlib>
 #include <sstream>
+#include <thread>
+#include <chrono>
 
 
 #if defined TARGET_OS_Windows
@@ -31,20 +36,22 @@
 #include <winsock2.h> // htons and co.
 //#define TERM_SPEED 57600
 //#define TERM_SPEED CBR_115200 // ModularBCI is a bit faster than others
-#define TERM_SPEED CBR_128000 
+#define TERM_SPEED CBR_128000
 #elif defined TARGET_OS_Linux
  #include <cstdio>
+ #include <cerrno>
  #include <unistd.h>
  #include <fcntl.h>
  #include <termios.h>
  #include <sys/select.h>
  #include <netinet/in.h> // htons and co.
  #include <unistd.h>
- //#define TERM_SPEED B115200
- #define TERM_SPEED B115200
+ // 128000 has no Bxxx constant, the port is set with termios2
 #else
 #endif
 
+#define TERM_BAUD_RATE 128000 // huart1 of the firmware, for the port and the link planner
+
 
 using namespace OpenViBE;
 using namespace /*OpenViBE::*/AcquisitionServer;
@@ -68,6 +75,106 @@ using namespace /*OpenViBE::*/Kernel;
 #define Token_MissingSampleDelayBeforeReset       "AcquisitionDriver_ModularBCI_MissingSampleDelayBeforeReset"
 #define Token_DroppedSampleCountBeforeReset       "AcquisitionDriver_ModularBCI_DroppedSampleCountBeforeReset"
 #define Token_DroppedSampleSafetyDelayBeforeReset "AcquisitionDriver_ModularBCI_DroppedSampleSafetyDelayBeforeReset"
+#define Token_NotchFrequency                      "AcquisitionDriver_ModularBCI_NotchFrequency"
+#define Token_NotchQualityFactor                  "AcquisitionDriver_ModularBCI_NotchQualityFactor"
+#define Token_HighPassFrequency                   "AcquisitionDriver_ModularBCI_HighPassFrequency"
+#define Token_LowPassFrequency                    "AcquisitionDriver_ModularBCI_LowPassFrequency"
+#define Token_FilteredChannelMask                 "AcquisitionDriver_ModularBCI_FilteredChannelMask"
+#define Token_ArtifactAmplitude                   "AcquisitionDriver_ModularBCI_ArtifactAmplitude"
+#define Token_ArtifactDerivative                  "AcquisitionDriver_ModularBCI_ArtifactDerivative"
+#define Token_ArtifactHold                        "AcquisitionDriver_ModularBCI_ArtifactHold"
+#define Token_ArtifactChannelMask                 "AcquisitionDriver_ModularBCI_ArtifactChannelMask"
+#define Token_ArtifactEOGChannel                  "AcquisitionDriver_ModularBCI_ArtifactEOGChannel"
+#define Token_SpectralHop                         "AcquisitionDriver_ModularBCI_SpectralHop"
+#define Token_SpectralWindowSize                  "AcquisitionDriver_ModularBCI_SpectralWindowSize"
+#define Token_SpectralBands                       "AcquisitionDriver_ModularBCI_SpectralBands"
+#define Token_SpectralStreamPort                  "AcquisitionDriver_ModularBCI_SpectralStreamPort"
+#define Token_RecordingFile                       "AcquisitionDriver_ModularBCI_RecordingFile"
+#define Token_ReplayFile                          "AcquisitionDriver_ModularBCI_ReplayFile"
+#define Token_ReplaySpeed                         "AcquisitionDriver_ModularBCI_ReplaySpeed"
+#define Token_ReplaySamples                       "AcquisitionDriver_ModularBCI_ReplaySamples"
+#define Token_MotorImageryModel                   "AcquisitionDriver_ModularBCI_MotorImageryModel"
+#define Token_SSVEPFrequencies                    "AcquisitionDriver_ModularBCI_SSVEPFrequencies"
+#define Token_SSVEPHarmonics                      "AcquisitionDriver_ModularBCI_SSVEPHarmonics"
+#define Token_SSVEPSubBands                       "AcquisitionDriver_ModularBCI_SSVEPSubBands"
+#define Token_SSVEPWindow                         "AcquisitionDriver_ModularBCI_SSVEPWindow"
+#define Token_SSVEPHop                            "AcquisitionDriver_ModularBCI_SSVEPHop"
+#define Token_SSVEPChannelMask                    "AcquisitionDriver_ModularBCI_SSVEPChannelMask"
+#define Token_SSVEPThreshold                      "AcquisitionDriver_ModularBCI_SSVEPThreshold"
+#define Token_SSVEPCommands                       "AcquisitionDriver_ModularBCI_SSVEPCommands"
+#define Token_MotorImageryThreshold               "AcquisitionDriver_ModularBCI_MotorImageryThreshold"
+#define Token_MotorImageryCommands                "AcquisitionDriver_ModularBCI_MotorImageryCommands"
+#define Token_CommandAddress                      "AcquisitionDriver_ModularBCI_CommandAddress"
+#define Token_CommandDebounce                     "AcquisitionDriver_ModularBCI_CommandDebounce"
+#define Token_CommandRefractory                   "AcquisitionDriver_ModularBCI_CommandRefractory"
+#define Token_CommandWatchdog                     "AcquisitionDriver_ModularBCI_CommandWatchdog"
+#define Token_StreamPort                          "AcquisitionDriver_ModularBCI_StreamPort"
+#define Token_StreamLocalOnly                     "AcquisitionDriver_ModularBCI_StreamLocalOnly"
+#define Token_SharedMemoryName                    "AcquisitionDriver_ModularBCI_SharedMemoryName"
+#define Token_SharedMemoryLength                  "AcquisitionDriver_ModularBCI_SharedMemoryLength"
+#define Token_LatencyProbeInterval                "AcquisitionDriver_ModularBCI_LatencyProbeInterval"
+#define Token_MetricsPort                         "AcquisitionDriver_ModularBCI_MetricsPort"
+#define Token_MetricsFile                         "AcquisitionDriver_ModularBCI_MetricsFile"
+#define Token_MetricsFilePeriod                   "AcquisitionDriver_ModularBCI_MetricsFilePeriod"
+#define Token_AdditionalDevices                   "AcquisitionDriver_ModularBCI_AdditionalDevices"
+#define Token_SyncMarker                          "AcquisitionDriver_ModularBCI_SyncMarker"
+#define Token_SyncInterval                        "AcquisitionDriver_ModularBCI_SyncInterval"
+#define Token_ReadBatch                           "AcquisitionDriver_ModularBCI_ReadBatch"
+#define Token_ReadMaxWait                         "AcquisitionDriver_ModularBCI_ReadMaxWait"
+#define Token_ImpedanceCheck                      "AcquisitionDriver_ModularBCI_ImpedanceCheck"
+#define Token_SelfTest                            "AcquisitionDriver_ModularBCI_SelfTest"
+
+// samples replayed per loop when replaying as fast as possible
+#define REPLAY_SAMPLE_COUNT_PER_LOOP 256
+
+// blocks kept in the sample bus ring, how far behind a DropOldest subscriber may fall
+#define SAMPLE_BUS_SLOT_COUNT 256
+
+// interval between two logs of the latency probe percentiles, in us
+#define LATENCY_PROBE_REPORT_PERIOD 10000000
+
+// interval between two copies of the stage counts into the metrics, in us
+#define METRICS_UPDATE_PERIOD 1000000
+
+// samples of each board kept for the alignment of a multi-board acquisition, in s
+#define BOARD_ALIGNMENT_LENGTH 4
+
+// interval between two logs of the board offsets and skews, in us
+#define BOARD_REPORT_PERIOD 10000000
+
+// marker command of the firmware, followed by the marker code
+#define MARKER_COMMAND 'k'
+
+// sets the ADS1299 data rate, followed by its CONFIG1 DR code
+#define DATA_RATE_COMMAND 'r'
+
+// measures the electrode impedances, followed by one mask byte per ADS1299
+#define IMPEDANCE_COMMAND 'z'
+
+// fundamental of the 6nA square wave lead-off current the firmware excites the electrodes with, in A
+#define IMPEDANCE_CURRENT (4 / 3.14159265358979323846 * 6e-9)
+
+// samples the firmware takes per channel, settling included
+#define IMPEDANCE_SAMPLE_COUNT_PER_CHANNEL 74
+
+// runs the self-test of the enabled channels, no argument
+#define SELF_TEST_COMMAND 't'
+
+// the self-test takes about 3.2 s whatever the data rate
+#define SELF_TEST_TIMEOUT 7000
+
+// self-test result flags, and the test signal amplitude the firmware checks against in ADC codes
+#define SELF_TEST_AMPLITUDE_OK 1
+#define SELF_TEST_FREQUENCY_OK 2
+#define SELF_TEST_NOISE_OK     4
+#define SELF_TEST_ALL_OK       7
+#define SELF_TEST_AMPLITUDE    83886
+
+// Butterworth quality factor of a second order section
+#define BUTTERWORTH_Q 0.70710678
+
+// default bands of the online spectral engine
+#define DEFAULT_SPECTRAL_BANDS "theta:4-8;alpha:8-13;beta:13-30"
 
 //___________________________________________________________________//
 // Heavily inspired by OpenEEG code. Will override channel count and sampling late upon "daisy" selection. If daisy module is attached, will concatenate EEG values and average accelerometer values every two samples.
@@ -88,12 +195,71 @@ CDriverModularBCI::CDriverModularBCI(IDriverContext& ctx)
 	m_settings.add("ReadBoardReplyTimeout", &m_readBoardReplyTimeout);
 	m_settings.add("FlushBoardReplyTimeout", &m_flushBoardReplyTimeout);
 	m_settings.add("DaisyModule", &m_daisyModule);
+	m_settings.add("ChannelMask", &m_channelMask);
+	m_settings.add("SamplingRate", &m_sampling);
 
 	m_settings.load();
 
 	m_missingSampleDelayBeforeReset       = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_MissingSampleDelayBeforeReset, 1000));
 	m_droppedSampleCountBeforeReset       = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_DroppedSampleCountBeforeReset, 5));
 	m_droppedSampleSafetyDelayBeforeReset = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_DroppedSampleSafetyDelayBeforeReset, 1000));
+	m_notchFrequency                      = ctx.getConfigurationManager().expandAsFloat(Token_NotchFrequency, 0);
+	m_notchQualityFactor                  = ctx.getConfigurationManager().expandAsFloat(Token_NotchQualityFactor, 30);
+	m_highPassFrequency                   = ctx.getConfigurationManager().expandAsFloat(Token_HighPassFrequency, 0);
+	m_lowPassFrequency                    = ctx.getConfigurationManager().expandAsFloat(Token_LowPassFrequency, 0);
+	m_filteredChannelMask                 = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_FilteredChannelMask, 0xFFFFFFFF));
+	m_artifactAmplitude                   = ctx.getConfigurationManager().expandAsFloat(Token_ArtifactAmplitude, 0);
+	m_artifactDerivative                  = ctx.getConfigurationManager().expandAsFloat(Token_ArtifactDerivative, 0);
+	m_artifactHold                        = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_ArtifactHold, 250));
+	m_artifactChannelMask                 = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_ArtifactChannelMask, 0xFFFFFFFF));
+	m_artifactEOGChannel                  = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_ArtifactEOGChannel, 0));
+	m_spectralHop                         = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SpectralHop, 0));
+	m_spectralWindowSize                  = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SpectralWindowSize, 256));
+	m_spectralBands                       = ctx.getConfigurationManager().expand("${" Token_SpectralBands "}");
+	if (m_spectralBands.length() == 0) { m_spectralBands = DEFAULT_SPECTRAL_BANDS; }
+	m_spectralStreamPort                  = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SpectralStreamPort, 0));
+	m_recordingFilename                   = ctx.getConfigurationManager().expand("${" Token_RecordingFile "}");
+	m_replayFilename                      = ctx.getConfigurationManager().expand("${" Token_ReplayFile "}");
+	m_replaySpeed                         = ctx.getConfigurationManager().expandAsFloat(Token_ReplaySpeed, 1);
+	m_replaySamples                       = ctx.getConfigurationManager().expandAsBoolean(Token_ReplaySamples, false);
+	m_motorImageryModelFilename           = ctx.getConfigurationManager().expand("${" Token_MotorImageryModel "}");
+	m_ssvepFrequencies                    = ctx.getConfigurationManager().expand("${" Token_SSVEPFrequencies "}");
+	m_ssvepHarmonics                      = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SSVEPHarmonics, 3));
+	m_ssvepSubBands                       = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SSVEPSubBands, 5));
+	m_ssvepWindow                         = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SSVEPWindow, 1000));
+	m_ssvepHop                            = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SSVEPHop, 60));
+	m_ssvepChannelMask                    = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SSVEPChannelMask, 0xFFFFFFFF));
+	m_ssvepThreshold                      = ctx.getConfigurationManager().expandAsFloat(Token_SSVEPThreshold, 0.3);
+	m_ssvepCommands                       = ctx.getConfigurationManager().expand("${" Token_SSVEPCommands "}");
+	m_motorImageryThreshold               = ctx.getConfigurationManager().expandAsFloat(Token_MotorImageryThreshold, 0.7);
+	m_motorImageryCommands                = ctx.getConfigurationManager().expand("${" Token_MotorImageryCommands "}");
+	m_commandAddress                      = ctx.getConfigurationManager().expand("${" Token_CommandAddress "}");
+	m_commandDebounce                     = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_CommandDebounce, 3));
+	m_commandRefractory                   = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_CommandRefractory, 1000));
+	m_commandWatchdog                     = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_CommandWatchdog, 500));
+	m_streamPort                          = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_StreamPort, 0));
+	m_streamLocalOnly                     = ctx.getConfigurationManager().expandAsBoolean(Token_StreamLocalOnly, true);
+	m_sharedMemoryName                    = ctx.getConfigurationManager().expand("${" Token_SharedMemoryName "}");
+	m_sharedMemoryLength                  = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SharedMemoryLength, 10000));
+	m_latencyProbeInterval                = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_LatencyProbeInterval, 0));
+	m_metricsPort                         = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_MetricsPort, 0));
+	m_metricsFilename                     = ctx.getConfigurationManager().expand("${" Token_MetricsFile "}");
+	m_metricsFilePeriod                   = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_MetricsFilePeriod, 1000));
+	m_syncMarker                          = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SyncMarker, 15));
+	m_syncInterval                        = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_SyncInterval, 1000));
+	m_readBatch                           = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_ReadBatch, 1));
+	m_readMaxWait                         = uint32_t(ctx.getConfigurationManager().expandAsUInteger(Token_ReadMaxWait, 10));
+	m_impedanceCheck                      = ctx.getConfigurationManager().expandAsBoolean(Token_ImpedanceCheck, false);
+	m_selfTest                            = ctx.getConfigurationManager().expandAsBoolean(Token_SelfTest, false);
+
+	std::stringstream devices(ctx.getConfigurationManager().expand("${" Token_AdditionalDevices "}").toASCIIString());
+	std::string device;
+	while (std::getline(devices, device, ';'))
+	{
+		device.erase(0, device.find_first_not_of(" \t"));
+		device.erase(device.find_last_not_of(" \t") + 1);
+		if (!device.empty()) { m_boardDevices.push_back(device); }
+	}
 
 	// default parameter loaded, update channel count and frequency
 	this->updateDaisy(true);
@@ -103,24 +269,945 @@ CDriverModularBCI::CDriverModularBCI(IDriverContext& ctx)
 void CDriverModularBCI::updateDaisy(const bool quietLogging)
 {
 	// change channel and sampling rate according to daisy module
-	const auto info = CConfigurationModularBCI::getDaisyInformation(m_daisyModule ? CConfigurationModularBCI::EDaisyStatus::Active
+	const auto info = CConfigurationModularBCI::getDaisyInformation(this->isSourceDaisy() ? CConfigurationModularBCI::EDaisyStatus::Active
 																	 : CConfigurationModularBCI::EDaisyStatus::Inactive);
 
-	m_header.setSamplingFrequency(info.sampling);
-	m_header.setChannelCount(info.nEEGChannel + info.nAccChannel);
+	// only the channels enabled in the mask are streamed by the board
+	const uint32_t nEEGChannel = CConfigurationModularBCI::getEnabledChannelCount(this->getSourceChannelMask(), info.nEEGChannel);
+	m_nEEGValuePerSample       = nEEGChannel;
+
+	// additional boards are set up like the first one, their channels follow its channels
+	m_nBoard = m_replayFilename.length() != 0 ? 1 : uint32_t(1 + m_boardDevices.size());
+
+	const uint32_t sampling = this->getSourceSampling();
+	m_header.setSamplingFrequency(CModularBCILinkPlanner::getDataRateCode(sampling) >= 0 ? sampling : info.sampling);
+	m_header.setChannelCount(m_nBoard * (nEEGChannel + info.nAccChannel));
 
 	if (!quietLogging)
 	{
-		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Status - " << CString(m_daisyModule ? "Daisy" : "** NO ** Daisy") <<
-				" module option enabled, " << m_header.getChannelCount() << " channels -- " << int((m_daisyModule ? 4 : 1) * EEG_VALUE_COUNT_PER_SAMPLE) <<
-				" EEG and " << int(ACC_VALUE_COUNT_PER_SAMPLE) << " accelerometer -- at " << m_header.getSamplingFrequency() << "Hz.\n";
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Status - " << CString(this->isSourceDaisy() ? "Daisy" : "** NO ** Daisy") <<
+				" module option enabled, " << m_header.getChannelCount() << " channels -- " << nEEGChannel << " of " << info.nEEGChannel <<
+				" EEG (channel mask " << CConfigurationModularBCI::channelMaskToString(this->getSourceChannelMask()) << ") and " << int(ACC_VALUE_COUNT_PER_SAMPLE) <<
+				" accelerometer -- at " << m_header.getSamplingFrequency() << "Hz" << (m_nBoard > 1 ? ", on each of " : "") <<
+				(m_nBoard > 1 ? std::to_string(m_nBoard) + " boards" : "").c_str() << ".\n";
+	}
+
+	for (uint32_t board = 0; board < m_nBoard; ++board)
+	{
+		const uint32_t first = board * (nEEGChannel + info.nAccChannel);
+
+		// microvolt for EEG channels
+		for (uint32_t i = 0; i < nEEGChannel; ++i) { m_header.setChannelUnits(first + i, OVTK_UNIT_Volts, OVTK_FACTOR_Micro); }
+
+		// undefined for accelerometer/extra channels
+		for (int i = 0; i < info.nAccChannel; ++i) { m_header.setChannelUnits(first + nEEGChannel + i, OVTK_UNIT_Unspecified, OVTK_FACTOR_Base); }
+	}
+}
+
+std::vector<size_t> CDriverModularBCI::getAcquiredChannels(const uint32_t boardChannelMask) const
+{
+	const auto info          = CConfigurationModularBCI::getDaisyInformation(this->isSourceDaisy() ? CConfigurationModularBCI::EDaisyStatus::Active
+																		 : CConfigurationModularBCI::EDaisyStatus::Inactive);
+	const auto boardChannels = CConfigurationModularBCI::getEnabledChannels(this->getSourceChannelMask(), info.nEEGChannel);
+	std::vector<size_t> res;
+	for (uint32_t board = 0; board < m_nBoard; ++board)
+	{
+		// the same channels of every board
+		const size_t first = board * (m_header.getChannelCount() / m_nBoard);
+		for (size_t i = 0; i < boardChannels.size(); ++i) { if (boardChannelMask & (1U << boardChannels[i])) { res.push_back(first + i); } }
+	}
+	return res;
+}
+
+bool CDriverModularBCI::initializeFilterBank()
+{
+	const double sampling = double(m_header.getSamplingFrequency());
+	if (!m_filterBank.initialize(m_nChannel, sampling)) { return false; }
+
+	const std::vector<size_t> channels = this->getAcquiredChannels(m_filteredChannelMask);
+
+	bool ok = true;
+	if (m_notchFrequency > 0)
+	{
+		ok &= m_filterBank.addStageToChannels(channels, CModularBCIFilterBank::EFilterType::Notch, m_notchFrequency, m_notchQualityFactor);
+	}
+	if (m_highPassFrequency > 0)
+	{
+		ok &= m_filterBank.addStageToChannels(channels, CModularBCIFilterBank::EFilterType::HighPass, m_highPassFrequency, BUTTERWORTH_Q);
+	}
+	if (m_lowPassFrequency > 0)
+	{
+		ok &= m_filterBank.addStageToChannels(channels, CModularBCIFilterBank::EFilterType::LowPass, m_lowPassFrequency, BUTTERWORTH_Q);
+	}
+
+	if (!ok)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid online filter settings (notch " << m_notchFrequency << "Hz, high-pass "
+				<< m_highPassFrequency << "Hz, low-pass " << m_lowPassFrequency << "Hz at " << sampling << "Hz sampling rate) - please check the "
+				<< CString(Token_NotchFrequency) << ", " << CString(Token_HighPassFrequency) << " and " << CString(Token_LowPassFrequency) << " tokens\n";
+		return false;
+	}
+
+	if (!m_filterBank.isEmpty())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Online filtering of " << uint32_t(channels.size()) << " channels with "
+				<< uint32_t(m_filterBank.getStageCount()) << " sections (notch " << m_notchFrequency << "Hz, high-pass " << m_highPassFrequency
+				<< "Hz, low-pass " << m_lowPassFrequency << "Hz)\n";
+	}
+	return true;
+}
+
+bool CDriverModularBCI::initializeArtifactStage()
+{
+	m_artifactStage.uninitialize();
+	if (m_artifactAmplitude <= 0 && m_artifactDerivative <= 0 && m_artifactEOGChannel == 0) { return true; }
+
+	const std::vector<size_t> channels = this->getAcquiredChannels(m_artifactChannelMask);
+	std::vector<size_t> eogChannels;
+	if (m_artifactEOGChannel > 0 && m_artifactEOGChannel <= 32) { eogChannels = this->getAcquiredChannels(1U << (m_artifactEOGChannel - 1)); }
+	const double sampling = double(m_header.getSamplingFrequency());
+
+	if ((m_artifactEOGChannel != 0 && eogChannels.empty())
+		|| !m_artifactStage.initialize(m_nChannel, sampling, channels, m_artifactAmplitude, m_artifactDerivative, m_artifactHold / 1000.0,
+									   eogChannels.empty() ? size_t(-1) : eogChannels[0]))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid artifact settings (amplitude " << m_artifactAmplitude << "uV, derivative "
+				<< m_artifactDerivative << "uV, EOG reference on channel " << m_artifactEOGChannel << ") - the EOG reference must be an enabled channel, please check the "
+				<< CString(Token_ArtifactAmplitude) << ", " << CString(Token_ArtifactDerivative) << " and " << CString(Token_ArtifactEOGChannel) << " tokens\n";
+		return false;
+	}
+
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Artifact handling with EOG reference on channel " << m_artifactEOGChannel
+			<< " (0 for none), flagging " << uint32_t(channels.size()) << " channels over " << m_artifactAmplitude << "uV or steps over " << m_artifactDerivative
+			<< "uV (0 for none) for " << m_artifactHold << "ms\n";
+	return true;
+}
+
+bool CDriverModularBCI::initializeSpectralEngine()
+{
+	m_spectralEngine.uninitialize();
+	if (m_spectralHop == 0) { return true; }
+
+	const double sampling = double(m_header.getSamplingFrequency());
+	const size_t hopSize  = std::max<size_t>(1, size_t(std::lround(sampling * m_spectralHop / 1000.0)));
+	std::vector<CModularBCISpectralEngine::band_t> bands;
+	if (!CModularBCISpectralEngine::parseBands(m_spectralBands.toASCIIString(), bands)
+		|| !m_spectralEngine.initialize(m_nChannel, sampling, m_spectralWindowSize, hopSize, bands))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid spectral engine settings (bands [" << m_spectralBands
+				<< "], window of " << m_spectralWindowSize << " samples) - the window size must be a power of two, please check the "
+				<< CString(Token_SpectralBands) << " and " << CString(Token_SpectralWindowSize) << " tokens\n";
+		return false;
+	}
+
+	if (m_spectralStreamPort > 0xFFFF)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid band power stream port " << m_spectralStreamPort
+				<< " - please check the " << CString(Token_SpectralStreamPort) << " token\n";
+		return false;
 	}
 
-	// microvolt for EEG channels
-	for (int i = 0; i < info.nEEGChannel; ++i) { m_header.setChannelUnits(i, OVTK_UNIT_Volts, OVTK_FACTOR_Micro); }
+	// every estimate is a block of one sample, a value per channel and band, for the in-process consumers and the band power stream
+	const size_t nValue = m_nChannel * bands.size();
+	m_bandPowerBus.initialize(uint32_t(nValue), 1, SAMPLE_BUS_SLOT_COUNT);
+	m_spectralEngine.setListener([this, nValue](const uint64_t sampleIndex, const std::vector<float>& bandPowers)
+	{
+		CModularBCISampleBus::CBlock* block = m_bandPowerBus.acquire();
+		if (block != nullptr)
+		{
+			std::copy(bandPowers.begin(), bandPowers.begin() + nValue, block->getData());
+			block->setSampleCount(1);
+			block->setFirstSample(sampleIndex);
+			block->setTime(m_readTime);
+			m_bandPowerBus.publish(block);
+		}
+
+		// diagnostic only
+		if (!m_driverCtx.getLogManager().isActive(LogLevel_Debug)) { return; }
+		const size_t nBand = m_spectralEngine.getBandCount();
+		std::stringstream ss;
+		for (size_t i = 0; i < bandPowers.size(); ++i)
+		{
+			if (i % nBand == 0) { ss << (i == 0 ? "" : " |"); }
+			ss << " " << m_spectralEngine.getBands()[i % nBand].name << "=" << bandPowers[i];
+		}
+		m_driverCtx.getLogManager() << LogLevel_Debug << this->m_driverName << ": Band powers at sample " << sampleIndex << " (uV^2):" << ss.str().c_str()
+				<< "\n";
+	});
+
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Band powers of " << m_nChannel << " channels every " << m_spectralHop
+			<< "ms (" << uint32_t(hopSize) << " samples) over windows of " << m_spectralWindowSize << " samples, bands [" << m_spectralBands << "]\n";
 
-	// undefined for accelerometer/extra channels
-	for (int i = 0; i < info.nAccChannel; ++i) { m_header.setChannelUnits(info.nEEGChannel + i, OVTK_UNIT_Unspecified, OVTK_FACTOR_Base); }
+	if (m_spectralStreamPort == 0) { return true; }
+	if (!m_bandPowerServer.start(m_bandPowerBus, uint16_t(m_spectralStreamPort), m_streamLocalOnly, this->getBandPowerDescriptor(sampling / double(hopSize))))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not listen for band power clients on port " << m_spectralStreamPort
+				<< " - please check the " << CString(Token_SpectralStreamPort) << " token\n";
+		return false;
+	}
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Streaming the band powers on TCP port " << m_bandPowerServer.getPort()
+			<< (m_streamLocalOnly ? " to local clients\n" : " to any client\n");
+	return true;
+}
+
+bool CDriverModularBCI::startMotorImagery()
+{
+	if (m_motorImageryModelFilename.length() == 0) { return true; }
+
+	motor_imagery_model_t model;
+	std::string error;
+	if (!loadMotorImageryModel(m_motorImageryModelFilename.toASCIIString(), model, error) || !checkMotorImageryModel(model, m_nChannel, error))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not load the motor imagery model [" << m_motorImageryModelFilename
+				<< "] (" << error.c_str() << ") - please check the " << CString(Token_MotorImageryModel) << " token\n";
+		return false;
+	}
+	if (std::fabs(model.sampling - double(m_header.getSamplingFrequency())) > 0.5 || !m_motorImagery.initialize(model, m_nChannel))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": The motor imagery model [" << m_motorImageryModelFilename
+				<< "] was trained at " << model.sampling << "Hz and can't decode " << m_header.getSamplingFrequency() << "Hz\n";
+		return false;
+	}
+
+	m_motorImagery.setListener([this](const uint64_t sampleIndex, const std::vector<double>& probabilities)
+	{
+		const size_t best = probabilities[1] > probabilities[0] ? 1 : 0;
+		m_commandStage.submit(ECommandSource::MotorImagery, best, probabilities[best], sampleIndex, this->getDataReadyTime(m_motorImageryBlock, sampleIndex));
+
+		if (!m_driverCtx.getLogManager().isActive(LogLevel_Debug)) { return; }
+		const motor_imagery_model_t& decoderModel = m_motorImagery.getModel();
+		m_driverCtx.getLogManager() << LogLevel_Debug << this->m_driverName << ": Motor imagery at sample " << sampleIndex << ": "
+				<< decoderModel.classes[0].c_str() << "=" << probabilities[0] << " " << decoderModel.classes[1].c_str() << "=" << probabilities[1] << "\n";
+	});
+
+	// a decoder that falls behind skips blocks rather than stalling the acquisition
+	if (!m_motorImageryConsumer.start(m_sampleBus, CModularBCISampleBus::EPolicy::DropOldest,
+									  [this](const CModularBCISampleBus::CBlock& block)
+									  {
+										  m_motorImageryBlock.lastSample = block.getFirstSample() + block.getSampleCount() - 1;
+										  m_motorImageryBlock.time       = block.getTime();
+										  m_motorImagery.process(block);
+									  }))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not subscribe the motor imagery decoder to the sample bus\n";
+		return false;
+	}
+
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Decoding motor imagery (" << model.classes[0].c_str() << " / "
+			<< model.classes[1].c_str() << ") from " << uint32_t(model.channels.size()) << " channels with " << model.nFilter << " CSP filters, "
+			<< model.bandLow << "-" << model.bandHigh << "Hz, every " << model.hopSize << " samples over windows of " << model.windowSize << " samples\n";
+	return true;
+}
+
+bool CDriverModularBCI::startSSVEPDetector()
+{
+	if (m_ssvepFrequencies.length() == 0) { return true; }
+
+	const double sampling             = double(m_header.getSamplingFrequency());
+	const size_t windowSize           = size_t(std::lround(sampling * m_ssvepWindow / 1000.0));
+	const size_t hopSize              = std::max<size_t>(1, size_t(std::lround(sampling * m_ssvepHop / 1000.0)));
+	const std::vector<size_t> channels = this->getAcquiredChannels(m_ssvepChannelMask);
+	std::vector<double> frequencies;
+	if (!CModularBCISSVEPDetector::parseFrequencies(m_ssvepFrequencies.toASCIIString(), frequencies)
+		|| !m_ssvepDetector.initialize(channels, sampling, frequencies, m_ssvepHarmonics, m_ssvepSubBands, windowSize, hopSize))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid SSVEP detector settings (frequencies [" << m_ssvepFrequencies
+				<< "] with " << m_ssvepHarmonics << " harmonics at " << sampling << "Hz, window of " << m_ssvepWindow << "ms on "
+				<< uint32_t(channels.size()) << " channels) - the highest harmonic must stay below the Nyquist frequency and the window must hold more samples "
+				<< "than channels, please check the "
+				<< CString(Token_SSVEPFrequencies) << ", " << CString(Token_SSVEPHarmonics) << ", " << CString(Token_SSVEPWindow) << " and "
+				<< CString(Token_SSVEPChannelMask) << " tokens\n";
+		return false;
+	}
+
+	m_ssvepDetector.setListener([this](const uint64_t sampleIndex, const size_t target, const std::vector<double>& scores)
+	{
+		// confidence is the relative margin of the best target over the second one
+		double second = 0;
+		for (size_t i = 0; i < scores.size(); ++i) { if (i != target) { second = std::max(second, scores[i]); } }
+		const double confidence = scores[target] > 0 ? (scores[target] - second) / scores[target] : 0;
+		m_commandStage.submit(ECommandSource::SSVEP, target, confidence, sampleIndex, this->getDataReadyTime(m_ssvepBlock, sampleIndex));
+
+		if (!m_driverCtx.getLogManager().isActive(LogLevel_Debug)) { return; }
+		std::stringstream ss;
+		for (size_t i = 0; i < scores.size(); ++i) { ss << " " << m_ssvepDetector.getFrequencies()[i] << "Hz=" << scores[i]; }
+		m_driverCtx.getLogManager() << LogLevel_Debug << this->m_driverName << ": SSVEP at sample " << sampleIndex << ": "
+				<< m_ssvepDetector.getFrequencies()[target] << "Hz, scores" << ss.str().c_str() << "\n";
+	});
+
+	// a detector that falls behind skips blocks rather than stalling the acquisition
+	if (!m_ssvepConsumer.start(m_sampleBus, CModularBCISampleBus::EPolicy::DropOldest,
+							   [this](const CModularBCISampleBus::CBlock& block)
+							   {
+								   m_ssvepBlock.lastSample = block.getFirstSample() + block.getSampleCount() - 1;
+								   m_ssvepBlock.time       = block.getTime();
+								   m_ssvepDetector.process(block);
+							   }))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not subscribe the SSVEP detector to the sample bus\n";
+		return false;
+	}
+
+	std::stringstream ss;
+	for (size_t m = 0; m < m_ssvepDetector.getSubBandCount(); ++m) { ss << " " << m_ssvepDetector.getSubBandLowFrequency(m); }
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Detecting SSVEP at [" << m_ssvepFrequencies << "] Hz with " << m_ssvepHarmonics
+			<< " harmonics on " << uint32_t(channels.size()) << " channels, every " << m_ssvepHop << "ms over windows of " << m_ssvepWindow << "ms, sub-bands from"
+			<< ss.str().c_str() << " to " << m_ssvepDetector.getSubBandHighFrequency() << "Hz\n";
+	return true;
+}
+
+bool CDriverModularBCI::startCommandStage()
+{
+	if (m_commandAddress.length() == 0) { return true; }
+
+	const std::string address = m_commandAddress.toASCIIString();
+	const size_t colon        = address.rfind(':');
+	const std::string host    = address.substr(0, colon);
+	const int port            = colon == std::string::npos ? DRONE_LINK_DEFAULT_PORT : std::atoi(address.c_str() + colon + 1);
+
+	// each decoder commands only if it runs and has one command per class or target
+	std::vector<EDroneCommand> miCommands, ssvepCommands;
+	if (!parseDroneCommands(m_motorImageryCommands.toASCIIString(), miCommands) || !parseDroneCommands(m_ssvepCommands.toASCIIString(), ssvepCommands)
+		|| (m_motorImageryConsumer.isRunning() && m_motorImageryCommands.length() != 0 && miCommands.size() != m_motorImagery.getModel().classes.size())
+		|| (m_ssvepConsumer.isRunning() && m_ssvepCommands.length() != 0 && ssvepCommands.size() != m_ssvepDetector.getFrequencies().size()))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid drone commands [" << m_motorImageryCommands << "] / ["
+				<< m_ssvepCommands << "] - they need one of hover, takeoff, land, forward, backward, left, right, up, down, yawleft, yawright or none "
+				<< "per motor imagery class and per SSVEP frequency, please check the " << CString(Token_MotorImageryCommands) << " and "
+				<< CString(Token_SSVEPCommands) << " tokens\n";
+		return false;
+	}
+	m_commandStage.setSource(ECommandSource::MotorImagery, miCommands, m_motorImageryThreshold);
+	m_commandStage.setSource(ECommandSource::SSVEP, ssvepCommands, m_ssvepThreshold);
+
+	m_commandStage.setListener([this](const CModularBCICommandStage::command_report_t& report)
+	{
+		// one message per command, the stage thread logs concurrently with the decoders
+		const char* sources[] = { "watchdog", "motor imagery", "SSVEP" };
+		std::stringstream ss;
+		ss << "Drone command #" << uint32_t(report.sequence) << " " << getDroneCommandName(report.command) << " (" << sources[size_t(report.source)]
+				<< ", confidence " << report.confidence << ")";
+		if (report.droneTime == 0) { ss << " was not acknowledged"; }
+		else if (report.drdyTime == 0) { ss << ": decision to drone " << double(report.droneTime - report.decisionTime) / 1000 << "ms"; }
+		else
+		{
+			ss << ": data ready to decision " << double(report.decisionTime - report.drdyTime) / 1000 << "ms, decision to send "
+					<< double(report.sendTime - report.decisionTime) / 1000 << "ms, data ready to drone " << double(report.droneTime - report.drdyTime) / 1000 << "ms";
+		}
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": " << ss.str().c_str() << "\n";
+	});
+
+	if (port <= 0 || port > 0xFFFF
+		|| !m_commandStage.start(host, uint16_t(port), m_commandDebounce, m_commandRefractory, m_commandWatchdog))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not open the drone link to [" << m_commandAddress
+				<< "] - please check the " << CString(Token_CommandAddress) << " token\n";
+		return false;
+	}
+
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Sending drone commands to [" << m_commandAddress << "] after "
+			<< m_commandDebounce << " decisions in a row, not repeated within " << m_commandRefractory << "ms, hover after " << m_commandWatchdog
+			<< "ms without decision\n";
+	return true;
+}
+
+bool CDriverModularBCI::startStreamServer()
+{
+	if (m_streamPort == 0) { return true; }
+	if (m_streamPort > 0xFFFF)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid stream port " << m_streamPort << " - please check the "
+				<< CString(Token_StreamPort) << " token\n";
+		return false;
+	}
+
+	if (!m_streamServer.start(m_sampleBus, uint16_t(m_streamPort), m_streamLocalOnly, this->getStreamDescriptor()))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not listen for stream clients on port " << m_streamPort
+				<< " - please check the " << CString(Token_StreamPort) << " token\n";
+		return false;
+	}
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Streaming the decoded blocks on TCP port " << m_streamServer.getPort()
+			<< (m_streamLocalOnly ? " to local clients\n" : " to any client\n");
+	return true;
+}
+
+bool CDriverModularBCI::openSharedRing()
+{
+	if (m_sharedMemoryName.length() == 0) { return true; }
+
+	const size_t capacity = std::max<size_t>(size_t(m_sharedMemoryLength) * m_header.getSamplingFrequency() / 1000, REPLAY_SAMPLE_COUNT_PER_LOOP);
+	if (!m_sharedRing.create(m_sharedMemoryName.toASCIIString(), m_nChannel, m_header.getSamplingFrequency(), capacity, this->getStreamDescriptor()))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not create the shared memory [" << m_sharedMemoryName
+				<< "] - please check the " << CString(Token_SharedMemoryName) << " token (a name without slashes, not used by another driver)\n";
+		return false;
+	}
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Exporting the samples to shared memory [" << m_sharedMemoryName << "], "
+			<< capacity * 1000 / m_header.getSamplingFrequency() << "ms kept\n";
+	return true;
+}
+
+// one series of the metric per additional board, the help text on the first one
+template <typename T>
+static void addBoardMetrics(CModularBCIMetrics& metrics, T& (CModularBCIMetrics::*add)(const std::string&, const std::string&, const std::string&),
+							const std::string& name, const std::string& help, const uint32_t nBoard, std::vector<T*>& series)
+{
+	series.clear();
+	for (uint32_t i = 1; i < nBoard; ++i) { series.push_back(&(metrics.*add)(name, i == 1 ? help : "", "board=\"" + std::to_string(i + 1) + "\"")); }
+}
+
+void CDriverModularBCI::initializeMetrics()
+{
+	m_metrics.clear();
+	m_metric = {};
+	auto& metrics = m_metrics;
+
+	m_metric.bytesRead    = &metrics.addCounter("modularbci_read_bytes_total", "Bytes read from the board or the replayed recording.");
+	m_metric.readErrors   = &metrics.addCounter("modularbci_read_errors_total", "Reads from the board that failed.");
+	m_metric.skippedBytes = &metrics.addCounter("modularbci_skipped_bytes_total", "Bytes skipped while looking for the start of a frame, all boards.");
+	m_metric.syncLosses   = &metrics.addCounter("modularbci_sync_losses_total", "Times the parser lost the frame boundaries and had to resynchronize, all boards.");
+	m_metric.locks        = &metrics.addCounter("modularbci_frame_locks_total", "Times the parser locked on frame boundaries confirmed by the following frames, all boards.");
+	m_metric.falseLocks   = &metrics.addCounter("modularbci_false_locks_total", "Locks given up a few frames after being taken, all boards.");
+	m_metric.corruptedFrames = &metrics.addCounter("modularbci_corrupted_frames_total", "Frames dropped for a failed check without losing the lock, all boards.");
+	m_metric.lostFrames   = &metrics.addCounter("modularbci_lost_frames_total", "Gaps in the frame sequence numbers, corrupted frames included, all boards.");
+	m_metric.lockBytes    = &metrics.addGauge("modularbci_lock_bytes", "Bytes it took to lock on the frame boundaries the last time, longest over the boards.");
+	m_metric.auxChecksumErrors = &metrics.addCounter("modularbci_aux_checksum_errors_total", "Auxiliary frames dropped for a wrong checksum.");
+	m_metric.stalls       = &metrics.addCounter("modularbci_stalls_total", "Times the board stopped sending samples for longer than the missing sample delay.");
+	m_metric.stalled      = &metrics.addGauge("modularbci_stalled", "1 while the board sends no samples.");
+	m_metric.recoveries   = &metrics.addCounter("modularbci_recoveries_total", "Times the streaming of a stalled board was restarted.");
+	m_metric.samples      = &metrics.addCounter("modularbci_samples_total", "Samples decoded.");
+	m_metric.markers      = &metrics.addCounter("modularbci_markers_total", "Markers received from the board.");
+	m_metric.readSize     = &metrics.addHistogram("modularbci_read_size_bytes", "Bytes returned by each read.", { 0, 1, 16, 64, 256, 1024, 4096, 16384 });
+	m_metric.loopDuration = &metrics.addHistogram("modularbci_loop_duration_seconds", "Duration of the acquisition loop, read included.",
+												   { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000 }, 1e-6);
+	m_metric.readWait     = &metrics.addHistogram("modularbci_read_wait_seconds", "Time the acquisition loop waited for the board before reading.",
+												 { 100, 500, 1000, 2000, 4000, 8000, 16000, 32000 }, 1e-6);
+	m_metric.blockSize    = &metrics.addHistogram("modularbci_block_size_samples", "Samples of each block handed to OpenViBE and to the sample bus.",
+												  { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512 });
+
+	m_metric.busOverruns = &metrics.addCounter("modularbci_bus_overruns_total", "Blocks the sample bus had no free slot for.");
+	m_metric.motorImageryPending = &metrics.addGauge("modularbci_queue_depth_blocks", "Blocks published on the sample bus and not read yet.",
+													 "consumer=\"motor_imagery\"");
+	m_metric.ssvepPending  = &metrics.addGauge("modularbci_queue_depth_blocks", "", "consumer=\"ssvep\"");
+	m_metric.streamPending = &metrics.addGauge("modularbci_queue_depth_blocks", "", "consumer=\"stream\"");
+	m_metric.motorImageryDroppedBlocks = &metrics.addCounter("modularbci_dropped_blocks_total", "Blocks a consumer of the sample bus missed.",
+															  "consumer=\"motor_imagery\"");
+	m_metric.ssvepDroppedBlocks     = &metrics.addCounter("modularbci_dropped_blocks_total", "", "consumer=\"ssvep\"");
+	m_metric.streamDroppedBlocks    = &metrics.addCounter("modularbci_dropped_blocks_total", "", "consumer=\"stream\"");
+	m_metric.recorderDroppedSamples = &metrics.addCounter("modularbci_recording_dropped_samples_total", "Samples the recording could not keep up with.");
+	m_metric.recorderDroppedBytes   = &metrics.addCounter("modularbci_recording_dropped_bytes_total", "Raw bytes the recording could not keep up with.");
+	m_metric.artifacts              = &metrics.addCounter("modularbci_artifacts_total", "Artifacts flagged.");
+	m_metric.commands               = &metrics.addCounter("modularbci_drone_commands_total", "Commands sent to the drone.");
+	m_metric.streamBlocks           = &metrics.addCounter("modularbci_stream_blocks_total", "Blocks sent to stream clients.");
+	m_metric.streamSlowClients      = &metrics.addCounter("modularbci_stream_slow_clients_total", "Stream clients disconnected for falling behind.");
+	m_metric.streamClients          = &metrics.addGauge("modularbci_stream_clients", "Stream clients connected.");
+	m_metric.latencyProbes          = &metrics.addCounter("modularbci_latency_probes_total", "Latency probes sent to the board.");
+	m_metric.latencyReplies         = &metrics.addCounter("modularbci_latency_replies_total", "Latency probes the board answered.");
+	for (int i = 0; i < CModularBCILatencyProbe::Stage_Count; ++i)
+	{
+		std::string stage = CModularBCILatencyProbe::getStageName(CModularBCILatencyProbe::EStage(i));
+		std::replace(stage.begin(), stage.end(), ' ', '_');
+		const char* quantiles[] = { "0.5", "0.95", "0.99" };
+		for (size_t j = 0; j < 3; ++j)
+		{
+			m_metric.latencies[i][j] = &metrics.addGauge("modularbci_latency_seconds", i == 0 && j == 0 ? "Delays measured by the latency probe." : "",
+														 "stage=\"" + stage + "\",quantile=\"" + quantiles[j] + "\"");
+		}
+	}
+	metrics.addGauge("modularbci_channels", "Channels acquired.").set(m_nChannel);
+	metrics.addGauge("modularbci_sampling_rate_hertz", "Sampling rate of the acquisition.").set(m_header.getSamplingFrequency());
+	metrics.addGauge("modularbci_boards", "Boards acquired.").set(m_nBoard);
+
+	addBoardMetrics(metrics, &CModularBCIMetrics::addCounter, "modularbci_board_read_bytes_total", "Bytes read from an additional board.", m_nBoard,
+					m_metric.boardBytesRead);
+	addBoardMetrics(metrics, &CModularBCIMetrics::addGauge, "modularbci_board_offset_samples", "Sample index of a board minus the one of the first board.",
+					m_nBoard, m_metric.boardOffsets);
+	addBoardMetrics(metrics, &CModularBCIMetrics::addGauge, "modularbci_board_skew_ppm", "Clock rate of a board relative to the first board.", m_nBoard,
+					m_metric.boardSkews);
+	addBoardMetrics(metrics, &CModularBCIMetrics::addCounter, "modularbci_board_slips_total", "Samples of a board dropped or repeated to compensate its skew.",
+					m_nBoard, m_metric.boardSlips);
+	addBoardMetrics(metrics, &CModularBCIMetrics::addCounter, "modularbci_board_missing_samples_total",
+					"Samples of a board that were late and replaced by its last values.", m_nBoard, m_metric.boardMissing);
+
+	m_metricsUpdateTime = 0;
+	m_isStalled         = false;
+	m_recoveryTime      = 0;
+}
+
+bool CDriverModularBCI::startMetricsExporter()
+{
+	if (m_metricsPort == 0 && m_metricsFilename.length() == 0) { return true; }
+	if (m_metricsPort > 0xFFFF)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid metrics port " << m_metricsPort << " - please check the "
+				<< CString(Token_MetricsPort) << " token\n";
+		return false;
+	}
+
+	this->updateMetrics();
+	if (!m_metricsExporter.start(m_metrics, uint16_t(m_metricsPort), m_metricsFilename.toASCIIString(), m_metricsFilePeriod))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not serve the metrics on port " << m_metricsPort
+				<< " - please check the " << CString(Token_MetricsPort) << " token\n";
+		return false;
+	}
+	if (m_metricsExporter.getPort() != 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Serving the metrics on http://127.0.0.1:" << m_metricsExporter.getPort()
+				<< "/metrics\n";
+	}
+	if (m_metricsFilename.length() != 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Writing the metrics to [" << m_metricsFilename << "] every "
+				<< m_metricsFilePeriod << "ms\n";
+	}
+	return true;
+}
+
+void CDriverModularBCI::updateMetrics()
+{
+	m_metric.samples->set(m_nDecodedSample + m_sampleBlock.size() / m_nChannel);
+	m_metric.markers->set(m_nMarker);
+	uint64_t nSkippedByte = m_decoder.getSkippedByteCount(), nSyncLoss = m_decoder.getSyncLossCount(), nAuxChecksumError = m_decoder.getAuxChecksumErrorCount();
+	uint64_t nLock = m_decoder.getLockCount(), nFalseLock = m_decoder.getFalseLockCount();
+	uint64_t nCorruptedFrame = m_decoder.getCorruptedFrameCount(), nLostFrame = m_decoder.getLostFrameCount();
+	for (size_t i = 0; i < m_boardReaders.size(); ++i)
+	{
+		nSkippedByte += m_boardReaders[i]->getSkippedByteCount();
+		nSyncLoss += m_boardReaders[i]->getSyncLossCount();
+		nLock += m_boardReaders[i]->getLockCount();
+		nFalseLock += m_boardReaders[i]->getFalseLockCount();
+		nCorruptedFrame += m_boardReaders[i]->getCorruptedFrameCount();
+		nLostFrame += m_boardReaders[i]->getLostFrameCount();
+		nAuxChecksumError += m_boardReaders[i]->getAuxChecksumErrorCount();
+		m_metric.boardBytesRead[i]->set(m_boardReaders[i]->getByteCount());
+	}
+	for (size_t i = 1; i < m_boardAligner.getBoardCount() && i < m_nBoard; ++i)
+	{
+		m_metric.boardOffsets[i - 1]->set(m_boardAligner.getOffset(i));
+		m_metric.boardSkews[i - 1]->set(m_boardAligner.getSkew(i));
+		m_metric.boardSlips[i - 1]->set(m_boardAligner.getSlipCount(i));
+		m_metric.boardMissing[i - 1]->set(m_boardAligner.getMissingCount(i));
+	}
+	m_metric.skippedBytes->set(nSkippedByte);
+	m_metric.syncLosses->set(nSyncLoss);
+	m_metric.locks->set(nLock);
+	m_metric.falseLocks->set(nFalseLock);
+	m_metric.corruptedFrames->set(nCorruptedFrame);
+	m_metric.lostFrames->set(nLostFrame);
+	m_metric.lockBytes->set(double(m_decoder.getLastLockByteCount()));
+	m_metric.auxChecksumErrors->set(nAuxChecksumError);
+	m_metric.stalled->set(m_isStalled ? 1 : 0);
+	m_metric.busOverruns->set(m_sampleBus.getOverrunCount());
+	m_metric.motorImageryPending->set(double(m_motorImageryConsumer.getPendingCount()));
+	m_metric.ssvepPending->set(double(m_ssvepConsumer.getPendingCount()));
+	m_metric.motorImageryDroppedBlocks->set(m_motorImageryConsumer.getDroppedCount());
+	m_metric.ssvepDroppedBlocks->set(m_ssvepConsumer.getDroppedCount());
+	m_metric.recorderDroppedSamples->set(m_recorder.getDroppedSampleCount());
+	m_metric.recorderDroppedBytes->set(m_recorder.getDroppedRawByteCount());
+	m_metric.artifacts->set(m_artifactStage.getArtifactCount());
+	m_metric.commands->set(m_commandStage.getSentCount());
+	if (m_streamServer.isRunning())
+	{
+		m_metric.streamPending->set(double(m_streamServer.getPendingBlockCount()));
+		m_metric.streamDroppedBlocks->set(m_streamServer.getDroppedBlockCount());
+		m_metric.streamBlocks->set(m_streamServer.getSentBlockCount());
+		m_metric.streamSlowClients->set(m_streamServer.getSlowClientCount());
+		m_metric.streamClients->set(double(m_streamServer.getClientCount()));
+	}
+	m_metric.latencyProbes->set(m_latencyProbe.getSentCount());
+	m_metric.latencyReplies->set(m_latencyProbe.getReplyCount());
+	if (m_latencyProbe.getReplyCount() != 0)
+	{
+		const double percentiles[] = { 50, 95, 99 };
+		for (int i = 0; i < CModularBCILatencyProbe::Stage_Count; ++i)
+		{
+			for (size_t j = 0; j < 3; ++j) { m_metric.latencies[i][j]->set(m_latencyProbe.getPercentile(CModularBCILatencyProbe::EStage(i), percentiles[j])); }
+		}
+	}
+}
+
+static std::string quoteJSON(const std::string& s)
+{
+	std::string res = "\"";
+	for (const auto& c : s)
+	{
+		if (c == '"' || c == '\\') { res += '\\'; }
+		if (uint8_t(c) < 0x20) { res += ' '; }
+		else { res += c; }
+	}
+	return res + "\"";
+}
+
+std::string CDriverModularBCI::getStreamDescriptor() const
+{
+	std::stringstream ss;
+	ss << "{\"name\": " << quoteJSON(m_driverName.toASCIIString()) << ", \"type\": \"EEG\", \"sampling_rate\": " << m_header.getSamplingFrequency()
+			<< ", \"channel_count\": " << m_nChannel << ", \"format\": \"float32\", \"layout\": \"channel-major\", \"time_base\": \"host monotonic us\""
+			<< ", \"channels\": [";
+	for (uint32_t i = 0; i < m_nChannel; ++i)
+	{
+		const std::string name = m_header.isChannelNameSet(i) ? m_header.getChannelName(i) : "Channel " + std::to_string(i + 1);
+		ss << (i == 0 ? "" : ", ") << "{\"label\": " << quoteJSON(name) << ", \"unit\": \"" << (i % (m_nChannel / m_nBoard) < m_nEEGValuePerSample ? "uV" : "unspecified") << "\"}";
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+std::string CDriverModularBCI::getBandPowerDescriptor(const double rate) const
+{
+	// one value per channel and band, the bands of a channel next to each other
+	const std::vector<CModularBCISpectralEngine::band_t>& bands = m_spectralEngine.getBands();
+	std::stringstream ss;
+	ss << "{\"name\": " << quoteJSON(std::string(m_driverName.toASCIIString()) + " band powers") << ", \"type\": \"band power\", \"sampling_rate\": " << rate
+			<< ", \"channel_count\": " << m_nChannel * bands.size() << ", \"format\": \"float32\", \"layout\": \"channel-major\""
+			<< ", \"time_base\": \"host monotonic us\", \"channels\": [";
+	for (uint32_t i = 0; i < m_nChannel; ++i)
+	{
+		const std::string name = m_header.isChannelNameSet(i) ? m_header.getChannelName(i) : "Channel " + std::to_string(i + 1);
+		for (size_t j = 0; j < bands.size(); ++j)
+		{
+			ss << (i == 0 && j == 0 ? "" : ", ") << "{\"label\": " << quoteJSON(name + " " + bands[j].name) << ", \"unit\": \"uV^2\", \"low\": " << bands[j].low
+					<< ", \"high\": " << bands[j].high << "}";
+		}
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+uint64_t CDriverModularBCI::getDataReadyTime(const block_time_t& block, const uint64_t sampleIndex) const
+{
+	// the last sample of the block was ready one frame transfer before the block arrived, the previous ones one sampling period earlier each
+	const uint64_t age = (block.lastSample - sampleIndex) * 1000000 / m_header.getSamplingFrequency() + m_frameDuration;
+	return block.time > age ? block.time - age : 0;
+}
+
+bool CDriverModularBCI::openRecording()
+{
+	if (m_recordingFilename.length() == 0) { return true; }
+
+	// the samples of all boards, their raw bytes would not replay as one board
+	recording_header_t info = {};
+	info.nChannel           = m_nBoard * m_nEEGValuePerSample;
+	info.sampling           = m_header.getSamplingFrequency();
+	info.channelMask        = this->getSourceChannelMask();
+	info.nDevice            = this->isSourceDaisy() ? 4 : 1;
+	info.gain               = float(ADS1299_GAIN);
+	info.vref               = float(ADS1299_VREF);
+	info.unitsToMicroVolts  = m_unitsToMicroVolts;
+	::snprintf(info.firmware, sizeof(info.firmware), "ModularBCI STM32L475, %u x ADS1299", info.nDevice);
+	::snprintf(info.configuration, sizeof(info.configuration), "channel mask %s; %s%s", CConfigurationModularBCI::channelMaskToString(info.channelMask).c_str(),
+			   m_additionalCmds.toASCIIString(), m_nBoard > 1 ? ("; " + std::to_string(m_nBoard) + " boards").c_str() : "");
+
+	if (!m_recorder.open(m_recordingFilename.toASCIIString(), info))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not start the recording to [" << m_recordingFilename << "] ("
+				<< m_recorder.getLastError().c_str() << ") - please check the " << CString(Token_RecordingFile) << " token\n";
+		return false;
+	}
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Recording raw stream and samples to [" << m_recordingFilename << "]\n";
+	return true;
+}
+
+bool CDriverModularBCI::openReplay()
+{
+	if (!m_replayReader.open(m_replayFilename.toASCIIString()))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not open the recording to replay [" << m_replayFilename << "] ("
+				<< m_replayReader.getLastError().c_str() << ") - please check the " << CString(Token_ReplayFile) << " token\n";
+		return false;
+	}
+
+	// a recording knows how the board was configured, a plain capture is taken as matching the current settings
+	const recording_header_t& info = m_replayReader.getHeader();
+	m_replayLayout    = info;
+	m_hasReplayLayout = !m_replayReader.isPlainCapture();
+	this->updateDaisy(true);
+
+	if (m_replaySamples && (m_replayReader.isPlainCapture() || info.nChannel != m_nEEGValuePerSample))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": [" << m_replayFilename
+				<< "] holds no decoded samples matching its channel mask, please replay its raw bytes (" << CString(Token_ReplaySamples) << " token)\n";
+		m_replayReader.close();
+		return false;
+	}
+
+	const double sampling    = double(m_header.getSamplingFrequency());
+	const double nominalRate = m_replaySamples ? sampling : sampling * (3 + 3 * m_nEEGValuePerSample); // status word and 24 bits per channel
+	if (!m_replayer.initialize(m_replayReader, m_replaySamples ? ERecordingChunkType::Samples : ERecordingChunkType::Raw, m_replaySpeed, nominalRate))
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Nothing to replay in [" << m_replayFilename << "] at speed "
+				<< m_replaySpeed << " - please check the " << CString(Token_ReplaySpeed) << " token\n";
+		m_replayReader.close();
+		return false;
+	}
+
+	m_replayCodes.resize(REPLAY_SAMPLE_COUNT_PER_LOOP * m_nEEGValuePerSample);
+	m_replayFinished = false;
+	m_startTime      = System::Time::getTime();
+	m_tick           = m_startTime;
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Replaying the " << CString(m_replaySamples ? "decoded samples" : "raw bytes")
+			<< " of [" << m_replayFilename << "] ";
+	if (m_replaySpeed == 0) { m_driverCtx.getLogManager() << "as fast as possible"; }
+	else if (m_replaySpeed == 1) { m_driverCtx.getLogManager() << "in real time"; }
+	else { m_driverCtx.getLogManager() << "at " << m_replaySpeed << "x"; }
+	m_driverCtx.getLogManager() << " instead of the board (channel mask " << CConfigurationModularBCI::channelMaskToString(this->getSourceChannelMask()) << ")\n";
+	return true;
+}
+
+uint32_t CDriverModularBCI::readFromReplay()
+{
+	uint32_t length = 0;
+	if (!m_replaySamples) { length = uint32_t(m_replayer.read(&m_readBuffers[0], m_readBuffers.size())); }
+	else
+	{
+		// decoded samples skip the parser and go straight to the block
+		const size_t nSample = m_replayer.read(&m_replayCodes[0], REPLAY_SAMPLE_COUNT_PER_LOOP);
+		for (size_t i = 0; i < nSample; ++i)
+		{
+			for (uint32_t j = 0; j < m_nEEGValuePerSample; ++j)
+			{
+				m_sampleEEGCodes[j]   = m_replayCodes[i * m_nEEGValuePerSample + j];
+				m_sampleEEGBuffers[j] = m_sampleEEGCodes[j] * m_unitsToMicroVolts;
+			}
+			this->pushCurrentSample();
+		}
+	}
+
+	if (m_replayer.isFinished())
+	{
+		m_tick = System::Time::getTime(); // no missing sample warning once the replay is over
+		if (!m_replayFinished)
+		{
+			m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Replay of [" << m_replayFilename << "] finished ("
+					<< m_replayer.getSkippedCount() << CString(m_replaySamples ? " samples" : " bytes") << " were lost at recording time)\n";
+			m_replayFinished = true;
+		}
+	}
+	return length;
+}
+
+void CDriverModularBCI::closeSource()
+{
+	if (m_replayReader.isOpen())
+	{
+		m_replayer.uninitialize();
+		m_replayReader.close();
+		m_hasReplayLayout = false;
+		this->updateDaisy(true); // back to the layout of the settings
+	}
+	else
+	{
+		if (m_isDeviceOpen) { this->closeDevice(m_fileDesc); }
+		m_isDeviceOpen = false;
+		this->closeBoards();
+	}
+}
+
+void CDriverModularBCI::abortInitialization()
+{
+	// the consumers first, they read the bus and the stages
+	m_motorImageryConsumer.stop();
+	m_ssvepConsumer.stop();
+	m_commandStage.stop();
+	m_streamServer.stop();
+	m_bandPowerServer.stop();
+	m_sharedRing.destroy();
+	m_metricsExporter.stop();
+	m_filterBank.uninitialize();
+	m_artifactStage.uninitialize();
+	m_spectralEngine.uninitialize();
+	m_motorImagery.uninitialize();
+	m_ssvepDetector.uninitialize();
+	m_bandPowerBus.uninitialize();
+	m_sampleBus.uninitialize();
+	m_metrics.clear();
+	this->closeSource();
+}
+
+bool CDriverModularBCI::openBoards()
+{
+	m_boardReaders.clear();
+	m_boardTTYNames.clear();
+	m_boardAligner.uninitialize();
+	if (m_nBoard == 1) { return true; }
+
+	const size_t length = size_t(m_header.getSamplingFrequency()) * BOARD_ALIGNMENT_LENGTH;
+	size_t capacity     = 1;
+	while (capacity < length) { capacity <<= 1; }
+	if (m_syncMarker > 15)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid sync marker " << m_syncMarker << " - please check the "
+				<< CString(Token_SyncMarker) << " token (a marker code from 1 to 15, 0 to align on the arrival times only)\n";
+		return false;
+	}
+	m_boardAligner.initialize(m_nBoard, m_nEEGValuePerSample, m_header.getSamplingFrequency(), uint8_t(m_syncMarker), capacity);
+
+	for (size_t i = 0; i < m_boardDevices.size(); ++i)
+	{
+		// a device is a port number of the configuration dialog or a port name
+		const std::string& device = m_boardDevices[i];
+		CString ttyName           = device.c_str();
+		if (device.find_first_not_of("0123456789") == std::string::npos)
+		{
+			const unsigned long number = ::strtoul(device.c_str(), nullptr, 10);
+			if (number >= CConfigurationModularBCI::getMaximumTtyCount())
+			{
+				m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Invalid port number " << CString(device.c_str()) << " for board "
+						<< uint32_t(i + 2) << " - please check the " << CString(Token_AdditionalDevices) << " token (from 0 to "
+						<< CConfigurationModularBCI::getMaximumTtyCount() - 1 << ", or a port name)\n";
+				this->closeBoards();
+				return false;
+			}
+			ttyName = CConfigurationModularBCI::getTTYFileName(uint32_t(number));
+		}
+		FD_TYPE fileDesc;
+		if (!this->openPort(&fileDesc, ttyName))
+		{
+			m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not open board " << uint32_t(i + 2) << " - please check the "
+					<< CString(Token_AdditionalDevices) << " token\n";
+			this->closeBoards();
+			return false;
+		}
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Board " << uint32_t(i + 2) << " on port [" << ttyName << "]\n";
+		if (!this->resetBoard(fileDesc, true))
+		{
+			this->closeDevice(fileDesc);
+			this->closeBoards();
+			return false;
+		}
+		m_boardFileDescs.push_back(fileDesc);
+		m_boardTTYNames.push_back(ttyName);
+
+		// each reader waits for its board the same way as the acquisition loop
+		auto scheduler = std::make_shared<CModularBCIReadScheduler>();
+		scheduler->initialize(SAMPLE_FRAME_HEADER_SIZE + 3 * m_nEEGValuePerSample, m_header.getSamplingFrequency(), m_readBatch, uint64_t(m_readMaxWait) * 1000);
+		m_boardReaders.emplace_back(new CModularBCIBoardReader());
+		m_boardReaders.back()->start(m_boardAligner, i + 1, m_nEEGValuePerSample, [fileDesc, scheduler](uint8_t* buffer, const uint32_t size)
+		{
+			if (!waitForDevice(fileDesc, scheduler->getSleep(getDroneLinkTime()), scheduler->getTimeout())) { return READ_ERROR; }
+			const uint32_t length = readFromDevice(fileDesc, buffer, size);
+			if (length != READ_ERROR) { scheduler->onRead(length, getDroneLinkTime()); }
+			return length;
+		});
+	}
+
+	m_syncTime        = 0;
+	m_boardReportTime = getDroneLinkTime();
+	m_isBoardAligned.assign(m_nBoard, false);
+	if (m_syncMarker == 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": No sync marker, the " << m_nBoard
+				<< " boards are aligned on the arrival times of their samples only\n";
+	}
+	else
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Aligning the " << m_nBoard << " boards on marker " << m_syncMarker
+				<< (m_syncInterval != 0 ? ", sent to all of them every " + std::to_string(m_syncInterval) + "ms" : std::string(", from their marker inputs")).c_str()
+				<< "\n";
+	}
+	return true;
+}
+
+void CDriverModularBCI::closeBoards()
+{
+	for (auto& reader : m_boardReaders) { reader->stop(); }
+	for (const auto& fileDesc : m_boardFileDescs) { this->closeDevice(fileDesc); }
+	m_boardFileDescs.clear();
+}
+
+void CDriverModularBCI::sendSyncMarker()
+{
+	if (m_nBoard == 1 || m_syncMarker == 0 || m_syncInterval == 0) { return; }
+
+	const uint64_t now = getDroneLinkTime();
+	if (now - m_syncTime < uint64_t(m_syncInterval) * 1000) { return; }
+	m_syncTime = now;
+
+	// back to back, so that the boards latch it on the same sample as nearly as the ports allow
+	const std::string command = CModularBCISerialPort::getCommandFrame(MARKER_COMMAND, std::string(1, char(m_syncMarker)));
+	const uint32_t size       = uint32_t(command.size());
+	bool isSent               = this->writeToDevice(m_fileDesc, command.data(), size) == size;
+	for (const auto& fileDesc : m_boardFileDescs) { isSent = this->writeToDevice(fileDesc, command.data(), size) == size && isSent; }
+	if (!isSent) { m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Could not send the sync marker to every board\n"; }
+}
+
+void CDriverModularBCI::pushBoardSamples()
+{
+	const size_t nRow          = m_boardAligner.pull(&m_boardRows[0], &m_boardMarkers[0], m_boardMarkers.size(), getDroneLinkTime());
+	const size_t nBoardChannel = m_nChannel / m_nBoard;
+	for (size_t i = 0; i < nRow; ++i)
+	{
+		const int32_t* codes = &m_boardRows[i * m_nBoard * m_nEEGValuePerSample];
+		for (uint32_t board = 0; board < m_nBoard; ++board)
+		{
+			for (uint32_t j = 0; j < m_nEEGValuePerSample; ++j) { m_sampleBuffers[board * nBoardChannel + j] = codes[board * m_nEEGValuePerSample + j] * m_unitsToMicroVolts; }
+		}
+		m_sampleBlock.insert(m_sampleBlock.end(), m_sampleBuffers.begin(), m_sampleBuffers.end());
+		m_recorder.appendSample(codes);
+		this->appendMarker(m_boardMarkers[i]);
+	}
+	if (nRow != 0) { m_tick = System::Time::getTime(); }
+
+	for (uint32_t i = 1; i < m_nBoard; ++i)
+	{
+		if (m_boardAligner.isAligned(i) && !m_isBoardAligned[i])
+		{
+			m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Board " << i + 1 << " aligned on the sync marker, offset "
+					<< m_boardAligner.getOffset(i) << " samples\n";
+		}
+		m_isBoardAligned[i] = m_boardAligner.isAligned(i);
+	}
+
+	const uint64_t now = getDroneLinkTime();
+	if (now - m_boardReportTime >= BOARD_REPORT_PERIOD)
+	{
+		this->logBoards(false);
+		m_boardReportTime = now;
+	}
+}
+
+void CDriverModularBCI::logBoards(const bool isFinal)
+{
+	for (uint32_t i = 1; i < m_nBoard; ++i)
+	{
+		m_driverCtx.getLogManager() << (isFinal ? LogLevel_Info : LogLevel_Debug) << this->m_driverName << ": Board " << i + 1 << " ["
+				<< m_boardTTYNames[i - 1] << "] " << CString(m_boardAligner.isAligned(i) ? "aligned on " : "estimated from arrival times, ")
+				<< m_boardAligner.getSyncCount(i) << " sync markers, offset " << m_boardAligner.getOffset(i) << " samples, skew " << m_boardAligner.getSkew(i)
+				<< "ppm, " << m_boardAligner.getSlipCount(i) << " samples dropped or repeated for the skew, " << m_boardAligner.getMissingCount(i)
+				<< " late samples replaced and " << m_boardAligner.getOverflowCount(i) << " lost\n";
+	}
+}
+
+void CDriverModularBCI::appendMarker(const uint8_t marker)
+{
+	// the board latched the marker on the data ready of this very sample, so it is dated to the sample and not to its arrival
+	if (marker == 0) { return; }
+	const uint64_t position = m_sampleBlock.size() / m_nChannel - 1;
+	m_markers.appendStimulation(OVTK_StimulationId_Label_00 + marker, CTime(m_header.getSamplingFrequency(), position).time(), 0);
+	m_driverCtx.getLogManager() << LogLevel_Debug << this->m_driverName << ": Marker " << uint32_t(marker) << " at sample " << m_nDecodedSample + position
+			<< "\n";
+	m_nMarker++;
+}
+
+void CDriverModularBCI::pushCurrentSample()
+{
+	if (m_nBoard > 1)
+	{
+		// merged with the other boards once their matching samples are in, see pushBoardSamples()
+		m_boardAligner.pushMissing(0, m_replaySamples ? 0 : m_decoder.getGap(), m_readTime);
+		m_boardAligner.push(0, &m_sampleEEGCodes[0], m_sampleMarker, m_readTime);
+		m_sampleMarker = 0;
+		return;
+	}
+
+	std::copy(m_sampleEEGBuffers.begin(), m_sampleEEGBuffers.end(), m_sampleBuffers.begin());
+	m_sampleBlock.insert(m_sampleBlock.end(), m_sampleBuffers.begin(), m_sampleBuffers.end());
+	m_recorder.appendSample(&m_sampleEEGCodes[0]);
+	this->appendMarker(m_sampleMarker);
+	m_sampleMarker = 0;
+	m_tick         = System::Time::getTime();
 }
 
 bool CDriverModularBCI::initialize(const uint32_t /*nSamplePerSentBlock*/, IDriverCallback& callback)
@@ -137,6 +1224,13 @@ bool CDriverModularBCI::initialize(const uint32_t /*nSamplePerSentBlock*/, IDriv
 			m_droppedSampleSafetyDelayBeforeReset << " ; this can be changed in the openvibe configuration file setting the " << CString(
 				Token_DroppedSampleSafetyDelayBeforeReset) << " token\n";
 
+	// replaying adopts the channel mask of the recording, so it comes before the channel count is read
+	if (m_replayFilename.length() != 0 && !this->openReplay())
+	{
+		this->abortInitialization();
+		return false;
+	}
+
 	m_nChannel = m_header.getChannelCount();
 	m_driverCtx.getLogManager() << LogLevel_Info << "m_nChannel =  " <<int(m_nChannel) << "\n";
 
@@ -147,32 +1241,106 @@ bool CDriverModularBCI::initialize(const uint32_t /*nSamplePerSentBlock*/, IDriv
 
 	// change channel and sampling rate according to daisy module
 	this->updateDaisy(false);
+	if (m_nEEGValuePerSample == 0)
+	{
+		// the saved mask may enable channels of the daisy module only, the board would then stream empty frames
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": The channel mask " << CConfigurationModularBCI::channelMaskToString(this->getSourceChannelMask())
+				<< " enables none of the EEG channels of the board - please check the channel mask and daisy module in the driver settings\n";
+		this->abortInitialization();
+		return false;
+	}
+	for (uint32_t i = 0; m_nBoard > 1 && i < m_header.getChannelCount(); ++i)
+	{
+		const uint32_t nBoardChannel = m_header.getChannelCount() / m_nBoard;
+		if (!m_header.isChannelNameSet(i))
+		{
+			m_header.setChannelName(i, ("Board " + std::to_string(i / nBoardChannel + 1) + " Channel " + std::to_string(i % nBoardChannel + 1)).c_str());
+		}
+	}
 
 	// init state
-	m_readState        = ParserAutomaton_Default;
-	m_extractPosition  = 0;
+	m_decoder.initialize(m_nEEGValuePerSample);
+	m_readScheduler.initialize(SAMPLE_FRAME_HEADER_SIZE + 3 * m_nEEGValuePerSample, m_header.getSamplingFrequency(), m_readBatch,
+							   m_replayReader.isOpen() ? 0 : uint64_t(m_readMaxWait) * 1000); // the replay paces itself
 	m_sampleNumber     = -1;
 	m_seenPacketFooter = true; // let's say we will start with header
 
-	if (!this->openDevice(&m_fileDesc, m_deviceID)) { return false; }
+	if (!m_replayReader.isOpen())
+	{
+		// a board sending more than its link carries misses frames without telling
+		const CModularBCILinkPlanner::plan_t plan = CModularBCILinkPlanner::plan(m_nEEGValuePerSample, m_header.getSamplingFrequency(), TERM_BAUD_RATE,
+																				 m_readMaxWait != 0 ? m_readBatch : 1);
+		if (!plan.isFeasible)
+		{
+			uint32_t channelMask = 0, sampling = 0;
+			const int nEEGChannel = CConfigurationModularBCI::getDaisyInformation(this->isSourceDaisy() ? CConfigurationModularBCI::EDaisyStatus::Active
+																					: CConfigurationModularBCI::EDaisyStatus::Inactive).nEEGChannel;
+			m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": " << m_nEEGValuePerSample << " channels at "
+					<< m_header.getSamplingFrequency() << "Hz need " << uint32_t(plan.utilization * 100) << "% of the " << uint32_t(TERM_BAUD_RATE)
+					<< " baud link" << (CModularBCILinkPlanner::suggest(this->getSourceChannelMask(), nEEGChannel, m_header.getSamplingFrequency(), TERM_BAUD_RATE,
+																		 m_readMaxWait != 0 ? m_readBatch : 1, channelMask, sampling)
+											 ? ", " + std::to_string(CConfigurationModularBCI::getEnabledChannelCount(channelMask, nEEGChannel)) + " channels ("
+											   + CConfigurationModularBCI::channelMaskToString(channelMask) + ") at " + std::to_string(sampling) + "Hz would fit"
+											 : std::string()).c_str() << " - please check the channel mask and sampling rate in the driver settings\n";
+			this->abortInitialization();
+			return false;
+		}
+		m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Link at " << uint32_t(plan.utilization * 100) << "% ("
+				<< uint32_t(plan.bytesPerSecond) << " bytes/s), " << plan.latency * 1000 << "ms from data ready to the host\n";
+
+		// the additional boards are read by their own threads as soon as they stream, the first one once initialized
+		m_isDeviceOpen = this->openBoards() && this->openDevice(&m_fileDesc, m_deviceID);
+		if (!m_isDeviceOpen)
+		{
+			this->abortInitialization();
+			return false;
+		}
 
-	// check board status and print response
-	if (!this->resetBoard(m_fileDesc, true))
-	{
-		this->closeDevice(m_fileDesc);
-		return false;
+		// check board status and print response, the self-test and impedances are checked on the first board, the one they are reported for
+		if (!this->resetBoard(m_fileDesc, true, true))
+		{
+			this->abortInitialization();
+			return false;
+		}
 	}
 
 	// prepare buffer for samples
-	m_sampleEEGBuffers.resize(EEG_VALUE_COUNT_PER_SAMPLE);
-	m_sampleEEGBuffersDaisy.resize(EEG_VALUE_COUNT_PER_SAMPLE);
+	m_sampleEEGBuffers.resize(m_nEEGValuePerSample);
+	m_sampleEEGCodes.resize(m_nEEGValuePerSample);
+	m_sampleEEGBuffersDaisy.resize(m_nEEGValuePerSample);
 	m_sampleAccBuffers.resize(ACC_VALUE_COUNT_PER_SAMPLE);
 	m_sampleAccBuffersTemp.resize(ACC_VALUE_COUNT_PER_SAMPLE);
 
-	// init buffer for 1 EEG value and 1 accel value
-	m_eegValueBuffers.resize(EEG_VALUE_BUFFER_SIZE);
+	// init buffer for 1 accel value
 	m_accValueBuffers.resize(ACC_VALUE_BUFFER_SIZE); // Not used in modularBCI board
 	m_sampleBuffers.resize(m_nChannel);
+	m_sampleBlock.clear();
+	const size_t nMaxSamplePerLoop = std::max<size_t>(m_readBuffers.size() / (3 * (m_nEEGValuePerSample + 1)), REPLAY_SAMPLE_COUNT_PER_LOOP); // a full read buffer of samples
+	m_sampleBlock.reserve(nMaxSamplePerLoop * m_nChannel);
+	m_sampleBus.initialize(m_nChannel, uint32_t(nMaxSamplePerLoop), SAMPLE_BUS_SLOT_COUNT);
+	m_boardRows.resize(m_nBoard > 1 ? nMaxSamplePerLoop * m_nBoard * m_nEEGValuePerSample : 0);
+	m_boardMarkers.resize(m_nBoard > 1 ? nMaxSamplePerLoop : 0);
+	m_nDecodedSample = 0;
+	m_nMarker        = 0;
+	m_markers.clear();
+	m_latencyProbe.initialize();
+	m_latencyProbeTime  = 0;
+	m_latencyReportTime = getDroneLinkTime();
+	if (m_latencyProbeInterval != 0 && !m_replayReader.isOpen())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Probing the latency to the board every " << m_latencyProbeInterval
+				<< "ms\n";
+	}
+	m_frameDuration  = uint64_t(3 + 3 * m_nEEGValuePerSample) * 10 * 1000000 / TERM_BAUD_RATE; // start, data and stop bits
+	this->initializeMetrics();
+
+	if (!this->initializeFilterBank() || !this->initializeArtifactStage() || !this->initializeSpectralEngine() || !this->startMotorImagery()
+		|| !this->startSSVEPDetector() || !this->startCommandStage() || !this->startStreamServer() || !this->openSharedRing()
+		|| !this->startMetricsExporter())
+	{
+		this->abortInitialization();
+		return false;
+	}
 
 	m_callback         = &callback;
 	m_lastPacketNumber = UNINITIALIZED_PACKET_NUMBER;
@@ -187,6 +1355,12 @@ bool CDriverModularBCI::initialize(const uint32_t /*nSamplePerSentBlock*/, IDriv
 	uint32_t unitsToMicroVolts = (float) (ADS1299_VREF/(pow(2.,23)-1)/ADS1299_GAIN*1000000.); // $$$$ The notation here is ambiguous
 	::printf("CHECK THIS OUT : %g %g %g\n", unitsToMicroVolts-m_unitsToMicroVolts, unitsToMicroVolts, m_unitsToMicroVolts);
 #endif
+	if (!this->openRecording())
+	{
+		this->abortInitialization();
+		return false;
+	}
+
 	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Initialization finished\n";
 	return true;
 }
@@ -213,15 +1387,114 @@ bool CDriverModularBCI::uninitialize()
 {
 	if (!m_driverCtx.isConnected() || m_driverCtx.isStarted()) { return false; }
 
-	this->closeDevice(m_fileDesc);
+	this->closeSource();
+	this->updateMetrics(); // while the stages still hold their counts
 
 	m_driverCtx.getLogManager() << LogLevel_Debug << CString(this->getName()) << " driver closed.\n";
 
 	// Uninitializes data structures
 	m_readBuffers.clear();
 	m_callbackSamples.clear();
+	m_sampleBlock.clear();
+	m_markers.clear();
+	if (m_nMarker != 0) { m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Received " << m_nMarker << " markers from the board\n"; }
+	if (m_latencyProbe.getSentCount() != 0) { this->logLatencyProbe(true); }
+	if (m_decoder.getLockCount() != 0)
+	{
+		// a frame lasts a sample period whatever the number of channels
+		const uint64_t frameSize = m_decoder.getFrameSize();
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Locked " << m_decoder.getLockCount() << " times on the frame boundaries ("
+				<< (m_decoder.isSequenced() ? "sequenced frames" : "older firmware without sequence numbers") << "), the longest after "
+				<< m_decoder.getMaxLockByteCount() << " bytes (" << m_decoder.getMaxLockByteCount() / frameSize << " frames, "
+				<< m_decoder.getMaxLockByteCount() * 1000 / (frameSize * m_header.getSamplingFrequency()) << " ms), " << m_decoder.getFalseLockCount() << " false locks, "
+				<< m_decoder.getCorruptedFrameCount() << " corrupted and " << m_decoder.getLostFrameCount() << " lost frames\n";
+	}
+	if (m_decoder.getAuxChecksumErrorCount() != 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": " << m_decoder.getAuxChecksumErrorCount()
+				<< " auxiliary frames from the board were corrupted\n";
+	}
+	if (m_nBoard > 1 && m_boardAligner.getBoardCount() == m_nBoard)
+	{
+		this->logBoards(true);
+		m_boardAligner.uninitialize();
+	}
+	m_filterBank.uninitialize();
+	if (m_artifactStage.isEnabled())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": " << m_artifactStage.getArtifactCount() << " artifacts flagged over "
+				<< m_artifactStage.getArtifactSampleCount() << " samples (" << m_artifactStage.getAmplitudeCount() << " samples over the amplitude threshold, "
+				<< m_artifactStage.getDerivativeCount() << " steps over the derivative threshold)\n";
+	}
+	m_artifactStage.uninitialize();
+	m_spectralEngine.uninitialize();
+	if (m_bandPowerServer.isRunning())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Streamed " << m_bandPowerServer.getSentBlockCount() << " band power estimates to "
+				<< m_bandPowerServer.getAcceptedCount() << " clients (" << m_bandPowerServer.getSlowClientCount() << " disconnected for falling behind, "
+				<< m_bandPowerServer.getDroppedBlockCount() << " estimates dropped by the server)\n";
+		m_bandPowerServer.stop();
+	}
+	m_bandPowerBus.uninitialize();
+	if (m_motorImageryConsumer.isRunning())
+	{
+		m_motorImageryConsumer.stop();
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Motor imagery decoder made " << m_motorImagery.getDecisionCount()
+				<< " decisions in " << m_motorImagery.getMeanDecisionDuration() * 1000 << "ms on average (" << m_motorImagery.getMaxDecisionDuration() * 1000
+				<< "ms at most), " << m_motorImagery.getSuppressedCount() << " suppressed by artifacts\n";
+	}
+	m_motorImagery.uninitialize();
+	if (m_ssvepConsumer.isRunning())
+	{
+		m_ssvepConsumer.stop();
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": SSVEP detector made " << m_ssvepDetector.getDecisionCount()
+				<< " decisions in " << m_ssvepDetector.getMeanDecisionDuration() * 1000 << "ms on average (" << m_ssvepDetector.getMaxDecisionDuration() * 1000
+				<< "ms at most), " << m_ssvepDetector.getSuppressedCount() << " suppressed by artifacts\n";
+	}
+	m_ssvepDetector.uninitialize();
+	if (m_commandStage.isRunning())
+	{
+		m_commandStage.stop(); // after the decoders, which submit to it
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Sent " << m_commandStage.getSentCount() << " drone commands ("
+				<< m_commandStage.getWatchdogCount() << " by the watchdog), " << m_commandStage.getAcknowledgedCount() << " acknowledged, data ready to drone in "
+				<< m_commandStage.getMeanLatency() * 1000 << "ms on average, " << m_commandStage.getLatencyPercentile(50) * 1000 << "ms median, "
+				<< m_commandStage.getLatencyPercentile(95) * 1000 << "ms at 95% and " << m_commandStage.getMaxLatency() * 1000 << "ms at most\n";
+	}
+	if (m_streamServer.isRunning())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Streamed " << m_streamServer.getSentBlockCount() << " blocks to "
+				<< m_streamServer.getAcceptedCount() << " clients (" << m_streamServer.getSlowClientCount() << " disconnected for falling behind, "
+				<< m_streamServer.getDroppedBlockCount() << " blocks dropped by the server)\n";
+		m_streamServer.stop();
+	}
+	m_sampleBus.uninitialize(); // subscribers are stopped by now
+	if (m_sharedRing.isOpen())
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Exported " << m_sharedRing.getWrittenCount() << " samples to shared memory ["
+				<< m_sharedMemoryName << "]\n";
+		m_sharedRing.destroy();
+	}
 	m_ttyName = "";
 
+	if (m_recorder.isOpen())
+	{
+		if (!m_recorder.close())
+		{
+			m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": Could not finalize the recording [" << m_recordingFilename
+					<< "], its index is missing\n";
+		}
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Recorded " << m_recorder.getSampleCount() << " samples to ["
+				<< m_recordingFilename << "] (" << m_recorder.getDroppedSampleCount() << " samples and " << m_recorder.getDroppedRawByteCount()
+				<< " raw bytes dropped, " << m_recorder.getWriteErrorCount() << " write errors)\n";
+	}
+	if (m_metricsExporter.isRunning())
+	{
+		m_metricsExporter.stop(); // writes the file a last time
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Served the metrics " << m_metricsExporter.getScrapeCount() << " times ("
+				<< m_metricsExporter.getWriteErrorCount() << " file write errors)\n";
+	}
+	m_metrics.clear();
+
 #if 0
 	delete [] m_sample;
 	m_sample= nullptr;
@@ -239,6 +1512,10 @@ bool CDriverModularBCI::configure()
 	config.setReadBoardReplyTimeout(m_readBoardReplyTimeout);
 	config.setFlushBoardReplyTimeout(m_flushBoardReplyTimeout);
 	config.setDaisyModule(m_daisyModule);
+	config.setChannelMask(m_channelMask);
+	config.setSampling(m_sampling);
+	config.setBaudRate(TERM_BAUD_RATE);
+	config.setReadBatch(m_readMaxWait != 0 ? m_readBatch : 1);
 
 	if (!config.configure(m_header)) { return false; }
 
@@ -246,6 +1523,8 @@ bool CDriverModularBCI::configure()
 	m_readBoardReplyTimeout  = config.getReadBoardReplyTimeout();
 	m_flushBoardReplyTimeout = config.getFlushBoardReplyTimeout();
 	m_daisyModule            = config.getDaisyModule();
+	m_channelMask            = config.getChannelMask();
+	m_sampling               = config.getSampling();
 	m_settings.save();
 
 	this->updateDaisy(false);
@@ -256,97 +1535,120 @@ bool CDriverModularBCI::configure()
 // if waitForResponse, will wait response before leaving the function (until timeout is reached)
 // if logResponse, the actual response is sent to log manager
 // timeout: time to sleep between each character written (in ms)
-bool CDriverModularBCI::sendCommand(const FD_TYPE fileDesc, const char* cmd, const bool waitForResponse, const bool logResponse, const uint32_t timeout,
+bool CDriverModularBCI::sendCommand(const FD_TYPE fileDesc, const std::string& cmd, const bool waitForResponse, const bool logResponse, const uint32_t timeout,
 								 std::string& reply)
 {
-	const uint32_t size = strlen(cmd);
+	const uint32_t size = uint32_t(cmd.size());
 	reply               = "";
 
 	// no command: don't go further
 	if (size == 0) { return true; }
 
-	// write command to the board
-	for (size_t i = 0; i < size; ++i)
+	// write command to the board, at once so that a frame reaches the firmware without a gap
+	std::ostringstream bytes;
+	for (size_t i = 0; i < size; ++i) { bytes << (i == 0 ? "" : " ") << int(uint8_t(cmd[i])); }
+	m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Sending sequence to ModularBCI board [" << bytes.str().c_str() << "]\n";
+	if (this->writeToDevice(fileDesc, cmd.data(), size) != size) { return false; }
+
+	// wait for response
+	if (waitForResponse)
 	{
-		m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Sending sequence to ModularBCI board [" << std::string(1,cmd[i]) << "]\n";
-		if (this->writeToDevice(fileDesc, &cmd[i], 1) == WRITE_ERROR) { return false; }
+		// buffer for serial reading
+		std::ostringstream readStream;
 
-		// wait for response
-		if (waitForResponse)
+		uint64_t out          = timeout;
+		const uint64_t tStart = System::Time::getTime();
+		bool finished         = false;
+		while (System::Time::getTime() - tStart < out && !finished)
 		{
-			// buffer for serial reading
-			std::ostringstream readStream;
-
-			uint64_t out          = timeout;
-			const uint64_t tStart = System::Time::getTime();
-			bool finished         = false;
-			while (System::Time::getTime() - tStart < out && !finished)
+			const uint32_t readLength = this->readFromDevice(fileDesc, &m_readBuffers[0], m_readBuffers.size(), 10);
+			if (readLength == READ_ERROR) { return false; }
+			readStream.write(reinterpret_cast<const char*>(&m_readBuffers[0]), readLength);
+
+			// early stop when the "$$$" pattern is detected
+			const std::string& content  = readStream.str();
+			const std::string earlyStop = "$$$";
+			if (content.size() >= earlyStop.size())
 			{
-				const uint32_t readLength = this->readFromDevice(fileDesc, &m_readBuffers[0], m_readBuffers.size(), 10);
-				if (readLength == READ_ERROR) { return false; }
-				readStream.write(reinterpret_cast<const char*>(&m_readBuffers[0]), readLength);
-
-				// early stop when the "$$$" pattern is detected
-				const std::string& content  = readStream.str();
-				const std::string earlyStop = "$$$";
-				if (content.size() >= earlyStop.size())
-				{
-					if (content.substr(content.size() - earlyStop.size(), earlyStop.size()) == earlyStop) { finished = true; }
-				}
+				if (content.substr(content.size() - earlyStop.size(), earlyStop.size()) == earlyStop) { finished = true; }
 			}
+		}
 
-			if (!finished)
-			{
-				m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": After " << out <<
-						"ms, timed out while waiting for board response !\n";
-			}
+		if (!finished)
+		{
+			m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": After " << out <<
+					"ms, timed out while waiting for board response !\n";
+		}
 
-			// now log response to log manager
-			if (logResponse)
+		// now log response to log manager
+		if (logResponse)
+		{
+			// readStream stream to std::string and then to const to please log manager
+			if (!readStream.str().empty())
 			{
-				// readStream stream to std::string and then to const to please log manager
-				if (!readStream.str().empty())
-				{
-					m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": " << (
-						finished ? "Board response" : "Partial board response") << " was (size=" << readStream.str().size() << ") :\n";
-					m_driverCtx.getLogManager() << readStream.str() << "\n";
-				}
-				else { m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Board did not reply !\n"; }
+				m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": " << (
+					finished ? "Board response" : "Partial board response") << " was (size=" << readStream.str().size() << ") :\n";
+				m_driverCtx.getLogManager() << readStream.str() << "\n";
 			}
-
-			// saves reply
-			reply += readStream.str();
-		}
-		else
-		{
-			// When no reply is expected, wait at least 100ms that the commands hits the device
-			System::Time::sleep(100);
+			else { m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Board did not reply !\n"; }
 		}
+
+		// saves reply
+		reply += readStream.str();
+	}
+	else
+	{
+		// When no reply is expected, wait at least 100ms that the commands hits the device
+		System::Time::sleep(100);
 	}
 
 	return true;
 }
 
 
-bool CDriverModularBCI::resetBoard(const FD_TYPE fileDescriptor, const bool regularInitialization)
+bool CDriverModularBCI::sendAcknowledgedCommand(const FD_TYPE fileDesc, const std::string& cmd, const uint32_t timeout, bool& isAccepted, std::string& reply)
+{
+	isAccepted = false;
+	reply.clear();
+	if (!this->sendCommand(fileDesc, cmd, false, false, timeout, reply)) { return false; }
+
+	// the reply is an auxiliary frame, the frames the board may stream after it are left in the reply for the caller
+	int status               = -1;
+	const uint64_t startTime = System::Time::getTime();
+	while (status < 0 && System::Time::getTime() - startTime < timeout)
+	{
+		const uint32_t readLength = this->readFromDevice(fileDesc, &m_readBuffers[0], m_readBuffers.size(), 10);
+		if (readLength == READ_ERROR) { return false; }
+		reply.append(reinterpret_cast<const char*>(&m_readBuffers[0]), readLength);
+		status = CModularBCISerialPort::findCommandReply(reply, cmd[1]);
+	}
+	if (status < 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": After " << timeout << "ms, timed out while waiting for the reply to command '"
+				<< cmd[1] << "' !\n";
+		return false;
+	}
+	isAccepted = status == COMMAND_ACCEPTED;
+	return true;
+}
+
+
+bool CDriverModularBCI::resetBoard(const FD_TYPE fileDescriptor, const bool regularInitialization, const bool runChecks)
 {
 	const uint32_t startTime = System::Time::getTime();
 	std::string reply;
 
 	// stop/reset/default board
 	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Stopping board streaming...\n";
-	if (!this->sendCommand(fileDescriptor, "s", true, false, m_flushBoardReplyTimeout, reply)) // the waiting serves to flush pending samples after stopping the streaming
-	/* {
-		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in stopping board !\n";
-		return false;
-	} */
+	if (!this->sendCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame('s'), true, false, m_flushBoardReplyTimeout, reply)) // the waiting serves to flush pending samples after stopping the streaming
+	{
+		// not fatal, the board may already be stopped
+		m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": Did not succeed in stopping board !\n";
+	}
 
-	// regular initialization of the board (not for recovery)
+	// regular initialization of the board (not for the recovery of a stall in loop)
 	if (regularInitialization)
 	{
-		std::string line;
-
-
 		// After discussin with @Aj May 2016 it has been decided to disable
 		// the daisy module when it was present and not requested instead of
 		// checking its presence
@@ -363,34 +1665,93 @@ bool CDriverModularBCI::resetBoard(const FD_TYPE fileDescriptor, const bool regu
 		if (m_deviceInfo.daisyId != 0x00 && !m_daisyModule)
 		{
 			m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Daisy module present but not requested, will now be disabled\n";
-			if (!this->sendCommand(fileDescriptor, "c", true, true, m_readBoardReplyTimeout, reply))
+			if (!this->sendCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame('c'), true, true, m_readBoardReplyTimeout, reply))
 			{
 				m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in disabling daisy module !\n";
 				return false;
 			}
 		}
 #endif
+	}
 
-		// sends additional commands if necessary
+	// tells the board which channels to power on and stream, one mask byte per ADS1299, on the recovery of a stall too as the board may have restarted with its defaults
+	const uint32_t nDevice = m_daisyModule ? 4 : 1;
+	std::string mask;
+	for (uint32_t i = 0; i < nDevice; ++i) { mask += char((m_channelMask >> (8 * i)) & 0xFF); }
+	m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Setting channel mask to " <<
+			CConfigurationModularBCI::channelMaskToString(m_channelMask) << "\n";
+	bool isAccepted = false;
+	if (!this->sendAcknowledgedCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame('m', mask), m_readBoardReplyTimeout, isAccepted, reply))
+	{
+		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in setting the channel mask !\n";
+		return false;
+	}
+	if (!isAccepted)
+	{
+		// the board would stream another channel layout than the one the driver decodes
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": The board rejected the channel mask of " << nDevice
+				<< " ADS1299 - please check the daisy module option in the driver settings\n";
+		return false;
+	}
+
+	// and at which data rate
+	const std::string rateCmd = CModularBCISerialPort::getCommandFrame(DATA_RATE_COMMAND, std::string(1, char(CModularBCILinkPlanner::getDataRateCode(m_header.getSamplingFrequency()))));
+	m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Setting sampling rate to " << m_header.getSamplingFrequency() << "Hz\n";
+	if (!this->sendAcknowledgedCommand(fileDescriptor, rateCmd, m_readBoardReplyTimeout, isAccepted, reply) || !isAccepted)
+	{
+		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in setting the sampling rate !\n";
+		return false;
+	}
+
+	if (regularInitialization)
+	{
+		std::string line;
+
+		// sends additional commands if necessary, the first character of a line is the command and the next ones its arguments
 		std::istringstream ss(m_additionalCmds.toASCIIString());
 		while (std::getline(ss, line, '\255'))
 		{
 			if (line.length() > 0)
 			{
 				m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Additional custom commands for initialization : [" << line << "]\n";
-				if (!this->sendCommand(fileDescriptor, line.c_str(), true, true, m_readBoardReplyTimeout, reply))
+				if (line.length() > 1 + COMMAND_MAX_ARGUMENT_SIZE)
+				{
+					m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Additional command [" << line << "] has more than "
+							<< COMMAND_MAX_ARGUMENT_SIZE << " argument bytes - please check the custom commands in the driver settings\n";
+					return false;
+				}
+				if (!this->sendAcknowledgedCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame(line[0], line.substr(1)), m_readBoardReplyTimeout,
+												   isAccepted, reply))
 				{
 					m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed sending additional command [" << line
 							<< "] !\n";
 					return false;
 				}
+				if (!isAccepted)
+				{
+					m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": The board rejected the additional command [" << line
+							<< "] - please check the custom commands in the driver settings\n";
+					return false;
+				}
 			}
 		}
+
+		// checks of the board and of the electrode contact, once the board knows its channels and data rate
+		if (runChecks && m_selfTest && !this->runSelfTest(fileDescriptor))
+		{
+			m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in running the self-test !\n";
+			return false;
+		}
+		if (runChecks && (m_impedanceCheck || m_driverCtx.isImpedanceCheckRequested()) && !this->checkImpedance(fileDescriptor))
+		{
+			m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed in measuring the impedances !\n";
+			return false;
+		}
 	}
 
 	// start stream
 	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Starting stream...\n";
-	if (!this->sendCommand(fileDescriptor, "b", false, false, m_readBoardReplyTimeout, reply))
+	if (!this->sendCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame('b'), false, false, m_readBoardReplyTimeout, reply))
 	{
 		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Did not succeed starting stream\n";
 		return false;
@@ -408,6 +1769,154 @@ bool CDriverModularBCI::resetBoard(const FD_TYPE fileDescriptor, const bool regu
 }
 
 
+bool CDriverModularBCI::runBoardTest(const FD_TYPE fileDescriptor, const std::string& command, const uint8_t type, const size_t payloadSize,
+									 const uint32_t timeout, bool& isAccepted, std::vector<std::vector<uint8_t>>& results)
+{
+	const uint32_t nEEGChannel = uint32_t(CConfigurationModularBCI::getDaisyInformation(m_daisyModule ? CConfigurationModularBCI::EDaisyStatus::Active
+																						  : CConfigurationModularBCI::EDaisyStatus::Inactive).nEEGChannel);
+	std::string reply;
+	results.clear();
+	if (!this->sendAcknowledgedCommand(fileDescriptor, command, m_readBoardReplyTimeout, isAccepted, reply)) { return false; }
+	if (!isAccepted) { return true; }
+
+	// the board streams while testing, each result follows a frame, the first frames may have come with the reply
+	results.assign(m_nEEGValuePerSample, std::vector<uint8_t>());
+	uint32_t nResult = 0;
+	m_decoder.initialize(m_nEEGValuePerSample);
+	m_decoder.push(reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+	const uint64_t startTime = System::Time::getTime();
+	while (nResult < m_nEEGValuePerSample && System::Time::getTime() - startTime < timeout)
+	{
+		const uint32_t readLength = this->readFromDevice(fileDescriptor, &m_readBuffers[0], m_readBuffers.size(), 10);
+		if (readLength == READ_ERROR) { return false; }
+		m_decoder.push(&m_readBuffers[0], readLength);
+		for (auto event = m_decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = m_decoder.next())
+		{
+			const std::vector<uint8_t>& payload = m_decoder.getAuxPayload();
+			if (event != CModularBCIFrameDecoder::Event_AuxFrame || m_decoder.getAuxType() != type || payload.size() != payloadSize
+				|| payload[0] >= nEEGChannel || !(m_channelMask & (1UL << payload[0])))
+			{
+				continue;
+			}
+			const size_t index = CConfigurationModularBCI::getEnabledChannelCount(m_channelMask & ((1UL << payload[0]) - 1), nEEGChannel);
+			if (results[index].empty()) { nResult++; }
+			results[index] = payload;
+		}
+	}
+
+	// stops the board in case it is still testing and flushes the frames of the test
+	if (!this->sendCommand(fileDescriptor, CModularBCISerialPort::getCommandFrame('s'), true, false, m_flushBoardReplyTimeout, reply)) { return false; }
+	m_decoder.initialize(m_nEEGValuePerSample);
+	m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Board test done in " << System::Time::getTime() - startTime << "ms\n";
+	return true;
+}
+
+
+bool CDriverModularBCI::checkImpedance(const FD_TYPE fileDescriptor)
+{
+	const uint32_t nDevice = m_daisyModule ? 4 : 1;
+	std::string mask;
+	for (uint32_t i = 0; i < nDevice; ++i) { mask += char((m_channelMask >> (8 * i)) & 0xFF); }
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Measuring the electrode impedances...\n";
+
+	// one channel after the other
+	std::vector<std::vector<uint8_t>> results;
+	const uint32_t timeout = 1000 + 2000 * m_nEEGValuePerSample * IMPEDANCE_SAMPLE_COUNT_PER_CHANNEL / m_header.getSamplingFrequency();
+	bool isAccepted        = false;
+	if (!this->runBoardTest(fileDescriptor, CModularBCISerialPort::getCommandFrame(IMPEDANCE_COMMAND, mask), AUX_FRAME_IMPEDANCE, 5, timeout, isAccepted, results))
+	{
+		return false;
+	}
+	if (!isAccepted)
+	{
+		// the firmware drives the excitation on a single ADS1299 only
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": The board rejected the impedance measurement, it is only supported "
+				<< "without daisy module - please disable the impedance check\n";
+		return false;
+	}
+
+	const double unitsToVolts = ADS1299_VREF / ((pow(2., 23) - 1) * ADS1299_GAIN);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const std::string name = m_header.isChannelNameSet(uint32_t(i)) ? m_header.getChannelName(uint32_t(i)) : "Channel " + std::to_string(i + 1);
+		if (results[i].empty())
+		{
+			m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": No impedance measured on " << name.c_str() << "\n";
+			continue;
+		}
+
+		// the excitation shows on the channel as the current times the electrode impedance, the reference one in series
+		const std::vector<uint8_t>& payload = results[i];
+		const uint32_t amplitude = uint32_t(payload[1]) | uint32_t(payload[2]) << 8 | uint32_t(payload[3]) << 16 | uint32_t(payload[4]) << 24;
+		const double impedance   = amplitude * unitsToVolts / IMPEDANCE_CURRENT;
+		const bool isGood        = m_driverCtx.getImpedanceLimit() <= 0 || impedance <= double(m_driverCtx.getImpedanceLimit());
+		m_driverCtx.getLogManager() << (isGood ? LogLevel_Info : LogLevel_Warning) << this->m_driverName << ": Impedance of " << name.c_str() << " is "
+				<< impedance / 1000 << " kOhm" << (isGood ? "" : ", please check the electrode contact") << "\n";
+		if (m_driverCtx.isImpedanceCheckRequested()) { m_driverCtx.updateImpedance(i, impedance); }
+	}
+	return true;
+}
+
+
+bool CDriverModularBCI::runSelfTest(const FD_TYPE fileDescriptor)
+{
+	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Running the self-test of the board...\n";
+
+	// all channels at once, the test signal then the shorted inputs
+	std::vector<std::vector<uint8_t>> results;
+	bool isAccepted = false;
+	if (!this->runBoardTest(fileDescriptor, CModularBCISerialPort::getCommandFrame(SELF_TEST_COMMAND), AUX_FRAME_SELF_TEST, 10, SELF_TEST_TIMEOUT, isAccepted,
+							results))
+	{
+		return false;
+	}
+	if (!isAccepted)
+	{
+		// the firmware switches the inputs of a single ADS1299 only, the connection goes on as for a failed test
+		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Self-test not supported by the board (daisy module), skipped\n";
+		return true;
+	}
+
+	const double unitsToMicroVolts = ADS1299_VREF * 1000000 / ((pow(2., 23) - 1) * ADS1299_GAIN);
+	size_t nFailed                 = 0;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const std::string name = m_header.isChannelNameSet(uint32_t(i)) ? m_header.getChannelName(uint32_t(i)) : "Channel " + std::to_string(i + 1);
+		if (results[i].empty())
+		{
+			m_driverCtx.getLogManager() << LogLevel_Warning << this->m_driverName << ": No self-test result for " << name.c_str() << "\n";
+			nFailed++;
+			continue;
+		}
+
+		const std::vector<uint8_t>& payload = results[i];
+		const uint8_t flags        = payload[1];
+		const uint32_t amplitude   = uint32_t(payload[2]) | uint32_t(payload[3]) << 8 | uint32_t(payload[4]) << 16 | uint32_t(payload[5]) << 24;
+		const uint32_t frequency   = uint32_t(payload[6]) | uint32_t(payload[7]) << 8;
+		const uint32_t noise       = uint32_t(payload[8]) | uint32_t(payload[9]) << 8;
+		const bool isPassed        = (flags & SELF_TEST_ALL_OK) == SELF_TEST_ALL_OK;
+		std::string failures;
+		if (!(flags & SELF_TEST_AMPLITUDE_OK)) { failures += " amplitude"; }
+		if (!(flags & SELF_TEST_FREQUENCY_OK)) { failures += " frequency"; }
+		if (!(flags & SELF_TEST_NOISE_OK)) { failures += " noise"; }
+		if (!isPassed) { nFailed++; }
+		m_driverCtx.getLogManager() << (isPassed ? LogLevel_Info : LogLevel_Warning) << this->m_driverName << ": Self-test of " << name.c_str()
+				<< (isPassed ? " passed" : " failed (" + failures.substr(1) + ")").c_str() << ": test signal at " << amplitude * 100 / SELF_TEST_AMPLITUDE
+				<< "% of its amplitude and " << frequency / 1000. << "Hz, noise of the shorted input " << noise * unitsToMicroVolts << "uV RMS\n";
+	}
+	if (nFailed == 0)
+	{
+		m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Self-test passed on all " << results.size() << " channels\n";
+	}
+	else
+	{
+		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Self-test failed on " << nFailed << " of " << results.size()
+				<< " channels, please check the board before the session\n";
+	}
+	return true;
+}
+
+
 bool CDriverModularBCI::openDevice(FD_TYPE* fileDesc, const uint32_t ttyNumber)
 {
 	CString ttyName;
@@ -435,6 +1944,13 @@ bool CDriverModularBCI::openDevice(FD_TYPE* fileDesc, const uint32_t ttyNumber)
 	}
 	else { ttyName = CConfigurationModularBCI::getTTYFileName(ttyNumber); }
 
+	if (!this->openPort(fileDesc, ttyName)) { return false; }
+	m_ttyName = ttyName;
+	return true;
+}
+
+bool CDriverModularBCI::openPort(FD_TYPE* fileDesc, const CString& ttyName)
+{
 #if defined TARGET_OS_Windows
 
 	DCB dcb   = { 0 };
@@ -483,32 +1999,18 @@ bool CDriverModularBCI::openDevice(FD_TYPE* fileDesc, const uint32_t ttyNumber)
 
 #elif defined TARGET_OS_Linux
 
-	struct termios terminalAttributes;
-
 	if((*fileDesc=::open(ttyName.toASCIIString(), O_RDWR))==-1)
 	{
 		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": Could not open port [" << ttyName << "]\n";
 		return false;
 	}
 
-	if(::tcgetattr(*fileDesc, &terminalAttributes)!=0)
-	{
-		::close(*fileDesc);
-		*fileDesc=-1;
-		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": terminal: tcgetattr() failed - did you use the right port [" << ttyName << "] ?\n";
-		return false;
-	}
-
-	/* terminalAttributes.c_cflag = TERM_SPEED | CS8 | CRTSCTS | CLOCAL | CREAD; */
-	terminalAttributes.c_cflag = TERM_SPEED | CS8 | CLOCAL | CREAD;
-	terminalAttributes.c_iflag = 0;
-	terminalAttributes.c_oflag = OPOST | ONLCR;
-	terminalAttributes.c_lflag = 0;
-	if(::tcsetattr(*fileDesc, TCSAFLUSH, &terminalAttributes)!=0)
+	// raw, the commands are binary frames, at the rate of the firmware
+	if(!CModularBCISerialPort::setRawPort(*fileDesc, TERM_BAUD_RATE))
 	{
 		::close(*fileDesc);
 		*fileDesc=-1;
-		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": terminal: tcsetattr() failed - did you use the right port [" << ttyName << "] ?\n";
+		m_driverCtx.getLogManager() << LogLevel_Error << this->m_driverName << ": terminal: setting " << TERM_BAUD_RATE << " baud failed - did you use the right port [" << ttyName << "] ?\n";
 		return false;
 	}
 
@@ -517,7 +2019,6 @@ bool CDriverModularBCI::openDevice(FD_TYPE* fileDesc, const uint32_t ttyNumber)
 #endif
 
 	m_driverCtx.getLogManager() << LogLevel_Info << this->m_driverName << ": Successfully opened port [" << ttyName << "]\n";
-	m_ttyName = ttyName;
 	return true;
 }
 
@@ -574,6 +2075,7 @@ uint32_t CDriverModularBCI::readFromDevice(const FD_TYPE fileDesc, void* buffer,
 
 	val.tv_sec=0;
 	val.tv_usec=((timeOut>>20)*1000*1000)>>12;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(val.tv_usec);
 
 	uint32_t bytesLeftToRead=size;
 	do
@@ -584,7 +2086,14 @@ uint32_t CDriverModularBCI::readFromDevice(const FD_TYPE fileDesc, void* buffer,
 		switch(::select(fileDesc + 1, &inputFileDescSet, nullptr, nullptr, &val))
 		{
 			case -1: // error
-				return READ_ERROR;
+				if (errno != EINTR) { return READ_ERROR; }
+				{
+					// a signal only cuts the wait short, it goes on for the remaining time
+					const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+					val.tv_sec  = 0;
+					val.tv_usec = long(remaining > 0 ? remaining : 0);
+				}
+				break;
 
 			case  0: // timeout
 				finished = true;
@@ -610,134 +2119,254 @@ uint32_t CDriverModularBCI::readFromDevice(const FD_TYPE fileDesc, void* buffer,
 }
 
 
+bool CDriverModularBCI::waitForDevice(const FD_TYPE fileDesc, const uint64_t sleep, const uint64_t timeOut)
+{
+	// the bytes arriving during the sleep queue in the serial driver
+	if (sleep != 0) { std::this_thread::sleep_for(std::chrono::microseconds(sleep)); }
+
+#if defined TARGET_OS_Windows
+
+	// the port is not opened for overlapped I/O, its queue is checked every millisecond instead
+	for (uint64_t waited = 0;; waited += 1000)
+	{
+		struct _COMSTAT status;
+		DWORD state;
+		if (!ClearCommError(fileDesc, &state, &status)) { return false; }
+		if (status.cbInQue != 0 || waited >= timeOut) { return true; }
+		Sleep(1);
+	}
+
+#elif defined TARGET_OS_Linux
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeOut);
+	while (true)
+	{
+		fd_set inputFileDescSet;
+		FD_ZERO(&inputFileDescSet);
+		FD_SET(fileDesc, &inputFileDescSet);
+		const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+		struct timeval val;
+		val.tv_sec  = long(remaining > 0 ? remaining / 1000000 : 0);
+		val.tv_usec = long(remaining > 0 ? remaining % 1000000 : 0);
+		if (::select(fileDesc + 1, &inputFileDescSet, nullptr, nullptr, &val) != -1) { return true; }
+		if (errno != EINTR) { return false; } // a signal only cuts the wait short, it goes on for the remaining time
+	}
+
+#else
+	return true;
+#endif
+}
+
 // This functions gets called all the time to read data
 bool CDriverModularBCI::loop()
 {
 	if (!m_driverCtx.isConnected()) { return false; }
+	const uint64_t loopTime = getDroneLinkTime();
 
-	if (System::Time::getTime() - m_tick > m_missingSampleDelayBeforeReset)
+	const uint32_t tickTime = System::Time::getTime();
+	if (tickTime - m_tick > m_missingSampleDelayBeforeReset)
 	{
-		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << "No response for " << uint32_t(m_missingSampleDelayBeforeReset) <<
-				"ms, will try recovery now (Note this may eventually be hopeless as the board may not reply to any command either).\n";
+		if (!m_isStalled) { m_metric.stalls->add(); }
+		m_isStalled = true;
+
+		// restarts the streaming once per missing sample delay until the samples come back, with the channel mask and data rate in case the board restarted
+		if (!m_replayReader.isOpen() && (m_recoveryTime == 0 || tickTime - m_recoveryTime > m_missingSampleDelayBeforeReset))
+		{
+			m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": No response for " << tickTime - m_tick
+					<< "ms, will try recovery now (Note this may eventually be hopeless as the board may not reply to any command either).\n";
+			m_metric.recoveries->add();
+			const uint32_t lastSampleTime = m_tick;
+			if (!this->resetBoard(m_fileDesc, false))
+			{
+				m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Recovery failed, retrying in "
+						<< uint32_t(m_missingSampleDelayBeforeReset) << "ms\n";
+			}
+			m_tick         = lastSampleTime; // stalled until a sample comes
+			m_recoveryTime = System::Time::getTime();
+		}
 	}
+	else { m_isStalled = false; }
 
-	// read datastream from device
-	const uint32_t length = this->readFromDevice(m_fileDesc, &m_readBuffers[0], m_readBuffers.size());
+	// waits for the next batch of frames rather than polling, then reads the datastream from device
+	bool isReady = true;
+	if (m_readScheduler.isEnabled())
+	{
+		const uint64_t waitTime = getDroneLinkTime();
+		isReady                 = this->waitForDevice(m_fileDesc, m_readScheduler.getSleep(waitTime), m_readScheduler.getTimeout());
+		m_metric.readWait->observe(getDroneLinkTime() - waitTime);
+	}
+	const uint32_t length = !isReady ? READ_ERROR
+								: m_replayReader.isOpen() ? this->readFromReplay() : this->readFromDevice(m_fileDesc, &m_readBuffers[0], m_readBuffers.size());
+	m_readTime = getDroneLinkTime();
+	if (length != READ_ERROR) { m_readScheduler.onRead(length, m_readTime); }
 
 	if (length == READ_ERROR)
 	{
 		m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Could not receive data from [" << m_ttyName << "]\n";
+		m_metric.readErrors->add();
 		return false;
 	}
-
-	// goes through the datastream received from the serial buffer and reads one element at the time
-	for (uint32_t i = 0; i < length; ++i)
+	m_metric.bytesRead->add(length);
+	m_metric.readSize->observe(length);
+	for (size_t i = 0; i < m_boardReaders.size(); ++i)
 	{
-		if (this->parseByte(m_readBuffers[i])){
-			std::copy(m_sampleEEGBuffers.begin(), m_sampleEEGBuffers.end(), m_sampleBuffers.begin());
-			m_channelBuffers.push_back(m_sampleBuffers);
-			m_tick = System::Time::getTime();
-			//m_driverCtx.getLogManager() << LogLevel_Info << "Packet processed "<<"\n";
-
+		if (m_boardReaders[i]->hasFailed())
+		{
+			m_driverCtx.getLogManager() << LogLevel_ImportantWarning << this->m_driverName << ": Could not receive data from [" << m_boardTTYNames[i] << "]\n";
+			m_metric.readErrors->add();
+			return false;
 		}
-		//m_driverCtx.getLogManager() << LogLevel_Info << "Value "<< int(value)<<"\n";
-		
 	}
+
+	// the recorder only copies into its preallocated chunks, the file is written by its own thread
+	if (m_nBoard == 1) { m_recorder.appendRaw(&m_readBuffers[0], length); }
+
+	// goes through the frames of the datastream received from the serial buffer one at the time
+	m_decoder.push(&m_readBuffers[0], length);
+	for (auto event = m_decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = m_decoder.next())
+	{
+		if (this->parseFrame(event)) { this->pushCurrentSample(); }
+	}
+	if (m_nBoard > 1) { this->pushBoardSamples(); }
 	
 	//m_driverCtx.getLogManager() << LogLevel_Info << "End of Loop\n";
 	// now deal with acquired samples
-	if (!m_channelBuffers.empty())
+	if (!m_sampleBlock.empty())
 	{
+		const uint32_t nSample = uint32_t(m_sampleBlock.size() / m_nChannel);
+		m_metric.blockSize->observe(nSample);
+
+		// filters while the block is still sample-major and hot in cache, also when not started so that the filters are settled on start
+		m_filterBank.process(&m_sampleBlock[0], nSample);
+		const bool isArtifact = m_artifactStage.process(&m_sampleBlock[0], nSample);
+		m_spectralEngine.push(&m_sampleBlock[0], nSample);
+
+		// OpenViBE expects channel-major blocks, they are written straight into a bus block that the in-process consumers share
+		CModularBCISampleBus::CBlock* block = m_sampleBus.acquire();
+		if (block != nullptr && block->getCapacity() < nSample) { block = nullptr; } // an unpublished block simply stays free
+		float* samples = nullptr;
+		if (block != nullptr) { samples = block->getData(); }
+		else
+		{
+			m_callbackSamples.resize(m_nChannel * nSample);
+			samples = &m_callbackSamples[0];
+		}
+
+		for (uint32_t i = 0, k = 0; i < m_nChannel; ++i)
+		{
+			for (uint32_t j = 0; j < nSample; ++j) { samples[k++] = m_sampleBlock[j * m_nChannel + i]; }
+		}
+
 		//m_driverCtx.getLogManager() << LogLevel_Info << "Not empty\n";
 		if (m_driverCtx.isStarted())
 		{
-			//m_driverCtx.getLogManager() << LogLevel_Info << "Started\n";
-			m_callbackSamples.resize(m_nChannel * m_channelBuffers.size());
-			//m_driverCtx.getLogManager() << LogLevel_Info << "Starts dealing with samples\n";
-
-			for (uint32_t i = 0, k = 0; i < m_nChannel; ++i)
-			{
-				for (uint32_t j = 0; j < m_channelBuffers.size(); ++j) { m_callbackSamples[k++] = m_channelBuffers[j][i]; }
-				//m_driverCtx.getLogManager() << LogLevel_Info << float(m_callbackSamples[k])<< "\n";
-			}
-			m_callback->setSamples(&m_callbackSamples[0], m_channelBuffers.size());
+			m_callback->setSamples(samples, nSample);
+			if (m_markers.getStimulationCount() != 0) { m_callback->setStimulationSet(m_markers); }
 			//m_driverCtx.correctDriftSampleCount(m_driverCtx.getSuggestedDriftCorrectionSampleCount());
 		}
-		m_channelBuffers.clear();
+
+		const uint32_t flags = isArtifact ? uint32_t(CModularBCISampleBus::BlockFlag_Artifact) : 0;
+		m_sharedRing.write(samples, nSample, m_readTime, flags);
+		if (block != nullptr)
+		{
+			block->setSampleCount(nSample);
+			block->setFirstSample(m_nDecodedSample);
+			block->setTime(m_readTime);
+			block->setFlags(flags);
+			m_sampleBus.publish(block);
+		}
+		m_nDecodedSample += nSample;
+		m_sampleBlock.clear();
+		m_markers.clear();
+	}
+
+	// after the block is out, so that the probe never delays the samples
+	this->sendLatencyProbe();
+	this->sendSyncMarker();
+
+	const uint64_t now = getDroneLinkTime();
+	if (now - m_metricsUpdateTime >= METRICS_UPDATE_PERIOD)
+	{
+		this->updateMetrics();
+		m_metricsUpdateTime = now;
 	}
+	m_metric.loopDuration->observe(now - loopTime);
 	return true;
 }
 
+void CDriverModularBCI::sendLatencyProbe()
+{
+	if (m_latencyProbeInterval == 0 || m_replayReader.isOpen()) { return; }
 
-bool CDriverModularBCI::parseByte(const uint8_t actbyte){
-	bool status = false;
+	// a single probe at a time, the firmware only keeps the last one
+	const uint64_t now = getDroneLinkTime();
+	if (now - m_latencyProbeTime < uint64_t(m_latencyProbeInterval) * 1000 || m_latencyProbe.isWaiting(now)) { return; }
 
-	switch (m_readState)
+	const uint8_t tag         = m_latencyProbe.prepare(now);
+	const std::string command = CModularBCISerialPort::getCommandFrame(LATENCY_PROBE_COMMAND, std::string(1, char(tag)));
+	if (this->writeToDevice(m_fileDesc, command.data(), uint32_t(command.size())) == WRITE_ERROR)
 	{
-	case ParserAutomaton_Default: // First byte of status bits. Is used as synchronization
-	// HAS TO BE CHANGED IF LEAD OF DETECTION ARE ACTIVATED (same for all ParserAutomaton_Default)
-		if (actbyte == 192){m_readState = ParserAutomaton_Default_2;}
-		break;
-	case ParserAutomaton_Default_2:
-		if (actbyte == 0){m_readState = ParserAutomaton_Default_3;}
-		break;
-	case ParserAutomaton_Default_3:
-		if (actbyte == 0){m_readState = ParserAutomaton_Channels;}
-		m_sampleNumber         = -1;
-		m_extractPosition      = 0;
-		m_sampleBufferPosition = 0;
-		break;
+		m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Could not send the latency probe\n";
+	}
+	m_latencyProbe.setWritten(tag, getDroneLinkTime());
+	m_latencyProbeTime = now;
 
+	if (now - m_latencyReportTime >= LATENCY_PROBE_REPORT_PERIOD)
+	{
+		this->logLatencyProbe(false);
+		m_latencyReportTime = now;
+	}
+}
 
-	case ParserAutomaton_Channels: // Reads the data of the electrodes
-		if (m_extractPosition < EEG_VALUE_COUNT_PER_SAMPLE){
-			if (m_sampleBufferPosition < EEG_VALUE_BUFFER_SIZE)
-			{
-				m_eegValueBuffers[m_sampleBufferPosition] = actbyte;
-				m_sampleBufferPosition++;
-			}
-			if (m_sampleBufferPosition == EEG_VALUE_BUFFER_SIZE)
+void CDriverModularBCI::logLatencyProbe(const bool isFinal)
+{
+	m_driverCtx.getLogManager() << (isFinal ? LogLevel_Info : LogLevel_Debug) << this->m_driverName << ": " << m_latencyProbe.getReplyCount() << " of "
+			<< m_latencyProbe.getSentCount() << " latency probes answered (" << m_latencyProbe.getUnmatchedCount() << " unmatched replies)\n";
+	if (m_latencyProbe.getReplyCount() == 0) { return; }
+	for (int i = 0; i < CModularBCILatencyProbe::Stage_Count; ++i)
+	{
+		const auto stage = CModularBCILatencyProbe::EStage(i);
+		m_driverCtx.getLogManager() << (isFinal ? LogLevel_Info : LogLevel_Debug) << this->m_driverName << ":   " << CModularBCILatencyProbe::getStageName(stage)
+				<< ": " << m_latencyProbe.getMean(stage) * 1000 << "ms on average, " << m_latencyProbe.getPercentile(stage, 50) * 1000 << "ms median, "
+				<< m_latencyProbe.getPercentile(stage, 95) * 1000 << "ms at 95%, " << m_latencyProbe.getPercentile(stage, 99) * 1000 << "ms at 99% and "
+				<< m_latencyProbe.getMax(stage) * 1000 << "ms at most\n";
+	}
+}
+
+void CDriverModularBCI::handleAuxFrame()
+{
+	const std::vector<uint8_t>& payload = m_decoder.getAuxPayload();
+	latency_probe_reply_t reply;
+	if (m_decoder.getAuxType() == AUX_FRAME_LATENCY_PROBE && CModularBCILatencyProbe::parseReply(payload.data(), payload.size(), reply))
+	{
+		m_latencyProbe.onReply(reply, m_readTime);
+	}
+	else
+	{
+		m_driverCtx.getLogManager() << LogLevel_Trace << this->m_driverName << ": Ignoring auxiliary frame of type " << uint32_t(m_decoder.getAuxType()) << " ("
+				<< payload.size() << " bytes)\n";
+	}
+}
+
+
+bool CDriverModularBCI::parseFrame(const CModularBCIFrameDecoder::EEvent event)
+{
+	switch (event)
+	{
+		case CModularBCIFrameDecoder::Event_Sample:
+			for (uint32_t i = 0; i < m_nEEGValuePerSample; ++i)
 			{
-				// fill EEG channel buffer, converting at the same time from 24 to 32 bits + scaling
-				uint8_t DATA_0 = 0;
-				uint8_t DATA_1 = m_eegValueBuffers[0] ;
-				//m_driverCtx.getLogManager() << LogLevel_Info << "Value "<< int(DATA_1)<<"\n";
-				uint8_t DATA_2 = m_eegValueBuffers[1] ;
-				//m_driverCtx.getLogManager() << LogLevel_Info << "Value "<< int(DATA_2)<<"\n";
-				uint8_t DATA_3 = m_eegValueBuffers[2] ;
-				//m_driverCtx.getLogManager() << LogLevel_Info << "Value "<< int(DATA_3)<<"\n";
-				if (DATA_1 >= 128) {DATA_0 = 255;}
-				int value = (DATA_0 << 24)|(DATA_1 << 16)|(DATA_2 << 8)|(DATA_3);
-				
-				m_sampleEEGBuffers[m_extractPosition] = value * m_unitsToMicroVolts;
-
-				
-			/* int newInt = (m_readBuffers[i] << 24) | (m_readBuffers[i+1] << 16) | (m_readBuffers[i+2] << 8); // Not sure of this implementation copied from ModularBCI Driver
-			if ((newInt & 0x00008000) > 0) { newInt |= 0x000000FF; }
-			else { newInt &= 0xFFFFFF00; }
-			int value = htonl(newInt); */
-			// Not sure of order if new items added to buffer in front change indexes
-
-				// reset for next value
-				m_sampleBufferPosition = 0;
-				m_extractPosition++;
+				m_sampleEEGCodes[i]   = m_decoder.getCodes()[i];
+				m_sampleEEGBuffers[i] = m_sampleEEGCodes[i] * m_unitsToMicroVolts;
 			}
-		}
+			m_sampleMarker = m_decoder.getMarker();
+			return true;
 
-		// finished with EEG
-		if (m_extractPosition == EEG_VALUE_COUNT_PER_SAMPLE)
-		{
-			// next step: accelerometer
-			m_readState = ParserAutomaton_Default;
-			// re-use the same variable to know position inside accelerometer block (I know, I'm bad!).
-			status = true;
-		}
-		break;
-		
-	default:
-		break;
-	}
+		case CModularBCIFrameDecoder::Event_AuxFrame:
+			this->handleAuxFrame();
+			return false;
 
-	if (status) {return true;}
-	return false;
+		default:
+			return false;
+	}
 }
\ No newline at end of file
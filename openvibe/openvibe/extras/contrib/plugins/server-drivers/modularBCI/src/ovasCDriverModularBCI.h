@@ -17,6 +17,24 @@
 #include "../ovasCSettingsHelper.h"
 #include "../ovasCSettingsHelperOperators.h"
 
+#include "ovasCModularBCIFilterBank.h"
+#include "ovasCModularBCISpectralEngine.h"
+#include "ovasCModularBCIArtifactStage.h"
+#include "ovasCModularBCIRecorder.h"
+#include "ovasCModularBCIReplayer.h"
+#include "ovasCModularBCISampleBus.h"
+#include "ovasCModularBCIMotorImagery.h"
+#include "ovasCModularBCISSVEPDetector.h"
+#include "ovasCModularBCICommandStage.h"
+#include "ovasCModularBCIStreamServer.h"
+#include "ovasCModularBCISharedRing.h"
+#include "ovasCModularBCILatencyProbe.h"
+#include "ovasCModularBCIMetrics.h"
+#include "ovasCModularBCIFrameDecoder.h"
+#include "ovasCModularBCIBoardAligner.h"
+#include "ovasCModularBCIBoardReader.h"
+#include "ovasCModularBCIReadScheduler.h"
+
 #if defined TARGET_OS_Windows
 typedef void* FD_TYPE;
 #elif defined TARGET_OS_Linux
@@ -26,6 +44,8 @@ typedef void* FD_TYPE;
 
 #include <vector>
 #include <deque>
+#include <memory>
+#include <string>
 
 namespace OpenViBE
 {
@@ -55,29 +75,69 @@ namespace OpenViBE
 			bool configure() override;
 			const IHeader* getHeader() override { return &m_header; }
 
-			typedef enum
-			{
-				ParserAutomaton_Default,
-				ParserAutomaton_Default_2,
-				ParserAutomaton_Default_3,
-				ParserAutomaton_Channels
-			} EParserAutomaton;
+			// filtered blocks of every loop, published whether the acquisition is started or not
+			CModularBCISampleBus& getSampleBus() { return m_sampleBus; }
 
 		protected:
 
 			int interpret24bitAsInt32(const std::vector<uint8_t>& byteBuffer);
 			int interpret16bitAsInt32(const std::vector<uint8_t>& byteBuffer);
-			bool parseByte(uint8_t actbyte);
-
-			bool sendCommand(FD_TYPE fileDesc, const char* cmd, bool waitForResponse, bool logResponse, uint32_t timeout, std::string& reply);
-			bool resetBoard(FD_TYPE fileDescriptor, bool regularInitialization);
+			bool parseFrame(CModularBCIFrameDecoder::EEvent event); // true when the frame m_decoder just decoded is a sample, in m_sampleEEGCodes
+			void handleAuxFrame(); // acts on the auxiliary frame m_decoder just decoded
+			void sendLatencyProbe(); // sends a latency probe when due
+			void logLatencyProbe(bool isFinal); // percentiles of every stage, in the debug log while acquiring and in the info log on disconnection
+			void initializeMetrics(); // registers the metrics of the session, whether they are exported or not
+			bool startMetricsExporter(); // starts the optional export of the metrics from the configuration tokens
+			void updateMetrics(); // copies the counts kept by the stages into the metrics
+
+			bool sendCommand(FD_TYPE fileDesc, const std::string& cmd, bool waitForResponse, bool logResponse, uint32_t timeout, std::string& reply);
+			// sends a configuration or test command and waits for its reply, false on a link error or without reply, isAccepted false when the board rejected it
+			// reply: the bytes read until the reply, the frames the board sent after it included
+			bool sendAcknowledgedCommand(FD_TYPE fileDesc, const std::string& cmd, uint32_t timeout, bool& isAccepted, std::string& reply);
+			bool resetBoard(FD_TYPE fileDescriptor, bool regularInitialization, bool runChecks = false); // runChecks: the self-test and impedance check as configured
+			// sends a test command and gathers the auxiliary frames of the type it is answered with, one per enabled channel, false on a link error
+			// isAccepted false when the board rejected the test, then without results
+			bool runBoardTest(FD_TYPE fileDescriptor, const std::string& command, uint8_t type, size_t payloadSize, uint32_t timeout, bool& isAccepted,
+							  std::vector<std::vector<uint8_t>>& results);
+			bool checkImpedance(FD_TYPE fileDescriptor); // measures the electrode impedances with the lead-off excitation of the firmware, false on a link error or when the board can not
+			bool runSelfTest(FD_TYPE fileDescriptor); // checks every channel on the test signal and shorted inputs of the ADS1299, false on a link error
 			bool handleCurrentSample(int packetNumber); // will take car of samples fetch from ModularBCI board, dropping/merging packets if necessary
 			void updateDaisy(bool quietLogging); // update internal state regarding daisy module
+			std::vector<size_t> getAcquiredChannels(uint32_t boardChannelMask) const; // acquired channels of the board channels in the mask (same bit layout as m_channelMask)
+			// layout of the source, the one of the recording when replaying one and the settings otherwise
+			uint32_t getSourceChannelMask() const { return m_hasReplayLayout ? m_replayLayout.channelMask : m_channelMask; }
+			bool isSourceDaisy() const { return m_hasReplayLayout ? m_replayLayout.nDevice > 1 : m_daisyModule; }
+			uint32_t getSourceSampling() const { return m_hasReplayLayout ? m_replayLayout.sampling : m_sampling; }
+			bool initializeFilterBank(); // sets up the optional notch / high-pass / low-pass cascade from the configuration tokens
+			bool initializeSpectralEngine(); // sets up the optional band power estimation from the configuration tokens
+			bool initializeArtifactStage(); // sets up the optional EOG removal and artifact detection from the configuration tokens
+			bool openRecording(); // starts the optional binary recording from the configuration tokens
+			bool startMotorImagery(); // loads the optional motor imagery model and starts decoding the sample bus
+			bool startSSVEPDetector(); // starts the optional SSVEP detection of the sample bus from the configuration tokens
+			bool startCommandStage(); // starts the optional drone command output of the decoder decisions from the configuration tokens
+			bool startStreamServer(); // starts the optional TCP stream of the sample bus from the configuration tokens
+			bool openSharedRing(); // creates the optional shared memory export of the samples from the configuration tokens
+			std::string getStreamDescriptor() const; // JSON description of the samples for the stream server and the shared ring
+			std::string getBandPowerDescriptor(double rate) const; // JSON description of the band powers for their stream server, rate in estimates per second
+			bool openReplay(); // opens the recording to replay instead of the board, adopting its channel mask and daisy setting
+			uint32_t readFromReplay(); // feeds due raw bytes to m_readBuffers (returned count) or due decoded samples to the block
+			void closeSource(); // closes the board or the replayed recording
+			void abortInitialization(); // stops and closes whatever initialize set up before failing, safe at any of its steps
+			void pushCurrentSample(); // appends the last decoded sample to the block, or hands it to the board aligner
+			void appendMarker(uint8_t marker); // dates a board marker to the last sample of the block
+			bool openBoards(); // opens, starts and reads the optional additional boards from the configuration tokens
+			void closeBoards();
+			void pushBoardSamples(); // appends the rows of all boards the aligner merged to the block
+			void sendSyncMarker(); // sends the sync marker to all boards when due
+			void logBoards(bool isFinal); // offset and skew of every additional board, in the debug log while acquiring and in the info log on disconnection
 
 			bool openDevice(FD_TYPE* fileDesc, uint32_t ttyNumber);
+			bool openPort(FD_TYPE* fileDesc, const CString& ttyName);
 			static void closeDevice(FD_TYPE fileDesc);
 			static uint32_t writeToDevice(FD_TYPE fileDesc, const void* buffer, uint32_t size);
 			static uint32_t readFromDevice(FD_TYPE fileDesc, void* buffer, uint32_t size, uint64_t timeOut = 0);
+			// sleeps, then waits until the port is readable or for timeOut, both in us, false on error
+			static bool waitForDevice(FD_TYPE fileDesc, uint64_t sleep, uint64_t timeOut);
 
 			SettingsHelper m_settings;
 
@@ -85,6 +145,7 @@ namespace OpenViBE
 			CHeader m_header;
 
 			FD_TYPE m_fileDesc;
+			bool m_isDeviceOpen = false; // m_fileDesc holds an open port
 
 			CString m_driverName = "ModularBCI";
 			CString m_ttyName;
@@ -94,12 +155,14 @@ namespace OpenViBE
 			uint32_t m_readBoardReplyTimeout  = 5000; // parameter com init string
 			uint32_t m_flushBoardReplyTimeout = 500;  // parameter com init string
 			bool m_daisyModule                = false; // daisy module attached or not
+			uint32_t m_channelMask            = 0xFFFFFFFF; // bit n set -> EEG channel n+1 is powered on and streamed by the board
+			uint32_t m_sampling               = 250; // one of the ADS1299 data rates
 
 			// ModularBCI protocol related
+			CModularBCIFrameDecoder m_decoder;  // of the first board
 			int16_t m_sampleNumber         = 0; // returned by the board
-			uint32_t m_readState           = 0; // position in the sample (see doc)
-			uint8_t m_sampleBufferPosition = 0;// position in the buffer
-			std::vector<uint8_t> m_eegValueBuffers; // buffer for one EEG value (int24)
+			uint8_t m_sampleMarker         = 0; // marker code the board latched in the status word of the current sample, 0 if none
+			uint32_t m_nEEGValuePerSample  = EEG_VALUE_COUNT_PER_SAMPLE; // number of EEG values actually sent by the board (enabled channels only)
 			std::vector<uint8_t> m_accValueBuffers; // buffer for one accelerometer value (int16_t)
 			const static uint8_t EEG_VALUE_BUFFER_SIZE      = 3; // int24 == 3 bytes
 			const static uint8_t ACC_VALUE_BUFFER_SIZE      = 0; // int16_t == 2 bytes
@@ -110,25 +173,205 @@ namespace OpenViBE
 			uint32_t m_droppedSampleCountBeforeReset       = 0; // in samples - value acquired from configuration manager
 			uint32_t m_droppedSampleSafetyDelayBeforeReset = 0; // in ms - value acquired from configuration manager
 
+			// online filtering, applied on the decoded block before it is handed to OpenViBE
+			CModularBCIFilterBank m_filterBank;
+			double m_notchFrequency        = 0; // in Hz, 0 to disable - value acquired from configuration manager
+			double m_notchQualityFactor    = 0; // value acquired from configuration manager
+			double m_highPassFrequency     = 0; // in Hz, 0 to disable - value acquired from configuration manager
+			double m_lowPassFrequency      = 0; // in Hz, 0 to disable - value acquired from configuration manager
+			uint32_t m_filteredChannelMask = 0; // board channels to filter (same bit layout as m_channelMask) - value acquired from configuration manager
+
+			// online artifact handling, on the filtered block: EOG removal for everything downstream, flags for the in-process decoders
+			CModularBCIArtifactStage m_artifactStage;
+			double m_artifactAmplitude     = 0; // in uV, 0 to disable - value acquired from configuration manager
+			double m_artifactDerivative    = 0; // in uV per sample, 0 to disable - value acquired from configuration manager
+			uint32_t m_artifactHold        = 0; // in ms - value acquired from configuration manager
+			uint32_t m_artifactChannelMask = 0; // board channels to watch (same bit layout as m_channelMask) - value acquired from configuration manager
+			uint32_t m_artifactEOGChannel  = 0; // board channel number of the EOG reference, 0 to disable - value acquired from configuration manager
+
+			// online band powers, computed on the filtered block
+			CModularBCISpectralEngine m_spectralEngine;
+			uint32_t m_spectralHop        = 0; // in ms, 0 to disable - value acquired from configuration manager
+			uint32_t m_spectralWindowSize = 0; // in samples, power of two - value acquired from configuration manager
+			CString m_spectralBands;           // "name:low-high;..." - value acquired from configuration manager
+			uint32_t m_spectralStreamPort = 0; // TCP port the band powers are streamed on, 0 to disable - value acquired from configuration manager
+			CModularBCISampleBus m_bandPowerBus; // one block of one sample per estimate, a value per channel and band
+			CModularBCIStreamServer m_bandPowerServer;
+
+			// optional binary recording of the raw stream and of the decoded samples
+			CModularBCIRecorder m_recorder;
+			CString m_recordingFilename; // empty to disable - value acquired from configuration manager
+
+			// optional replay of a recording instead of the board
+			CModularBCIRecordingReader m_replayReader;
+			CModularBCIReplayer m_replayer;
+			CString m_replayFilename;           // empty to acquire from the board - value acquired from configuration manager
+			double m_replaySpeed       = 1;     // 1 for real time, 0 for as fast as possible - value acquired from configuration manager
+			bool m_replaySamples       = false; // replays the decoded samples instead of the raw bytes - value acquired from configuration manager
+			bool m_replayFinished      = false;
+			std::vector<int32_t> m_replayCodes; // decoded samples read from the recording
+			recording_header_t m_replayLayout = {}; // board configuration stored in the recording, kept apart from the settings
+			bool m_hasReplayLayout = false;         // false for a plain capture, taken as matching the settings
+
 			std::deque<uint32_t> m_droppedSampleTimes;
 
 			float m_unitsToMicroVolts      = 0; // convert from int to microvolt
 			float m_unitsToRadians         = 0; // converts from int16_t to radians
-			uint32_t m_extractPosition     = 0; // used to situate sample reading both with EEG and accelerometer data
 			uint32_t m_nValidAccelerometer = 0;
 			int m_lastPacketNumber         = 0; // used to detect consecutive packets when daisy module is used
 
 			// buffer for multibyte reading over serial connection
 			std::vector<uint8_t> m_readBuffers;
-			// buffer to store sample coming from ModularBCI -- filled by parseByte(), passed to handleCurrentSample()
+			// buffer to store sample coming from ModularBCI -- filled by parseFrame(), passed to handleCurrentSample()
 			std::vector<float> m_sampleEEGBuffers;
+			std::vector<int32_t> m_sampleEEGCodes; // ADC codes of the current sample, for the recording
 			std::vector<float> m_sampleEEGBuffersDaisy;
 			std::vector<float> m_sampleAccBuffers;
 			std::vector<float> m_sampleAccBuffersTemp;
 
 			// buffer to store aggregated samples
-			std::vector<std::vector<float>> m_channelBuffers; // buffer to store channels & chunks
+			std::vector<float> m_sampleBlock; // decoded samples of the current loop, sample-major (one row of m_nChannel values per sample)
 			std::vector<float> m_sampleBuffers;
+			CModularBCISampleBus m_sampleBus; // channel-major blocks shared with the in-process consumers, the OpenViBE callback reads from them too
+			uint64_t m_nDecodedSample = 0;    // samples decoded since initialize, index of the first sample of the next block
+			CStimulationSet m_markers;        // board markers of the current block, dated from its first sample
+			uint64_t m_nMarker        = 0;    // markers received since initialize
+
+			// optional motor imagery decoding, in its own thread
+			CModularBCIMotorImageryDecoder m_motorImagery;
+			CModularBCIBusConsumer m_motorImageryConsumer;
+			CString m_motorImageryModelFilename; // empty to disable - value acquired from configuration manager
+
+			// optional SSVEP detection, in its own thread
+			CModularBCISSVEPDetector m_ssvepDetector;
+			CModularBCIBusConsumer m_ssvepConsumer;
+			CString m_ssvepFrequencies;               // "f1;f2;..." in Hz, empty to disable - value acquired from configuration manager
+			uint32_t m_ssvepHarmonics   = 0;          // value acquired from configuration manager
+			uint32_t m_ssvepSubBands    = 0;          // value acquired from configuration manager
+			uint32_t m_ssvepWindow      = 0;          // in ms - value acquired from configuration manager
+			uint32_t m_ssvepHop         = 0;          // in ms - value acquired from configuration manager
+			uint32_t m_ssvepChannelMask = 0;          // board channels to analyze (same bit layout as m_channelMask) - value acquired from configuration manager
+			double m_ssvepThreshold     = 0;          // relative margin of the best target over the second one to command - value acquired from configuration manager
+			CString m_ssvepCommands;                  // "command1;command2;..." one per frequency, empty for none - value acquired from configuration manager
+
+			// optional drone command output of the decisions, data ready times are estimated from the arrival of the blocks on the host
+			typedef struct
+			{
+				uint64_t lastSample = 0; // index of the last sample of the block
+				uint64_t time       = 0; // when the block reached the host, in us of getDroneLinkTime()
+			} block_time_t;
+
+			uint64_t getDataReadyTime(const block_time_t& block, uint64_t sampleIndex) const; // 0 if unknown
+
+			CModularBCICommandStage m_commandStage;
+			block_time_t m_motorImageryBlock;           // block being decoded, motor imagery thread only
+			block_time_t m_ssvepBlock;                  // block being decoded, SSVEP thread only
+			uint64_t m_frameDuration        = 0;        // serial transfer time of one sample frame, in us
+			CString m_commandAddress;                   // "host:port" of the drone, empty to disable - value acquired from configuration manager
+			uint32_t m_commandDebounce      = 0;        // value acquired from configuration manager
+			uint32_t m_commandRefractory    = 0;        // in ms - value acquired from configuration manager
+			uint32_t m_commandWatchdog      = 0;        // in ms, 0 to disable - value acquired from configuration manager
+			CString m_motorImageryCommands;             // "command1;command2" one per class, empty for none - value acquired from configuration manager
+			double m_motorImageryThreshold  = 0;        // probability to command - value acquired from configuration manager
+
+			// optional stream of the decoded blocks to local clients, in its own thread
+			CModularBCIStreamServer m_streamServer;
+			uint32_t m_streamPort  = 0;    // TCP port, 0 to disable - value acquired from configuration manager
+			bool m_streamLocalOnly = true; // only accept clients of this machine - value acquired from configuration manager
+
+			// optional export of the samples to readers of the same machine, written by the acquisition loop
+			CModularBCISharedRing m_sharedRing;
+			CString m_sharedMemoryName;         // empty to disable - value acquired from configuration manager
+			uint32_t m_sharedMemoryLength = 0;  // in ms of samples kept - value acquired from configuration manager
+
+			// optional additional boards, read in their own threads and merged with the first one into rows of all their channels
+			std::vector<std::string> m_boardDevices; // port numbers or names - value acquired from configuration manager
+			uint32_t m_syncMarker   = 15;            // marker code all boards latch on the same pulse, 0 for none - value acquired from configuration manager
+			uint32_t m_syncInterval = 1000;          // in ms, 0 for pulses from the marker inputs only - value acquired from configuration manager
+			uint32_t m_nBoard       = 1;
+			std::vector<FD_TYPE> m_boardFileDescs;
+			std::vector<CString> m_boardTTYNames;
+			std::vector<std::unique_ptr<CModularBCIBoardReader>> m_boardReaders;
+			CModularBCIBoardAligner m_boardAligner;
+			std::vector<int32_t> m_boardRows;     // merged rows of codes of the current loop
+			std::vector<uint8_t> m_boardMarkers;  // their markers
+			std::vector<bool> m_isBoardAligned;   // aligned on a sync marker already, to log it once
+			uint64_t m_syncTime        = 0;       // when the last sync marker was sent, in us of getDroneLinkTime()
+			uint64_t m_boardReportTime = 0;       // when the offsets were last logged
+
+			// waits of the acquisition loop for the board instead of polling it
+			CModularBCIReadScheduler m_readScheduler;
+			uint32_t m_readBatch   = 1;  // in frames - value acquired from configuration manager
+			uint32_t m_readMaxWait = 10; // in ms, 0 to poll - value acquired from configuration manager
+
+			// board and electrode contact checks on connection
+			bool m_impedanceCheck = false; // even when the acquisition server does not ask for it - value acquired from configuration manager
+			bool m_selfTest       = false; // value acquired from configuration manager
+
+			// optional measure of the delays between the host and the firmware
+			CModularBCILatencyProbe m_latencyProbe;
+			uint32_t m_latencyProbeInterval = 0; // in ms, 0 to disable - value acquired from configuration manager
+			uint64_t m_latencyProbeTime     = 0; // when the last probe was sent, in us of getDroneLinkTime()
+			uint64_t m_latencyReportTime    = 0; // when the percentiles were last logged
+			uint64_t m_readTime             = 0; // when the bytes being parsed reached the host, in us of getDroneLinkTime()
+
+			// metrics of the session, the hot path ones are updated in place, the others copied from the stages every second
+			CModularBCIMetrics m_metrics;
+			CModularBCIMetricsExporter m_metricsExporter;
+			uint32_t m_metricsPort       = 0;    // TCP port on the loopback interface, 0 to disable - value acquired from configuration manager
+			CString m_metricsFilename;           // empty to disable - value acquired from configuration manager
+			uint32_t m_metricsFilePeriod = 1000; // in ms - value acquired from configuration manager
+			uint64_t m_metricsUpdateTime = 0;    // in us of getDroneLinkTime()
+			bool m_isStalled             = false; // no sample for longer than m_missingSampleDelayBeforeReset
+			uint32_t m_recoveryTime      = 0;     // last restart of the streaming of a stalled board
+
+			typedef struct
+			{
+				CModularBCIMetrics::CCounter* bytesRead;
+				CModularBCIMetrics::CCounter* readErrors;
+				CModularBCIMetrics::CCounter* skippedBytes;
+				CModularBCIMetrics::CCounter* syncLosses;
+				CModularBCIMetrics::CCounter* locks;
+				CModularBCIMetrics::CCounter* falseLocks;
+				CModularBCIMetrics::CCounter* corruptedFrames;
+				CModularBCIMetrics::CCounter* lostFrames;
+				CModularBCIMetrics::CGauge* lockBytes;
+				CModularBCIMetrics::CCounter* stalls;
+				CModularBCIMetrics::CCounter* recoveries;
+				CModularBCIMetrics::CHistogram* readSize;
+				CModularBCIMetrics::CHistogram* loopDuration;
+				CModularBCIMetrics::CHistogram* readWait;
+				CModularBCIMetrics::CHistogram* blockSize;
+
+				CModularBCIMetrics::CCounter* samples;
+				CModularBCIMetrics::CCounter* markers;
+				CModularBCIMetrics::CCounter* auxChecksumErrors;
+				CModularBCIMetrics::CCounter* busOverruns;
+				CModularBCIMetrics::CCounter* recorderDroppedSamples;
+				CModularBCIMetrics::CCounter* recorderDroppedBytes;
+				CModularBCIMetrics::CCounter* artifacts;
+				CModularBCIMetrics::CCounter* streamBlocks;
+				CModularBCIMetrics::CCounter* streamDroppedBlocks;
+				CModularBCIMetrics::CCounter* streamSlowClients;
+				CModularBCIMetrics::CCounter* motorImageryDroppedBlocks;
+				CModularBCIMetrics::CCounter* ssvepDroppedBlocks;
+				CModularBCIMetrics::CCounter* commands;
+				CModularBCIMetrics::CCounter* latencyProbes;
+				CModularBCIMetrics::CCounter* latencyReplies;
+				CModularBCIMetrics::CGauge* motorImageryPending;
+				CModularBCIMetrics::CGauge* ssvepPending;
+				CModularBCIMetrics::CGauge* streamPending;
+				CModularBCIMetrics::CGauge* streamClients;
+				CModularBCIMetrics::CGauge* stalled;
+				CModularBCIMetrics::CGauge* latencies[CModularBCILatencyProbe::Stage_Count][3]; // median, 95% and 99%
+				std::vector<CModularBCIMetrics::CCounter*> boardBytesRead; // additional boards
+				std::vector<CModularBCIMetrics::CGauge*> boardOffsets;
+				std::vector<CModularBCIMetrics::CGauge*> boardSkews;
+				std::vector<CModularBCIMetrics::CCounter*> boardSlips;
+				std::vector<CModularBCIMetrics::CCounter*> boardMissing;
+			} metrics_t;
+
+			metrics_t m_metric = {};
 
 			bool m_seenPacketFooter = true; // extra precaution to sync packets
 
@@ -155,7 +398,7 @@ namespace OpenViBE
 				char mocapChipset[64];
 			} device_information_t;
 
-			device_information_t m_deviceInfo;
+			device_information_t m_deviceInfo = {};
 		};
 	}  // namespace AcquisitionServer
 }  // namespace OpenViBE
@@ -0,0 +1,161 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIArtifactStage.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define ARTIFACT_REGRESSION_TIME 20 // in s, time constant of the EOG covariances
+#define ARTIFACT_BASELINE_TIME   2  // in s, time constant of the amplitude baseline, longer than a blink
+
+bool CModularBCIArtifactStage::initialize(const size_t nChannel, const double sampling, const std::vector<size_t>& detectedChannels, const double amplitude,
+										  const double derivative, const double holdSeconds, const size_t eogChannel)
+{
+	this->uninitialize();
+	if (nChannel == 0 || sampling <= 0 || amplitude < 0 || derivative < 0 || holdSeconds < 0) { return false; }
+	if (eogChannel != size_t(-1) && eogChannel >= nChannel) { return false; }
+	for (const auto& c : detectedChannels) { if (c >= nChannel) { return false; } }
+
+	m_nChannel       = nChannel;
+	m_hasReference   = eogChannel != size_t(-1);
+	m_reference      = m_hasReference ? eogChannel : 0;
+	m_regressionRate = 1.0 / (sampling * ARTIFACT_REGRESSION_TIME);
+	m_means.assign(nChannel, 0.0);
+	m_covariances.assign(nChannel, 0.0);
+	m_regressed.assign(nChannel, 1.0);
+	if (m_hasReference) { m_regressed[m_reference] = 0; }
+
+	if (amplitude > 0 || derivative > 0) { m_detected = detectedChannels; }
+	m_amplitude    = amplitude > 0 ? amplitude : HUGE_VAL;
+	m_derivative   = derivative > 0 ? derivative : HUGE_VAL;
+	m_baselineRate = 1.0 / (sampling * ARTIFACT_BASELINE_TIME);
+	m_baselines.assign(m_detected.size(), 0.0);
+	m_previous.assign(m_detected.size(), 0.0F);
+	m_holdSize = size_t(std::lround(holdSeconds * sampling));
+
+	this->reset();
+	return true;
+}
+
+void CModularBCIArtifactStage::uninitialize()
+{
+	m_nChannel     = 0;
+	m_hasReference = false;
+	m_means.clear();
+	m_covariances.clear();
+	m_regressed.clear();
+	m_detected.clear();
+	m_baselines.clear();
+	m_previous.clear();
+	m_nArtifact       = 0;
+	m_nArtifactSample = 0;
+	m_nAmplitude      = 0;
+	m_nDerivative     = 0;
+}
+
+void CModularBCIArtifactStage::reset()
+{
+	m_isPrimed          = false;
+	m_referenceMean     = 0;
+	m_referenceVariance = 0;
+	std::fill(m_covariances.begin(), m_covariances.end(), 0.0);
+	m_nHold   = 0;
+	m_nFreeze = 0;
+}
+
+double CModularBCIArtifactStage::getEOGCoefficient(const size_t channel) const
+{
+	if (!m_hasReference || channel >= m_nChannel || m_referenceVariance <= 0) { return 0; }
+	return m_regressed[channel] * m_covariances[channel] / m_referenceVariance;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIArtifactStage::process(float* samples, const size_t nSample)
+{
+	if (!this->isEnabled()) { return false; }
+
+	bool isArtifact = false;
+	for (size_t i = 0; i < nSample; ++i)
+	{
+		float* x = samples + i * m_nChannel;
+		if (!m_isPrimed)
+		{
+			// starts the running statistics on the first sample instead of ramping up from zero
+			std::copy(x, x + m_nChannel, m_means.begin());
+			m_referenceMean = m_hasReference ? x[m_reference] : 0;
+			for (size_t k = 0; k < m_detected.size(); ++k) { m_baselines[k] = m_previous[k] = x[m_detected[k]]; }
+			m_isPrimed = true;
+		}
+
+		if (m_hasReference) { this->regress(x, m_nFreeze == 0 ? m_regressionRate : 0); }
+		if (m_nFreeze != 0) { m_nFreeze--; }
+		if (this->detect(x))
+		{
+			if (m_nHold == 0) { m_nArtifact++; }
+			m_nHold = m_holdSize + 1;
+		}
+		if (m_nHold != 0)
+		{
+			m_nHold--;
+			m_nArtifactSample++;
+			isArtifact = true;
+		}
+	}
+	return isArtifact;
+}
+
+void CModularBCIArtifactStage::regress(float* x, const double rate)
+{
+	m_referenceMean += rate * (x[m_reference] - m_referenceMean);
+	const double r = x[m_reference] - m_referenceMean;
+	m_referenceVariance += rate * (r * r - m_referenceVariance);
+	const double scale = m_referenceVariance > 0 ? r / m_referenceVariance : 0;
+
+	// one pass over the channels without branches, the reference has a weight of 0
+	double* means       = &m_means[0];
+	double* covariances = &m_covariances[0];
+	const double* w     = &m_regressed[0];
+	for (size_t c = 0; c < m_nChannel; ++c)
+	{
+		means[c] += rate * (x[c] - means[c]);
+		covariances[c] += rate * ((x[c] - means[c]) * r - covariances[c]);
+		x[c] = float(x[c] - w[c] * covariances[c] * scale);
+	}
+}
+
+bool CModularBCIArtifactStage::detect(const float* x)
+{
+	bool res = false;
+	for (size_t k = 0; k < m_detected.size(); ++k)
+	{
+		const float value = x[m_detected[k]];
+		const double step = std::fabs(double(value) - m_previous[k]);
+		const double dev  = std::fabs(value - m_baselines[k]);
+		m_previous[k]     = value;
+
+		// the baseline is too slow to follow a blink, but an electrode that shifts is only flagged for a few seconds
+		m_baselines[k] += m_baselineRate * (value - m_baselines[k]);
+		if (dev > m_amplitude)
+		{
+			m_nAmplitude++;
+			res = true;
+		}
+		if (step > m_derivative)
+		{
+			// EMG on a frontal reference would bias the coefficients of every channel for tens of seconds
+			m_nDerivative++;
+			m_nFreeze = m_holdSize + 1;
+			res       = true;
+		}
+	}
+	return res;
+}
@@ -0,0 +1,92 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIArtifactStage
+		 * \brief Streaming EOG removal and blink / EMG burst detection on the decoded samples
+		 *
+		 * EOG removal is a regression on a reference channel (an electrode above or next to an eye,
+		 * or the most frontal one): every channel gets its running covariance with the reference,
+		 * divided by the running variance of the reference, times the reference subtracted. The
+		 * covariances are exponentially weighted over tens of seconds so that the coefficients
+		 * follow electrode drifts but not individual blinks. They are frozen while EMG is detected,
+		 * as a jaw clench on the reference would bias them. The reference channel itself is kept.
+		 *
+		 * Detection then runs on the cleaned channels: an amplitude detector on the deviation from
+		 * a running baseline catches blinks the regression missed and movement, a derivative
+		 * detector on the sample to sample step catches EMG bursts such as jaw clenches. A detection
+		 * marks the following hold period as artifact, so a block is flagged as soon as one of its
+		 * samples is.
+		 *
+		 * Blocks are processed in place with no delay and no allocation after initialize().
+		 */
+		class CModularBCIArtifactStage final
+		{
+		public:
+
+			// thresholds in uV (per sample for the derivative), 0 disables a detector, SIZE_MAX for no EOG reference
+			bool initialize(size_t nChannel, double sampling, const std::vector<size_t>& detectedChannels, double amplitude, double derivative,
+							double holdSeconds, size_t eogChannel);
+			void uninitialize();
+			bool isEnabled() const { return m_hasReference || !m_detected.empty(); }
+
+			void reset(); // forgets the running statistics
+
+			// cleans a sample-major block (nSample rows of nChannel values) in place, true if any of its samples is an artifact
+			bool process(float* samples, size_t nSample);
+
+			uint64_t getArtifactCount() const { return m_nArtifact; }             // detections outside a hold period
+			uint64_t getArtifactSampleCount() const { return m_nArtifactSample; } // samples flagged
+			uint64_t getAmplitudeCount() const { return m_nAmplitude; }           // samples over the amplitude threshold
+			uint64_t getDerivativeCount() const { return m_nDerivative; }         // samples over the derivative threshold
+			double getEOGCoefficient(const size_t channel) const;                 // current regression coefficient of a channel
+
+		protected:
+
+			void regress(float* x, double rate);
+			bool detect(const float* x);
+
+			size_t m_nChannel = 0;
+			bool m_isPrimed   = false; // statistics start from the first sample
+
+			// EOG regression
+			bool m_hasReference        = false;
+			size_t m_reference         = 0;
+			double m_regressionRate    = 0; // exponential forgetting factor per sample
+			double m_referenceMean     = 0;
+			double m_referenceVariance = 0;
+			std::vector<double> m_means;
+			std::vector<double> m_covariances; // with the reference, 0 for the reference itself
+			std::vector<double> m_regressed;   // 1 for the channels to clean, 0 for the reference
+
+			// detectors
+			std::vector<size_t> m_detected;
+			double m_amplitude    = 0;
+			double m_derivative   = 0;
+			double m_baselineRate = 0;
+			std::vector<double> m_baselines; // per detected channel
+			std::vector<float> m_previous;   // per detected channel
+			size_t m_holdSize = 0;           // in samples
+			size_t m_nHold    = 0;           // samples left in the current hold period
+			size_t m_nFreeze  = 0;           // samples left without regression updates, after EMG
+
+			uint64_t m_nArtifact       = 0;
+			uint64_t m_nArtifactSample = 0;
+			uint64_t m_nAmplitude      = 0;
+			uint64_t m_nDerivative     = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
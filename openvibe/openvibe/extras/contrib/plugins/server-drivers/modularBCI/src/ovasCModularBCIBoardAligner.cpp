@@ -0,0 +1,278 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIBoardAligner.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define ALIGN_WINDOW        200000 // in us, arrival times are reduced to the earliest sample of each window
+#define ALIGN_WINDOW_COUNT  8      // windows an arrival estimate is averaged on
+#define ALIGN_SYNC_MATCH    100000 // in us, sync markers of different boards arriving that close belong to the same pulse
+#define ALIGN_SYNC_COUNT    16     // sync markers of the first board kept for matching
+#define ALIGN_FIT_COUNT     64     // sync measurements the offset and skew are fitted on
+#define ALIGN_FIT_OUTLIER   2.0    // in samples, a sync measurement that far from the fit restarts it (a board reset, a lost block)
+#define ALIGN_TIMEOUT       250000 // in us, longest wait for the sample of a board before repeating its last values
+
+bool CModularBCIBoardAligner::initialize(const size_t nBoard, const size_t nValue, const uint32_t sampling, const uint8_t syncMarker, const size_t capacity)
+{
+	if (nBoard == 0 || sampling == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0) { return false; }
+
+	m_boards.clear();
+	for (size_t i = 0; i < nBoard; ++i)
+	{
+		m_boards.emplace_back(new board_t());
+		board_t& board = *m_boards.back();
+		board.codes.assign(capacity * nValue, 0);
+		board.markers.assign(capacity, 0);
+		board.times.assign(capacity, 0);
+		board.lastCodes.assign(nValue, 0);
+	}
+	m_nValue     = nValue;
+	m_sampling   = sampling;
+	m_syncMarker = syncMarker;
+	m_mask       = capacity - 1;
+	return true;
+}
+
+void CModularBCIBoardAligner::uninitialize() { m_boards.clear(); }
+
+bool CModularBCIBoardAligner::push(const size_t board, const int32_t* codes, const uint8_t marker, const uint64_t time)
+{
+	board_t& b          = *m_boards[board];
+	const uint64_t head = b.head.load(std::memory_order_relaxed);
+	if (head - b.tail.load(std::memory_order_acquire) > m_mask)
+	{
+		b.nOverflow.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	const size_t slot = size_t(head) & m_mask;
+	std::copy(codes, codes + m_nValue, b.codes.begin() + slot * m_nValue);
+	b.markers[slot] = marker;
+	b.times[slot]   = time;
+	b.head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool CModularBCIBoardAligner::pushMissing(const size_t board, const size_t n, const uint64_t time)
+{
+	board_t& b = *m_boards[board];
+	bool res   = true;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const uint64_t head = b.head.load(std::memory_order_relaxed);
+		if (head == 0) { return res; } // nothing to hold yet, the offset measurement takes the start of the board
+		const size_t last = (size_t(head) - 1) & m_mask;
+		res               = this->push(board, &b.codes[last * m_nValue], 0, time) && res;
+	}
+	return res;
+}
+
+void CModularBCIBoardAligner::scan(const size_t board)
+{
+	board_t& b          = *m_boards[board];
+	const uint64_t head = b.head.load(std::memory_order_acquire);
+	for (; b.scanned < head; ++b.scanned)
+	{
+		const size_t slot   = size_t(b.scanned) & m_mask;
+		const uint64_t time = b.times[slot];
+
+		// how late the sample arrived compared to its nominal time since the first one, the earliest of a window being the least delayed
+		const int64_t window = int64_t(time / ALIGN_WINDOW);
+		const double late    = double(time) - double(b.scanned) * 1000000 / m_sampling;
+		if (window != b.window)
+		{
+			if (b.window >= 0)
+			{
+				b.windows.emplace_back(b.window, b.windowMin);
+				if (b.windows.size() > ALIGN_WINDOW_COUNT) { b.windows.pop_front(); }
+			}
+			b.window    = window;
+			b.windowMin = late;
+		}
+		else { b.windowMin = std::min(b.windowMin, late); }
+
+		if (m_syncMarker != 0 && b.markers[slot] == m_syncMarker)
+		{
+			b.syncs.push_back({ b.scanned, time });
+			if (b.syncs.size() > ALIGN_SYNC_COUNT) { b.syncs.pop_front(); }
+		}
+		b.lastTime = time;
+	}
+}
+
+void CModularBCIBoardAligner::addMeasure(board_t& board, const measure_t& measure, const bool isSync)
+{
+	if (isSync && board.isAligned && std::fabs(measure.offset - (board.fitOffset + board.fitSlope * (measure.index - board.fitIndex))) > ALIGN_FIT_OUTLIER)
+	{
+		board.measures.clear();
+	}
+	if (isSync && !board.isAligned) { board.measures.clear(); } // arrival estimates are much less precise
+	board.isAligned = board.isAligned || isSync;
+	board.measures.push_back(measure);
+	if (board.measures.size() > (isSync ? ALIGN_FIT_COUNT : ALIGN_WINDOW_COUNT)) { board.measures.pop_front(); }
+
+	double meanIndex = 0, meanOffset = 0;
+	for (const auto& m : board.measures)
+	{
+		meanIndex += m.index;
+		meanOffset += m.offset;
+	}
+	meanIndex /= double(board.measures.size());
+	meanOffset /= double(board.measures.size());
+
+	// arrival estimates are too noisy for a slope over a few seconds, their average follows the drift well enough
+	double sxx = 0, sxy = 0;
+	if (isSync)
+	{
+		for (const auto& m : board.measures)
+		{
+			sxx += (m.index - meanIndex) * (m.index - meanIndex);
+			sxy += (m.index - meanIndex) * (m.offset - meanOffset);
+		}
+	}
+	board.fitIndex  = meanIndex;
+	board.fitOffset = meanOffset;
+	board.fitSlope  = sxx > 0 ? sxy / sxx : 0;
+}
+
+int64_t CModularBCIBoardAligner::getTargetOffset(const board_t& board, const uint64_t index) const
+{
+	const double target = board.fitOffset + board.fitSlope * (double(index) - board.fitIndex);
+	if (!board.hasOffset) { return int64_t(std::llround(target)); }
+
+	// sync measurements are exact to a sample, arrival estimates get a margin against their jitter
+	const double threshold = board.isAligned ? 0.5 : 1.0;
+	return std::fabs(target - double(board.offset)) > threshold ? int64_t(std::llround(target)) : board.offset;
+}
+
+size_t CModularBCIBoardAligner::pull(int32_t* codes, uint8_t* markers, const size_t nMax, const uint64_t now)
+{
+	if (m_boards.empty()) { return 0; }
+	for (size_t i = 0; i < m_boards.size(); ++i) { this->scan(i); }
+
+	board_t& first = *m_boards[0];
+	for (size_t i = 1; i < m_boards.size(); ++i)
+	{
+		board_t& board = *m_boards[i];
+
+		// a sync marker matches the one of the first board arriving closest to it
+		for (auto it = board.syncs.begin(); it != board.syncs.end();)
+		{
+			auto match = first.syncs.end();
+			for (auto s = first.syncs.begin(); s != first.syncs.end(); ++s)
+			{
+				const uint64_t distance = s->time > it->time ? s->time - it->time : it->time - s->time;
+				if (distance < ALIGN_SYNC_MATCH && (match == first.syncs.end()
+													|| distance < (match->time > it->time ? match->time - it->time : it->time - match->time))) { match = s; }
+			}
+			if (match != first.syncs.end())
+			{
+				this->addMeasure(board, { double(match->index), double(it->index) - double(match->index) }, true);
+				board.nSync++;
+				it = board.syncs.erase(it);
+			}
+			else if (first.lastTime > it->time + ALIGN_SYNC_MATCH) { it = board.syncs.erase(it); } // the first board missed it
+			else { ++it; }
+		}
+
+		// windows both boards completed, only until the first sync marker
+		while (!board.windows.empty())
+		{
+			const auto window = board.windows.front();
+			const auto match  = std::find_if(first.windows.begin(), first.windows.end(),
+											 [&window](const std::pair<int64_t, double>& w) { return w.first == window.first; });
+			if (first.windows.empty() || first.windows.back().first < window.first) { break; } // not completed by the first board yet
+			if (match != first.windows.end() && !board.isAligned)
+			{
+				const double index = ((double(window.first) + 0.5) * ALIGN_WINDOW - match->second) * m_sampling / 1000000;
+				this->addMeasure(board, { index, (match->second - window.second) * m_sampling / 1000000 }, false);
+			}
+			board.windows.pop_front();
+		}
+	}
+
+	const size_t nBoard = m_boards.size();
+	size_t n            = 0;
+	while (n < nMax)
+	{
+		const uint64_t index = first.tail.load(std::memory_order_relaxed);
+		if (index >= first.scanned) { break; }
+		const size_t slot      = size_t(index) & m_mask;
+		const uint64_t rowTime = first.times[slot];
+
+		// the matching samples of the other boards, unless they are late
+		bool isReady = true;
+		for (size_t i = 1; i < nBoard && isReady; ++i)
+		{
+			board_t& board       = *m_boards[i];
+			const bool isPresent = board.lastTime != 0 && now < board.lastTime + ALIGN_TIMEOUT;
+			if (board.measures.empty())
+			{
+				isReady = !isPresent;
+				continue;
+			}
+			const int64_t offset = this->getTargetOffset(board, index);
+			if (board.hasOffset) { board.nSlip += uint64_t(std::llabs(offset - board.offset)); }
+			board.offset    = offset;
+			board.hasOffset = true;
+			const int64_t j = int64_t(index) + board.offset;
+			if (j >= int64_t(board.scanned) && isPresent && now < rowTime + ALIGN_TIMEOUT) { isReady = false; }
+		}
+		if (!isReady) { break; }
+
+		int32_t* row  = codes + n * nBoard * m_nValue;
+		uint8_t marker = first.markers[slot] == m_syncMarker ? 0 : first.markers[slot];
+		std::copy(first.codes.begin() + slot * m_nValue, first.codes.begin() + (slot + 1) * m_nValue, row);
+		first.tail.store(index + 1, std::memory_order_release);
+
+		for (size_t i = 1; i < nBoard; ++i)
+		{
+			board_t& board = *m_boards[i];
+			uint64_t tail  = board.tail.load(std::memory_order_relaxed);
+			if (board.measures.empty()) { board.nMissing++; }
+			else
+			{
+				const int64_t j = int64_t(index) + board.offset;
+				if (j >= int64_t(tail) && j < int64_t(board.scanned))
+				{
+					// samples before the matching one are dropped, their markers kept
+					for (; tail <= uint64_t(j); ++tail)
+					{
+						const uint8_t code = board.markers[size_t(tail) & m_mask];
+						if (marker == 0 && code != m_syncMarker) { marker = code; }
+					}
+					const size_t s = size_t(j) & m_mask;
+					std::copy(board.codes.begin() + s * m_nValue, board.codes.begin() + (s + 1) * m_nValue, board.lastCodes.begin());
+					board.tail.store(tail, std::memory_order_release);
+				}
+				else if (j >= int64_t(tail)) { board.nMissing++; } // late, repeats its last values
+				// otherwise the offset went down by the skew, or the board started after the first one, and its last sample is repeated
+			}
+			std::copy(board.lastCodes.begin(), board.lastCodes.end(), row + i * m_nValue);
+		}
+		markers[n++] = marker;
+	}
+	return n;
+}
+
+bool CModularBCIBoardAligner::isAligned(const size_t board) const { return board == 0 || m_boards[board]->isAligned; }
+
+double CModularBCIBoardAligner::getOffset(const size_t board) const
+{
+	const board_t& b = *m_boards[board];
+	if (board == 0 || b.measures.empty()) { return 0; }
+	return b.fitOffset + b.fitSlope * (double(m_boards[0]->tail.load(std::memory_order_relaxed)) - b.fitIndex);
+}
+
+double CModularBCIBoardAligner::getSkew(const size_t board) const { return board == 0 ? 0 : m_boards[board]->fitSlope * 1000000; }
+uint64_t CModularBCIBoardAligner::getSyncCount(const size_t board) const { return m_boards[board]->nSync; }
+uint64_t CModularBCIBoardAligner::getSlipCount(const size_t board) const { return m_boards[board]->nSlip; }
+uint64_t CModularBCIBoardAligner::getMissingCount(const size_t board) const { return m_boards[board]->nMissing; }
@@ -0,0 +1,118 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIBoardAligner
+		 * \brief Merges the samples of several boards into rows of all their channels, the first board setting the pace
+		 *
+		 * Each board pushes its decoded samples from its own thread into its own single-producer /
+		 * single-consumer ring, and the acquisition loop pulls the merged rows. The boards run from
+		 * their own oscillators, so the board sample matching a sample of the first board drifts
+		 * away from a constant offset. The offset of every other board is measured with sync
+		 * markers, a marker code all boards latch on the same pulse, which gives it exactly, or
+		 * until the first match (or without sync markers) from the host arrival times of the
+		 * samples, to about a millisecond. A line fitted through the last measurements gives the
+		 * offset to apply to every row and the skew of the board, and the offset is kept by
+		 * dropping or repeating one sample of the board whenever the fit moves by one sample.
+		 * A row waits for the matching samples of all boards, except for a board that delivers
+		 * nothing for long enough, whose channels then repeat its last values. The frames a board
+		 * lost on its link, known from the gaps in its sequence numbers, are replaced by its last
+		 * values when it pushes its next sample, so that a lost frame does not shift its offset.
+		 */
+		class CModularBCIBoardAligner final
+		{
+		public:
+
+			// capacity in samples of each board ring, a power of two
+			bool initialize(size_t nBoard, size_t nValue, uint32_t sampling, uint8_t syncMarker, size_t capacity);
+			void uninitialize();
+
+			// one producer thread per board, false if its ring is full and the sample dropped
+			bool push(size_t board, const int32_t* codes, uint8_t marker, uint64_t time);
+			// placeholders for the n frames the board lost before its next sample, its last values held so that its sample indices keep counting its conversions
+			bool pushMissing(size_t board, size_t n, uint64_t time);
+
+			// acquisition loop: up to nMax rows of nBoard x nValue codes and their markers (sync markers removed), now in us of the push times
+			size_t pull(int32_t* codes, uint8_t* markers, size_t nMax, uint64_t now);
+
+			size_t getBoardCount() const { return m_boards.size(); }
+			bool isAligned(size_t board) const;           // offset measured by sync markers, not only estimated from arrival times
+			double getOffset(size_t board) const;         // board sample index minus first board sample index, in samples
+			double getSkew(size_t board) const;           // clock rate relative to the first board, in ppm
+			uint64_t getSyncCount(size_t board) const;    // sync markers matched with the first board
+			uint64_t getSlipCount(size_t board) const;    // samples dropped or repeated to compensate the skew
+			uint64_t getMissingCount(size_t board) const; // rows in which the board repeated its last values as its samples were late
+			uint64_t getOverflowCount(size_t board) const { return m_boards[board]->nOverflow.load(std::memory_order_relaxed); }
+
+		protected:
+
+			typedef struct
+			{
+				double index;  // first board sample index
+				double offset; // board sample index minus first board sample index
+			} measure_t;
+
+			typedef struct
+			{
+				uint64_t index;
+				uint64_t time;
+			} sync_t;
+
+			typedef struct board_t
+			{
+				// ring, written by the producer
+				std::vector<int32_t> codes;
+				std::vector<uint8_t> markers;
+				std::vector<uint64_t> times;
+				std::atomic<uint64_t> head{0}; // samples pushed
+				std::atomic<uint64_t> nOverflow{0};
+
+				// consumer side
+				std::atomic<uint64_t> tail{0}; // next sample to merge, read by the producer for the free space
+				uint64_t scanned  = 0; // samples scanned for sync markers and arrival times
+				uint64_t lastTime = 0; // arrival of the last sample scanned, 0 if none
+				std::vector<int32_t> lastCodes;
+				std::deque<sync_t> syncs;       // not matched yet (other boards) or recent (first board)
+				int64_t window      = -1;       // arrival time window being scanned
+				double windowMin    = 0;        // lowest arrival time minus nominal time of its samples, in us
+				std::deque<std::pair<int64_t, double>> windows; // last completed windows
+				std::deque<measure_t> measures; // last offset measurements, oldest first
+				bool isAligned      = false;
+				double fitOffset    = 0;        // at fitIndex
+				double fitIndex     = 0;
+				double fitSlope     = 0;
+				bool hasOffset      = false;
+				int64_t offset      = 0;        // applied to the rows
+				uint64_t nSync      = 0;
+				uint64_t nSlip      = 0;
+				uint64_t nMissing   = 0;
+			} board_t;
+
+			void scan(size_t board);
+			void addMeasure(board_t& board, const measure_t& measure, bool isSync);
+			int64_t getTargetOffset(const board_t& board, uint64_t index) const;
+
+			std::vector<std::unique_ptr<board_t>> m_boards;
+			size_t m_nValue      = 0;
+			uint32_t m_sampling  = 0;
+			uint8_t m_syncMarker = 0;
+			size_t m_mask        = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,85 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIBoardReader.h"
+#include "ovasCModularBCIDroneLink.h"
+
+#include <chrono>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define BOARD_READ_SIZE   4096
+#define BOARD_READ_ERROR  uint32_t(-1)
+#define BOARD_READ_PERIOD 1 // in ms, sleep when the read function returned nothing, in case it did not wait itself
+
+bool CModularBCIBoardReader::start(CModularBCIBoardAligner& aligner, const size_t board, const size_t nValue, const read_function_t& read)
+{
+	this->stop();
+	m_aligner = &aligner;
+	m_board   = board;
+	m_read    = read;
+	m_decoder.initialize(nValue);
+	m_buffer.resize(BOARD_READ_SIZE);
+	m_stop.store(false);
+	m_hasFailed.store(false);
+	m_nByte.store(0);
+	m_nSample.store(0);
+	m_nSkippedByte.store(0);
+	m_nSyncLoss.store(0);
+	m_nLock.store(0);
+	m_nFalseLock.store(0);
+	m_nCorruptedFrame.store(0);
+	m_nLostFrame.store(0);
+	m_nAuxChecksumError.store(0);
+	m_thread = std::thread(&CModularBCIBoardReader::run, this);
+	return true;
+}
+
+void CModularBCIBoardReader::stop()
+{
+	if (!m_thread.joinable()) { return; }
+	m_stop.store(true);
+	m_thread.join();
+}
+
+void CModularBCIBoardReader::run()
+{
+	while (!m_stop.load())
+	{
+		const uint32_t length = m_read(&m_buffer[0], uint32_t(m_buffer.size()));
+		if (length == BOARD_READ_ERROR)
+		{
+			m_hasFailed.store(true);
+			return;
+		}
+		if (length == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(BOARD_READ_PERIOD));
+			continue;
+		}
+
+		const uint64_t time = getDroneLinkTime();
+		m_decoder.push(&m_buffer[0], length);
+		for (auto event = m_decoder.next(); event != CModularBCIFrameDecoder::Event_None; event = m_decoder.next())
+		{
+			// auxiliary frames only come as replies to the driver, which only talks to the first board
+			if (event != CModularBCIFrameDecoder::Event_Sample) { continue; }
+			m_aligner->pushMissing(m_board, m_decoder.getGap(), time);
+			m_aligner->push(m_board, m_decoder.getCodes(), m_decoder.getMarker(), time);
+		}
+
+		m_nByte.fetch_add(length, std::memory_order_relaxed);
+		m_nSample.store(m_decoder.getSampleCount(), std::memory_order_relaxed);
+		m_nSkippedByte.store(m_decoder.getSkippedByteCount(), std::memory_order_relaxed);
+		m_nSyncLoss.store(m_decoder.getSyncLossCount(), std::memory_order_relaxed);
+		m_nLock.store(m_decoder.getLockCount(), std::memory_order_relaxed);
+		m_nFalseLock.store(m_decoder.getFalseLockCount(), std::memory_order_relaxed);
+		m_nCorruptedFrame.store(m_decoder.getCorruptedFrameCount(), std::memory_order_relaxed);
+		m_nLostFrame.store(m_decoder.getLostFrameCount(), std::memory_order_relaxed);
+		m_nAuxChecksumError.store(m_decoder.getAuxChecksumErrorCount(), std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIFrameDecoder.h"
+#include "ovasCModularBCIBoardAligner.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIBoardReader
+		 * \brief Reads and decodes one additional board of a multi-board acquisition in its own thread
+		 *
+		 * The thread reads the port through the read function it is given, decodes the bytes with
+		 * its own frame decoder and pushes the samples, dated with the time they were read, to the
+		 * aligner, with placeholders for the frames lost before them. The counts of the decoder are published as atomics for the acquisition loop.
+		 */
+		class CModularBCIBoardReader final
+		{
+		public:
+
+			// waits for the port as long as it sees fit then reads up to size bytes, 0 if none came, uint32_t(-1) on error
+			typedef std::function<uint32_t(uint8_t* buffer, uint32_t size)> read_function_t;
+
+			~CModularBCIBoardReader() { this->stop(); }
+
+			bool start(CModularBCIBoardAligner& aligner, size_t board, size_t nValue, const read_function_t& read);
+			void stop();
+			bool isRunning() const { return m_thread.joinable(); }
+			bool hasFailed() const { return m_hasFailed.load(); } // a read failed and the thread ended
+
+			uint64_t getByteCount() const { return m_nByte.load(std::memory_order_relaxed); }
+			uint64_t getSampleCount() const { return m_nSample.load(std::memory_order_relaxed); }
+			uint64_t getSkippedByteCount() const { return m_nSkippedByte.load(std::memory_order_relaxed); }
+			uint64_t getSyncLossCount() const { return m_nSyncLoss.load(std::memory_order_relaxed); }
+			uint64_t getLockCount() const { return m_nLock.load(std::memory_order_relaxed); }
+			uint64_t getFalseLockCount() const { return m_nFalseLock.load(std::memory_order_relaxed); }
+			uint64_t getCorruptedFrameCount() const { return m_nCorruptedFrame.load(std::memory_order_relaxed); }
+			uint64_t getLostFrameCount() const { return m_nLostFrame.load(std::memory_order_relaxed); }
+			uint64_t getAuxChecksumErrorCount() const { return m_nAuxChecksumError.load(std::memory_order_relaxed); }
+
+		protected:
+
+			void run();
+
+			CModularBCIBoardAligner* m_aligner = nullptr;
+			size_t m_board                     = 0;
+			read_function_t m_read;
+			CModularBCIFrameDecoder m_decoder;
+			std::vector<uint8_t> m_buffer;
+
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+			std::atomic<bool> m_hasFailed{false};
+			std::atomic<uint64_t> m_nByte{0};
+			std::atomic<uint64_t> m_nSample{0};
+			std::atomic<uint64_t> m_nSkippedByte{0};
+			std::atomic<uint64_t> m_nSyncLoss{0};
+			std::atomic<uint64_t> m_nLock{0};
+			std::atomic<uint64_t> m_nFalseLock{0};
+			std::atomic<uint64_t> m_nCorruptedFrame{0};
+			std::atomic<uint64_t> m_nLostFrame{0};
+			std::atomic<uint64_t> m_nAuxChecksumError{0};
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
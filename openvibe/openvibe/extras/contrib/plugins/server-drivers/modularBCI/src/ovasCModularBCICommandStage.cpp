@@ -0,0 +1,227 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCICommandStage.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define COMMAND_ACKNOWLEDGE_TIMEOUT 1000000 // in us, a command not acknowledged by then is reported as lost
+#define COMMAND_LATENCY_BIN_COUNT 1000      // 1 ms bins, the last one gathers everything above
+#define COMMAND_RECEIVE_TIMEOUT 20          // in ms, also the resolution of the watchdog
+
+void CModularBCICommandStage::setSource(const ECommandSource source, const std::vector<EDroneCommand>& commands, const double threshold)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	source_t& state = m_sources[size_t(source)];
+	state.commands  = commands;
+	state.threshold = threshold;
+	state.candidate = size_t(-1);
+	state.nInRow    = 0;
+}
+
+bool CModularBCICommandStage::start(const std::string& host, const uint16_t port, const uint32_t debounce, const uint32_t refractoryMs,
+									const uint32_t watchdogMs)
+{
+	this->stop();
+	if (!m_socket.open(0) || !m_socket.setRemote(host, port))
+	{
+		m_socket.close();
+		return false;
+	}
+
+	m_debounce         = std::max<uint32_t>(debounce, 1);
+	m_refractory       = uint64_t(refractoryMs) * 1000;
+	m_watchdog         = uint64_t(watchdogMs) * 1000;
+	m_sequence         = 0;
+	m_lastCommand      = EDroneCommand::None;
+	m_lastCommandTime  = 0;
+	m_lastDecisionTime = getDroneLinkTime();
+	m_isHovering       = false;
+	std::fill(m_isPending, m_isPending + 256, false);
+
+	m_nSent.store(0);
+	m_nAcknowledged.store(0);
+	m_nWatchdog.store(0);
+	m_nLatency     = 0;
+	m_totalLatency = 0;
+	m_maxLatency   = 0;
+	m_latencyHistogram.assign(COMMAND_LATENCY_BIN_COUNT, 0);
+
+	m_stop.store(false);
+	m_thread = std::thread(&CModularBCICommandStage::run, this);
+	return true;
+}
+
+void CModularBCICommandStage::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_stop.store(true);
+		m_thread.join();
+	}
+	m_socket.close();
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+void CModularBCICommandStage::submit(const ECommandSource source, const size_t candidate, const double confidence, const uint64_t sampleIndex,
+									 const uint64_t drdyTime)
+{
+	if (!this->isRunning()) { return; }
+
+	const uint64_t now = getDroneLinkTime();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lastDecisionTime = now;
+
+	// a decision below the threshold breaks the row
+	source_t& state = m_sources[size_t(source)];
+	if (candidate >= state.commands.size() || confidence < state.threshold)
+	{
+		state.candidate = size_t(-1);
+		state.nInRow    = 0;
+		return;
+	}
+	if (candidate == state.candidate) { state.nInRow++; }
+	else
+	{
+		state.candidate = candidate;
+		state.nInRow    = 1;
+	}
+	if (state.nInRow < m_debounce) { return; }
+
+	const EDroneCommand command = state.commands[candidate];
+	if (command == EDroneCommand::None || (command == m_lastCommand && now - m_lastCommandTime < m_refractory)) { return; }
+	this->send(command, source, confidence, sampleIndex, drdyTime, now);
+}
+
+void CModularBCICommandStage::send(const EDroneCommand command, const ECommandSource source, const double confidence, const uint64_t sampleIndex,
+								   const uint64_t drdyTime, const uint64_t decisionTime)
+{
+	// called with m_mutex held
+	drone_command_t message = {};
+	message.drdyTime        = drdyTime;
+	message.decisionTime    = decisionTime;
+	message.sampleIndex     = sampleIndex;
+	message.confidence      = float(confidence);
+	message.command         = uint8_t(command);
+	message.source          = uint8_t(source);
+
+	uint8_t frame[DRONE_LINK_MAX_FRAME_SIZE];
+	message.sendTime  = getDroneLinkTime();
+	const size_t size = encodeDroneFrame(m_sequence, EDroneMessage::Command, &message, uint8_t(sizeof(message)), frame);
+	const bool ok     = m_socket.send(frame, size);
+
+	command_report_t& report = m_pending[m_sequence];
+	report.sequence          = m_sequence;
+	report.command           = command;
+	report.source            = source;
+	report.confidence        = message.confidence;
+	report.sampleIndex       = sampleIndex;
+	report.drdyTime          = drdyTime;
+	report.decisionTime      = decisionTime;
+	report.sendTime          = message.sendTime;
+	report.droneTime         = 0;
+	m_isPending[m_sequence]  = ok;
+
+	m_sequence++;
+	m_lastCommand     = command;
+	m_lastCommandTime = decisionTime;
+	m_isHovering      = command == EDroneCommand::Hover;
+	m_nSent++;
+}
+
+void CModularBCICommandStage::run()
+{
+	uint8_t buffer[DRONE_LINK_MAX_FRAME_SIZE];
+	while (!m_stop.load())
+	{
+		const int size     = m_socket.receive(buffer, sizeof(buffer), COMMAND_RECEIVE_TIMEOUT);
+		const uint64_t now = getDroneLinkTime();
+
+		command_report_t acknowledged;
+		bool isAcknowledged = false;
+		drone_frame_t frame;
+		if (size > 0 && decodeDroneFrame(buffer, size_t(size), frame) && frame.messageId == uint32_t(EDroneMessage::Acknowledge))
+		{
+			drone_acknowledge_t acknowledge;
+			std::memcpy(&acknowledge, frame.payload, sizeof(acknowledge));
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_isPending[acknowledge.sequence] && m_pending[acknowledge.sequence].sendTime == acknowledge.sendTime)
+			{
+				acknowledged                      = m_pending[acknowledge.sequence];
+				acknowledged.droneTime            = acknowledge.receiveTime;
+				isAcknowledged                    = true;
+				m_isPending[acknowledge.sequence] = false;
+			}
+		}
+
+		size_t nExpired = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_watchdog != 0 && !m_isHovering && now > m_lastDecisionTime + m_watchdog)
+			{
+				this->send(EDroneCommand::Hover, ECommandSource::Watchdog, 0, 0, 0, now);
+				m_nWatchdog++;
+			}
+			for (size_t i = 0; i < 256; ++i)
+			{
+				if (m_isPending[i] && now > m_pending[i].sendTime + COMMAND_ACKNOWLEDGE_TIMEOUT)
+				{
+					m_expired[nExpired++] = m_pending[i];
+					m_isPending[i]        = false;
+				}
+			}
+		}
+
+		if (isAcknowledged)
+		{
+			m_nAcknowledged++;
+			if (acknowledged.drdyTime != 0 && acknowledged.droneTime >= acknowledged.drdyTime)
+			{
+				const double latency = double(acknowledged.droneTime - acknowledged.drdyTime) / 1000000;
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_nLatency++;
+				m_totalLatency += latency;
+				m_maxLatency = std::max(m_maxLatency, latency);
+				m_latencyHistogram[std::min<size_t>(size_t(latency * 1000), COMMAND_LATENCY_BIN_COUNT - 1)]++;
+			}
+			if (m_listener) { m_listener(acknowledged); }
+		}
+		for (size_t i = 0; i < nExpired; ++i) { if (m_listener) { m_listener(m_expired[i]); } }
+	}
+}
+
+double CModularBCICommandStage::getMeanLatency() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nLatency == 0 ? 0 : m_totalLatency / double(m_nLatency);
+}
+
+double CModularBCICommandStage::getMaxLatency() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_maxLatency;
+}
+
+double CModularBCICommandStage::getLatencyPercentile(const double percentile) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_nLatency == 0) { return 0; }
+	const uint64_t rank = uint64_t(std::max(1.0, percentile / 100 * double(m_nLatency) + 0.5));
+	uint64_t count      = 0;
+	for (size_t i = 0; i < m_latencyHistogram.size(); ++i)
+	{
+		count += m_latencyHistogram[i];
+		if (count >= rank) { return double(i + 1) / 1000; }
+	}
+	return m_maxLatency;
+}
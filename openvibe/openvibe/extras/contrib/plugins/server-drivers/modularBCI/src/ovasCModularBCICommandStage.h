@@ -0,0 +1,122 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIDroneLink.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCICommandStage
+		 * \brief Turns decoder decisions into drone commands sent over the drone link
+		 *
+		 * Each source (motor imagery, SSVEP) maps its classes or targets to commands. A decision only
+		 * counts when its confidence reaches the threshold of its source, and a command is sent once
+		 * the same candidate won debounce decisions in a row. The same command is not repeated within
+		 * the refractory period. When no decision arrives for the watchdog period, hover is sent once,
+		 * so that a stalled acquisition or decoder never leaves the drone on its last command.
+		 *
+		 * Every command carries the estimated data ready time of the last sample it was decided on.
+		 * The drone acknowledges with its receive time, which gives the end-to-end latency of each
+		 * command from the ADS1299 to the drone. A thread receives the acknowledgements and runs the
+		 * watchdog, commands are sent from the thread of the decoder that decided them.
+		 */
+		class CModularBCICommandStage final
+		{
+		public:
+
+			typedef struct
+			{
+				uint8_t sequence;
+				EDroneCommand command;
+				ECommandSource source;
+				float confidence;
+				uint64_t sampleIndex;
+				uint64_t drdyTime;     // in us of getDroneLinkTime()
+				uint64_t decisionTime;
+				uint64_t sendTime;
+				uint64_t droneTime;    // 0 when the acknowledgement was lost
+			} command_report_t;
+
+			// called from the stage thread when a command is acknowledged or its acknowledgement is given up
+			typedef std::function<void(const command_report_t& report)> listener_t;
+
+			~CModularBCICommandStage() { this->stop(); }
+
+			// commands[i] is sent for class or target i of the source
+			void setSource(ECommandSource source, const std::vector<EDroneCommand>& commands, double threshold);
+			void setListener(const listener_t& listener) { m_listener = listener; }
+
+			bool start(const std::string& host, uint16_t port, uint32_t debounce, uint32_t refractoryMs, uint32_t watchdogMs);
+			void stop();
+			bool isRunning() const { return m_thread.joinable(); }
+
+			// a decision of a source, drdyTime is the estimated data ready time of sample sampleIndex
+			void submit(ECommandSource source, size_t candidate, double confidence, uint64_t sampleIndex, uint64_t drdyTime);
+
+			uint64_t getSentCount() const { return m_nSent; }
+			uint64_t getAcknowledgedCount() const { return m_nAcknowledged; }
+			uint64_t getWatchdogCount() const { return m_nWatchdog; }
+			double getMeanLatency() const; // in s, data ready to drone, decided commands only
+			double getMaxLatency() const;
+			double getLatencyPercentile(double percentile) const; // in s, from a histogram of 1 ms bins
+
+		protected:
+
+			typedef struct
+			{
+				std::vector<EDroneCommand> commands;
+				double threshold = 1;
+				size_t candidate = size_t(-1); // candidate of the last decisions above the threshold
+				uint32_t nInRow  = 0;
+			} source_t;
+
+			void send(EDroneCommand command, ECommandSource source, double confidence, uint64_t sampleIndex, uint64_t drdyTime, uint64_t decisionTime);
+			void run();
+
+			source_t m_sources[3];
+			listener_t m_listener;
+			uint32_t m_debounce   = 1;
+			uint64_t m_refractory = 0; // in us
+			uint64_t m_watchdog   = 0; // in us, 0 to disable
+
+			CModularBCIUdpSocket m_socket;
+			mutable std::mutex m_mutex; // sources, sending state, pending commands and latency statistics
+			uint8_t m_sequence          = 0;
+			EDroneCommand m_lastCommand = EDroneCommand::None;
+			uint64_t m_lastCommandTime  = 0;
+			uint64_t m_lastDecisionTime = 0;
+			bool m_isHovering           = false;
+			command_report_t m_pending[256]; // by frame sequence
+			bool m_isPending[256]            = {};
+			command_report_t m_expired[256]; // stage thread only
+
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+
+			// statistics, updated by the stage thread
+			std::atomic<uint64_t> m_nSent{0};
+			std::atomic<uint64_t> m_nAcknowledged{0};
+			std::atomic<uint64_t> m_nWatchdog{0};
+			uint64_t m_nLatency   = 0; // latency statistics under m_mutex, read by the acquisition thread
+			double m_totalLatency = 0;
+			double m_maxLatency   = 0;
+			std::vector<uint32_t> m_latencyHistogram;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
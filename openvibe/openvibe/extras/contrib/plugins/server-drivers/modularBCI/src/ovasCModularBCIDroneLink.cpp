@@ -0,0 +1,296 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIDroneLink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#elif defined TARGET_OS_Linux
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+namespace
+{
+	typedef struct
+	{
+		EDroneMessage message;
+		uint8_t payloadSize;
+		uint8_t crcExtra; // seed of the checksum, changes whenever the payload layout changes
+	} message_info_t;
+
+	const message_info_t MESSAGES[] = {
+		{ EDroneMessage::Command, uint8_t(sizeof(drone_command_t)), 0x6D },
+		{ EDroneMessage::Acknowledge, uint8_t(sizeof(drone_acknowledge_t)), 0x2B },
+	};
+
+	const message_info_t* findMessage(const uint32_t id)
+	{
+		for (const auto& info : MESSAGES) { if (uint32_t(info.message) == id) { return &info; } }
+		return nullptr;
+	}
+
+	// CRC-16/MCRF4XX, the X.25 variant MAVLink uses
+	uint16_t accumulateCrc(const uint8_t* data, const size_t size, uint16_t crc)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			uint8_t tmp = uint8_t(data[i] ^ uint8_t(crc & 0xFF));
+			tmp ^= uint8_t(tmp << 4);
+			crc = uint16_t((crc >> 8) ^ (uint16_t(tmp) << 8) ^ (uint16_t(tmp) << 3) ^ (tmp >> 4));
+		}
+		return crc;
+	}
+
+	const char* COMMAND_NAMES[] = { "hover", "takeoff", "land", "forward", "backward", "left", "right", "up", "down", "yawleft", "yawright" };
+}  // namespace
+
+uint64_t OpenViBE::AcquisitionServer::getDroneLinkTime()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+const char* OpenViBE::AcquisitionServer::getDroneCommandName(const EDroneCommand command)
+{
+	if (command == EDroneCommand::None) { return "none"; }
+	return size_t(command) < sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]) ? COMMAND_NAMES[size_t(command)] : "unknown";
+}
+
+bool OpenViBE::AcquisitionServer::parseDroneCommand(const std::string& name, EDroneCommand& command)
+{
+	std::string lower;
+	for (const auto& c : name) { if (!std::isspace(static_cast<unsigned char>(c))) { lower += char(std::tolower(static_cast<unsigned char>(c))); } }
+
+	if (lower == "none")
+	{
+		command = EDroneCommand::None;
+		return true;
+	}
+	for (size_t i = 0; i < sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]); ++i)
+	{
+		if (lower == COMMAND_NAMES[i])
+		{
+			command = EDroneCommand(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool OpenViBE::AcquisitionServer::parseDroneCommands(const std::string& names, std::vector<EDroneCommand>& commands)
+{
+	commands.clear();
+	size_t begin = 0;
+	while (begin < names.size()) // an empty list has no command, a trailing separator no empty one
+	{
+		const size_t end = std::min(names.find(';', begin), names.size());
+		EDroneCommand command;
+		if (!parseDroneCommand(names.substr(begin, end - begin), command)) { return false; }
+		commands.push_back(command);
+		begin = end + 1;
+	}
+	return true;
+}
+
+size_t OpenViBE::AcquisitionServer::encodeDroneFrame(const uint8_t sequence, const EDroneMessage message, const void* payload, const uint8_t payloadSize,
+													uint8_t* output)
+{
+	const message_info_t* info = findMessage(uint32_t(message));
+	if (info == nullptr || info->payloadSize != payloadSize) { return 0; }
+
+	output[0] = DRONE_LINK_MAGIC;
+	output[1] = payloadSize;
+	output[2] = 0; // incompatible flags
+	output[3] = 0; // compatible flags
+	output[4] = sequence;
+	output[5] = DRONE_LINK_SYSTEM_ID;
+	output[6] = DRONE_LINK_COMPONENT_ID;
+	output[7] = uint8_t(uint32_t(message) & 0xFF);
+	output[8] = uint8_t((uint32_t(message) >> 8) & 0xFF);
+	output[9] = uint8_t((uint32_t(message) >> 16) & 0xFF);
+	std::memcpy(output + DRONE_LINK_HEADER_SIZE, payload, payloadSize);
+
+	uint16_t crc = accumulateCrc(output + 1, DRONE_LINK_HEADER_SIZE - 1 + payloadSize, 0xFFFF);
+	crc          = accumulateCrc(&info->crcExtra, 1, crc);
+	output[DRONE_LINK_HEADER_SIZE + payloadSize]     = uint8_t(crc & 0xFF);
+	output[DRONE_LINK_HEADER_SIZE + payloadSize + 1] = uint8_t(crc >> 8);
+	return DRONE_LINK_HEADER_SIZE + payloadSize + DRONE_LINK_CHECKSUM_SIZE;
+}
+
+bool OpenViBE::AcquisitionServer::decodeDroneFrame(const uint8_t* data, const size_t size, drone_frame_t& frame)
+{
+	if (size < DRONE_LINK_HEADER_SIZE + DRONE_LINK_CHECKSUM_SIZE || data[0] != DRONE_LINK_MAGIC || data[2] != 0) { return false; }
+	const uint8_t payloadSize = data[1];
+	if (size != size_t(DRONE_LINK_HEADER_SIZE + payloadSize + DRONE_LINK_CHECKSUM_SIZE)) { return false; }
+
+	const uint32_t id          = uint32_t(data[7]) | (uint32_t(data[8]) << 8) | (uint32_t(data[9]) << 16);
+	const message_info_t* info = findMessage(id);
+	if (info == nullptr || info->payloadSize != payloadSize) { return false; }
+
+	uint16_t crc = accumulateCrc(data + 1, DRONE_LINK_HEADER_SIZE - 1 + payloadSize, 0xFFFF);
+	crc          = accumulateCrc(&info->crcExtra, 1, crc);
+	if (data[DRONE_LINK_HEADER_SIZE + payloadSize] != (crc & 0xFF) || data[DRONE_LINK_HEADER_SIZE + payloadSize + 1] != (crc >> 8)) { return false; }
+
+	frame.sequence    = data[4];
+	frame.systemId    = data[5];
+	frame.componentId = data[6];
+	frame.messageId   = id;
+	frame.payload     = data + DRONE_LINK_HEADER_SIZE;
+	frame.payloadSize = payloadSize;
+	return true;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+#if defined TARGET_OS_Windows
+#define INVALID_UDP_SOCKET uintptr_t(INVALID_SOCKET)
+#elif defined TARGET_OS_Linux
+#define INVALID_UDP_SOCKET -1
+#else
+#define INVALID_UDP_SOCKET -1
+#endif
+
+bool CModularBCIUdpSocket::isOpen() const { return m_socket != INVALID_UDP_SOCKET; }
+
+bool CModularBCIUdpSocket::open(const uint16_t localPort)
+{
+	this->close();
+
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+#if defined TARGET_OS_Windows
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) { return false; }
+#endif
+
+	m_socket = decltype(m_socket)(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+	if (m_socket == INVALID_UDP_SOCKET)
+	{
+#if defined TARGET_OS_Windows
+		WSACleanup();
+#endif
+		return false;
+	}
+
+	sockaddr_in address     = {};
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons(localPort);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (::bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		this->close();
+		return false;
+	}
+	return true;
+#else
+	(void)localPort;
+	return false;
+#endif
+}
+
+void CModularBCIUdpSocket::close()
+{
+	if (this->isOpen())
+	{
+#if defined TARGET_OS_Windows
+		::closesocket(m_socket);
+		WSACleanup();
+#elif defined TARGET_OS_Linux
+		::close(m_socket);
+#else
+#endif
+	}
+	m_socket    = INVALID_UDP_SOCKET;
+	m_hasRemote = false;
+	m_hasSender = false;
+}
+
+bool CModularBCIUdpSocket::setRemote(const std::string& host, const uint16_t port)
+{
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+	static_assert(sizeof(m_remote) >= sizeof(sockaddr_in), "sockaddr_in does not fit");
+
+	addrinfo hints      = {};
+	hints.ai_family     = AF_INET;
+	hints.ai_socktype   = SOCK_DGRAM;
+	addrinfo* addresses = nullptr;
+	if (::getaddrinfo(host.c_str(), nullptr, &hints, &addresses) != 0 || addresses == nullptr) { return false; }
+
+	sockaddr_in address = *reinterpret_cast<const sockaddr_in*>(addresses->ai_addr);
+	address.sin_port    = htons(port);
+	::freeaddrinfo(addresses);
+
+	std::memcpy(m_remote, &address, sizeof(address));
+	m_hasRemote = true;
+	return true;
+#else
+	(void)host;
+	(void)port;
+	return false;
+#endif
+}
+
+bool CModularBCIUdpSocket::send(const void* data, const size_t size)
+{
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+	if (!this->isOpen() || (!m_hasRemote && !m_hasSender)) { return false; }
+	const sockaddr* address = reinterpret_cast<const sockaddr*>(m_hasRemote ? m_remote : m_sender);
+	return ::sendto(m_socket, static_cast<const char*>(data), int(size), 0, address, sizeof(sockaddr_in)) == int(size);
+#else
+	(void)data;
+	(void)size;
+	return false;
+#endif
+}
+
+int CModularBCIUdpSocket::receive(void* buffer, const size_t size, const uint32_t timeoutMs)
+{
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+	if (!this->isOpen()) { return -1; }
+
+#if defined TARGET_OS_Windows
+	WSAPOLLFD descriptor = {};
+	descriptor.fd        = m_socket;
+	descriptor.events    = POLLRDNORM;
+	const int nReady     = WSAPoll(&descriptor, 1, int(timeoutMs));
+#else
+	pollfd descriptor = {};
+	descriptor.fd     = m_socket;
+	descriptor.events = POLLIN;
+	const int nReady  = ::poll(&descriptor, 1, int(timeoutMs));
+#endif
+	if (nReady <= 0) { return nReady; }
+
+	sockaddr_in sender  = {};
+	socklen_t senderLen = sizeof(sender);
+	const int res       = int(::recvfrom(m_socket, static_cast<char*>(buffer), int(size), 0, reinterpret_cast<sockaddr*>(&sender), &senderLen));
+	if (res >= 0)
+	{
+		std::memcpy(m_sender, &sender, sizeof(sender));
+		m_hasSender = true;
+	}
+	return res;
+#else
+	(void)buffer;
+	(void)size;
+	(void)timeoutMs;
+	return -1;
+#endif
+}
@@ -0,0 +1,121 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Drone link, the UDP messages between the command stage and the drone (or the
+ * openvibe-modularbci-drone-sim stand-in), all values little endian
+ *
+ * Frames follow the MAVLink 2 layout, without signing nor payload truncation: magic 0xFD, payload
+ * length, incompatible and compatible flags, sequence, system id, component id, 24 bits message
+ * id, payload, then the X.25 CRC of everything after the magic plus a per-message seed byte. The
+ * message ids are outside the MAVLink common set, so a real MAVLink endpoint drops them.
+ *
+ * Times are in us of the host monotonic clock (getDroneLinkTime()), which all the processes of
+ * the machine share, so that the simulator timestamps can be compared to the driver ones.
+ */
+
+#define DRONE_LINK_MAGIC         0xFD
+#define DRONE_LINK_HEADER_SIZE   10
+#define DRONE_LINK_CHECKSUM_SIZE 2
+#define DRONE_LINK_MAX_FRAME_SIZE (DRONE_LINK_HEADER_SIZE + 255 + DRONE_LINK_CHECKSUM_SIZE)
+#define DRONE_LINK_SYSTEM_ID     255 // ground station
+#define DRONE_LINK_COMPONENT_ID  42
+#define DRONE_LINK_DEFAULT_PORT  14560
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		enum class EDroneMessage : uint32_t { Command = 42000, Acknowledge = 42001 };
+
+		enum class EDroneCommand : uint8_t { Hover = 0, Takeoff, Land, Forward, Backward, Left, Right, Up, Down, YawLeft, YawRight, None = 0xFF };
+
+		// what made the command stage send a command
+		enum class ECommandSource : uint8_t { Watchdog = 0, MotorImagery, SSVEP };
+
+#pragma pack(push, 1)
+		typedef struct
+		{
+			uint64_t drdyTime;     // estimated data ready time of the last sample the decision used
+			uint64_t decisionTime; // when the decoder came out with the decision
+			uint64_t sendTime;     // when the frame was handed to the socket
+			uint64_t sampleIndex;  // last sample the decision used
+			float confidence;
+			uint8_t command;       // EDroneCommand
+			uint8_t source;        // ECommandSource
+		} drone_command_t;
+
+		typedef struct
+		{
+			uint64_t sendTime;    // echo of the command
+			uint64_t receiveTime; // when the drone got the command
+			uint8_t sequence;     // frame sequence of the command
+			uint8_t command;      // EDroneCommand
+			uint8_t result;       // 0 when accepted
+		} drone_acknowledge_t;
+#pragma pack(pop)
+
+		typedef struct
+		{
+			uint8_t sequence;
+			uint8_t systemId;
+			uint8_t componentId;
+			uint32_t messageId;
+			const uint8_t* payload;
+			uint8_t payloadSize;
+		} drone_frame_t;
+
+		uint64_t getDroneLinkTime();
+
+		const char* getDroneCommandName(EDroneCommand command);
+		bool parseDroneCommand(const std::string& name, EDroneCommand& command); // case insensitive, "none" for EDroneCommand::None
+		bool parseDroneCommands(const std::string& names, std::vector<EDroneCommand>& commands); // "name1;name2;...", empty for none
+
+		// writes a frame to output (DRONE_LINK_MAX_FRAME_SIZE bytes), returns its size, 0 for an unknown message
+		size_t encodeDroneFrame(uint8_t sequence, EDroneMessage message, const void* payload, uint8_t payloadSize, uint8_t* output);
+
+		// false if the datagram is not one whole valid frame of a known message
+		bool decodeDroneFrame(const uint8_t* data, size_t size, drone_frame_t& frame);
+
+		/**
+		 * \class CModularBCIUdpSocket
+		 * \brief Minimal UDP endpoint for the drone link
+		 */
+		class CModularBCIUdpSocket final
+		{
+		public:
+
+			~CModularBCIUdpSocket() { this->close(); }
+
+			bool open(uint16_t localPort); // 0 for any port
+			void close();
+			bool isOpen() const;
+
+			bool setRemote(const std::string& host, uint16_t port); // numeric IPv4 address or host name
+			bool send(const void* data, size_t size);               // to the remote, or back to the last sender when no remote is set
+			int receive(void* buffer, size_t size, uint32_t timeoutMs); // bytes received, 0 on timeout, -1 on error
+
+		protected:
+
+#if defined TARGET_OS_Windows
+			uintptr_t m_socket = uintptr_t(~0);
+#else
+			int m_socket = -1;
+#endif
+			uint8_t m_remote[16] = {}; // sockaddr_in
+			bool m_hasRemote     = false;
+			uint8_t m_sender[16] = {};
+			bool m_hasSender     = false;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,179 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIFilterBank.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MODULARBCI_FILTER_SSE2
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define SIMD_WIDTH 4
+
+// Coefficients from R. Bristow-Johnson's audio EQ cookbook, normalized by a0
+CModularBCIFilterBank::biquad_t CModularBCIFilterBank::design(const EFilterType type, const double frequency, const double sampling, const double q)
+{
+	const double pi    = 3.14159265358979323846;
+	const double w0    = 2 * pi * frequency / sampling;
+	const double cosW0 = std::cos(w0);
+	const double alpha = std::sin(w0) / (2 * q);
+	const double a0    = 1 + alpha;
+
+	double b0 = 1, b1 = 0, b2 = 0;
+	switch (type)
+	{
+		case EFilterType::Notch: b0 = 1;
+			b1 = -2 * cosW0;
+			b2 = 1;
+			break;
+		case EFilterType::HighPass: b0 = (1 + cosW0) / 2;
+			b1 = -(1 + cosW0);
+			b2 = (1 + cosW0) / 2;
+			break;
+		case EFilterType::LowPass: b0 = (1 - cosW0) / 2;
+			b1 = 1 - cosW0;
+			b2 = (1 - cosW0) / 2;
+			break;
+		case EFilterType::BandPass: b0 = alpha;
+			b1 = 0;
+			b2 = -alpha;
+			break;
+	}
+
+	biquad_t res;
+	res.b0 = float(b0 / a0);
+	res.b1 = float(b1 / a0);
+	res.b2 = float(b2 / a0);
+	res.a1 = float(-2 * cosW0 / a0);
+	res.a2 = float((1 - alpha) / a0);
+	return res;
+}
+
+bool CModularBCIFilterBank::initialize(const size_t nChannel, const double sampling)
+{
+	this->uninitialize();
+	if (nChannel == 0 || sampling <= 0) { return false; }
+
+	m_nChannel       = nChannel;
+	m_nChannelPadded = (nChannel + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	m_sampling       = sampling;
+	m_nStagePerChannel.assign(nChannel, 0);
+	m_row.assign(m_nChannelPadded, 0);
+	return true;
+}
+
+void CModularBCIFilterBank::uninitialize()
+{
+	m_nChannel       = 0;
+	m_nChannelPadded = 0;
+	m_nStage         = 0;
+	m_sampling       = 0;
+	m_b0.clear();
+	m_b1.clear();
+	m_b2.clear();
+	m_a1.clear();
+	m_a2.clear();
+	m_z1.clear();
+	m_z2.clear();
+	m_nStagePerChannel.clear();
+	m_row.clear();
+}
+
+size_t CModularBCIFilterBank::addStage()
+{
+	m_b0.resize(m_b0.size() + m_nChannelPadded, 1);
+	m_b1.resize(m_b1.size() + m_nChannelPadded, 0);
+	m_b2.resize(m_b2.size() + m_nChannelPadded, 0);
+	m_a1.resize(m_a1.size() + m_nChannelPadded, 0);
+	m_a2.resize(m_a2.size() + m_nChannelPadded, 0);
+	m_z1.resize(m_z1.size() + m_nChannelPadded, 0);
+	m_z2.resize(m_z2.size() + m_nChannelPadded, 0);
+	return m_nStage++;
+}
+
+bool CModularBCIFilterBank::addStage(const size_t channel, const EFilterType type, const double frequency, const double q)
+{
+	if (channel >= m_nChannel || frequency <= 0 || frequency >= m_sampling / 2 || q <= 0) { return false; }
+
+	// reuses the first pass-through section of this channel, or appends a new one
+	const size_t stage = m_nStagePerChannel[channel] < m_nStage ? m_nStagePerChannel[channel] : this->addStage();
+	m_nStagePerChannel[channel]++;
+
+	const biquad_t coefs = design(type, frequency, m_sampling, q);
+	const size_t idx     = stage * m_nChannelPadded + channel;
+	m_b0[idx]            = coefs.b0;
+	m_b1[idx]            = coefs.b1;
+	m_b2[idx]            = coefs.b2;
+	m_a1[idx]            = coefs.a1;
+	m_a2[idx]            = coefs.a2;
+	m_z1[idx]            = 0;
+	m_z2[idx]            = 0;
+	return true;
+}
+
+bool CModularBCIFilterBank::addStageToChannels(const std::vector<size_t>& channels, const EFilterType type, const double frequency, const double q)
+{
+	for (const auto& channel : channels) { if (!this->addStage(channel, type, frequency, q)) { return false; } }
+	return true;
+}
+
+void CModularBCIFilterBank::reset()
+{
+	std::fill(m_z1.begin(), m_z1.end(), 0.0F);
+	std::fill(m_z2.begin(), m_z2.end(), 0.0F);
+}
+
+void CModularBCIFilterBank::process(float* samples, const size_t nSample)
+{
+	if (m_nStage == 0) { return; }
+
+	for (size_t i = 0; i < nSample; ++i)
+	{
+		float* sample = samples + i * m_nChannel;
+		std::copy(sample, sample + m_nChannel, m_row.begin());
+		float* x = &m_row[0];
+
+		for (size_t s = 0; s < m_nStage; ++s)
+		{
+			const size_t offset = s * m_nChannelPadded;
+			const float* b0     = &m_b0[offset];
+			const float* b1     = &m_b1[offset];
+			const float* b2     = &m_b2[offset];
+			const float* a1     = &m_a1[offset];
+			const float* a2     = &m_a2[offset];
+			float* z1           = &m_z1[offset];
+			float* z2           = &m_z2[offset];
+
+#if defined MODULARBCI_FILTER_SSE2
+			for (size_t c = 0; c < m_nChannelPadded; c += SIMD_WIDTH)
+			{
+				const __m128 in  = _mm_loadu_ps(x + c);
+				const __m128 out = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b0 + c), in), _mm_loadu_ps(z1 + c));
+				_mm_storeu_ps(z1 + c, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(b1 + c), in), _mm_mul_ps(_mm_loadu_ps(a1 + c), out)), _mm_loadu_ps(z2 + c)));
+				_mm_storeu_ps(z2 + c, _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(b2 + c), in), _mm_mul_ps(_mm_loadu_ps(a2 + c), out)));
+				_mm_storeu_ps(x + c, out);
+			}
+#else
+			for (size_t c = 0; c < m_nChannelPadded; ++c)
+			{
+				const float in  = x[c];
+				const float out = b0[c] * in + z1[c];
+				z1[c]           = b1[c] * in - a1[c] * out + z2[c];
+				z2[c]           = b2[c] * in - a2[c] * out;
+				x[c]            = out;
+			}
+#endif
+		}
+
+		std::copy(m_row.begin(), m_row.begin() + m_nChannel, sample);
+	}
+}
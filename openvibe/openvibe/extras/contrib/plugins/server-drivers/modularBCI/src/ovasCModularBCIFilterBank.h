@@ -0,0 +1,76 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIFilterBank
+		 * \brief Streaming cascade of IIR biquads, one cascade per channel
+		 *
+		 * Every channel owns the same number of second order sections. A channel that does not use
+		 * one of the stages gets a pass-through section there, so that all channels run the same
+		 * branch-free code and the inner loop can run across channels with SIMD (the recursion
+		 * itself runs along time and can't be vectorized).
+		 *
+		 * Sections are in transposed direct form II. Butterworth high-pass / low-pass sections
+		 * and narrow notches keep the group delay in the pass-band to a few samples, which is the
+		 * best a causal filter can do with respect to phase lag.
+		 */
+		class CModularBCIFilterBank final
+		{
+		public:
+
+			enum class EFilterType { Notch, HighPass, LowPass, BandPass };
+
+			typedef struct
+			{
+				float b0, b1, b2, a1, a2;
+			} biquad_t;
+
+			static biquad_t design(EFilterType type, double frequency, double sampling, double q);
+
+			bool initialize(size_t nChannel, double sampling);
+			void uninitialize();
+
+			// adds one section to the cascade of a channel, the other channels get a pass-through section when needed
+			bool addStage(size_t channel, EFilterType type, double frequency, double q);
+			bool addStageToChannels(const std::vector<size_t>& channels, EFilterType type, double frequency, double q);
+
+			void reset(); // clears filter memory but keeps the sections
+
+			// filters a sample-major block (nSample rows of nChannel values) in place
+			void process(float* samples, size_t nSample);
+
+			size_t getChannelCount() const { return m_nChannel; }
+			size_t getStageCount() const { return m_nStage; }
+			bool isEmpty() const { return m_nStage == 0; }
+
+		protected:
+
+			size_t addStage(); // appends a pass-through section to all channels, returns its index
+
+			size_t m_nChannel       = 0;
+			size_t m_nChannelPadded = 0; // rounded up to the SIMD width, padding channels are never read back
+			size_t m_nStage         = 0;
+			double m_sampling       = 0;
+
+			// structure of arrays, one row of m_nChannelPadded values per section
+			std::vector<float> m_b0, m_b1, m_b2, m_a1, m_a2;
+			std::vector<float> m_z1, m_z2;
+			std::vector<size_t> m_nStagePerChannel;
+
+			std::vector<float> m_row; // padded copy of one sample
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,262 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIFrameDecoder.h"
+
+#include <algorithm>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define MARKER_CODE_MASK       0x0F // low nibble of the last status byte
+#define SYNC_SEQUENCED_COUNT   2    // sample frames with a valid check and consecutive sequence numbers to lock on a candidate
+#define SYNC_LEGACY_COUNT      3    // sample frames with zero status bytes to lock on a candidate, older firmware
+#define SYNC_MISS_COUNT        2    // consecutive frames failing their check to give the lock up
+#define SYNC_AUX_COUNT         2    // auxiliary frames allowed between the sample frames confirming a candidate
+#define SYNC_CONFIRM_COUNT     16   // frames a lock must hold not to count as a false lock
+#define SYNC_COMPACT_SIZE      4096 // bytes consumed before they are removed from the buffer
+
+uint8_t CModularBCIFrameDecoder::getFrameCheck(const uint8_t* frame, const size_t size)
+{
+	// CRC of each nibble from the CRC so far XORed into it, the bitwise loop would cost a few ns per byte of search
+	static const uint8_t TABLE[16] = { 0x0, 0x3, 0x6, 0x5, 0xC, 0xF, 0xA, 0x9, 0xB, 0x8, 0xD, 0xE, 0x7, 0x4, 0x1, 0x2 };
+	uint8_t crc        = 0;
+	const auto process = [&crc](const uint8_t byte)
+	{
+		crc = TABLE[crc ^ (byte >> 4)];
+		crc = TABLE[crc ^ (byte & 0x0F)];
+	};
+	process(frame[1]);
+	process(frame[2] & MARKER_CODE_MASK);
+	for (size_t i = SAMPLE_FRAME_HEADER_SIZE; i < size; ++i) { process(frame[i]); }
+	return crc;
+}
+
+void CModularBCIFrameDecoder::initialize(const size_t nValue)
+{
+	m_buffer.clear();
+	m_position  = 0;
+	m_base      = 0;
+	m_frameSize = SAMPLE_FRAME_HEADER_SIZE + 3 * nValue;
+	m_codes.assign(nValue, 0);
+	m_marker = 0;
+	m_gap    = 0;
+	m_auxPayload.clear();
+	m_auxPayload.reserve(255);
+
+	m_isLocked     = false;
+	m_isSequenced  = false;
+	m_sequence     = 0;
+	m_nMiss        = 0;
+	m_missPosition = 0;
+	m_nLockedFrame = 0;
+	m_searchStart  = 0;
+
+	m_nSample           = 0;
+	m_nSkippedByte      = 0;
+	m_nSyncLoss         = 0;
+	m_nLock             = 0;
+	m_nFalseLock        = 0;
+	m_nCorruptedFrame   = 0;
+	m_nLostFrame        = 0;
+	m_nAuxChecksumError = 0;
+	m_lastLockBytes     = 0;
+	m_maxLockBytes      = 0;
+}
+
+void CModularBCIFrameDecoder::push(const uint8_t* bytes, const size_t size)
+{
+	this->compact();
+	m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+void CModularBCIFrameDecoder::compact()
+{
+	// the bytes from the first frame failing its check are kept, the search restarts there if the lock is given up
+	const size_t keep = m_nMiss != 0 ? std::min(m_position, m_missPosition) : m_position;
+	if (keep < SYNC_COMPACT_SIZE) { return; }
+	m_buffer.erase(m_buffer.begin(), m_buffer.begin() + keep);
+	m_position -= keep;
+	m_missPosition -= std::min(m_missPosition, keep);
+	m_base += keep;
+}
+
+int CModularBCIFrameDecoder::checkUnit(const size_t position, size_t& length) const
+{
+	if (position >= m_buffer.size()) { return Unit_Incomplete; }
+	const size_t available = m_buffer.size() - position;
+	const uint8_t* unit = &m_buffer[position];
+
+	if (unit[0] == SAMPLE_FRAME_START)
+	{
+		length = m_frameSize;
+		if (available < m_frameSize) { return Unit_Incomplete; }
+		int res = Unit_Invalid;
+		if (unit[1] == 0 && (unit[2] & ~MARKER_CODE_MASK) == 0) { res |= Unit_Legacy; }
+		if ((unit[2] >> 4) == getFrameCheck(unit, m_frameSize)) { res |= Unit_Sequenced; }
+		return res;
+	}
+	if (unit[0] == AUX_FRAME_START)
+	{
+		if (available < 3) { return Unit_Incomplete; }
+		length = size_t(4) + unit[2];
+		if (available < length) { return Unit_Incomplete; }
+		uint8_t checksum = 0;
+		for (size_t i = 1; i + 1 < length; ++i) { checksum ^= unit[i]; }
+		return checksum == unit[length - 1] ? Unit_Aux : Unit_Invalid;
+	}
+	length = 1;
+	return Unit_Invalid;
+}
+
+int CModularBCIFrameDecoder::tryLock(const size_t position, const bool isSequenced, size_t& end) const
+{
+	// the start bytes and the sequence numbers of the chain first, they rule most candidates out without a check computed
+	const size_t nNeeded = isSequenced ? SYNC_SEQUENCED_COUNT : SYNC_LEGACY_COUNT;
+	size_t samples[SYNC_LEGACY_COUNT > SYNC_SEQUENCED_COUNT ? SYNC_LEGACY_COUNT : SYNC_SEQUENCED_COUNT];
+	size_t nSample = 0, nAux = 0;
+	bool isComplete = true;
+	for (end = position; nSample < nNeeded;)
+	{
+		if (end >= m_buffer.size() || m_buffer[end] == AUX_FRAME_START)
+		{
+			size_t length  = 0;
+			const int unit = this->checkUnit(end, length);
+			if (unit & Unit_Incomplete)
+			{
+				isComplete = false;
+				break;
+			}
+			// bounded, so that a run of auxiliary frames does not keep the search waiting on an ever longer chain
+			if (!(unit & Unit_Aux) || ++nAux > SYNC_AUX_COUNT) { return Unit_Invalid; }
+			end += length;
+			continue;
+		}
+		if (m_buffer[end] != SAMPLE_FRAME_START) { return Unit_Invalid; }
+		if (end + SAMPLE_FRAME_HEADER_SIZE > m_buffer.size())
+		{
+			isComplete = false;
+			break;
+		}
+		if (isSequenced && nSample != 0 && m_buffer[end + 1] != uint8_t(m_buffer[samples[nSample - 1] + 1] + 1)) { return Unit_Invalid; }
+		if (!isSequenced && (m_buffer[end + 1] != 0 || (m_buffer[end + 2] & ~MARKER_CODE_MASK) != 0)) { return Unit_Invalid; }
+		samples[nSample++] = end;
+		end += m_frameSize;
+	}
+
+	// then the checks of the complete frames
+	const int format = isSequenced ? Unit_Sequenced : Unit_Legacy;
+	for (size_t i = 0; i < nSample && samples[i] + m_frameSize <= m_buffer.size(); ++i)
+	{
+		size_t length = 0;
+		if (!(this->checkUnit(samples[i], length) & format)) { return Unit_Invalid; }
+	}
+	return isComplete ? format : int(Unit_Incomplete);
+}
+
+void CModularBCIFrameDecoder::decodeSample(const size_t position)
+{
+	const uint8_t* frame = &m_buffer[position];
+	m_marker             = frame[2] & MARKER_CODE_MASK;
+	for (size_t i = 0; i < m_codes.size(); ++i)
+	{
+		const uint8_t* value = frame + SAMPLE_FRAME_HEADER_SIZE + 3 * i;
+		const uint32_t code  = uint32_t(value[0]) << 16 | uint32_t(value[1]) << 8 | value[2];
+		m_codes[i]           = int32_t(code << 8) >> 8; // sign extension of the 24 bits
+	}
+	m_nSample++;
+}
+
+CModularBCIFrameDecoder::EEvent CModularBCIFrameDecoder::next()
+{
+	while (true)
+	{
+		if (!m_isLocked && !this->search()) { return Event_None; }
+
+		size_t length  = 0;
+		const int unit = this->checkUnit(m_position, length);
+		if (unit & Unit_Incomplete) { return Event_None; }
+
+		if (unit & (Unit_Aux | (m_isSequenced ? Unit_Sequenced : Unit_Legacy)))
+		{
+			// frames dropped before this one were corrupted, the boundary was right
+			m_nCorruptedFrame += m_nMiss;
+			m_nMiss = 0;
+			m_nLockedFrame++;
+			const size_t position = m_position;
+			m_position += length;
+			if (unit & Unit_Aux)
+			{
+				m_auxType = m_buffer[position + 1];
+				m_auxPayload.assign(m_buffer.begin() + position + 3, m_buffer.begin() + position + length - 1);
+				return Event_AuxFrame;
+			}
+			m_gap = 0;
+			if (m_isSequenced)
+			{
+				m_gap = uint8_t(m_buffer[position + 1] - m_sequence);
+				m_nLostFrame += m_gap;
+				m_sequence = uint8_t(m_buffer[position + 1] + 1);
+			}
+			this->decodeSample(position);
+			return Event_Sample;
+		}
+
+		if (m_buffer[m_position] == AUX_FRAME_START && length > 1) { m_nAuxChecksumError++; }
+		if (m_nMiss++ == 0) { m_missPosition = m_position; }
+		if (m_nMiss < SYNC_MISS_COUNT)
+		{
+			// most likely a sample frame with corrupted bytes, the next frame tells
+			m_position += m_frameSize;
+			continue;
+		}
+
+		// the boundary is wrong, the search restarts right after the start of the first frame missed
+		if (m_nLockedFrame < SYNC_CONFIRM_COUNT) { m_nFalseLock++; }
+		m_nSyncLoss++;
+		m_nSkippedByte++;
+		m_isLocked    = false;
+		m_nMiss       = 0;
+		m_position    = m_missPosition + 1;
+		m_searchStart = m_base + m_missPosition;
+	}
+}
+
+bool CModularBCIFrameDecoder::search()
+{
+	// candidates are frame starts confirmed by the frames after them, the newer format first as it is the stricter,
+	// and only the newer format once seen, the zero status bytes of older firmware being easier to find in the values
+	for (; m_position < m_buffer.size(); ++m_position, ++m_nSkippedByte)
+	{
+		const uint8_t byte = m_buffer[m_position];
+		if (byte != SAMPLE_FRAME_START && byte != AUX_FRAME_START) { continue; }
+
+		size_t end          = 0;
+		const int sequenced = this->tryLock(m_position, true, end);
+		const int legacy    = sequenced == Unit_Sequenced || m_isSequenced ? int(Unit_Invalid) : this->tryLock(m_position, false, end);
+		if (sequenced == Unit_Sequenced || legacy == Unit_Legacy)
+		{
+			m_isLocked      = true;
+			m_isSequenced   = sequenced == Unit_Sequenced;
+			m_nMiss         = 0;
+			m_nLockedFrame  = 0;
+			m_lastLockBytes = m_base + end - m_searchStart;
+			m_maxLockBytes  = std::max(m_maxLockBytes, m_lastLockBytes);
+			m_nLock++;
+
+			// the sequence number of the first sample frame, an auxiliary frame may come before it
+			for (size_t i = m_position, length = 0; i < end; i += length)
+			{
+				if (this->checkUnit(i, length) & Unit_Aux) { continue; }
+				m_sequence = m_buffer[i + 1];
+				break;
+			}
+			return true;
+		}
+		if (sequenced == Unit_Incomplete || legacy == Unit_Incomplete) { return false; } // the frames after it are not there yet
+	}
+	return false;
+}
@@ -0,0 +1,135 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// sample frames: SAMPLE_FRAME_START, status byte 1, status byte 2, then 24 bits big endian per enabled channel
+// status byte 1 is the data ready sequence number and the high nibble of status byte 2 the frame check (0 and 0 for older firmware),
+// the low nibble of status byte 2 is the marker
+#define SAMPLE_FRAME_START       192
+#define SAMPLE_FRAME_HEADER_SIZE 3 // bytes before the values
+
+// auxiliary frames: AUX_FRAME_START, type, payload size, payload, XOR of the type, size and payload bytes
+#define AUX_FRAME_START         0xA5
+#define AUX_FRAME_LATENCY_PROBE 1
+#define AUX_FRAME_IMPEDANCE     2 // channel, then the amplitude of the lead-off excitation in ADC codes, 32 bits little endian
+#define AUX_FRAME_SELF_TEST     3 // channel, result flags, test signal amplitude in ADC codes (32 bits), its frequency in mHz and the noise in ADC codes (16 bits)
+#define AUX_FRAME_COMMAND_REPLY 4 // command, then COMMAND_ACCEPTED or COMMAND_REJECTED
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIFrameDecoder
+		 * \brief Decodes the byte stream of one board into sample and auxiliary frames
+		 *
+		 * Bytes are pushed as they come from the serial port and the complete frames are taken out
+		 * one at a time. The decoder only trusts a frame boundary that the next frames confirm: it
+		 * locks on a candidate once the following sample frames are valid too, two frames with a
+		 * valid check and consecutive sequence numbers, or three with the zero status bytes of older
+		 * firmware, so that a 192, 0, 0 inside the EEG values can not pass for a header. Once
+		 * locked, a frame failing its check is dropped as corrupted, and the lock is only given up
+		 * when the next frame fails as well, the search then restarting right after the last frame
+		 * boundary known to be good. The bytes pushed are kept until then, so a resynchronization
+		 * costs the corrupted frame and the lookahead of the next lock, a couple of frames. A
+		 * decoder keeps no reference to the driver, so every board of a multi-board acquisition has
+		 * its own.
+		 */
+		class CModularBCIFrameDecoder final
+		{
+		public:
+
+			enum EEvent
+			{
+				Event_None,     // more bytes are needed
+				Event_Sample,   // a sample frame, see getCodes() and getMarker()
+				Event_AuxFrame  // an auxiliary frame with a valid checksum, see getAuxType() and getAuxPayload()
+			};
+
+			void initialize(size_t nValue); // EEG values of a sample frame, the enabled channels
+			void push(const uint8_t* bytes, size_t size);
+			EEvent next(); // the next frame of the bytes pushed, to call until Event_None
+
+			size_t getValueCount() const { return m_codes.size(); }
+			size_t getFrameSize() const { return m_frameSize; }
+			size_t getBufferSize() const { return m_buffer.size(); } // bytes kept, pushed but not consumed yet or kept for a resynchronization
+			const int32_t* getCodes() const { return m_codes.data(); } // ADC codes of the last sample
+			uint8_t getMarker() const { return m_marker; }             // marker the board latched on the last sample, 0 if none
+			uint8_t getGap() const { return m_gap; }                   // frames lost right before the last sample, from its sequence number
+			uint8_t getAuxType() const { return m_auxType; }
+			const std::vector<uint8_t>& getAuxPayload() const { return m_auxPayload; }
+
+			bool isLocked() const { return m_isLocked; }
+			bool isSequenced() const { return m_isSequenced; } // the frames carry a sequence number and a check
+
+			uint64_t getSampleCount() const { return m_nSample; }
+			uint64_t getSkippedByteCount() const { return m_nSkippedByte; }
+			uint64_t getSyncLossCount() const { return m_nSyncLoss; }         // locks given up
+			uint64_t getLockCount() const { return m_nLock; }
+			uint64_t getFalseLockCount() const { return m_nFalseLock; }       // locks given up a few frames after being taken
+			uint64_t getCorruptedFrameCount() const { return m_nCorruptedFrame; } // dropped without losing the lock
+			uint64_t getLostFrameCount() const { return m_nLostFrame; }       // gaps in the sequence numbers, corrupted frames included
+			uint64_t getAuxChecksumErrorCount() const { return m_nAuxChecksumError; }
+			uint64_t getLastLockByteCount() const { return m_lastLockBytes; } // bytes from the loss of the lock (or the start) to the last lock
+			uint64_t getMaxLockByteCount() const { return m_maxLockBytes; }
+
+			// 4 bit check of a sample frame: CRC-4 (x^4 + x + 1, MSB first, initial value 0) of status byte 1, the marker nibble and the values
+			static uint8_t getFrameCheck(const uint8_t* frame, size_t size);
+
+		protected:
+
+			enum
+			{
+				Unit_Invalid    = 0,
+				Unit_Legacy     = 1, // sample frame with the zero status bytes of older firmware
+				Unit_Sequenced  = 2, // sample frame with a valid check
+				Unit_Aux        = 4, // auxiliary frame with a valid checksum
+				Unit_Incomplete = 8
+			};
+
+			int checkUnit(size_t position, size_t& length) const; // Unit_ flags of the frame at the buffer position
+			int tryLock(size_t position, bool isSequenced, size_t& end) const; // Unit_Sequenced or Unit_Legacy when the frames confirm the candidate
+			bool search(); // moves to the next candidate the frames after it confirm, false when more bytes are needed
+			void decodeSample(size_t position);
+			void compact();
+
+			std::vector<uint8_t> m_buffer;
+			size_t m_position  = 0; // of the next frame, or of the next candidate while searching
+			uint64_t m_base    = 0; // stream offset of the first byte of the buffer
+			size_t m_frameSize = 0;
+
+			std::vector<int32_t> m_codes;
+			uint8_t m_marker  = 0;
+			uint8_t m_gap     = 0;
+			uint8_t m_auxType = 0;
+			std::vector<uint8_t> m_auxPayload;
+
+			bool m_isLocked         = false;
+			bool m_isSequenced      = false;
+			uint8_t m_sequence      = 0;  // expected in the next sample frame
+			uint32_t m_nMiss        = 0;  // consecutive frames failing their check
+			size_t m_missPosition   = 0;  // of the first of them
+			uint64_t m_nLockedFrame = 0;  // frames since the lock
+			uint64_t m_searchStart  = 0;  // stream offset the search started at
+
+			uint64_t m_nSample           = 0;
+			uint64_t m_nSkippedByte      = 0;
+			uint64_t m_nSyncLoss         = 0;
+			uint64_t m_nLock             = 0;
+			uint64_t m_nFalseLock        = 0;
+			uint64_t m_nCorruptedFrame   = 0;
+			uint64_t m_nLostFrame        = 0;
+			uint64_t m_nAuxChecksumError = 0;
+			uint64_t m_lastLockBytes     = 0;
+			uint64_t m_maxLockBytes      = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
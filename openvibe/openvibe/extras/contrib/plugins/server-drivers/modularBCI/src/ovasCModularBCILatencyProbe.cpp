@@ -0,0 +1,196 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCILatencyProbe.h"
+
+#include <algorithm>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define LATENCY_PROBE_TIMEOUT     1000000 // in us, a probe not answered by then is given up
+#define LATENCY_BIN_WIDTH         10      // in us
+#define LATENCY_BIN_COUNT         10000   // the last bin gathers everything above 100 ms
+#define LATENCY_CLOCK_GROUP_SIZE  8       // probes the fastest one is taken from for the clock fit
+#define LATENCY_CLOCK_GROUP_COUNT 8       // groups the clock offset and drift are fitted on
+
+void CModularBCILatencyProbe::initialize()
+{
+	std::fill(m_isPending, m_isPending + LATENCY_PROBE_TAG_COUNT, false);
+	m_lastSendTime    = 0;
+	m_lastTag         = 0;
+	m_firmwareTime    = 0;
+	m_hasFirmwareTime = false;
+	m_clockSamples.clear();
+	m_clockSamples.reserve(LATENCY_CLOCK_GROUP_SIZE * LATENCY_CLOCK_GROUP_COUNT + 1);
+	for (auto& histogram : m_histograms)
+	{
+		histogram.bins.assign(LATENCY_BIN_COUNT, 0);
+		histogram.count = 0;
+		histogram.total = 0;
+		histogram.max   = 0;
+	}
+	m_nSent      = 0;
+	m_nReply     = 0;
+	m_nUnmatched = 0;
+}
+
+bool CModularBCILatencyProbe::isWaiting(const uint64_t time) const
+{
+	return m_isPending[m_lastTag] && time - m_lastSendTime < LATENCY_PROBE_TIMEOUT;
+}
+
+uint8_t CModularBCILatencyProbe::prepare(const uint64_t time)
+{
+	// the firmware keeps a single probe, so an outstanding one is lost by now
+	m_isPending[m_lastTag] = false;
+
+	const uint8_t tag  = uint8_t(m_nSent % LATENCY_PROBE_TAG_COUNT);
+	m_sendTimes[tag]   = time;
+	m_writeTimes[tag]  = time;
+	m_isPending[tag]   = true;
+	m_lastTag          = tag;
+	m_lastSendTime     = time;
+	m_nSent++;
+	return tag;
+}
+
+void CModularBCILatencyProbe::setWritten(const uint8_t tag, const uint64_t time) { m_writeTimes[tag % LATENCY_PROBE_TAG_COUNT] = time; }
+
+bool CModularBCILatencyProbe::onReply(const latency_probe_reply_t& reply, const uint64_t time)
+{
+	const uint8_t tag = reply.tag % LATENCY_PROBE_TAG_COUNT;
+	if (!m_isPending[tag] || time < m_sendTimes[tag])
+	{
+		m_nUnmatched++;
+		return false;
+	}
+	m_isPending[tag] = false;
+	m_nReply++;
+
+	const uint64_t sendTime     = m_sendTimes[tag];
+	const int64_t firmwareRx    = int64_t(this->unwrap(reply.receiveTime));
+	const int64_t firmwareDrdy  = int64_t(this->unwrap(reply.drdyTime));
+	const int64_t firmwareTx    = int64_t(this->unwrap(reply.sendTime));
+	const int64_t roundTrip     = int64_t(time - sendTime);
+	const int64_t residence     = firmwareTx - firmwareRx;
+	const double offset         = 0.5 * double((firmwareRx - int64_t(sendTime)) + (firmwareTx - int64_t(time)));
+
+	m_clockSamples.push_back({ sendTime + uint64_t(roundTrip / 2), offset, uint64_t(std::max<int64_t>(roundTrip - residence, 0)) });
+	if (m_clockSamples.size() > LATENCY_CLOCK_GROUP_SIZE * LATENCY_CLOCK_GROUP_COUNT) { m_clockSamples.erase(m_clockSamples.begin()); }
+	const double fitted = this->getOffset();
+
+	this->add(Stage_RoundTrip, roundTrip);
+	this->add(Stage_HostWrite, int64_t(m_writeTimes[tag] - sendTime));
+	this->add(Stage_Uplink, int64_t(double(firmwareRx) - fitted) - int64_t(sendTime));
+	this->add(Stage_FirmwareWait, residence);
+	this->add(Stage_Downlink, int64_t(time) - int64_t(double(firmwareTx) - fitted));
+	this->add(Stage_DataReady, int64_t(time) - int64_t(double(firmwareDrdy) - fitted));
+	return true;
+}
+
+bool CModularBCILatencyProbe::parseReply(const uint8_t* payload, const size_t size, latency_probe_reply_t& reply)
+{
+	// tag, then the three times little endian
+	if (size != 13) { return false; }
+	const auto readUInt32 = [payload](const size_t i)
+	{
+		return uint32_t(payload[i]) | uint32_t(payload[i + 1]) << 8 | uint32_t(payload[i + 2]) << 16 | uint32_t(payload[i + 3]) << 24;
+	};
+	reply = { payload[0], readUInt32(1), readUInt32(5), readUInt32(9) };
+	return true;
+}
+
+uint64_t CModularBCILatencyProbe::unwrap(const uint32_t firmwareTime)
+{
+	if (!m_hasFirmwareTime)
+	{
+		m_firmwareTime    = firmwareTime;
+		m_hasFirmwareTime = true;
+	}
+	else { m_firmwareTime += uint64_t(int64_t(int32_t(firmwareTime - uint32_t(m_firmwareTime)))); }
+	return m_firmwareTime;
+}
+
+double CModularBCILatencyProbe::getOffset() const
+{
+	// fastest probe of each group, newest group first
+	std::vector<std::pair<double, double>> points;
+	const uint64_t origin = m_clockSamples.back().hostTime;
+	for (size_t end = m_clockSamples.size(); end != 0;)
+	{
+		const size_t begin = end > LATENCY_CLOCK_GROUP_SIZE ? end - LATENCY_CLOCK_GROUP_SIZE : 0;
+		const auto fastest = std::min_element(m_clockSamples.begin() + begin, m_clockSamples.begin() + end,
+											  [](const clock_sample_t& a, const clock_sample_t& b) { return a.transport < b.transport; });
+		points.emplace_back(double(int64_t(fastest->hostTime - origin)), fastest->offset);
+		end = begin;
+	}
+	if (points.size() == 1) { return points[0].second; }
+
+	// least squares line through them, evaluated at the newest probe
+	double meanX = 0, meanY = 0;
+	for (const auto& point : points)
+	{
+		meanX += point.first;
+		meanY += point.second;
+	}
+	meanX /= double(points.size());
+	meanY /= double(points.size());
+	double sxx = 0, sxy = 0;
+	for (const auto& point : points)
+	{
+		sxx += (point.first - meanX) * (point.first - meanX);
+		sxy += (point.first - meanX) * (point.second - meanY);
+	}
+	return sxx > 0 ? meanY - sxy / sxx * meanX : meanY;
+}
+
+void CModularBCILatencyProbe::add(const EStage stage, const int64_t delay)
+{
+	// a one-way delay can come out slightly negative from the clock fit
+	const uint64_t value   = uint64_t(std::max<int64_t>(delay, 0));
+	histogram_t& histogram = m_histograms[stage];
+	histogram.bins[std::min<size_t>(size_t(value / LATENCY_BIN_WIDTH), LATENCY_BIN_COUNT - 1)]++;
+	histogram.count++;
+	histogram.total += double(value);
+	histogram.max = std::max(histogram.max, value);
+}
+
+double CModularBCILatencyProbe::getMean(const EStage stage) const
+{
+	const histogram_t& histogram = m_histograms[stage];
+	return histogram.count == 0 ? 0 : histogram.total / double(histogram.count) / 1000000;
+}
+
+double CModularBCILatencyProbe::getMax(const EStage stage) const { return double(m_histograms[stage].max) / 1000000; }
+
+double CModularBCILatencyProbe::getPercentile(const EStage stage, const double percentile) const
+{
+	const histogram_t& histogram = m_histograms[stage];
+	if (histogram.count == 0) { return 0; }
+	const uint64_t rank = uint64_t(std::max(1.0, percentile / 100 * double(histogram.count) + 0.5));
+	uint64_t count      = 0;
+	for (size_t i = 0; i < histogram.bins.size(); ++i)
+	{
+		count += histogram.bins[i];
+		if (count >= rank) { return std::min(double((i + 1) * LATENCY_BIN_WIDTH), double(histogram.max)) / 1000000; }
+	}
+	return double(histogram.max) / 1000000;
+}
+
+const char* CModularBCILatencyProbe::getStageName(const EStage stage)
+{
+	switch (stage)
+	{
+		case Stage_RoundTrip: return "round trip";
+		case Stage_HostWrite: return "host write";
+		case Stage_Uplink: return "uplink";
+		case Stage_FirmwareWait: return "firmware wait";
+		case Stage_Downlink: return "downlink";
+		case Stage_DataReady: return "data ready to decoded";
+		default: return "";
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define LATENCY_PROBE_COMMAND   'p' // command of the firmware, its argument is the tag
+#define LATENCY_PROBE_TAG_COUNT 64  // tags cycled through, far more than the probes sent within the timeout
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		// what the firmware answers a probe with, its times are in us of its own clock and wrap after 71 minutes
+		typedef struct
+		{
+			uint8_t tag;
+			uint32_t receiveTime; // the probe command frame was received
+			uint32_t drdyTime;    // data ready of the frame the reply follows
+			uint32_t sendTime;    // the reply started, right after that frame
+		} latency_probe_reply_t;
+
+		/**
+		 * \class CModularBCILatencyProbe
+		 * \brief Measures the delays between the host and the firmware with tagged pings
+		 *
+		 * The driver sends a probe from its acquisition loop. The firmware timestamps its
+		 * reception and answers right after its next frame with the data ready time of that frame,
+		 * and the driver matches the answer by tag when it decodes it. The round trip and the
+		 * firmware stages are exact. The one-way delays need the offset between the two clocks,
+		 * which drift apart (the board runs from its internal oscillator): it is fitted as a line
+		 * through the offsets of the fastest probes of successive groups, the fastest probes being
+		 * the least delayed by queues in both directions and so the most symmetric.
+		 */
+		class CModularBCILatencyProbe final
+		{
+		public:
+
+			enum EStage
+			{
+				Stage_RoundTrip,    // probe written to reply decoded
+				Stage_HostWrite,    // write system call
+				Stage_Uplink,       // probe written to received by the firmware: tty, USB bridge, UART
+				Stage_FirmwareWait, // probe received to reply sent: waiting for the next frame and sending it
+				Stage_Downlink,     // reply sent to decoded: UART, USB bridge latency timer, tty, acquisition loop scheduling
+				Stage_DataReady,    // data ready of a frame to its decoding, the acquisition latency of the samples
+				Stage_Count
+			};
+
+			void initialize();
+			bool isWaiting(uint64_t time) const; // a probe is outstanding and not timed out yet
+
+			// tag of a new probe about to be written at time, then its write duration once written
+			uint8_t prepare(uint64_t time);
+			void setWritten(uint8_t tag, uint64_t time);
+			bool onReply(const latency_probe_reply_t& reply, uint64_t time); // time the reply reached the host, false if it matches no probe
+
+			// the reply in the payload of an auxiliary frame of the latency probe type, false if the payload is not one
+			static bool parseReply(const uint8_t* payload, size_t size, latency_probe_reply_t& reply);
+
+			uint64_t getSentCount() const { return m_nSent; }
+			uint64_t getReplyCount() const { return m_nReply; }
+			uint64_t getUnmatchedCount() const { return m_nUnmatched; }
+			double getMean(EStage stage) const;                       // in s
+			double getMax(EStage stage) const;                        // in s
+			double getPercentile(EStage stage, double percentile) const; // in s, from a histogram of 10 us bins
+			static const char* getStageName(EStage stage);
+
+		protected:
+
+			typedef struct
+			{
+				uint64_t hostTime; // middle of the round trip
+				double offset;     // firmware minus host clock, in us
+				uint64_t transport;
+			} clock_sample_t;
+
+			typedef struct
+			{
+				std::vector<uint32_t> bins;
+				uint64_t count = 0;
+				double total   = 0;
+				uint64_t max   = 0;
+			} histogram_t;
+
+			uint64_t unwrap(uint32_t firmwareTime); // extends a firmware time to 64 bits
+			double getOffset() const;               // at m_clockSamples.back().hostTime
+			void add(EStage stage, int64_t delay);
+
+			uint64_t m_sendTimes[LATENCY_PROBE_TAG_COUNT]  = {};
+			uint64_t m_writeTimes[LATENCY_PROBE_TAG_COUNT] = {};
+			bool m_isPending[LATENCY_PROBE_TAG_COUNT]      = {};
+			uint64_t m_lastSendTime                       = 0;
+			uint8_t m_lastTag                              = 0;
+
+			uint64_t m_firmwareTime = 0; // last firmware time received, extended
+			bool m_hasFirmwareTime  = false;
+			std::vector<clock_sample_t> m_clockSamples; // last probes, oldest first
+
+			histogram_t m_histograms[Stage_Count];
+			uint64_t m_nSent      = 0;
+			uint64_t m_nReply     = 0;
+			uint64_t m_nUnmatched = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
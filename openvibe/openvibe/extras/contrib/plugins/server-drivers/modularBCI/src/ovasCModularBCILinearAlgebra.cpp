@@ -0,0 +1,174 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCILinearAlgebra.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+bool ModularBCILinearAlgebra::cholesky(std::vector<double>& a, const size_t n)
+{
+	for (size_t j = 0; j < n; ++j)
+	{
+		double diagonal = a[j * n + j];
+		for (size_t k = 0; k < j; ++k) { diagonal -= a[j * n + k] * a[j * n + k]; }
+		if (diagonal <= 0) { return false; }
+		diagonal     = std::sqrt(diagonal);
+		a[j * n + j] = diagonal;
+
+		for (size_t i = j + 1; i < n; ++i)
+		{
+			double value = a[i * n + j];
+			for (size_t k = 0; k < j; ++k) { value -= a[i * n + k] * a[j * n + k]; }
+			a[i * n + j] = value / diagonal;
+		}
+		for (size_t i = j + 1; i < n; ++i) { a[j * n + i] = 0; }
+	}
+	return true;
+}
+
+void ModularBCILinearAlgebra::lowerSolve(const std::vector<double>& l, const size_t n, double* b)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		double value = b[i];
+		for (size_t k = 0; k < i; ++k) { value -= l[i * n + k] * b[k]; }
+		b[i] = value / l[i * n + i];
+	}
+}
+
+void ModularBCILinearAlgebra::choleskySolve(const std::vector<double>& l, const size_t n, double* b)
+{
+	lowerSolve(l, n, b);
+	for (size_t i = n; i-- > 0;)
+	{
+		double value = b[i];
+		for (size_t k = i + 1; k < n; ++k) { value -= l[k * n + i] * b[k]; }
+		b[i] = value / l[i * n + i];
+	}
+}
+
+namespace
+{
+	// cyclic Jacobi rotations until a is diagonal, accumulated into v (n x n, may be nullptr)
+	void jacobi(std::vector<double>& a, const size_t n, double* v)
+	{
+		for (size_t sweep = 0; sweep < 100; ++sweep)
+		{
+			double offDiagonal = 0, total = 0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				for (size_t j = 0; j < n; ++j)
+				{
+					total += a[i * n + j] * a[i * n + j];
+					if (i != j) { offDiagonal += a[i * n + j] * a[i * n + j]; }
+				}
+			}
+			if (offDiagonal <= 1e-24 * total) { return; }
+
+			for (size_t p = 0; p < n; ++p)
+			{
+				for (size_t q = p + 1; q < n; ++q)
+				{
+					const double apq = a[p * n + q];
+					if (std::fabs(apq) < 1e-300) { continue; }
+
+					// rotation that zeroes a[p][q]
+					const double theta = (a[q * n + q] - a[p * n + p]) / (2 * apq);
+					const double t     = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+					const double c     = 1 / std::sqrt(t * t + 1);
+					const double s     = t * c;
+
+					for (size_t k = 0; k < n; ++k)
+					{
+						const double akp = a[k * n + p], akq = a[k * n + q];
+						a[k * n + p]     = c * akp - s * akq;
+						a[k * n + q]     = s * akp + c * akq;
+					}
+					for (size_t k = 0; k < n; ++k)
+					{
+						const double apk = a[p * n + k], aqk = a[q * n + k];
+						a[p * n + k]     = c * apk - s * aqk;
+						a[q * n + k]     = s * apk + c * aqk;
+					}
+					if (v == nullptr) { continue; }
+					for (size_t k = 0; k < n; ++k)
+					{
+						const double vkp = v[k * n + p], vkq = v[k * n + q];
+						v[k * n + p]     = c * vkp - s * vkq;
+						v[k * n + q]     = s * vkp + c * vkq;
+					}
+				}
+			}
+		}
+	}
+}  // namespace
+
+void ModularBCILinearAlgebra::symmetricEigen(std::vector<double> a, const size_t n, std::vector<double>& values, std::vector<double>& vectors)
+{
+	std::vector<double> v(n * n, 0);
+	for (size_t i = 0; i < n; ++i) { v[i * n + i] = 1; }
+	jacobi(a, n, &v[0]);
+
+	std::vector<size_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](const size_t i, const size_t j) { return a[i * n + i] > a[j * n + j]; });
+
+	values.resize(n);
+	vectors.resize(n * n);
+	for (size_t j = 0; j < n; ++j)
+	{
+		values[j] = a[order[j] * n + order[j]];
+		for (size_t i = 0; i < n; ++i) { vectors[i * n + j] = v[i * n + order[j]]; }
+	}
+}
+
+double ModularBCILinearAlgebra::largestEigenvalue(std::vector<double>& a, const size_t n)
+{
+	jacobi(a, n, nullptr);
+	double res = a[0];
+	for (size_t i = 1; i < n; ++i) { res = std::max(res, a[i * n + i]); }
+	return res;
+}
+
+bool ModularBCILinearAlgebra::generalizedEigen(const std::vector<double>& a, const std::vector<double>& b, const size_t n, std::vector<double>& values,
+											   std::vector<double>& vectors)
+{
+	// b = L L^T, then L^-1 a L^-T y = lambda y and x = L^-T y
+	std::vector<double> l = b;
+	if (!cholesky(l, n)) { return false; }
+
+	std::vector<double> c(a), column(n);
+	for (size_t j = 0; j < n; ++j)
+	{
+		for (size_t i = 0; i < n; ++i) { column[i] = c[i * n + j]; }
+		lowerSolve(l, n, &column[0]);
+		for (size_t i = 0; i < n; ++i) { c[i * n + j] = column[i]; }
+	}
+	for (size_t i = 0; i < n; ++i) { lowerSolve(l, n, &c[i * n]); }
+	for (size_t i = 0; i < n; ++i) { for (size_t j = 0; j < i; ++j) { c[i * n + j] = c[j * n + i] = (c[i * n + j] + c[j * n + i]) / 2; } }
+
+	std::vector<double> y;
+	symmetricEigen(c, n, values, y);
+
+	vectors.resize(n * n);
+	for (size_t j = 0; j < n; ++j)
+	{
+		for (size_t i = 0; i < n; ++i) { column[i] = y[i * n + j]; }
+		for (size_t i = n; i-- > 0;)
+		{
+			double value = column[i];
+			for (size_t k = i + 1; k < n; ++k) { value -= l[k * n + i] * column[k]; }
+			column[i] = value / l[i * n + i];
+		}
+		for (size_t i = 0; i < n; ++i) { vectors[i * n + j] = column[i]; }
+	}
+	return true;
+}
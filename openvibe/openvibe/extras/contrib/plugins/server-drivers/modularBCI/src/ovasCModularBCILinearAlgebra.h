@@ -0,0 +1,43 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * Small dense linear algebra used by the decoders and their training tools. Matrices are
+		 * square, row-major std::vector<double> of n * n values. The functions that take output
+		 * vectors resize them, so the online paths pass vectors that already have the right size
+		 * and nothing gets allocated.
+		 */
+		namespace ModularBCILinearAlgebra
+		{
+			// in place Cholesky factorization a = L L^T, L in the lower triangle (the upper triangle is zeroed), false if not positive definite
+			bool cholesky(std::vector<double>& a, size_t n);
+
+			// solves L L^T x = b in place, l from cholesky()
+			void choleskySolve(const std::vector<double>& l, size_t n, double* b);
+
+			// solves L y = b in place (forward substitution)
+			void lowerSolve(const std::vector<double>& l, size_t n, double* b);
+
+			// eigen decomposition of a symmetric matrix by cyclic Jacobi rotations, eigenvalues in decreasing order, eigenvectors as columns
+			void symmetricEigen(std::vector<double> a, size_t n, std::vector<double>& values, std::vector<double>& vectors);
+
+			// largest eigenvalue of a symmetric matrix, a is overwritten (no allocation)
+			double largestEigenvalue(std::vector<double>& a, size_t n);
+
+			// solves a x = lambda b x for symmetric a and symmetric positive definite b, x normalized so that x^T b x = 1
+			bool generalizedEigen(const std::vector<double>& a, const std::vector<double>& b, size_t n, std::vector<double>& values, std::vector<double>& vectors);
+		}  // namespace ModularBCILinearAlgebra
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,77 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCILinkPlanner.h"
+
+#include <algorithm>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define LINK_STATUS_SIZE     3    // status word of every frame
+#define LINK_VALUE_SIZE      3    // 24 bits per channel
+#define LINK_BITS_PER_BYTE   10   // start, 8 data and stop bits
+#define LINK_MAX_UTILIZATION 0.9  // the rest is left to the auxiliary frames and the clock tolerance of both UARTs
+
+const std::vector<uint32_t>& CModularBCILinkPlanner::getSamplingRates()
+{
+	static const std::vector<uint32_t> rates = { 250, 500, 1000, 2000, 4000, 8000, 16000 };
+	return rates;
+}
+
+int CModularBCILinkPlanner::getDataRateCode(const uint32_t sampling)
+{
+	// DR 6 is 250 SPS, each lower code doubles the rate
+	const auto& rates = getSamplingRates();
+	const auto it     = std::find(rates.begin(), rates.end(), sampling);
+	return it == rates.end() ? -1 : int(6 - (it - rates.begin()));
+}
+
+CModularBCILinkPlanner::plan_t CModularBCILinkPlanner::plan(const uint32_t nChannel, const uint32_t sampling, const uint32_t baudRate, const uint32_t batch)
+{
+	plan_t res;
+	res.frameSize      = LINK_STATUS_SIZE + LINK_VALUE_SIZE * nChannel;
+	res.bytesPerSecond = double(res.frameSize) * sampling;
+	res.utilization    = baudRate == 0 ? 1 : res.bytesPerSecond * LINK_BITS_PER_BYTE / baudRate;
+	res.isFeasible     = sampling != 0 && res.utilization <= LINK_MAX_UTILIZATION;
+
+	// the last frame of a batch is on the wire after the others waited for it
+	const double frameTime = baudRate == 0 ? 0 : double(res.frameSize) * LINK_BITS_PER_BYTE / baudRate;
+	res.latency            = frameTime + (sampling == 0 ? 0 : double(std::max<uint32_t>(batch, 1) - 1) / sampling);
+	return res;
+}
+
+bool CModularBCILinkPlanner::suggest(const uint32_t channelMask, const int nEEGChannel, const uint32_t sampling, const uint32_t baudRate, const uint32_t batch,
+									 uint32_t& suggestedChannelMask, uint32_t& suggestedSampling)
+{
+	std::vector<uint32_t> channels;
+	for (int i = 0; i < nEEGChannel && i < 32; ++i) { if (channelMask & (1U << i)) { channels.push_back(uint32_t(i)); } }
+	const auto& rates = getSamplingRates();
+
+	// all channels at the highest rate up to the requested one
+	for (auto it = rates.rbegin(); it != rates.rend(); ++it)
+	{
+		if (*it <= std::max(sampling, rates.front()) && plan(uint32_t(channels.size()), *it, baudRate, batch).isFeasible)
+		{
+			suggestedChannelMask = channelMask;
+			suggestedSampling    = *it;
+			return true;
+		}
+	}
+
+	// the first channels that fit at the lowest rate
+	for (size_t n = channels.size(); n > 1; --n)
+	{
+		if (plan(uint32_t(n - 1), rates.front(), baudRate, batch).isFeasible)
+		{
+			suggestedChannelMask = 0;
+			for (size_t i = 0; i + 1 < n; ++i) { suggestedChannelMask |= 1U << channels[i]; }
+			suggestedSampling = rates.front();
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,53 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCILinkPlanner
+		 * \brief Tells whether the serial link between the board and the host can carry a configuration
+		 *
+		 * The firmware sends one frame per data ready of the ADS1299, a status word and 24 bits per
+		 * enabled channel, and blocks on the UART until it is sent. A frame that takes longer than a
+		 * sampling period to send makes it miss the next data ready, so the frames of an overcommitted
+		 * link are silently lost on the board. The planner computes the bytes each configuration puts
+		 * on the wire, refuses the ones above a utilization leaving room for the auxiliary frames, and
+		 * finds the cheapest feasible configuration: the highest sampling rate that keeps all channels,
+		 * or when even the lowest rate is too much, the first channels of the mask that fit at it.
+		 */
+		class CModularBCILinkPlanner final
+		{
+		public:
+
+			typedef struct
+			{
+				uint32_t frameSize;   // in bytes
+				double bytesPerSecond;
+				double utilization;   // of the link, 1 when saturated
+				double latency;       // in s, from the data ready of a sample to its bytes on the host, the read batch included
+				bool isFeasible;
+			} plan_t;
+
+			static const std::vector<uint32_t>& getSamplingRates(); // the ADS1299 data rates, lowest first
+			static int getDataRateCode(uint32_t sampling);          // CONFIG1 DR code of a sampling rate, -1 if the ADS1299 has none
+
+			// nChannel enabled channels, baudRate of the UART (8N1), batch frames read at once by the driver
+			static plan_t plan(uint32_t nChannel, uint32_t sampling, uint32_t baudRate, uint32_t batch);
+
+			// false when no configuration fits, the suggestion is the configuration itself when feasible
+			static bool suggest(uint32_t channelMask, int nEEGChannel, uint32_t sampling, uint32_t baudRate, uint32_t batch,
+								uint32_t& suggestedChannelMask, uint32_t& suggestedSampling);
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
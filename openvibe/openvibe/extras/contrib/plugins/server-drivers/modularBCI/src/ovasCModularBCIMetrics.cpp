@@ -0,0 +1,358 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIMetrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#elif defined TARGET_OS_Linux
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define METRICS_POLL_TIMEOUT    100  // in ms, also the latency of stopping
+#define METRICS_REQUEST_TIMEOUT 500  // in ms, a scraper that sends no complete request by then is dropped
+#define METRICS_REQUEST_SIZE    4096 // request line and headers, the body is ignored
+#define INVALID_METRICS_SOCKET  uintptr_t(~0)
+
+namespace
+{
+	void closeSocket(const uintptr_t socket)
+	{
+#if defined TARGET_OS_Windows
+		::closesocket(SOCKET(socket));
+#elif defined TARGET_OS_Linux
+		::close(int(socket));
+#else
+		(void)socket;
+#endif
+	}
+
+	void appendValue(std::string& out, const double value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+		out += buffer;
+	}
+
+	void appendValue(std::string& out, const uint64_t value) { out += std::to_string(value); }
+
+	void appendSeries(std::string& out, const std::string& name, const std::string& labels, const std::string& extraLabel = "")
+	{
+		out += name;
+		if (!labels.empty() || !extraLabel.empty())
+		{
+			out += '{';
+			out += labels;
+			if (!labels.empty() && !extraLabel.empty()) { out += ','; }
+			out += extraLabel;
+			out += '}';
+		}
+		out += ' ';
+	}
+}  // namespace
+
+//___________________________________________________________________//
+//                                                                   //
+
+CModularBCIMetrics::CHistogram::CHistogram(const std::vector<uint64_t>& bounds, const double scale)
+	: m_bounds(bounds), m_scale(scale), m_buckets(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+	std::sort(m_bounds.begin(), m_bounds.end());
+	for (size_t i = 0; i <= m_bounds.size(); ++i) { m_buckets[i].store(0); }
+}
+
+void CModularBCIMetrics::CHistogram::observe(const uint64_t value)
+{
+	// a dozen bounds, a linear search beats a binary one
+	size_t i = 0;
+	while (i < m_bounds.size() && value > m_bounds[i]) { i++; }
+	m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+CModularBCIMetrics::CCounter& CModularBCIMetrics::addCounter(const std::string& name, const std::string& help, const std::string& labels)
+{
+	m_entries.push_back({ EType::Counter, name, help, labels, m_counters.size() });
+	m_counters.emplace_back(new CCounter());
+	return *m_counters.back();
+}
+
+CModularBCIMetrics::CGauge& CModularBCIMetrics::addGauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+	m_entries.push_back({ EType::Gauge, name, help, labels, m_gauges.size() });
+	m_gauges.emplace_back(new CGauge());
+	return *m_gauges.back();
+}
+
+CModularBCIMetrics::CHistogram& CModularBCIMetrics::addHistogram(const std::string& name, const std::string& help, const std::vector<uint64_t>& bounds,
+																 const double scale, const std::string& labels)
+{
+	m_entries.push_back({ EType::Histogram, name, help, labels, m_histograms.size() });
+	m_histograms.emplace_back(new CHistogram(bounds, scale));
+	return *m_histograms.back();
+}
+
+void CModularBCIMetrics::clear()
+{
+	m_entries.clear();
+	m_counters.clear();
+	m_gauges.clear();
+	m_histograms.clear();
+}
+
+std::string CModularBCIMetrics::render() const
+{
+	std::string out;
+	out.reserve(256 * m_entries.size());
+	const std::string* lastName = nullptr;
+	for (const auto& entry : m_entries)
+	{
+		// series of the same name are registered together and share their description
+		if (lastName == nullptr || *lastName != entry.name)
+		{
+			out += "# HELP " + entry.name + " " + entry.help + "\n";
+			out += "# TYPE " + entry.name + (entry.type == EType::Counter ? " counter\n" : entry.type == EType::Gauge ? " gauge\n" : " histogram\n");
+			lastName = &entry.name;
+		}
+
+		if (entry.type == EType::Counter)
+		{
+			appendSeries(out, entry.name, entry.labels);
+			appendValue(out, m_counters[entry.index]->get());
+			out += '\n';
+		}
+		else if (entry.type == EType::Gauge)
+		{
+			appendSeries(out, entry.name, entry.labels);
+			appendValue(out, m_gauges[entry.index]->get());
+			out += '\n';
+		}
+		else
+		{
+			const CHistogram& histogram = *m_histograms[entry.index];
+			uint64_t count              = 0;
+			for (size_t i = 0; i < histogram.getBounds().size(); ++i)
+			{
+				count += histogram.getBucket(i);
+				std::string bound = "le=\"";
+				appendValue(bound, double(histogram.getBounds()[i]) * histogram.getScale());
+				appendSeries(out, entry.name + "_bucket", entry.labels, bound + "\"");
+				appendValue(out, count);
+				out += '\n';
+			}
+			count += histogram.getBucket(histogram.getBounds().size());
+			appendSeries(out, entry.name + "_bucket", entry.labels, "le=\"+Inf\"");
+			appendValue(out, count);
+			out += '\n';
+			appendSeries(out, entry.name + "_sum", entry.labels);
+			appendValue(out, double(histogram.getSum()) * histogram.getScale());
+			out += '\n';
+			appendSeries(out, entry.name + "_count", entry.labels);
+			appendValue(out, count);
+			out += '\n';
+		}
+	}
+	return out;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIMetricsExporter::start(const CModularBCIMetrics& metrics, const uint16_t port, const std::string& filename, const uint32_t periodMs)
+{
+	this->stop();
+	if (port == 0 && filename.empty()) { return false; }
+
+	if (port != 0)
+	{
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+#if defined TARGET_OS_Windows
+		WSADATA wsaData;
+		if (::WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) { return false; }
+#endif
+		const uintptr_t listener = uintptr_t(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+#if defined TARGET_OS_Linux
+		const bool isValid = int(listener) >= 0;
+#else
+		const bool isValid = listener != uintptr_t(INVALID_SOCKET);
+#endif
+		if (!isValid)
+		{
+#if defined TARGET_OS_Windows
+			::WSACleanup();
+#endif
+			return false;
+		}
+		m_socket = listener;
+
+		const int reuse = 1;
+		::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+		// counters of the session are nobody else's business, the endpoint is local only
+		sockaddr_in address     = {};
+		address.sin_family      = AF_INET;
+		address.sin_port        = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t size          = sizeof(address);
+		if (::bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(m_socket, 4) != 0
+			|| ::getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+		{
+			this->stop();
+			return false;
+		}
+		m_port = ntohs(address.sin_port);
+#else
+		return false;
+#endif
+	}
+
+	m_metrics  = &metrics;
+	m_filename = filename;
+	m_period   = std::max<uint32_t>(periodMs, METRICS_POLL_TIMEOUT);
+	m_nScrape.store(0);
+	m_nWriteError.store(0);
+	m_stop.store(false);
+	m_thread = std::thread(&CModularBCIMetricsExporter::run, this);
+	return true;
+}
+
+void CModularBCIMetricsExporter::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_stop.store(true);
+		m_thread.join();
+		if (!m_filename.empty() && !this->writeFile()) { m_nWriteError++; } // final values
+	}
+	if (m_socket != INVALID_METRICS_SOCKET)
+	{
+		closeSocket(m_socket);
+		m_socket = INVALID_METRICS_SOCKET;
+#if defined TARGET_OS_Windows
+		::WSACleanup();
+#endif
+	}
+	m_metrics = nullptr;
+	m_port    = 0;
+}
+
+void CModularBCIMetricsExporter::run()
+{
+	auto nextWrite = std::chrono::steady_clock::now();
+	while (!m_stop.load())
+	{
+		if (!m_filename.empty() && std::chrono::steady_clock::now() >= nextWrite)
+		{
+			if (!this->writeFile()) { m_nWriteError++; }
+			nextWrite += std::chrono::milliseconds(m_period);
+		}
+
+		if (m_socket == INVALID_METRICS_SOCKET)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(METRICS_POLL_TIMEOUT));
+			continue;
+		}
+
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+		fd_set sockets;
+		FD_ZERO(&sockets);
+		FD_SET(m_socket, &sockets);
+		timeval timeout = { 0, METRICS_POLL_TIMEOUT * 1000 };
+		if (::select(int(m_socket + 1), &sockets, nullptr, nullptr, &timeout) <= 0) { continue; }
+
+		const uintptr_t socket = uintptr_t(::accept(m_socket, nullptr, nullptr));
+#if defined TARGET_OS_Linux
+		if (int(socket) < 0) { continue; }
+#else
+		if (socket == uintptr_t(INVALID_SOCKET)) { continue; }
+#endif
+		this->serve(socket);
+		closeSocket(socket);
+#endif
+	}
+}
+
+void CModularBCIMetricsExporter::serve(const uintptr_t socket)
+{
+#if defined TARGET_OS_Windows
+	const DWORD timeout = METRICS_REQUEST_TIMEOUT;
+	::setsockopt(SOCKET(socket), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	::setsockopt(SOCKET(socket), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#elif defined TARGET_OS_Linux
+	const timeval timeout = { 0, METRICS_REQUEST_TIMEOUT * 1000 };
+	::setsockopt(int(socket), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	::setsockopt(int(socket), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#endif
+
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+	// request line and headers, up to the empty line
+	std::string request;
+	char buffer[512];
+	while (request.size() < METRICS_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos)
+	{
+		const int n = int(::recv(socket, buffer, sizeof(buffer), 0));
+		if (n <= 0) { return; }
+		request.append(buffer, size_t(n));
+	}
+
+	std::string status = "200 OK", body;
+	if (request.compare(0, 4, "GET ") != 0) { status = "405 Method Not Allowed"; }
+	else
+	{
+		const std::string path = request.substr(4, request.find(' ', 4) - 4);
+		if (path == "/metrics" || path == "/") { body = m_metrics->render(); }
+		else { status = "404 Not Found"; }
+	}
+	const std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: "
+								 + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+	size_t nSent = 0;
+	while (nSent < response.size())
+	{
+#if defined TARGET_OS_Linux
+		const int n = int(::send(int(socket), response.data() + nSent, response.size() - nSent, MSG_NOSIGNAL));
+#else
+		const int n = ::send(SOCKET(socket), response.data() + nSent, int(response.size() - nSent), 0);
+#endif
+		if (n <= 0) { return; }
+		nSent += size_t(n);
+	}
+	if (!body.empty()) { m_nScrape++; }
+#else
+	(void)socket;
+#endif
+}
+
+bool CModularBCIMetricsExporter::writeFile()
+{
+	const std::string content   = m_metrics->render();
+	const std::string temporary = m_filename + ".tmp";
+	FILE* file                  = std::fopen(temporary.c_str(), "wb");
+	if (file == nullptr) { return false; }
+	const bool isWritten = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+	if (std::fclose(file) != 0 || !isWritten) { return false; }
+
+#if defined TARGET_OS_Windows
+	return ::MoveFileExA(temporary.c_str(), m_filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(temporary.c_str(), m_filename.c_str()) == 0;
+#endif
+}
@@ -0,0 +1,144 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIMetrics
+		 * \brief Registry of counters, gauges and histograms, rendered in the Prometheus text format
+		 *
+		 * Metrics are registered while nothing reads the registry (before the exporter starts),
+		 * then updated from any thread with relaxed atomics: an update is a single atomic add or
+		 * store, with no lock and no allocation, so it can sit in the acquisition loop. Readers may
+		 * see the metrics of a single render slightly out of step with each other.
+		 */
+		class CModularBCIMetrics final
+		{
+		public:
+
+			class CCounter final
+			{
+			public:
+				void add(const uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+				void set(const uint64_t value) { m_value.store(value, std::memory_order_relaxed); } // mirrors a count kept elsewhere
+				uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+			protected:
+				std::atomic<uint64_t> m_value{0};
+			};
+
+			class CGauge final
+			{
+			public:
+				void set(const double value) { m_value.store(value, std::memory_order_relaxed); }
+				double get() const { return m_value.load(std::memory_order_relaxed); }
+
+			protected:
+				std::atomic<double> m_value{0};
+			};
+
+			// integer observations (bytes, samples, us), bounds are the inclusive upper bounds of the buckets in the same unit
+			class CHistogram final
+			{
+			public:
+				CHistogram(const std::vector<uint64_t>& bounds, double scale);
+				void observe(uint64_t value);
+
+				const std::vector<uint64_t>& getBounds() const { return m_bounds; }
+				double getScale() const { return m_scale; } // rendered value of one unit
+				uint64_t getBucket(size_t i) const { return m_buckets[i].load(std::memory_order_relaxed); } // bounds.size() is the overflow bucket
+				uint64_t getSum() const { return m_sum.load(std::memory_order_relaxed); }
+
+			protected:
+				std::vector<uint64_t> m_bounds;
+				double m_scale = 1;
+				std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+				std::atomic<uint64_t> m_sum{0};
+			};
+
+			// labels are rendered as they are, e.g. stage="uplink", several series may share a name with different labels
+			CCounter& addCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+			CGauge& addGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+			CHistogram& addHistogram(const std::string& name, const std::string& help, const std::vector<uint64_t>& bounds, double scale = 1,
+									 const std::string& labels = "");
+			void clear(); // nothing may use the metrics anymore
+
+			std::string render() const;
+
+		protected:
+
+			enum class EType { Counter, Gauge, Histogram };
+
+			typedef struct
+			{
+				EType type;
+				std::string name;
+				std::string help;
+				std::string labels;
+				size_t index; // in the vector of its type
+			} entry_t;
+
+			std::vector<entry_t> m_entries; // in registration order
+			std::vector<std::unique_ptr<CCounter>> m_counters;
+			std::vector<std::unique_ptr<CGauge>> m_gauges;
+			std::vector<std::unique_ptr<CHistogram>> m_histograms;
+		};
+
+		/**
+		 * \class CModularBCIMetricsExporter
+		 * \brief Exports a metrics registry from its own thread, to HTTP scrapers and/or to a file
+		 *
+		 * The HTTP endpoint listens on the loopback interface only and answers GET /metrics (or /)
+		 * with the text format Prometheus and most dashboard agents read. The file is rewritten
+		 * every period through a temporary file and a rename, so a reader never sees it half
+		 * written, and a last time when the exporter stops.
+		 */
+		class CModularBCIMetricsExporter final
+		{
+		public:
+
+			~CModularBCIMetricsExporter() { this->stop(); }
+
+			// port 0 and an empty filename each disable their output, the registry must outlive the exporter
+			bool start(const CModularBCIMetrics& metrics, uint16_t port, const std::string& filename, uint32_t periodMs);
+			void stop();
+			bool isRunning() const { return m_thread.joinable(); }
+			uint16_t getPort() const { return m_port; }
+
+			uint64_t getScrapeCount() const { return m_nScrape.load(); }
+			uint64_t getWriteErrorCount() const { return m_nWriteError.load(); }
+
+		protected:
+
+			void run();
+			void serve(uintptr_t socket);
+			bool writeFile();
+
+			const CModularBCIMetrics* m_metrics = nullptr;
+			std::string m_filename;
+			uint32_t m_period  = 1000;
+			uint16_t m_port    = 0;
+			uintptr_t m_socket = uintptr_t(~0); // listening socket
+
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+			std::atomic<uint64_t> m_nScrape{0};
+			std::atomic<uint64_t> m_nWriteError{0};
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,305 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIMotorImagery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define MOTOR_IMAGERY_CHUNK_SIZE 64 // samples filtered at once
+#define BUTTERWORTH_Q 0.70710678
+
+//___________________________________________________________________//
+//                                                                   //
+
+namespace
+{
+	template <typename T>
+	bool readValues(std::istringstream& line, std::vector<T>& values)
+	{
+		T value;
+		while (line >> value) { values.push_back(value); }
+		return line.eof();
+	}
+}  // namespace
+
+bool OpenViBE::AcquisitionServer::loadMotorImageryModel(const std::string& filename, motor_imagery_model_t& model, std::string& error)
+{
+	model = motor_imagery_model_t();
+	std::ifstream file(filename.c_str());
+	if (!file.is_open())
+	{
+		error = "can't open the file";
+		return false;
+	}
+
+	std::string text;
+	size_t lineNumber = 0;
+	while (std::getline(file, text))
+	{
+		lineNumber++;
+		if (!text.empty() && text.back() == '\r') { text.pop_back(); }
+		if (text.empty() || text[0] == '#') { continue; }
+
+		std::istringstream line(text);
+		std::string key;
+		line >> key;
+
+		bool ok = true;
+		if (key == "classes") { ok = readValues(line, model.classes); }
+		else if (key == "channels") { ok = readValues(line, model.channels); }
+		else if (key == "sampling") { ok = bool(line >> model.sampling); }
+		else if (key == "band") { ok = bool(line >> model.bandLow >> model.bandHigh); }
+		else if (key == "window") { ok = bool(line >> model.windowSize); }
+		else if (key == "hop") { ok = bool(line >> model.hopSize); }
+		else if (key == "filters") { ok = bool(line >> model.nFilter); }
+		else if (key == "filter") { ok = readValues(line, model.filters); }
+		else if (key == "weights") { ok = readValues(line, model.weights); }
+		else if (key == "bias") { ok = bool(line >> model.bias); }
+		else { ok = false; }
+
+		if (!ok)
+		{
+			error = "invalid line " + std::to_string(lineNumber) + " [" + text + "]";
+			return false;
+		}
+	}
+
+	return checkMotorImageryModel(model, 0, error);
+}
+
+bool OpenViBE::AcquisitionServer::saveMotorImageryModel(const std::string& filename, const motor_imagery_model_t& model)
+{
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) { return false; }
+
+	const size_t nChannel = model.channels.size();
+	file << "# ModularBCI motor imagery model (CSP + LDA), probability of the second class\n" << std::setprecision(17);
+	file << "classes";
+	for (const auto& name : model.classes) { file << " " << name; }
+	file << "\nchannels";
+	for (const auto& channel : model.channels) { file << " " << channel; }
+	file << "\nsampling " << model.sampling << "\nband " << model.bandLow << " " << model.bandHigh << "\nwindow " << model.windowSize << "\nhop "
+			<< model.hopSize << "\nfilters " << model.nFilter << "\n";
+	for (size_t k = 0; k < model.nFilter; ++k)
+	{
+		file << "filter";
+		for (size_t i = 0; i < nChannel; ++i) { file << " " << model.filters[k * nChannel + i]; }
+		file << "\n";
+	}
+	file << "weights";
+	for (const auto& weight : model.weights) { file << " " << weight; }
+	file << "\nbias " << model.bias << "\n";
+	return file.good();
+}
+
+bool OpenViBE::AcquisitionServer::checkMotorImageryModel(const motor_imagery_model_t& model, const size_t nBlockChannel, std::string& error)
+{
+	const size_t nChannel = model.channels.size();
+	if (model.classes.size() != 2) { error = "the model must have two classes"; }
+	else if (nChannel == 0) { error = "the model has no channel"; }
+	else if (nBlockChannel != 0 && *std::max_element(model.channels.begin(), model.channels.end()) >= nBlockChannel)
+	{
+		error = "the model uses channel " + std::to_string(*std::max_element(model.channels.begin(), model.channels.end()) + 1) + " of "
+				+ std::to_string(nBlockChannel);
+	}
+	else if (model.sampling <= 0 || model.bandLow <= 0 || model.bandHigh <= model.bandLow || model.bandHigh >= model.sampling / 2)
+	{
+		error = "invalid band or sampling rate";
+	}
+	else if (model.windowSize <= nChannel || model.hopSize == 0) { error = "invalid window or hop size"; }
+	else if (model.nFilter == 0 || model.filters.size() != model.nFilter * nChannel || model.weights.size() != model.nFilter)
+	{
+		error = "filter and weight counts don't match";
+	}
+	else { return true; }
+	return false;
+}
+
+void OpenViBE::AcquisitionServer::computeMotorImageryFeatures(const motor_imagery_model_t& model, const double* covariance, double* features)
+{
+	const size_t n = model.channels.size();
+	double total   = 0;
+	for (size_t k = 0; k < model.nFilter; ++k)
+	{
+		// w^T C w from the upper triangle
+		const double* w = &model.filters[k * n];
+		double variance = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const double* row = covariance + i * n;
+			double sum        = 0;
+			for (size_t j = i + 1; j < n; ++j) { sum += row[j] * w[j]; }
+			variance += w[i] * (row[i] * w[i] + 2 * sum);
+		}
+		features[k] = std::max(variance, std::numeric_limits<double>::min());
+		total += features[k];
+	}
+	for (size_t k = 0; k < model.nFilter; ++k) { features[k] = std::log(features[k] / total); }
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIMotorImageryDecoder::initialize(const motor_imagery_model_t& model, const size_t nBlockChannel)
+{
+	this->uninitialize();
+
+	std::string error;
+	if (!checkMotorImageryModel(model, nBlockChannel, error)) { return false; }
+
+	const size_t nChannel = model.channels.size();
+	if (!m_filterBank.initialize(nChannel, model.sampling)) { return false; }
+	for (size_t i = 0; i < nChannel; ++i)
+	{
+		if (!m_filterBank.addStage(i, CModularBCIFilterBank::EFilterType::HighPass, model.bandLow, BUTTERWORTH_Q)
+			|| !m_filterBank.addStage(i, CModularBCIFilterBank::EFilterType::LowPass, model.bandHigh, BUTTERWORTH_Q))
+		{
+			m_filterBank.uninitialize();
+			return false;
+		}
+	}
+
+	m_model    = model;
+	m_nChannel = nChannel;
+	m_chunk.assign(MOTOR_IMAGERY_CHUNK_SIZE * nChannel, 0);
+	m_window.assign(model.windowSize * nChannel, 0);
+	m_covariance.assign(nChannel * nChannel, 0);
+	m_features.assign(model.nFilter, 0);
+	m_probabilities.assign(2, 0.5);
+	this->reset();
+	return true;
+}
+
+void CModularBCIMotorImageryDecoder::uninitialize()
+{
+	m_model    = motor_imagery_model_t();
+	m_nChannel = 0;
+	m_filterBank.uninitialize();
+	m_chunk.clear();
+	m_window.clear();
+	m_covariance.clear();
+	m_features.clear();
+	m_probabilities.clear();
+	m_nextSample            = 0;
+	m_artifactEnd           = 0;
+	m_nDecision             = 0;
+	m_nSuppressed           = 0;
+	m_maxDecisionDuration   = 0;
+	m_totalDecisionDuration = 0;
+}
+
+void CModularBCIMotorImageryDecoder::reset()
+{
+	m_filterBank.reset();
+	std::fill(m_covariance.begin(), m_covariance.end(), 0.0);
+	m_position      = 0;
+	m_nFilled       = 0;
+	m_nSinceRefresh = 0;
+	m_nSinceHop     = 0;
+}
+
+void CModularBCIMotorImageryDecoder::process(const CModularBCISampleBus::CBlock& block)
+{
+	if (!this->isInitialized()) { return; }
+	if (block.getFirstSample() != m_nextSample) { this->reset(); }
+	if (block.getFlags() & CModularBCISampleBus::BlockFlag_Artifact) { m_artifactEnd = block.getFirstSample() + block.getSampleCount(); }
+
+	const uint32_t nSample = block.getSampleCount();
+	for (uint32_t offset = 0; offset < nSample; offset += MOTOR_IMAGERY_CHUNK_SIZE)
+	{
+		const uint32_t n = std::min<uint32_t>(MOTOR_IMAGERY_CHUNK_SIZE, nSample - offset);
+		for (size_t c = 0; c < m_nChannel; ++c)
+		{
+			const float* input = block.getChannel(m_model.channels[c]) + offset;
+			for (uint32_t i = 0; i < n; ++i) { m_chunk[i * m_nChannel + c] = input[i]; }
+		}
+		m_filterBank.process(&m_chunk[0], n);
+		for (uint32_t i = 0; i < n; ++i) { this->push(&m_chunk[i * m_nChannel], block.getFirstSample() + offset + i); }
+	}
+	m_nextSample = block.getFirstSample() + nSample;
+}
+
+void CModularBCIMotorImageryDecoder::push(const float* sample, const uint64_t sampleIndex)
+{
+	const size_t n = m_nChannel;
+	double* slot   = &m_window[m_position * n];
+
+	// rank-one updates of the upper triangle, the oldest sample leaves a full window
+	if (m_nFilled == m_model.windowSize)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			double* row     = &m_covariance[i * n];
+			const double xi = sample[i], oi = slot[i];
+			for (size_t j = i; j < n; ++j) { row[j] += xi * sample[j] - oi * slot[j]; }
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			double* row     = &m_covariance[i * n];
+			const double xi = sample[i];
+			for (size_t j = i; j < n; ++j) { row[j] += xi * sample[j]; }
+		}
+		m_nFilled++;
+	}
+	for (size_t i = 0; i < n; ++i) { slot[i] = sample[i]; }
+	m_position = (m_position + 1) % m_model.windowSize;
+
+	if (++m_nSinceRefresh >= m_model.windowSize) { this->recomputeCovariance(); }
+	if (++m_nSinceHop >= m_model.hopSize && m_nFilled == m_model.windowSize)
+	{
+		m_nSinceHop = 0;
+		// no decision on a window that overlaps an artifact
+		if (sampleIndex + 1 - m_model.windowSize < m_artifactEnd) { m_nSuppressed++; }
+		else { this->decide(sampleIndex); }
+	}
+}
+
+void CModularBCIMotorImageryDecoder::recomputeCovariance()
+{
+	const size_t n = m_nChannel;
+	std::fill(m_covariance.begin(), m_covariance.end(), 0.0);
+	for (size_t s = 0; s < m_nFilled; ++s)
+	{
+		const double* sample = &m_window[s * n];
+		for (size_t i = 0; i < n; ++i)
+		{
+			double* row     = &m_covariance[i * n];
+			const double xi = sample[i];
+			for (size_t j = i; j < n; ++j) { row[j] += xi * sample[j]; }
+		}
+	}
+	m_nSinceRefresh = 0;
+}
+
+void CModularBCIMotorImageryDecoder::decide(const uint64_t sampleIndex)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	computeMotorImageryFeatures(m_model, &m_covariance[0], &m_features[0]);
+	double score = m_model.bias;
+	for (size_t k = 0; k < m_model.nFilter; ++k) { score += m_model.weights[k] * m_features[k]; }
+	m_probabilities[1] = 1 / (1 + std::exp(-score));
+	m_probabilities[0] = 1 - m_probabilities[1];
+
+	const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_maxDecisionDuration = std::max(m_maxDecisionDuration, duration);
+	m_totalDecisionDuration += duration;
+	m_nDecision++;
+
+	if (m_listener) { m_listener(sampleIndex, m_probabilities); }
+}
@@ -0,0 +1,114 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIFilterBank.h"
+#include "ovasCModularBCISampleBus.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * Two-class motor imagery model, as written by the modularbci-train-mi tool. The features
+		 * are the log-variances of the CSP components normalized by their sum, the classifier a
+		 * linear discriminant whose logistic output is the probability of the second class.
+		 */
+		typedef struct
+		{
+			std::vector<std::string> classes;    // two class names
+			std::vector<uint32_t> channels;      // indices of the channels the filters apply to
+			double sampling     = 0;             // in Hz, the model only applies at this rate
+			double bandLow      = 0;             // band-pass applied before the covariance, in Hz
+			double bandHigh     = 0;
+			uint32_t windowSize = 0;             // in samples
+			uint32_t hopSize    = 0;             // in samples, between two decisions
+			uint32_t nFilter    = 0;
+			std::vector<double> filters;         // nFilter rows of channels.size() spatial weights
+			std::vector<double> weights;         // LDA weights, one per filter
+			double bias = 0;
+		} motor_imagery_model_t;
+
+		bool loadMotorImageryModel(const std::string& filename, motor_imagery_model_t& model, std::string& error);
+		bool saveMotorImageryModel(const std::string& filename, const motor_imagery_model_t& model);
+
+		// checks that the model is complete and consistent, nBlockChannel = 0 skips the channel range check
+		bool checkMotorImageryModel(const motor_imagery_model_t& model, size_t nBlockChannel, std::string& error);
+
+		// log(variance / total variance) of each CSP component, only the upper triangle of the row-major covariance is read
+		void computeMotorImageryFeatures(const motor_imagery_model_t& model, const double* covariance, double* features);
+
+		/**
+		 * \class CModularBCIMotorImageryDecoder
+		 * \brief Streaming CSP + LDA decoder fed with sample bus blocks
+		 *
+		 * The selected channels are band-passed by their own filter bank and kept in a ring of one
+		 * window. The window covariance is updated with a rank-one update per sample (the new sample
+		 * added, the one leaving the window removed) and recomputed from the ring once per window to
+		 * keep rounding errors from accumulating. Every hop samples, the CSP filters and the LDA are
+		 * applied to the covariance, which costs nFilter * nChannel^2 operations whatever the window
+		 * length. All buffers are allocated by initialize(), none while streaming.
+		 */
+		class CModularBCIMotorImageryDecoder final
+		{
+		public:
+
+			// probabilities holds one value per class
+			typedef std::function<void(uint64_t sampleIndex, const std::vector<double>& probabilities)> listener_t;
+
+			bool initialize(const motor_imagery_model_t& model, size_t nBlockChannel);
+			void uninitialize();
+			bool isInitialized() const { return !m_model.channels.empty(); }
+
+			void setListener(const listener_t& listener) { m_listener = listener; }
+			const motor_imagery_model_t& getModel() const { return m_model; }
+
+			// feeds a block of the sample bus, blocks must be consecutive (a gap resets the window)
+			void process(const CModularBCISampleBus::CBlock& block);
+
+			uint64_t getDecisionCount() const { return m_nDecision; }
+			uint64_t getSuppressedCount() const { return m_nSuppressed; } // decisions skipped as their window overlapped an artifact
+			double getMaxDecisionDuration() const { return m_maxDecisionDuration; } // in s, spatial filtering and classification
+			double getMeanDecisionDuration() const { return m_nDecision == 0 ? 0 : m_totalDecisionDuration / double(m_nDecision); }
+
+		protected:
+
+			void reset();
+			void push(const float* sample, uint64_t sampleIndex);
+			void recomputeCovariance();
+			void decide(uint64_t sampleIndex);
+
+			motor_imagery_model_t m_model;
+			size_t m_nChannel = 0;
+			listener_t m_listener;
+
+			CModularBCIFilterBank m_filterBank;
+			std::vector<float> m_chunk;        // sample-major copy of the selected channels, filtered in place
+			std::vector<double> m_window;      // ring of windowSize samples
+			std::vector<double> m_covariance;  // row-major, only the upper triangle is kept up to date
+			std::vector<double> m_features;
+			std::vector<double> m_probabilities;
+			size_t m_position      = 0; // next ring index
+			size_t m_nFilled       = 0; // samples in the ring
+			size_t m_nSinceRefresh = 0;
+			size_t m_nSinceHop     = 0;
+			uint64_t m_nextSample  = 0;
+			uint64_t m_artifactEnd = 0; // sample after the last block flagged as artifact
+
+			uint64_t m_nDecision           = 0;
+			uint64_t m_nSuppressed         = 0;
+			double m_maxDecisionDuration   = 0;
+			double m_totalDecisionDuration = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,38 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIReadScheduler.h"
+
+#include <algorithm>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+void CModularBCIReadScheduler::initialize(const size_t frameSize, const uint32_t sampling, const uint32_t batch, const uint64_t maxWait)
+{
+	m_frameSize = frameSize;
+	m_byteRate  = double(frameSize) * sampling / 1000000;
+	m_batch     = std::max<uint32_t>(batch, 1);
+	m_maxWait   = (frameSize == 0 || sampling == 0) ? 0 : maxWait;
+	m_residual  = 0;
+	m_expected  = 0;
+}
+
+uint64_t CModularBCIReadScheduler::getSleep(const uint64_t now) const
+{
+	if (m_maxWait == 0 || m_expected <= now) { return 0; }
+	return std::min(m_expected - now, m_maxWait);
+}
+
+void CModularBCIReadScheduler::onRead(const uint32_t nByte, const uint64_t time)
+{
+	if (m_maxWait == 0 || nByte == 0) { return; } // an empty read keeps the estimate, the next one waits for the port
+
+	// the port was drained at time, the rest of the current frame and the whole batch come at the nominal rate from there
+	m_residual          = (m_residual + nByte) % m_frameSize;
+	const size_t needed = m_batch * m_frameSize - m_residual;
+	m_expected          = time + uint64_t(double(needed) / m_byteRate);
+}
@@ -0,0 +1,51 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIReadScheduler
+		 * \brief Plans how long the acquisition loop waits for the board before reading
+		 *
+		 * The board sends frames of a known size at a known rate, so after a read the time the
+		 * next batch of frames will be complete is known. The loop first sleeps until then, the
+		 * bytes arriving meanwhile simply queue in the serial driver, and then waits for the port
+		 * to be readable, since the USB bridge delivers the bytes in bursts that can come later
+		 * than the estimate. Both waits are capped, so that the loop still runs (and notices a
+		 * silent board) at least that often. The number of wakeups then follows the data rate
+		 * rather than spinning on empty reads.
+		 */
+		class CModularBCIReadScheduler final
+		{
+		public:
+
+			// frameSize in bytes of a sample frame, sampling in Hz, batch in frames, maxWait in us, 0 disables the waits
+			void initialize(size_t frameSize, uint32_t sampling, uint32_t batch, uint64_t maxWait);
+			bool isEnabled() const { return m_maxWait != 0; }
+
+			uint64_t getSleep(uint64_t now) const; // in us, until the next batch is expected to be complete
+			uint64_t getTimeout() const { return m_maxWait; } // in us, longest wait for the port to be readable after the sleep
+
+			void onRead(uint32_t nByte, uint64_t time); // after every read, time in us as for getSleep
+
+		protected:
+
+			size_t m_frameSize  = 0;
+			double m_byteRate   = 0; // bytes per us
+			uint32_t m_batch    = 1;
+			uint64_t m_maxWait  = 0;
+			size_t m_residual   = 0; // bytes of the frame being received, assuming no auxiliary frame
+			uint64_t m_expected = 0; // time the next batch is expected to be complete, 0 if unknown
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
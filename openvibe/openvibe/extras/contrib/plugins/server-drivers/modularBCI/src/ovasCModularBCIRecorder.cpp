@@ -0,0 +1,365 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIRecorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <windows.h>
+#elif defined TARGET_OS_Linux
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define RECORDING_EXTENT_CHUNK_COUNT 64 // the file grows by this many chunks at once
+
+//___________________________________________________________________//
+//                                                                   //
+
+void CModularBCIRecorder::CIndexRing::initialize(const size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity + 1) { size *= 2; }
+	m_values.assign(size, 0);
+	m_mask = size - 1;
+	m_head.store(0, std::memory_order_relaxed);
+	m_tail.store(0, std::memory_order_relaxed);
+}
+
+bool CModularBCIRecorder::CIndexRing::push(const uint32_t value)
+{
+	const size_t tail = m_tail.load(std::memory_order_relaxed);
+	if (((tail + 1) & m_mask) == m_head.load(std::memory_order_acquire)) { return false; }
+	m_values[tail] = value;
+	m_tail.store((tail + 1) & m_mask, std::memory_order_release);
+	return true;
+}
+
+bool CModularBCIRecorder::CIndexRing::pop(uint32_t& value)
+{
+	const size_t head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire)) { return false; }
+	value = m_values[head];
+	m_head.store((head + 1) & m_mask, std::memory_order_release);
+	return true;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIRecorder::open(const std::string& filename, const recording_header_t& info, const size_t nBuffer, const uint32_t chunkSize)
+{
+	this->close();
+	if (info.nChannel == 0 || nBuffer < 2 || chunkSize < sizeof(recording_chunk_header_t) + info.nChannel * sizeof(int32_t))
+	{
+		m_lastError = "invalid recording parameters";
+		return false;
+	}
+
+#if defined TARGET_OS_Windows
+	m_file = ::CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file      = nullptr;
+		m_lastError = "could not create " + filename;
+		return false;
+	}
+#elif defined TARGET_OS_Linux
+	m_file = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (m_file < 0)
+	{
+		m_lastError = "could not create " + filename + " (" + std::strerror(errno) + ")";
+		return false;
+	}
+#else
+	m_lastError = "recording is not supported on this platform";
+	return false;
+#endif
+
+	m_header = info;
+	std::memset(m_header.magic, 0, sizeof(m_header.magic));
+	std::memcpy(m_header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+	m_header.version         = RECORDING_VERSION;
+	m_header.headerSize      = RECORDING_HEADER_SIZE;
+	m_header.chunkSize       = chunkSize;
+	m_header.startTime       = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	m_header.nSample         = 0;
+	m_header.nRawByte        = 0;
+	m_header.nChunk          = 0;
+	m_header.indexOffset     = 0;
+	m_header.nDroppedSample  = 0;
+	m_header.nDroppedRawByte = 0;
+
+	m_chunkSize       = chunkSize;
+	m_payloadCapacity = chunkSize - uint32_t(sizeof(recording_chunk_header_t));
+	m_allocatedSize   = 0;
+	m_nChunk          = 0;
+	m_nSample         = 0;
+	m_nRawByte        = 0;
+	m_nDroppedSample  = 0;
+	m_nDroppedRawByte = 0;
+	m_rawBuffer       = NO_BUFFER;
+	m_sampleBuffer    = NO_BUFFER;
+	m_nWriteError.store(0);
+	m_index.clear();
+	m_index.reserve(1024);
+
+	// the header slot is written now with zero totals, so that an interrupted recording is still identifiable
+	std::vector<uint8_t> header(RECORDING_HEADER_SIZE, 0);
+	std::memcpy(&header[0], &m_header, sizeof(m_header));
+	if (!this->reserve(RECORDING_HEADER_SIZE + uint64_t(RECORDING_EXTENT_CHUNK_COUNT) * chunkSize) || !this->writeAt(&header[0], header.size(), 0))
+	{
+		m_lastError = "could not write the header of " + filename;
+		m_chunkSize = 0;
+		this->finalize();
+		return false;
+	}
+
+	m_pool.assign(nBuffer * chunkSize, 0);
+	m_freeBuffers.initialize(nBuffer);
+	m_fullBuffers.initialize(nBuffer);
+	for (uint32_t i = 0; i < nBuffer; ++i) { m_freeBuffers.push(i); }
+
+	m_startTime = std::chrono::steady_clock::now();
+	m_stop.store(false);
+	m_thread = std::thread(&CModularBCIRecorder::writerThread, this);
+	return true;
+}
+
+bool CModularBCIRecorder::close()
+{
+	if (!m_thread.joinable()) { return false; }
+
+	// hands the partially filled chunks over, there is always room as the rings can hold the whole pool
+	this->submitBuffer(m_rawBuffer);
+	this->submitBuffer(m_sampleBuffer);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop.store(true);
+	}
+	m_condition.notify_one();
+	m_thread.join();
+
+	const bool res = this->finalize();
+	m_pool.clear();
+	m_pool.shrink_to_fit();
+	return res;
+}
+
+uint64_t CModularBCIRecorder::getTime() const
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_startTime).count());
+}
+
+uint32_t CModularBCIRecorder::acquireBuffer(const ERecordingChunkType type)
+{
+	uint32_t index = NO_BUFFER;
+	if (!m_freeBuffers.pop(index)) { return NO_BUFFER; }
+
+	recording_chunk_header_t* chunk = this->getChunkHeader(index);
+	chunk->magic                    = RECORDING_CHUNK_MAGIC;
+	chunk->type                     = uint32_t(type);
+	chunk->payloadSize              = 0;
+	chunk->nSample                  = 0;
+	chunk->firstSample              = m_nSample;
+	chunk->time                     = this->getTime();
+	chunk->firstRawByte             = m_nRawByte;
+	return index;
+}
+
+void CModularBCIRecorder::submitBuffer(uint32_t& index)
+{
+	if (index == NO_BUFFER) { return; }
+	m_fullBuffers.push(index);
+	index = NO_BUFFER;
+	m_condition.notify_one(); // a missed wake up only delays the writer until its next timeout
+}
+
+void CModularBCIRecorder::appendRaw(const uint8_t* data, size_t size)
+{
+	if (!m_thread.joinable()) { return; }
+
+	while (size > 0)
+	{
+		if (m_rawBuffer == NO_BUFFER && (m_rawBuffer = this->acquireBuffer(ERecordingChunkType::Raw)) == NO_BUFFER)
+		{
+			m_nDroppedRawByte += size;
+			m_nRawByte += size;
+			return;
+		}
+
+		recording_chunk_header_t* chunk = this->getChunkHeader(m_rawBuffer);
+		const uint32_t n                = uint32_t(std::min<size_t>(size, m_payloadCapacity - chunk->payloadSize));
+		std::memcpy(this->getBuffer(m_rawBuffer) + sizeof(recording_chunk_header_t) + chunk->payloadSize, data, n);
+		chunk->payloadSize += n;
+		m_nRawByte += n;
+		data += n;
+		size -= n;
+
+		if (chunk->payloadSize == m_payloadCapacity) { this->submitBuffer(m_rawBuffer); }
+	}
+}
+
+void CModularBCIRecorder::appendSample(const int32_t* values)
+{
+	if (!m_thread.joinable()) { return; }
+
+	const uint32_t sampleSize = m_header.nChannel * uint32_t(sizeof(int32_t));
+	if (m_sampleBuffer == NO_BUFFER && (m_sampleBuffer = this->acquireBuffer(ERecordingChunkType::Samples)) == NO_BUFFER)
+	{
+		m_nDroppedSample++;
+		m_nSample++;
+		return;
+	}
+
+	recording_chunk_header_t* chunk = this->getChunkHeader(m_sampleBuffer);
+	std::memcpy(this->getBuffer(m_sampleBuffer) + sizeof(recording_chunk_header_t) + chunk->payloadSize, values, sampleSize);
+	chunk->payloadSize += sampleSize;
+	chunk->nSample++;
+	m_nSample++;
+
+	if (chunk->payloadSize + sampleSize > m_payloadCapacity) { this->submitBuffer(m_sampleBuffer); }
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+void CModularBCIRecorder::writerThread()
+{
+	while (true)
+	{
+		uint32_t index = NO_BUFFER;
+		if (m_fullBuffers.pop(index))
+		{
+			const recording_chunk_header_t* chunk = this->getChunkHeader(index);
+			const uint64_t offset                 = RECORDING_HEADER_SIZE + m_nChunk * m_chunkSize;
+
+			if (!this->reserve(offset + m_chunkSize) || !this->writeAt(this->getBuffer(index), sizeof(recording_chunk_header_t) + chunk->payloadSize, offset))
+			{
+				m_nWriteError.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				recording_index_entry_t entry;
+				entry.firstSample = chunk->firstSample;
+				entry.time        = chunk->time;
+				entry.chunk       = uint32_t(m_nChunk);
+				entry.type        = chunk->type;
+				entry.nSample     = chunk->nSample;
+				entry.payloadSize = chunk->payloadSize;
+				m_index.push_back(entry);
+				m_nChunk++;
+			}
+			m_freeBuffers.push(index);
+			continue;
+		}
+
+		if (m_stop.load()) { break; }
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait_for(lock, std::chrono::milliseconds(50), [this]() { return m_stop.load() || !m_fullBuffers.empty(); });
+	}
+}
+
+bool CModularBCIRecorder::reserve(const uint64_t size)
+{
+	if (size <= m_allocatedSize) { return true; }
+
+	const uint64_t extent = uint64_t(RECORDING_EXTENT_CHUNK_COUNT) * m_chunkSize;
+	const uint64_t target = std::max(size, m_allocatedSize + extent);
+
+#if defined TARGET_OS_Windows
+	LARGE_INTEGER position;
+	position.QuadPart = LONGLONG(target);
+	if (!::SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) || !::SetEndOfFile(m_file)) { return false; }
+#elif defined TARGET_OS_Linux
+	// posix_fallocate allocates the blocks for real, unlike a sparse ftruncate
+	if (::posix_fallocate(m_file, off_t(m_allocatedSize), off_t(target - m_allocatedSize)) != 0) { return false; }
+#else
+	return false;
+#endif
+	m_allocatedSize = target;
+	return true;
+}
+
+bool CModularBCIRecorder::writeAt(const void* data, const size_t size, const uint64_t offset)
+{
+	const uint8_t* buffer = static_cast<const uint8_t*>(data);
+	size_t written        = 0;
+	while (written < size)
+	{
+#if defined TARGET_OS_Windows
+		OVERLAPPED overlapped = {};
+		overlapped.Offset     = DWORD((offset + written) & 0xFFFFFFFF);
+		overlapped.OffsetHigh = DWORD((offset + written) >> 32);
+		DWORD n               = 0;
+		if (!::WriteFile(m_file, buffer + written, DWORD(size - written), &n, &overlapped) || n == 0) { return false; }
+#elif defined TARGET_OS_Linux
+		const ssize_t n = ::pwrite(m_file, buffer + written, size - written, off_t(offset + written));
+		if (n < 0 && errno == EINTR) { continue; }
+		if (n <= 0) { return false; }
+#else
+		return false;
+#endif
+		written += size_t(n);
+	}
+	return true;
+}
+
+bool CModularBCIRecorder::finalize()
+{
+	bool res = true;
+
+#if defined TARGET_OS_Windows
+	if (m_file == nullptr) { return false; }
+#else
+	if (m_file < 0) { return false; }
+#endif
+
+	if (m_chunkSize != 0)
+	{
+		// index after the last chunk, then the totals in the header
+		const uint64_t indexOffset = RECORDING_HEADER_SIZE + m_nChunk * m_chunkSize;
+		const size_t indexSize     = m_index.size() * sizeof(recording_index_entry_t);
+		if (indexSize != 0) { res &= this->writeAt(&m_index[0], indexSize, indexOffset); }
+
+		m_header.nSample         = m_nSample;
+		m_header.nRawByte        = m_nRawByte;
+		m_header.nChunk          = m_nChunk;
+		m_header.indexOffset     = indexOffset;
+		m_header.nDroppedSample  = m_nDroppedSample;
+		m_header.nDroppedRawByte = m_nDroppedRawByte;
+		res &= this->writeAt(&m_header, sizeof(m_header), 0);
+
+		// gives back the unused part of the last extent
+		const uint64_t size = indexOffset + indexSize;
+#if defined TARGET_OS_Windows
+		LARGE_INTEGER position;
+		position.QuadPart = LONGLONG(size);
+		res &= ::SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) && ::SetEndOfFile(m_file);
+#elif defined TARGET_OS_Linux
+		res &= ::ftruncate(m_file, off_t(size)) == 0;
+#endif
+	}
+
+#if defined TARGET_OS_Windows
+	::CloseHandle(m_file);
+	m_file = nullptr;
+#elif defined TARGET_OS_Linux
+	::close(m_file);
+	m_file = -1;
+#endif
+	m_chunkSize = 0;
+	return res;
+}
@@ -0,0 +1,119 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIRecordingFormat.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIRecorder
+		 * \brief Writes raw UART bytes and decoded samples to a binary recording (see ovasCModularBCIRecordingFormat.h)
+		 *
+		 * The acquisition thread fills chunk buffers taken from a pool allocated by open() and hands
+		 * them to a writer thread through two single-producer / single-consumer rings (free and full
+		 * buffers). The writer grows the file by large preallocated extents so that the file system
+		 * does not have to allocate blocks on every write. appendRaw() and appendSample() never
+		 * block nor allocate: when the writer falls behind and the pool is empty, data is dropped and
+		 * counted, which shows as a gap in the sample / byte indices of the following chunks.
+		 */
+		class CModularBCIRecorder final
+		{
+		public:
+
+			~CModularBCIRecorder() { this->close(); }
+
+			// info provides the description fields of the header (channels, sampling, gains, firmware...)
+			bool open(const std::string& filename, const recording_header_t& info, size_t nBuffer = 64, uint32_t chunkSize = RECORDING_CHUNK_SIZE);
+			bool close();
+			bool isOpen() const { return m_thread.joinable(); }
+
+			void appendRaw(const uint8_t* data, size_t size);
+			void appendSample(const int32_t* values); // one sample of nChannel values
+
+			const std::string& getLastError() const { return m_lastError; }
+			uint64_t getSampleCount() const { return m_nSample; }
+			uint64_t getDroppedSampleCount() const { return m_nDroppedSample; }
+			uint64_t getDroppedRawByteCount() const { return m_nDroppedRawByte; }
+			uint64_t getWriteErrorCount() const { return m_nWriteError.load(std::memory_order_relaxed); }
+
+		protected:
+
+			static const uint32_t NO_BUFFER = uint32_t(-1);
+
+			// single producer / single consumer ring of buffer indices
+			class CIndexRing
+			{
+			public:
+				void initialize(size_t capacity);
+				bool push(uint32_t value);
+				bool pop(uint32_t& value);
+				bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+			protected:
+				std::vector<uint32_t> m_values;
+				size_t m_mask = 0;
+				std::atomic<size_t> m_head{0}; // next read, owned by the consumer
+				std::atomic<size_t> m_tail{0}; // next write, owned by the producer
+			};
+
+			uint8_t* getBuffer(uint32_t index) { return &m_pool[size_t(index) * m_chunkSize]; }
+			recording_chunk_header_t* getChunkHeader(uint32_t index) { return reinterpret_cast<recording_chunk_header_t*>(this->getBuffer(index)); }
+			uint32_t acquireBuffer(ERecordingChunkType type);
+			void submitBuffer(uint32_t& index);
+			uint64_t getTime() const;
+
+			void writerThread();
+			bool writeAt(const void* data, size_t size, uint64_t offset);
+			bool reserve(uint64_t size);
+			bool finalize();
+
+			std::string m_lastError;
+			recording_header_t m_header = {};
+			uint32_t m_chunkSize        = 0;
+			uint32_t m_payloadCapacity  = 0;
+
+			std::vector<uint8_t> m_pool;
+			CIndexRing m_freeBuffers; // producer pops, writer pushes
+			CIndexRing m_fullBuffers; // producer pushes, writer pops
+
+			// producer side
+			uint32_t m_rawBuffer       = NO_BUFFER;
+			uint32_t m_sampleBuffer    = NO_BUFFER;
+			uint64_t m_nSample         = 0; // samples seen, dropped ones included
+			uint64_t m_nRawByte        = 0; // raw bytes seen, dropped ones included
+			uint64_t m_nDroppedSample  = 0;
+			uint64_t m_nDroppedRawByte = 0;
+			std::chrono::steady_clock::time_point m_startTime;
+
+			// writer side
+			std::thread m_thread;
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			std::atomic<bool> m_stop{false};
+			std::atomic<uint64_t> m_nWriteError{0};
+			std::vector<recording_index_entry_t> m_index;
+			uint64_t m_nChunk        = 0;
+			uint64_t m_allocatedSize = 0; // file size reserved so far
+
+#if defined TARGET_OS_Windows
+			void* m_file = nullptr;
+#else
+			int m_file = -1;
+#endif
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
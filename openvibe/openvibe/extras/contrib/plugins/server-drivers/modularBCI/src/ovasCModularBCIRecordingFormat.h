@@ -0,0 +1,102 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Layout of the ModularBCI binary recordings (.mbci), all values little endian
+ *
+ *   [ header, RECORDING_HEADER_SIZE bytes                        ]
+ *   [ chunk 0, header.chunkSize bytes                            ]
+ *   [ chunk 1, header.chunkSize bytes                            ]
+ *   [ ...                                                        ]
+ *   [ index, header.nChunk entries of recording_index_entry_t    ]
+ *
+ * Chunk i starts at RECORDING_HEADER_SIZE + i * chunkSize, so that a reader can map the file and
+ * jump to any chunk. Each chunk starts with a recording_chunk_header_t followed by its payload:
+ * either the unmodified bytes received from the UART, or decoded samples as int32 ADC codes,
+ * sample-major (nChannel values per sample). Multiply by unitsToMicroVolts to get uV.
+ *
+ * The index and the totals of the header are written when the recording is closed. A recording
+ * that was not closed (crash, power loss) has nChunk == 0 in its header, its chunks can still be
+ * recovered by scanning the slots for RECORDING_CHUNK_MAGIC.
+ *
+ * The header slot is zero padded, so that a field added at the end of the header reads as zero
+ * (its default) in the recordings written before it.
+ *
+ * This header is plain C++ with no OpenViBE dependency so that offline tools can include it.
+ */
+
+#define RECORDING_MAGIC        "MBCIREC"
+#define RECORDING_VERSION      1
+#define RECORDING_HEADER_SIZE  4096
+#define RECORDING_CHUNK_MAGIC  0x4B4E4843 // "CHNK"
+#define RECORDING_CHUNK_SIZE   65536      // default chunk size, a multiple of the page size
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		enum class ERecordingChunkType : uint32_t { Raw = 1, Samples = 2 };
+
+#pragma pack(push, 1)
+		typedef struct
+		{
+			char magic[8];                // RECORDING_MAGIC, zero terminated
+			uint32_t version;             // RECORDING_VERSION
+			uint32_t headerSize;          // RECORDING_HEADER_SIZE
+			uint32_t chunkSize;           // size of every chunk slot, chunk header included
+
+			uint32_t nChannel;            // EEG values per decoded sample
+			uint32_t sampling;            // in Hz
+			uint32_t channelMask;         // board channels streamed, bit n set -> channel n+1
+			uint32_t nDevice;             // number of ADS1299 on the board
+			float gain;                   // ADS1299 PGA gain
+			float vref;                   // reference voltage in V
+			float unitsToMicroVolts;      // ADC code to uV
+
+			uint64_t startTime;           // wall clock at the start of the recording, in us since 1970-01-01
+			uint64_t nSample;             // decoded samples recorded, written on close
+			uint64_t nRawByte;            // raw bytes recorded, written on close
+			uint64_t nChunk;              // chunks written, written on close
+			uint64_t indexOffset;         // file offset of the index, written on close
+			uint64_t nDroppedSample;      // samples lost because the writer could not keep up, written on close
+			uint64_t nDroppedRawByte;     // raw bytes lost because the writer could not keep up, written on close
+
+			char firmware[256];           // board and firmware description
+			char configuration[1024];     // commands sent to the board on initialization
+			char channelNames[512];       // space separated names of the channels, empty for Channel1..N (the driver recordings)
+		} recording_header_t;
+
+		typedef struct
+		{
+			uint32_t magic;               // RECORDING_CHUNK_MAGIC
+			uint32_t type;                // ERecordingChunkType
+			uint32_t payloadSize;         // in bytes
+			uint32_t nSample;             // samples in the payload, 0 for raw chunks
+			uint64_t firstSample;         // index of the first sample of the payload (samples recorded before the chunk for raw chunks)
+			uint64_t time;                // time of the first payload byte, in us since the start of the recording
+			uint64_t firstRawByte;        // raw bytes recorded before this chunk
+		} recording_chunk_header_t;
+
+		typedef struct
+		{
+			uint64_t firstSample;
+			uint64_t time;
+			uint32_t chunk;               // slot index
+			uint32_t type;                // ERecordingChunkType
+			uint32_t nSample;
+			uint32_t payloadSize;
+		} recording_index_entry_t;
+#pragma pack(pop)
+
+		static_assert(sizeof(recording_header_t) <= RECORDING_HEADER_SIZE, "recording header does not fit in its slot");
+		static_assert(sizeof(recording_chunk_header_t) == 40, "unexpected chunk header size");
+		static_assert(sizeof(recording_index_entry_t) == 32, "unexpected index entry size");
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
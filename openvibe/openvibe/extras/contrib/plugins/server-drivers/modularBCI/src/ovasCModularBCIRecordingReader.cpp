@@ -0,0 +1,210 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIRecordingReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <windows.h>
+#elif defined TARGET_OS_Linux
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+bool CModularBCIRecordingReader::open(const std::string& filename)
+{
+	this->close();
+
+#if defined TARGET_OS_Windows
+	m_file = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file      = nullptr;
+		m_lastError = "could not open " + filename;
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		m_lastError = filename + " is empty";
+		this->close();
+		return false;
+	}
+	m_size    = uint64_t(size.QuadPart);
+	m_mapping = ::CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr) { m_data = static_cast<const uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)); }
+	if (m_data == nullptr)
+	{
+		m_lastError = "could not map " + filename;
+		this->close();
+		return false;
+	}
+#elif defined TARGET_OS_Linux
+	const int file = ::open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		m_lastError = "could not open " + filename + " (" + std::strerror(errno) + ")";
+		return false;
+	}
+	struct stat status;
+	if (::fstat(file, &status) != 0 || status.st_size == 0)
+	{
+		m_lastError = filename + " is empty";
+		::close(file);
+		return false;
+	}
+	m_size     = uint64_t(status.st_size);
+	void* data = ::mmap(nullptr, size_t(m_size), PROT_READ, MAP_SHARED, file, 0);
+	::close(file); // the mapping keeps its own reference
+	if (data == MAP_FAILED)
+	{
+		m_lastError = "could not map " + filename + " (" + std::strerror(errno) + ")";
+		return false;
+	}
+	::madvise(data, size_t(m_size), MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(data);
+#else
+	m_lastError = "reading recordings is not supported on this platform";
+	return false;
+#endif
+
+	m_header = {};
+	m_index.clear();
+	m_plainCapture = m_size < RECORDING_HEADER_SIZE || std::memcmp(m_data, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0;
+
+	if (m_plainCapture)
+	{
+		// whole capture cut into raw chunks, positions are byte offsets
+		std::memcpy(m_header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+		m_header.chunkSize = RECORDING_CHUNK_SIZE;
+		m_header.nRawByte  = m_size;
+		for (uint64_t offset = 0; offset < m_size; offset += RECORDING_CHUNK_SIZE)
+		{
+			recording_index_entry_t entry = {};
+			entry.firstSample             = 0;
+			entry.chunk                   = uint32_t(offset / RECORDING_CHUNK_SIZE);
+			entry.type                    = uint32_t(ERecordingChunkType::Raw);
+			entry.payloadSize             = uint32_t(std::min<uint64_t>(RECORDING_CHUNK_SIZE, m_size - offset));
+			m_index.push_back(entry);
+		}
+		m_header.nChunk = m_index.size();
+		return true;
+	}
+
+	std::memcpy(&m_header, m_data, sizeof(m_header));
+	if (m_header.version != RECORDING_VERSION || m_header.headerSize != RECORDING_HEADER_SIZE || m_header.nChannel == 0
+		|| m_header.chunkSize <= sizeof(recording_chunk_header_t))
+	{
+		m_lastError = filename + " has an unsupported recording version or a corrupted header";
+		this->close();
+		return false;
+	}
+
+	const uint64_t indexSize = m_header.nChunk * sizeof(recording_index_entry_t);
+	if (m_header.nChunk != 0 && m_header.indexOffset >= RECORDING_HEADER_SIZE && m_header.indexOffset + indexSize <= m_size)
+	{
+		m_index.resize(size_t(m_header.nChunk));
+		std::memcpy(&m_index[0], m_data + m_header.indexOffset, size_t(indexSize));
+	}
+	else if (!this->rebuildIndex())
+	{
+		m_lastError = filename + " has no readable chunk";
+		this->close();
+		return false;
+	}
+
+	// the chunks must stay inside the mapping
+	for (const auto& entry : m_index)
+	{
+		if (entry.payloadSize > m_header.chunkSize - sizeof(recording_chunk_header_t)
+			|| RECORDING_HEADER_SIZE + uint64_t(entry.chunk) * m_header.chunkSize + sizeof(recording_chunk_header_t) + entry.payloadSize > m_size)
+		{
+			m_lastError = filename + " has an index pointing outside of the file";
+			this->close();
+			return false;
+		}
+		if (entry.type == uint32_t(ERecordingChunkType::Samples)) { m_sampleChunks.push_back(uint32_t(&entry - &m_index[0])); }
+	}
+	return true;
+}
+
+bool CModularBCIRecordingReader::rebuildIndex()
+{
+	// the recording was interrupted, the chunk slots written so far are still valid
+	uint64_t nSample = 0, nRawByte = 0;
+	for (uint64_t offset = RECORDING_HEADER_SIZE; offset + sizeof(recording_chunk_header_t) <= m_size; offset += m_header.chunkSize)
+	{
+		recording_chunk_header_t chunk;
+		std::memcpy(&chunk, m_data + offset, sizeof(chunk));
+		if (chunk.magic != RECORDING_CHUNK_MAGIC || chunk.payloadSize > m_header.chunkSize - sizeof(recording_chunk_header_t)
+			|| offset + sizeof(chunk) + chunk.payloadSize > m_size) { break; }
+
+		recording_index_entry_t entry;
+		entry.firstSample = chunk.firstSample;
+		entry.time        = chunk.time;
+		entry.chunk       = uint32_t((offset - RECORDING_HEADER_SIZE) / m_header.chunkSize);
+		entry.type        = chunk.type;
+		entry.nSample     = chunk.nSample;
+		entry.payloadSize = chunk.payloadSize;
+		m_index.push_back(entry);
+
+		if (chunk.type == uint32_t(ERecordingChunkType::Samples)) { nSample = std::max(nSample, chunk.firstSample + chunk.nSample); }
+		else { nRawByte = std::max(nRawByte, chunk.firstRawByte + chunk.payloadSize); }
+	}
+
+	m_header.nChunk   = m_index.size();
+	m_header.nSample  = nSample;
+	m_header.nRawByte = nRawByte;
+	return !m_index.empty();
+}
+
+void CModularBCIRecordingReader::close()
+{
+#if defined TARGET_OS_Windows
+	if (m_data != nullptr) { ::UnmapViewOfFile(m_data); }
+	if (m_mapping != nullptr) { ::CloseHandle(m_mapping); }
+	if (m_file != nullptr) { ::CloseHandle(m_file); }
+	m_mapping = nullptr;
+	m_file    = nullptr;
+#elif defined TARGET_OS_Linux
+	if (m_data != nullptr) { ::munmap(const_cast<uint8_t*>(m_data), size_t(m_size)); }
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_index.clear();
+	m_sampleChunks.clear();
+}
+
+const recording_chunk_header_t* CModularBCIRecordingReader::getChunkHeader(const recording_index_entry_t& entry) const
+{
+	if (m_plainCapture) { return nullptr; }
+	return reinterpret_cast<const recording_chunk_header_t*>(m_data + RECORDING_HEADER_SIZE + uint64_t(entry.chunk) * m_header.chunkSize);
+}
+
+const uint8_t* CModularBCIRecordingReader::getPayload(const recording_index_entry_t& entry) const
+{
+	if (m_plainCapture) { return m_data + uint64_t(entry.chunk) * RECORDING_CHUNK_SIZE; }
+	return m_data + RECORDING_HEADER_SIZE + uint64_t(entry.chunk) * m_header.chunkSize + sizeof(recording_chunk_header_t);
+}
+
+size_t CModularBCIRecordingReader::findSampleChunk(const uint64_t sample) const
+{
+	// sample chunks are written in increasing sample order
+	const auto it = std::upper_bound(m_sampleChunks.begin(), m_sampleChunks.end(), sample,
+									 [this](const uint64_t value, const uint32_t i) { return value < m_index[i].firstSample; });
+	if (it == m_sampleChunks.begin()) { return m_index.size(); }
+	const auto& entry = m_index[*(it - 1)];
+	return sample < entry.firstSample + entry.nSample ? *(it - 1) : m_index.size();
+}
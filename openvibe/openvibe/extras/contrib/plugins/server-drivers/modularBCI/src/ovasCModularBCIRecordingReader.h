@@ -0,0 +1,68 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIRecordingFormat.h"
+
+#include <string>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIRecordingReader
+		 * \brief Read-only memory mapping of a ModularBCI recording
+		 *
+		 * Opens .mbci recordings as well as plain captures of the UART byte stream (any file that
+		 * does not start with the recording magic). A plain capture is exposed as a sequence of raw
+		 * chunks of RECORDING_CHUNK_SIZE bytes without timestamps, and its header only has the
+		 * magic and the chunk size filled in. The index of a recording that was not closed is
+		 * rebuilt by scanning the chunk slots.
+		 */
+		class CModularBCIRecordingReader final
+		{
+		public:
+
+			~CModularBCIRecordingReader() { this->close(); }
+
+			bool open(const std::string& filename);
+			void close();
+			bool isOpen() const { return m_data != nullptr; }
+			bool isPlainCapture() const { return m_plainCapture; }
+
+			const std::string& getLastError() const { return m_lastError; }
+			const recording_header_t& getHeader() const { return m_header; }
+			const std::vector<recording_index_entry_t>& getIndex() const { return m_index; }
+
+			// nullptr for plain captures
+			const recording_chunk_header_t* getChunkHeader(const recording_index_entry_t& entry) const;
+			const uint8_t* getPayload(const recording_index_entry_t& entry) const;
+
+			// index entry of the samples chunk that holds the sample, getIndex().size() if none (out of range or dropped)
+			size_t findSampleChunk(uint64_t sample) const;
+
+		protected:
+
+			bool rebuildIndex();
+
+			std::string m_lastError;
+			recording_header_t m_header = {};
+			std::vector<recording_index_entry_t> m_index;
+			std::vector<uint32_t> m_sampleChunks; // positions of the samples chunks in m_index
+			bool m_plainCapture = false;
+
+			const uint8_t* m_data = nullptr;
+			uint64_t m_size       = 0;
+#if defined TARGET_OS_Windows
+			void* m_file    = nullptr;
+			void* m_mapping = nullptr;
+#endif
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
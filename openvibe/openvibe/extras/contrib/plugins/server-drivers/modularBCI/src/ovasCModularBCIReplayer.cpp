@@ -0,0 +1,129 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIReplayer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+bool CModularBCIReplayer::initialize(const CModularBCIRecordingReader& reader, const ERecordingChunkType type, const double speed, const double nominalRate)
+{
+	this->uninitialize();
+	if (!reader.isOpen() || speed < 0 || nominalRate <= 0) { return false; }
+	if (type == ERecordingChunkType::Samples && reader.isPlainCapture()) { return false; }
+
+	m_reader      = &reader;
+	m_type        = type;
+	m_unitSize    = (type == ERecordingChunkType::Raw ? 1 : reader.getHeader().nChannel * sizeof(int32_t));
+	m_speed       = speed;
+	m_nominalRate = nominalRate;
+	m_hasTime     = !reader.isPlainCapture();
+
+	uint64_t position = 0;
+	const auto& index = reader.getIndex();
+	for (size_t i = 0; i < index.size(); ++i)
+	{
+		if (index[i].type != uint32_t(type)) { continue; }
+
+		entry_t entry;
+		entry.index = uint32_t(i);
+		entry.time  = index[i].time;
+		if (type == ERecordingChunkType::Samples)
+		{
+			entry.position = index[i].firstSample;
+			entry.count    = index[i].nSample;
+		}
+		else
+		{
+			entry.position = reader.isPlainCapture() ? position : reader.getChunkHeader(index[i])->firstRawByte;
+			entry.count    = index[i].payloadSize;
+		}
+		position = entry.position + entry.count;
+		if (entry.count != 0) { m_entries.push_back(entry); }
+	}
+
+	if (m_entries.empty()) { return false; }
+	m_position = m_entries[0].position;
+	return true;
+}
+
+void CModularBCIReplayer::uninitialize()
+{
+	m_reader   = nullptr;
+	m_started  = false;
+	m_entry    = 0;
+	m_position = 0;
+	m_nSkipped = 0;
+	m_entries.clear();
+}
+
+void CModularBCIReplayer::start()
+{
+	m_startTime = std::chrono::steady_clock::now();
+	m_started   = true;
+}
+
+uint64_t CModularBCIReplayer::getDuePosition() const
+{
+	if (m_speed == 0) { return uint64_t(-1); }
+
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count() * m_speed; // in s of recording
+
+	if (!m_hasTime) { return m_entries[0].position + uint64_t(elapsed * m_nominalRate); }
+
+	// last chunk that started before the due time, then interpolates towards the next one
+	const uint64_t time = m_entries[0].time + uint64_t(elapsed * 1000000);
+	const auto it       = std::upper_bound(m_entries.begin(), m_entries.end(), time, [](const uint64_t value, const entry_t& entry) { return value < entry.time; });
+	const entry_t& from = *(it == m_entries.begin() ? it : it - 1);
+	if (time < from.time) { return from.position; }
+
+	const double offset = double(time - from.time) / 1000000;
+	if (it != m_entries.end() && it->time > from.time)
+	{
+		const double rate = double(from.count) / (double(it->time - from.time) / 1000000);
+		return from.position + std::min(from.count, uint64_t(offset * rate));
+	}
+	return from.position + std::min(from.count, uint64_t(offset * m_nominalRate));
+}
+
+size_t CModularBCIReplayer::read(void* buffer, const size_t maxCount)
+{
+	if (m_reader == nullptr || this->isFinished()) { return 0; }
+	if (!m_started) { this->start(); }
+
+	const uint64_t due = this->getDuePosition();
+	uint8_t* output    = static_cast<uint8_t*>(buffer);
+	size_t count       = 0;
+
+	while (count < maxCount && m_position < due && !this->isFinished())
+	{
+		const entry_t& entry = m_entries[m_entry];
+		if (m_position < entry.position)
+		{
+			// data lost at recording time, jumps over it
+			m_nSkipped += entry.position - m_position;
+			m_position = entry.position;
+			continue;
+		}
+		if (m_position >= entry.position + entry.count)
+		{
+			m_entry++;
+			continue;
+		}
+
+		const uint64_t offset = m_position - entry.position;
+		const size_t n        = size_t(std::min<uint64_t>(std::min<uint64_t>(entry.count - offset, maxCount - count), due - m_position));
+		std::memcpy(output + count * m_unitSize, m_reader->getPayload(m_reader->getIndex()[entry.index]) + offset * m_unitSize, n * m_unitSize);
+		count += n;
+		m_position += n;
+	}
+
+	while (!this->isFinished() && m_position >= m_entries[m_entry].position + m_entries[m_entry].count) { m_entry++; }
+	return count;
+}
@@ -0,0 +1,70 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIRecordingReader.h"
+
+#include <chrono>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIReplayer
+		 * \brief Paces one stream of a recording (raw bytes or decoded samples) for replay
+		 *
+		 * The chunk timestamps of the recording are used as anchors of the original arrival time,
+		 * with linear interpolation inside a chunk and the nominal rate after the last one. Plain
+		 * captures have no timestamps and are paced at the nominal rate. With a speed of 0, data is
+		 * delivered as fast as it is read.
+		 */
+		class CModularBCIReplayer final
+		{
+		public:
+
+			// nominalRate is in bytes per second for raw streams, in samples per second otherwise
+			bool initialize(const CModularBCIRecordingReader& reader, ERecordingChunkType type, double speed, double nominalRate);
+			void uninitialize();
+
+			void start(); // the replay clock starts on the first read otherwise
+
+			// copies at most maxCount bytes (raw) or samples of nChannel int32 values (samples) that are due, returns the count copied
+			size_t read(void* buffer, size_t maxCount);
+
+			bool isFinished() const { return m_entry >= m_entries.size(); }
+			uint64_t getPosition() const { return m_position; }
+			uint64_t getSkippedCount() const { return m_nSkipped; } // data dropped at recording time
+
+		protected:
+
+			typedef struct
+			{
+				uint32_t index;    // position in the reader index
+				uint64_t time;     // in us since the start of the recording
+				uint64_t position; // stream position of the first byte / sample of the chunk
+				uint64_t count;    // bytes / samples in the chunk
+			} entry_t;
+
+			uint64_t getDuePosition() const;
+
+			const CModularBCIRecordingReader* m_reader = nullptr;
+			ERecordingChunkType m_type                 = ERecordingChunkType::Raw;
+			size_t m_unitSize                          = 1; // bytes per position
+			double m_speed                             = 1;
+			double m_nominalRate                       = 0;
+			bool m_hasTime                             = false;
+			std::vector<entry_t> m_entries;
+
+			bool m_started = false;
+			std::chrono::steady_clock::time_point m_startTime;
+			size_t m_entry      = 0; // current chunk
+			uint64_t m_position = 0; // next byte / sample to deliver
+			uint64_t m_nSkipped = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,341 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCISSVEPDetector.h"
+#include "ovasCModularBCILinearAlgebra.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define SSVEP_CHUNK_SIZE 64            // samples filtered at once
+#define SSVEP_SUB_BAND_MARGIN 2.0      // in Hz, sub-band m starts this much below m times the lowest target frequency
+#define SSVEP_SUB_BAND_HIGH 88.0       // in Hz, common upper edge of the sub-bands
+#define SSVEP_RIDGE 1e-6               // regularization of the cross-products, relative to their mean diagonal value
+#define BUTTERWORTH_Q 0.70710678
+#define BUTTERWORTH_Q4_1 0.54119610    // the two sections of a fourth order Butterworth filter
+#define BUTTERWORTH_Q4_2 1.30656296
+
+namespace
+{
+	// copies the upper triangle of a n x n matrix into a full symmetric one, with a ridge on the diagonal
+	void symmetrize(const double* upper, const size_t n, std::vector<double>& full)
+	{
+		double trace = 0;
+		for (size_t i = 0; i < n; ++i) { trace += upper[i * n + i]; }
+		const double ridge = SSVEP_RIDGE * trace / double(n) + 1e-300;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			full[i * n + i] = upper[i * n + i] + ridge;
+			for (size_t j = i + 1; j < n; ++j) { full[i * n + j] = full[j * n + i] = upper[i * n + j]; }
+		}
+	}
+}  // namespace
+
+bool CModularBCISSVEPDetector::parseFrequencies(const std::string& text, std::vector<double>& frequencies)
+{
+	frequencies.clear();
+	std::stringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, ';'))
+	{
+		if (item.find_first_not_of(" \t") == std::string::npos) { continue; }
+		char* end              = nullptr;
+		const double frequency = std::strtod(item.c_str(), &end);
+		if (end == item.c_str() || frequency <= 0) { return false; }
+		frequencies.push_back(frequency);
+	}
+	return !frequencies.empty();
+}
+
+bool CModularBCISSVEPDetector::initialize(const std::vector<size_t>& channels, const double sampling, const std::vector<double>& frequencies,
+										  const size_t nHarmonic, const size_t nSubBand, const size_t windowSize, const size_t hopSize)
+{
+	this->uninitialize();
+	if (channels.empty() || sampling <= 0 || frequencies.empty() || nHarmonic == 0 || nSubBand == 0 || hopSize == 0) { return false; }
+
+	// references above the Nyquist frequency would alias
+	const double lowest  = *std::min_element(frequencies.begin(), frequencies.end());
+	const double highest = *std::max_element(frequencies.begin(), frequencies.end());
+	if (highest * double(nHarmonic) >= sampling / 2 || windowSize <= std::max(channels.size(), 2 * nHarmonic)) { return false; }
+
+	m_subBandHigh = std::min(SSVEP_SUB_BAND_HIGH, 0.45 * sampling);
+	for (size_t m = 0; m < nSubBand; ++m)
+	{
+		const double low = std::max(1.0, double(m + 1) * lowest - SSVEP_SUB_BAND_MARGIN);
+		if (low >= m_subBandHigh - 2 * SSVEP_SUB_BAND_MARGIN) { break; }
+		m_subBandLow.push_back(low);
+		m_subBandWeights.push_back(std::pow(double(m + 1), -1.25) + 0.25);
+	}
+	if (m_subBandLow.empty()) { return false; }
+
+	m_channels    = channels;
+	m_nChannel    = channels.size();
+	m_nSubBand    = m_subBandLow.size();
+	m_nTarget     = frequencies.size();
+	m_nReference  = 2 * nHarmonic;
+	m_windowSize  = windowSize;
+	m_hopSize     = hopSize;
+	m_frequencies = frequencies;
+	for (const auto& frequency : frequencies) { for (size_t h = 1; h <= nHarmonic; ++h) { m_referenceSteps.push_back(frequency * double(h) / sampling); } }
+
+	// sub-band m is a fourth order high-pass at its low edge and the common low-pass
+	const size_t nRow = m_nSubBand * m_nChannel;
+	bool ok           = m_filterBank.initialize(nRow, sampling);
+	for (size_t m = 0; ok && m < m_nSubBand; ++m)
+	{
+		for (size_t c = 0; ok && c < m_nChannel; ++c)
+		{
+			const size_t row = m * m_nChannel + c;
+			ok &= m_filterBank.addStage(row, CModularBCIFilterBank::EFilterType::HighPass, m_subBandLow[m], BUTTERWORTH_Q4_1);
+			ok &= m_filterBank.addStage(row, CModularBCIFilterBank::EFilterType::HighPass, m_subBandLow[m], BUTTERWORTH_Q4_2);
+			ok &= m_filterBank.addStage(row, CModularBCIFilterBank::EFilterType::LowPass, m_subBandHigh, BUTTERWORTH_Q);
+		}
+	}
+	if (!ok)
+	{
+		this->uninitialize();
+		return false;
+	}
+
+	const size_t nColumn = m_nTarget * m_nReference;
+	m_chunk.assign(SSVEP_CHUNK_SIZE * nRow, 0);
+	m_samples.assign(windowSize * nRow, 0);
+	m_references.assign(windowSize * nColumn, 0);
+	m_sxx.assign(m_nSubBand * m_nChannel * m_nChannel, 0);
+	m_sxy.assign(m_nSubBand * nColumn * m_nChannel, 0);
+	m_syy.assign(m_nTarget * m_nReference * m_nReference, 0);
+	m_factor.assign(m_nChannel * m_nChannel, 0);
+	m_whitened.assign(nColumn * m_nChannel, 0);
+	m_referenceFactors.assign(m_nTarget, std::vector<double>(m_nReference * m_nReference, 0));
+	m_correlation.assign(m_nReference * m_nReference + m_nReference, 0); // the matrix and one row of work space
+	m_scores.assign(m_nTarget, 0);
+	this->reset();
+	return true;
+}
+
+void CModularBCISSVEPDetector::uninitialize()
+{
+	m_channels.clear();
+	m_nChannel   = 0;
+	m_nSubBand   = 0;
+	m_nTarget    = 0;
+	m_nReference = 0;
+	m_frequencies.clear();
+	m_referenceSteps.clear();
+	m_subBandLow.clear();
+	m_subBandWeights.clear();
+	m_filterBank.uninitialize();
+	m_chunk.clear();
+	m_samples.clear();
+	m_references.clear();
+	m_sxx.clear();
+	m_sxy.clear();
+	m_syy.clear();
+	m_factor.clear();
+	m_whitened.clear();
+	m_referenceFactors.clear();
+	m_correlation.clear();
+	m_scores.clear();
+	m_nextSample            = 0;
+	m_artifactEnd           = 0;
+	m_nDecision             = 0;
+	m_nSuppressed           = 0;
+	m_maxDecisionDuration   = 0;
+	m_totalDecisionDuration = 0;
+}
+
+void CModularBCISSVEPDetector::reset()
+{
+	m_filterBank.reset();
+	std::fill(m_sxx.begin(), m_sxx.end(), 0.0);
+	std::fill(m_sxy.begin(), m_sxy.end(), 0.0);
+	std::fill(m_syy.begin(), m_syy.end(), 0.0);
+	m_position      = 0;
+	m_nFilled       = 0;
+	m_nSinceRefresh = 0;
+	m_nSinceHop     = 0;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+void CModularBCISSVEPDetector::process(const CModularBCISampleBus::CBlock& block)
+{
+	if (!this->isInitialized()) { return; }
+	if (block.getFirstSample() != m_nextSample) { this->reset(); }
+	if (block.getFlags() & CModularBCISampleBus::BlockFlag_Artifact) { m_artifactEnd = block.getFirstSample() + block.getSampleCount(); }
+
+	const size_t nRow      = m_nSubBand * m_nChannel;
+	const uint32_t nSample = block.getSampleCount();
+	for (uint32_t offset = 0; offset < nSample; offset += SSVEP_CHUNK_SIZE)
+	{
+		// every sub-band starts from a copy of the channel
+		const uint32_t n = std::min<uint32_t>(SSVEP_CHUNK_SIZE, nSample - offset);
+		for (size_t c = 0; c < m_nChannel; ++c)
+		{
+			const float* input = block.getChannel(uint32_t(m_channels[c])) + offset;
+			for (uint32_t i = 0; i < n; ++i) { for (size_t m = 0; m < m_nSubBand; ++m) { m_chunk[i * nRow + m * m_nChannel + c] = input[i]; } }
+		}
+		m_filterBank.process(&m_chunk[0], n);
+		for (uint32_t i = 0; i < n; ++i) { this->push(&m_chunk[i * nRow], block.getFirstSample() + offset + i); }
+	}
+	m_nextSample = block.getFirstSample() + nSample;
+}
+
+void CModularBCISSVEPDetector::push(const float* row, const uint64_t sampleIndex)
+{
+	const size_t n       = m_nChannel;
+	const size_t nRow    = m_nSubBand * n;
+	const size_t nColumn = m_nTarget * m_nReference;
+	double* x            = &m_samples[m_position * nRow];
+	double* y            = &m_references[m_position * nColumn];
+	const bool isFull    = m_nFilled == m_windowSize;
+
+	// the sample leaving the window is still in the ring slot the new one goes to
+	for (int pass = (isFull ? 0 : 1); pass < 2; ++pass)
+	{
+		const double sign = pass == 0 ? -1 : 1;
+		if (pass == 1)
+		{
+			for (size_t i = 0; i < nRow; ++i) { x[i] = row[i]; }
+			for (size_t r = 0; r < m_referenceSteps.size(); ++r)
+			{
+				// phase from the absolute sample index, so that references never drift
+				const double phase = 2 * 3.14159265358979323846 * std::fmod(m_referenceSteps[r] * double(sampleIndex), 1.0);
+				y[2 * r]           = std::sin(phase);
+				y[2 * r + 1]       = std::cos(phase);
+			}
+		}
+
+		for (size_t m = 0; m < m_nSubBand; ++m)
+		{
+			const double* xm = x + m * n;
+			double* sxx      = &m_sxx[m * n * n];
+			double* sxy      = &m_sxy[m * nColumn * n];
+			for (size_t i = 0; i < n; ++i)
+			{
+				const double xi = sign * xm[i];
+				for (size_t j = i; j < n; ++j) { sxx[i * n + j] += xi * xm[j]; }
+			}
+			for (size_t k = 0; k < nColumn; ++k)
+			{
+				const double yk = sign * y[k];
+				double* column  = sxy + k * n;
+				for (size_t i = 0; i < n; ++i) { column[i] += yk * xm[i]; }
+			}
+		}
+		for (size_t t = 0; t < m_nTarget; ++t)
+		{
+			const double* yt = y + t * m_nReference;
+			double* syy      = &m_syy[t * m_nReference * m_nReference];
+			for (size_t i = 0; i < m_nReference; ++i)
+			{
+				const double yi = sign * yt[i];
+				for (size_t j = i; j < m_nReference; ++j) { syy[i * m_nReference + j] += yi * yt[j]; }
+			}
+		}
+	}
+
+	m_position = (m_position + 1) % m_windowSize;
+	if (!isFull) { m_nFilled++; }
+
+	if (++m_nSinceRefresh >= m_windowSize) { this->recompute(); }
+	if (++m_nSinceHop >= m_hopSize && m_nFilled == m_windowSize)
+	{
+		m_nSinceHop = 0;
+		// no decision on a window that overlaps an artifact
+		if (sampleIndex + 1 - m_windowSize < m_artifactEnd) { m_nSuppressed++; }
+		else { this->decide(sampleIndex); }
+	}
+}
+
+void CModularBCISSVEPDetector::recompute()
+{
+	// rounding errors of the sliding updates never outlive a window
+	const size_t n       = m_nChannel;
+	const size_t nRow    = m_nSubBand * n;
+	const size_t nColumn = m_nTarget * m_nReference;
+	std::fill(m_sxx.begin(), m_sxx.end(), 0.0);
+	std::fill(m_sxy.begin(), m_sxy.end(), 0.0);
+	std::fill(m_syy.begin(), m_syy.end(), 0.0);
+
+	for (size_t s = 0; s < m_nFilled; ++s)
+	{
+		const double* x = &m_samples[s * nRow];
+		const double* y = &m_references[s * nColumn];
+		for (size_t m = 0; m < m_nSubBand; ++m)
+		{
+			const double* xm = x + m * n;
+			double* sxx      = &m_sxx[m * n * n];
+			double* sxy      = &m_sxy[m * nColumn * n];
+			for (size_t i = 0; i < n; ++i) { for (size_t j = i; j < n; ++j) { sxx[i * n + j] += xm[i] * xm[j]; } }
+			for (size_t k = 0; k < nColumn; ++k) { for (size_t i = 0; i < n; ++i) { sxy[k * n + i] += y[k] * xm[i]; } }
+		}
+		for (size_t t = 0; t < m_nTarget; ++t)
+		{
+			const double* yt = y + t * m_nReference;
+			double* syy      = &m_syy[t * m_nReference * m_nReference];
+			for (size_t i = 0; i < m_nReference; ++i) { for (size_t j = i; j < m_nReference; ++j) { syy[i * m_nReference + j] += yt[i] * yt[j]; } }
+		}
+	}
+	m_nSinceRefresh = 0;
+}
+
+void CModularBCISSVEPDetector::decide(const uint64_t sampleIndex)
+{
+	const auto start     = std::chrono::steady_clock::now();
+	const size_t n       = m_nChannel;
+	const size_t nRef    = m_nReference;
+	const size_t nColumn = m_nTarget * nRef;
+	double* work         = &m_correlation[nRef * nRef];
+
+	// the reference factors are shared by all sub-bands
+	for (size_t t = 0; t < m_nTarget; ++t)
+	{
+		symmetrize(&m_syy[t * nRef * nRef], nRef, m_referenceFactors[t]);
+		ModularBCILinearAlgebra::cholesky(m_referenceFactors[t], nRef);
+	}
+	std::fill(m_scores.begin(), m_scores.end(), 0.0);
+
+	for (size_t m = 0; m < m_nSubBand; ++m)
+	{
+		// whitens the channel side of all targets at once, Sxx = L L^T, A = L^-1 Sxy
+		symmetrize(&m_sxx[m * n * n], n, m_factor);
+		if (!ModularBCILinearAlgebra::cholesky(m_factor, n)) { continue; }
+		std::copy(m_sxy.begin() + m * nColumn * n, m_sxy.begin() + (m + 1) * nColumn * n, m_whitened.begin());
+		for (size_t k = 0; k < nColumn; ++k) { ModularBCILinearAlgebra::lowerSolve(m_factor, n, &m_whitened[k * n]); }
+
+		for (size_t t = 0; t < m_nTarget; ++t)
+		{
+			// B = A Ly^-T, the squared canonical correlations are the eigenvalues of B^T B
+			const double* a = &m_whitened[t * nRef * n];
+			std::fill(m_correlation.begin(), m_correlation.begin() + nRef * nRef, 0.0);
+			for (size_t i = 0; i < n; ++i)
+			{
+				for (size_t r = 0; r < nRef; ++r) { work[r] = a[r * n + i]; }
+				ModularBCILinearAlgebra::lowerSolve(m_referenceFactors[t], nRef, work);
+				for (size_t r = 0; r < nRef; ++r) { for (size_t s = 0; s < nRef; ++s) { m_correlation[r * nRef + s] += work[r] * work[s]; } }
+			}
+			const double rho2 = ModularBCILinearAlgebra::largestEigenvalue(m_correlation, nRef);
+			m_scores[t] += m_subBandWeights[m] * std::min(1.0, std::max(0.0, rho2));
+		}
+	}
+
+	const size_t best     = size_t(std::max_element(m_scores.begin(), m_scores.end()) - m_scores.begin());
+	const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_maxDecisionDuration = std::max(m_maxDecisionDuration, duration);
+	m_totalDecisionDuration += duration;
+	m_nDecision++;
+
+	if (m_listener) { m_listener(sampleIndex, best, m_scores); }
+}
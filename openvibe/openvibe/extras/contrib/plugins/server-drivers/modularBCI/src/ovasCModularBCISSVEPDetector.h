@@ -0,0 +1,121 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIFilterBank.h"
+#include "ovasCModularBCISampleBus.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCISSVEPDetector
+		 * \brief Filter-bank canonical correlation analysis (FBCCA) of SSVEP targets, fed with sample bus blocks
+		 *
+		 * Each selected channel is split into sub-bands that start at multiples of the lowest target
+		 * frequency, so that the higher sub-bands only hold the harmonics. Per sub-band and target,
+		 * the canonical correlation between the channels and sine / cosine references at the target
+		 * frequency and its harmonics is combined as sum(w(m) * rho(m)^2), w(m) = m^-1.25 + 0.25.
+		 *
+		 * The references are computed from the absolute sample index and kept in a ring alongside the
+		 * samples, and the cross-product matrices the CCA needs (channels x channels per sub-band,
+		 * channels x references of all targets per sub-band, references x references per target) are
+		 * slid one sample at a time with rank-one updates. A decision therefore costs the same whatever
+		 * the window length: one Cholesky factorization and one triangular solve of all the targets at
+		 * once per sub-band, then small references x references eigenproblems. This is equivalent to
+		 * the QR formulation of CCA. All buffers are allocated by initialize(), none while streaming.
+		 */
+		class CModularBCISSVEPDetector final
+		{
+		public:
+
+			// scores holds one FBCCA score per target, target is the index of the best one
+			typedef std::function<void(uint64_t sampleIndex, size_t target, const std::vector<double>& scores)> listener_t;
+
+			// parses "f1;f2;..." frequency lists in Hz
+			static bool parseFrequencies(const std::string& text, std::vector<double>& frequencies);
+
+			// channels are indices into the block channels, nSubBand is reduced when the higher sub-bands would not fit below the Nyquist frequency
+			bool initialize(const std::vector<size_t>& channels, double sampling, const std::vector<double>& frequencies, size_t nHarmonic, size_t nSubBand,
+							size_t windowSize, size_t hopSize);
+			void uninitialize();
+			bool isInitialized() const { return m_nChannel != 0; }
+
+			void setListener(const listener_t& listener) { m_listener = listener; }
+			const std::vector<double>& getFrequencies() const { return m_frequencies; }
+			size_t getSubBandCount() const { return m_nSubBand; }
+			double getSubBandLowFrequency(const size_t subBand) const { return m_subBandLow[subBand]; }
+			double getSubBandHighFrequency() const { return m_subBandHigh; }
+
+			// feeds a block of the sample bus, blocks must be consecutive (a gap resets the window)
+			void process(const CModularBCISampleBus::CBlock& block);
+
+			uint64_t getDecisionCount() const { return m_nDecision; }
+			uint64_t getSuppressedCount() const { return m_nSuppressed; } // decisions skipped as their window overlapped an artifact
+			double getMaxDecisionDuration() const { return m_maxDecisionDuration; } // in s
+			double getMeanDecisionDuration() const { return m_nDecision == 0 ? 0 : m_totalDecisionDuration / double(m_nDecision); }
+
+		protected:
+
+			void reset();
+			void push(const float* row, uint64_t sampleIndex);
+			void recompute();
+			void decide(uint64_t sampleIndex);
+
+			std::vector<size_t> m_channels;
+			size_t m_nChannel   = 0;
+			size_t m_nSubBand   = 0;
+			size_t m_nTarget    = 0;
+			size_t m_nReference = 0; // 2 * nHarmonic per target
+			size_t m_windowSize = 0;
+			size_t m_hopSize    = 0;
+			std::vector<double> m_frequencies;
+			std::vector<double> m_referenceSteps; // cycles per sample of each target harmonic
+			std::vector<double> m_subBandLow;
+			double m_subBandHigh = 0;
+			std::vector<double> m_subBandWeights;
+			listener_t m_listener;
+
+			CModularBCIFilterBank m_filterBank; // nSubBand * nChannel channels, sub-band major
+			std::vector<float> m_chunk;         // sample-major rows of nSubBand * nChannel values, filtered in place
+
+			// rings of windowSize samples
+			std::vector<double> m_samples;    // nSubBand * nChannel values per sample
+			std::vector<double> m_references; // nTarget * nReference values per sample
+			size_t m_position      = 0;
+			size_t m_nFilled       = 0;
+			size_t m_nSinceRefresh = 0;
+			size_t m_nSinceHop     = 0;
+			uint64_t m_nextSample  = 0;
+			uint64_t m_artifactEnd = 0; // sample after the last block flagged as artifact
+
+			// sliding cross-products, upper triangles for the symmetric ones
+			std::vector<double> m_sxx; // per sub-band, nChannel x nChannel
+			std::vector<double> m_sxy; // per sub-band, nTarget * nReference columns of nChannel values
+			std::vector<double> m_syy; // per target, nReference x nReference
+
+			// decision workspace
+			std::vector<double> m_factor;                        // Cholesky factor of one sub-band
+			std::vector<double> m_whitened;                      // m_sxy of one sub-band, whitened by m_factor
+			std::vector<std::vector<double>> m_referenceFactors; // Cholesky factor of each target
+			std::vector<double> m_correlation;                   // nReference x nReference
+			std::vector<double> m_scores;
+
+			uint64_t m_nDecision           = 0;
+			uint64_t m_nSuppressed         = 0;
+			double m_maxDecisionDuration   = 0;
+			double m_totalDecisionDuration = 0;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,267 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCISampleBus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define NO_BLOCK uint32_t(-1)
+
+bool CModularBCISampleBus::initialize(const uint32_t nChannel, const uint32_t capacity, const size_t nSlot, const size_t nExtraBlock, const size_t maxSubscriber)
+{
+	this->uninitialize();
+	if (nChannel == 0 || capacity == 0 || nSlot == 0 || maxSubscriber == 0) { return false; }
+
+	size_t nSlotPow2 = 1;
+	while (nSlotPow2 < nSlot) { nSlotPow2 *= 2; }
+
+	m_nChannel = nChannel;
+	m_slotMask = nSlotPow2 - 1;
+	m_nBlock   = nSlotPow2 + std::max<size_t>(nExtraBlock, 1); // the writer always finds a block while no reader holds more than nExtraBlock
+	m_data.assign(m_nBlock * nChannel * capacity, 0);
+	m_blocks.reset(new CBlock[m_nBlock]);
+	for (size_t i = 0; i < m_nBlock; ++i)
+	{
+		m_blocks[i].m_nChannel = nChannel;
+		m_blocks[i].m_capacity = capacity;
+		m_blocks[i].m_data     = &m_data[i * nChannel * capacity];
+	}
+
+	m_slots.reset(new std::atomic<uint32_t>[nSlotPow2]);
+	for (size_t i = 0; i < nSlotPow2; ++i) { m_slots[i].store(NO_BLOCK); }
+
+	m_maxSubscriber = maxSubscriber;
+	m_subscribers.reset(new subscriber_t[maxSubscriber]);
+	m_head.store(0);
+	m_nOverrun.store(0);
+	m_nextBlock = 0;
+	return true;
+}
+
+void CModularBCISampleBus::uninitialize()
+{
+	m_blocks.reset();
+	m_slots.reset();
+	m_subscribers.reset();
+	m_data.clear();
+	m_nBlock        = 0;
+	m_maxSubscriber = 0;
+	m_nChannel      = 0;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+uint64_t CModularBCISampleBus::getSlowestBlockingCursor(const uint64_t head) const
+{
+	uint64_t res = head;
+	for (size_t i = 0; i < m_maxSubscriber; ++i)
+	{
+		const subscriber_t& subscriber = m_subscribers[i];
+		if (subscriber.active.load(std::memory_order_acquire) && subscriber.blocking.load(std::memory_order_relaxed))
+		{
+			res = std::min(res, subscriber.cursor.load(std::memory_order_acquire));
+		}
+	}
+	return res;
+}
+
+CModularBCISampleBus::CBlock* CModularBCISampleBus::acquire()
+{
+	if (!m_blocks) { return nullptr; }
+
+	const uint64_t head = m_head.load(std::memory_order_relaxed);
+	while (true)
+	{
+		// a blocking subscriber must have read the block the new one will push out of the ring
+		if (head - this->getSlowestBlockingCursor(head) <= m_slotMask)
+		{
+			for (size_t n = 0; n < m_nBlock; ++n)
+			{
+				CBlock& block = m_blocks[m_nextBlock];
+				m_nextBlock   = (m_nextBlock + 1) % m_nBlock;
+				if (block.m_refCount.load(std::memory_order_acquire) == 0)
+				{
+					block.m_sequence    = head;
+					block.m_nSample     = 0;
+					block.m_firstSample = 0;
+					block.m_flags       = 0;
+					block.m_time        = 0;
+					return &block;
+				}
+			}
+			// every block is held by readers, only blocking subscribers are worth waiting for
+			if (this->getSlowestBlockingCursor(head) == head)
+			{
+				m_nOverrun.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+		}
+		std::this_thread::yield();
+	}
+}
+
+void CModularBCISampleBus::publish(CBlock* block)
+{
+	const uint64_t head = m_head.load(std::memory_order_relaxed);
+	block->m_refCount.store(1, std::memory_order_release); // reference of the ring
+
+	const uint32_t previous = m_slots[head & m_slotMask].exchange(uint32_t(block - &m_blocks[0]), std::memory_order_acq_rel);
+	if (previous != NO_BLOCK) { m_blocks[previous].m_refCount.fetch_sub(1, std::memory_order_acq_rel); }
+
+	m_head.store(head + 1, std::memory_order_release);
+	m_condition.notify_all(); // a reader that misses it wakes up on its timeout
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+size_t CModularBCISampleBus::subscribe(const EPolicy policy)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_maxSubscriber; ++i)
+	{
+		subscriber_t& subscriber = m_subscribers[i];
+		if (!subscriber.active.load())
+		{
+			subscriber.cursor.store(m_head.load());
+			subscriber.nDropped.store(0);
+			subscriber.blocking.store(policy == EPolicy::Block);
+			subscriber.active.store(true, std::memory_order_release);
+			return i;
+		}
+	}
+	return INVALID_SUBSCRIBER;
+}
+
+void CModularBCISampleBus::unsubscribe(const size_t subscriber)
+{
+	if (subscriber < m_maxSubscriber) { m_subscribers[subscriber].active.store(false, std::memory_order_release); }
+}
+
+bool CModularBCISampleBus::tryReference(CBlock& block) const
+{
+	// a block whose count dropped to 0 may already be refilled by the writer
+	uint32_t count = block.m_refCount.load(std::memory_order_acquire);
+	while (count != 0)
+	{
+		if (block.m_refCount.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel)) { return true; }
+	}
+	return false;
+}
+
+const CModularBCISampleBus::CBlock* CModularBCISampleBus::read(const size_t subscriber)
+{
+	if (subscriber >= m_maxSubscriber) { return nullptr; }
+	subscriber_t& state = m_subscribers[subscriber];
+
+	uint64_t cursor = state.cursor.load(std::memory_order_relaxed);
+	while (true)
+	{
+		const uint64_t head = m_head.load(std::memory_order_acquire);
+		if (cursor >= head) { return nullptr; }
+
+		// overrun, the ring only holds the last slot count blocks
+		if (head - cursor > m_slotMask + 1)
+		{
+			state.nDropped.fetch_add(head - (m_slotMask + 1) - cursor, std::memory_order_relaxed);
+			cursor = head - (m_slotMask + 1);
+		}
+
+		const uint32_t index = m_slots[cursor & m_slotMask].load(std::memory_order_acquire);
+		if (index != NO_BLOCK && this->tryReference(m_blocks[index]))
+		{
+			// the slot may have been reused between the load and the reference
+			if (m_blocks[index].m_sequence == cursor)
+			{
+				state.cursor.store(cursor + 1, std::memory_order_release);
+				return &m_blocks[index];
+			}
+			this->release(&m_blocks[index]);
+		}
+
+		// overwritten while reading it
+		state.nDropped.fetch_add(1, std::memory_order_relaxed);
+		cursor++;
+		state.cursor.store(cursor, std::memory_order_release);
+	}
+}
+
+void CModularBCISampleBus::release(const CBlock* block)
+{
+	if (block != nullptr) { const_cast<CBlock*>(block)->m_refCount.fetch_sub(1, std::memory_order_acq_rel); }
+}
+
+bool CModularBCISampleBus::wait(const size_t subscriber, const uint32_t timeoutMs)
+{
+	if (subscriber >= m_maxSubscriber) { return false; }
+	const subscriber_t& state = m_subscribers[subscriber];
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return m_condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]()
+	{
+		return state.cursor.load(std::memory_order_relaxed) < m_head.load(std::memory_order_acquire);
+	});
+}
+
+uint64_t CModularBCISampleBus::getDroppedCount(const size_t subscriber) const
+{
+	return subscriber < m_maxSubscriber ? m_subscribers[subscriber].nDropped.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t CModularBCISampleBus::getPendingCount(const size_t subscriber) const
+{
+	if (subscriber >= m_maxSubscriber || !m_subscribers[subscriber].active.load(std::memory_order_relaxed)) { return 0; }
+	const uint64_t head   = m_head.load(std::memory_order_relaxed);
+	const uint64_t cursor = m_subscribers[subscriber].cursor.load(std::memory_order_relaxed);
+	return head > cursor ? head - cursor : 0;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIBusConsumer::start(CModularBCISampleBus& bus, const CModularBCISampleBus::EPolicy policy, const handler_t& handler)
+{
+	this->stop();
+	m_subscriber = bus.subscribe(policy);
+	if (m_subscriber == CModularBCISampleBus::INVALID_SUBSCRIBER) { return false; }
+
+	m_bus     = &bus;
+	m_handler = handler;
+	m_stop.store(false);
+	m_thread = std::thread([this]()
+	{
+		while (!m_stop.load())
+		{
+			const CModularBCISampleBus::CBlock* block = m_bus->read(m_subscriber);
+			if (block == nullptr)
+			{
+				m_bus->wait(m_subscriber, 50);
+				continue;
+			}
+			m_handler(*block);
+			m_bus->release(block);
+		}
+	});
+	return true;
+}
+
+void CModularBCIBusConsumer::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_stop.store(true);
+		m_thread.join();
+	}
+	if (m_bus != nullptr) { m_bus->unsubscribe(m_subscriber); }
+	m_bus        = nullptr;
+	m_subscriber = CModularBCISampleBus::INVALID_SUBSCRIBER;
+}
@@ -0,0 +1,163 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCISampleBus
+		 * \brief Single writer / multiple reader fan-out of the decoded sample blocks
+		 *
+		 * Blocks come from a pool allocated by initialize() and are published into a ring of
+		 * slots. Readers get a read-only reference to the published block itself, so adding a
+		 * consumer costs no copy of the stream. A block goes back to the pool when the ring has
+		 * moved past it and no reader holds it anymore.
+		 *
+		 * Each subscriber has its own cursor and policy. A DropOldest subscriber that falls more
+		 * than the ring depth behind skips the oldest blocks and counts them. A Block subscriber
+		 * makes the writer wait until it has caught up, which stalls the acquisition: use it only
+		 * for consumers that must see every block, such as offline replays.
+		 *
+		 * Blocks are channel-major (nChannel rows of nSample values), the layout OpenViBE expects.
+		 */
+		class CModularBCISampleBus final
+		{
+		public:
+
+			enum class EPolicy { DropOldest, Block };
+
+			// bits of CBlock::getFlags()
+			enum EBlockFlag : uint32_t
+			{
+				BlockFlag_Artifact = 1 << 0, // at least one sample of the block is part of an artifact
+			};
+
+			class CBlock final
+			{
+			public:
+				uint64_t getSequence() const { return m_sequence; }
+				uint64_t getFirstSample() const { return m_firstSample; } // index of the first sample since the driver was initialized
+				uint32_t getSampleCount() const { return m_nSample; }
+				uint32_t getChannelCount() const { return m_nChannel; }
+				uint32_t getFlags() const { return m_flags; }
+				uint64_t getTime() const { return m_time; } // when the data of the block reached the host, in us of getDroneLinkTime(), 0 if unknown
+				const float* getChannel(const uint32_t channel) const { return m_data + size_t(channel) * m_nSample; }
+				const float* getData() const { return m_data; }
+
+				// writer side, valid between acquire() and publish()
+				float* getData() { return m_data; }
+				uint32_t getCapacity() const { return m_capacity; } // in samples
+				void setSampleCount(const uint32_t nSample) { m_nSample = nSample; }
+				void setFirstSample(const uint64_t firstSample) { m_firstSample = firstSample; }
+				void setFlags(const uint32_t flags) { m_flags = flags; }
+				void setTime(const uint64_t time) { m_time = time; }
+
+			private:
+				friend class CModularBCISampleBus;
+				uint64_t m_sequence    = 0;
+				uint64_t m_firstSample = 0;
+				uint32_t m_nSample     = 0;
+				uint32_t m_nChannel    = 0;
+				uint32_t m_capacity    = 0;
+				uint32_t m_flags       = 0;
+				uint64_t m_time        = 0;
+				float* m_data          = nullptr;
+				std::atomic<uint32_t> m_refCount{0}; // the ring holds one reference while the block is in a slot
+			};
+
+			static const size_t INVALID_SUBSCRIBER = size_t(-1);
+
+			// nSlot is rounded up to a power of two, the pool holds nSlot + nExtraBlock blocks (readers may keep up to nExtraBlock blocks in total)
+			bool initialize(uint32_t nChannel, uint32_t capacity, size_t nSlot = 64, size_t nExtraBlock = 32, size_t maxSubscriber = 8);
+			void uninitialize(); // no reader may hold a block anymore
+
+			// writer
+			CBlock* acquire(); // nullptr when every block is held by readers (DropOldest) - waits otherwise
+			void publish(CBlock* block);
+
+			// readers, each subscription is meant to be read from a single thread
+			size_t subscribe(EPolicy policy);
+			void unsubscribe(size_t subscriber);
+			const CBlock* read(size_t subscriber); // next block with a reference on it, nullptr when there is none yet
+			void release(const CBlock* block);
+			bool wait(size_t subscriber, uint32_t timeoutMs); // waits for a block to read, false on timeout
+
+			uint64_t getPublishedCount() const { return m_head.load(std::memory_order_acquire); }
+			uint64_t getDroppedCount(size_t subscriber) const; // blocks the subscriber missed
+			uint64_t getPendingCount(size_t subscriber) const; // blocks published and not read yet by the subscriber
+			uint64_t getOverrunCount() const { return m_nOverrun.load(std::memory_order_relaxed); } // blocks the writer could not get
+
+		protected:
+
+			typedef struct
+			{
+				std::atomic<bool> active{false};
+				std::atomic<bool> blocking{false};
+				std::atomic<uint64_t> cursor{0}; // next sequence to read
+				std::atomic<uint64_t> nDropped{0};
+			} subscriber_t;
+
+			bool tryReference(CBlock& block) const;
+			uint64_t getSlowestBlockingCursor(uint64_t head) const;
+
+			uint32_t m_nChannel = 0;
+			size_t m_slotMask   = 0;
+			std::unique_ptr<CBlock[]> m_blocks;
+			size_t m_nBlock = 0;
+			std::vector<float> m_data;
+			std::unique_ptr<std::atomic<uint32_t>[]> m_slots; // block index per slot
+			std::unique_ptr<subscriber_t[]> m_subscribers;
+			size_t m_maxSubscriber = 0;
+
+			std::atomic<uint64_t> m_head{0}; // sequence of the next block to publish
+			std::atomic<uint64_t> m_nOverrun{0};
+			size_t m_nextBlock = 0; // writer only, where the free block search starts
+
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+		};
+
+		/**
+		 * \class CModularBCIBusConsumer
+		 * \brief Runs a handler on every block of a sample bus subscription, in its own thread
+		 */
+		class CModularBCIBusConsumer final
+		{
+		public:
+
+			typedef std::function<void(const CModularBCISampleBus::CBlock& block)> handler_t;
+
+			~CModularBCIBusConsumer() { this->stop(); }
+
+			bool start(CModularBCISampleBus& bus, CModularBCISampleBus::EPolicy policy, const handler_t& handler);
+			void stop();
+			bool isRunning() const { return m_thread.joinable(); }
+			uint64_t getDroppedCount() const { return m_bus != nullptr ? m_bus->getDroppedCount(m_subscriber) : 0; }
+			uint64_t getPendingCount() const { return m_bus != nullptr ? m_bus->getPendingCount(m_subscriber) : 0; }
+
+		protected:
+
+			CModularBCISampleBus* m_bus = nullptr;
+			size_t m_subscriber         = CModularBCISampleBus::INVALID_SUBSCRIBER;
+			handler_t m_handler;
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,57 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCISerialPort.h"
+
+#include <cstdint>
+
+#if defined TARGET_OS_Linux
+// the termios2 of the kernel, which <termios.h> can not be included with
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+std::string CModularBCISerialPort::getCommandFrame(const char command, const std::string& arguments)
+{
+	std::string frame = { char(COMMAND_FRAME_START), command, char(arguments.size()) };
+	uint8_t checksum  = uint8_t(command) ^ uint8_t(arguments.size());
+	for (const char argument : arguments) { checksum ^= uint8_t(argument); }
+	return frame + arguments + char(checksum);
+}
+
+int CModularBCISerialPort::findCommandReply(const std::string& bytes, const char command)
+{
+	// the board does not stream when it replies, so the bytes are auxiliary frames only, or the last frames before it stopped
+	for (size_t i = bytes.size(); i >= 6; --i)
+	{
+		const char* frame = bytes.data() + i - 6;
+		if (uint8_t(frame[0]) == AUX_FRAME_START && uint8_t(frame[1]) == AUX_FRAME_COMMAND_REPLY && frame[2] == 2 && frame[3] == command
+			&& uint8_t(frame[5]) == uint8_t(AUX_FRAME_COMMAND_REPLY ^ 2 ^ uint8_t(frame[3]) ^ uint8_t(frame[4])))
+		{
+			return uint8_t(frame[4]);
+		}
+	}
+	return -1;
+}
+
+#if defined TARGET_OS_Linux
+bool CModularBCISerialPort::setRawPort(const int fileDesc, const uint32_t baudRate)
+{
+	struct termios2 attributes;
+	if (::ioctl(fileDesc, TCGETS2, &attributes) != 0) { return false; }
+	/* attributes.c_cflag = BOTHER | CS8 | CRTSCTS | CLOCAL | CREAD; */
+	attributes.c_cflag  = BOTHER | CS8 | CLOCAL | CREAD;
+	attributes.c_iflag  = 0;
+	attributes.c_oflag  = 0;
+	attributes.c_lflag  = 0;
+	attributes.c_ispeed = baudRate;
+	attributes.c_ospeed = baudRate;
+	return ::ioctl(fileDesc, TCSETSF2, &attributes) == 0;
+}
+#endif
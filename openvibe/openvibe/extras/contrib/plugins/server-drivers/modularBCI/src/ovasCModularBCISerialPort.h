@@ -0,0 +1,49 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCIFrameDecoder.h"
+
+#include <cstdint>
+#include <string>
+
+// commands of the firmware go in frames laid out like the auxiliary frames: COMMAND_FRAME_START, command, argument size, arguments, XOR checksum
+#define COMMAND_FRAME_START AUX_FRAME_START
+#define COMMAND_MAX_ARGUMENT_SIZE 8 // the firmware takes a larger size for a corrupted frame
+
+// status of the reply of the firmware to every command but the latency probe, sent in an AUX_FRAME_COMMAND_REPLY
+#define COMMAND_ACCEPTED 0
+#define COMMAND_REJECTED 1 // unknown command, wrong argument size or value, not accepted while streaming, or not supported by the board
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCISerialPort
+		 * \brief What the driver puts on the serial link to the board
+		 *
+		 * The commands are binary frames, so every byte of a frame has to reach the firmware as it
+		 * was written: the terminal of the port may translate none of them, a 0x0A sent as 0x0D 0x0A
+		 * would break the size and checksum of the frame.
+		 */
+		class CModularBCISerialPort final
+		{
+		public:
+
+			static std::string getCommandFrame(char command, const std::string& arguments = std::string()); // the frame the firmware takes the command in
+			// status of the last reply to the command in the bytes the board sent, -1 if they hold none
+			static int findCommandReply(const std::string& bytes, char command);
+
+#if defined TARGET_OS_Linux
+			// 8N1 without flow control, no translation on input or output, at any rate (termios2 with BOTHER, the firmware runs at 128000 baud
+			// which has no Bxxx constant), flushing what was received, false when the port refuses it
+			static bool setRawPort(int fileDesc, uint32_t baudRate);
+#endif
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
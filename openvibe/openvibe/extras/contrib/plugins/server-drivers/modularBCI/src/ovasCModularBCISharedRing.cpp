@@ -0,0 +1,287 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCISharedRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <windows.h>
+#elif defined TARGET_OS_Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define SHARED_RING_ALIGNMENT 64
+
+namespace
+{
+	size_t alignUp(const size_t size) { return (size + SHARED_RING_ALIGNMENT - 1) & ~size_t(SHARED_RING_ALIGNMENT - 1); }
+
+	std::string getSystemName(const std::string& name)
+	{
+#if defined TARGET_OS_Windows
+		return "Local\\" + name; // session namespace, no privilege needed
+#else
+		return "/" + name;
+#endif
+	}
+}  // namespace
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCISharedMemory::create(const std::string& name, const size_t size)
+{
+	this->close();
+	if (name.empty() || name.find_first_of("/\\") != std::string::npos || size == 0) { return false; }
+	const std::string systemName = getSystemName(name);
+
+#if defined TARGET_OS_Windows
+	const uint64_t size64 = size;
+	HANDLE handle = ::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size64 >> 32), DWORD(size64), systemName.c_str());
+	if (handle == nullptr) { return false; }
+	if (::GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		// another writer owns the name, its readers would see two drivers
+		::CloseHandle(handle);
+		return false;
+	}
+	void* data = ::MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (data == nullptr)
+	{
+		::CloseHandle(handle);
+		return false;
+	}
+	m_handle = uintptr_t(handle);
+#elif defined TARGET_OS_Linux
+	// a segment left behind by a crashed driver is replaced, its readers keep their mapping until they notice isWriting
+	::shm_unlink(systemName.c_str());
+	const int fd = ::shm_open(systemName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) { return false; }
+	void* data = MAP_FAILED;
+	if (::ftruncate(fd, off_t(size)) == 0) { data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); }
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		::shm_unlink(systemName.c_str());
+		return false;
+	}
+#else
+	void* data = nullptr;
+	return false;
+#endif
+
+	m_name      = systemName;
+	m_data      = static_cast<uint8_t*>(data);
+	m_size      = size;
+	m_isCreator = true;
+	return true;
+}
+
+bool CModularBCISharedMemory::open(const std::string& name, const bool readOnly)
+{
+	this->close();
+	if (name.empty() || name.find_first_of("/\\") != std::string::npos) { return false; }
+	const std::string systemName = getSystemName(name);
+
+#if defined TARGET_OS_Windows
+	HANDLE handle = ::OpenFileMappingA(readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, FALSE, systemName.c_str());
+	if (handle == nullptr) { return false; }
+	void* data = ::MapViewOfFile(handle, readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (data == nullptr || ::VirtualQuery(data, &info, sizeof(info)) == 0)
+	{
+		if (data != nullptr) { ::UnmapViewOfFile(data); }
+		::CloseHandle(handle);
+		return false;
+	}
+	m_handle = uintptr_t(handle);
+	m_size   = info.RegionSize;
+#elif defined TARGET_OS_Linux
+	const int fd = ::shm_open(systemName.c_str(), readOnly ? O_RDONLY : O_RDWR, 0);
+	if (fd < 0) { return false; }
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (::fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		data = ::mmap(nullptr, size_t(info.st_size), readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (data == MAP_FAILED) { return false; }
+	m_size = size_t(info.st_size);
+#else
+	(void)readOnly;
+	void* data = nullptr;
+	return false;
+#endif
+
+	m_name      = systemName;
+	m_data      = static_cast<uint8_t*>(data);
+	m_isCreator = false;
+	return true;
+}
+
+void CModularBCISharedMemory::close()
+{
+	if (m_data == nullptr) { return; }
+#if defined TARGET_OS_Windows
+	::UnmapViewOfFile(m_data);
+	::CloseHandle(HANDLE(m_handle));
+	m_handle = 0;
+#elif defined TARGET_OS_Linux
+	::munmap(m_data, m_size);
+	if (m_isCreator) { ::shm_unlink(m_name.c_str()); }
+#else
+#endif
+	m_name.clear();
+	m_data      = nullptr;
+	m_size      = 0;
+	m_isCreator = false;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCISharedRing::create(const std::string& name, const uint32_t nChannel, const uint32_t sampling, const size_t capacity,
+								   const std::string& descriptor)
+{
+	this->destroy();
+	if (nChannel == 0 || capacity == 0) { return false; }
+
+	size_t capacityPow2 = 1;
+	while (capacityPow2 < capacity) { capacityPow2 *= 2; }
+
+	const size_t blockOffset = alignUp(sizeof(shared_ring_header_t));
+	const size_t dataOffset  = blockOffset + alignUp(SHARED_RING_BLOCK_COUNT * sizeof(shared_ring_block_t));
+	if (!m_memory.create(name, dataOffset + sizeof(float) * nChannel * capacityPow2)) { return false; }
+
+	// a fresh segment is zero-filled, which is a valid state for every counter and stamp
+	uint8_t* base = m_memory.getData();
+	m_header      = reinterpret_cast<shared_ring_header_t*>(base);
+	m_blocks      = reinterpret_cast<shared_ring_block_t*>(base + blockOffset);
+	m_data        = reinterpret_cast<float*>(base + dataOffset);
+
+	m_header->version      = SHARED_RING_VERSION;
+	m_header->nChannel     = nChannel;
+	m_header->capacity     = uint32_t(capacityPow2);
+	m_header->nBlockRecord = SHARED_RING_BLOCK_COUNT;
+	m_header->sampling     = sampling;
+	m_header->blockOffset  = blockOffset;
+	m_header->dataOffset   = dataOffset;
+	std::strncpy(m_header->descriptor, descriptor.c_str(), SHARED_RING_DESCRIPTOR_SIZE - 1);
+	m_header->isWriting.store(1, std::memory_order_relaxed);
+	m_header->magic.store(SHARED_RING_MAGIC, std::memory_order_release);
+	return true;
+}
+
+void CModularBCISharedRing::destroy()
+{
+	if (m_header != nullptr) { m_header->isWriting.store(0, std::memory_order_release); }
+	m_memory.close();
+	m_header = nullptr;
+	m_blocks = nullptr;
+	m_data   = nullptr;
+}
+
+void CModularBCISharedRing::write(const float* samples, const uint32_t nSample, const uint64_t time, const uint32_t flags)
+{
+	if (m_header == nullptr || nSample == 0) { return; }
+
+	const size_t capacity = m_header->capacity;
+	const uint64_t first  = m_header->written.load(std::memory_order_relaxed);
+	const uint64_t last   = first + nSample;
+
+	// readers must see writing move before any sample they may be copying changes
+	m_header->writing.store(last, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// only the last capacity samples of an oversized block survive anyway
+	const uint32_t skip   = nSample > capacity ? uint32_t(nSample - capacity) : 0;
+	const size_t position = size_t(first + skip) & (capacity - 1);
+	const size_t nHead    = std::min(size_t(nSample - skip), capacity - position);
+	const size_t nTail    = nSample - skip - nHead;
+	for (uint32_t c = 0; c < m_header->nChannel; ++c)
+	{
+		const float* src = samples + size_t(c) * nSample + skip;
+		float* dst       = m_data + size_t(c) * capacity;
+		std::memcpy(dst + position, src, nHead * sizeof(float));
+		if (nTail != 0) { std::memcpy(dst, src + nHead, nTail * sizeof(float)); }
+	}
+	m_header->written.store(last, std::memory_order_release);
+
+	const uint64_t index         = m_header->nBlock.load(std::memory_order_relaxed);
+	shared_ring_block_t& record  = m_blocks[index & (SHARED_RING_BLOCK_COUNT - 1)];
+	record.stamp.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	record.info.firstSample = first;
+	record.info.time        = time;
+	record.info.nSample     = nSample;
+	record.info.flags       = flags;
+	record.stamp.store(2 * index + 2, std::memory_order_release);
+	m_header->nBlock.store(index + 1, std::memory_order_release);
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCISharedRingReader::open(const std::string& name)
+{
+	this->close();
+	if (!m_memory.open(name, true)) { return false; }
+
+	const auto* header = reinterpret_cast<const shared_ring_header_t*>(m_memory.getData());
+	if (m_memory.getSize() < sizeof(shared_ring_header_t) || header->magic.load(std::memory_order_acquire) != SHARED_RING_MAGIC
+		|| header->version != SHARED_RING_VERSION || header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0
+		|| header->nBlockRecord == 0 || (header->nBlockRecord & (header->nBlockRecord - 1)) != 0
+		|| header->dataOffset + sizeof(float) * size_t(header->nChannel) * header->capacity > m_memory.getSize()
+		|| header->blockOffset + header->nBlockRecord * sizeof(shared_ring_block_t) > header->dataOffset)
+	{
+		m_memory.close();
+		return false;
+	}
+	m_header = header;
+	m_blocks = reinterpret_cast<const shared_ring_block_t*>(m_memory.getData() + header->blockOffset);
+	m_data   = reinterpret_cast<const float*>(m_memory.getData() + header->dataOffset);
+	return true;
+}
+
+bool CModularBCISharedRingReader::read(const uint64_t first, const uint32_t nSample, float* samples) const
+{
+	const size_t capacity = m_header->capacity;
+	if (nSample > capacity || first + nSample > m_header->written.load(std::memory_order_acquire)) { return false; }
+
+	const size_t position = size_t(first) & (capacity - 1);
+	const size_t nHead    = std::min(size_t(nSample), capacity - position);
+	for (uint32_t c = 0; c < m_header->nChannel; ++c)
+	{
+		const float* src = m_data + size_t(c) * capacity;
+		float* dst       = samples + size_t(c) * nSample;
+		std::memcpy(dst, src + position, nHead * sizeof(float));
+		if (nHead < nSample) { std::memcpy(dst + nHead, src, (nSample - nHead) * sizeof(float)); }
+	}
+
+	// the copy is only valid if the writer did not start overwriting it meanwhile
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return m_header->writing.load(std::memory_order_relaxed) <= first + capacity;
+}
+
+bool CModularBCISharedRingReader::readBlock(const uint64_t index, shared_ring_block_info_t& block) const
+{
+	const shared_ring_block_t& record = m_blocks[index & (m_header->nBlockRecord - 1)];
+	const uint64_t stamp              = record.stamp.load(std::memory_order_acquire);
+	if (stamp != 2 * index + 2) { return false; }
+	std::memcpy(&block, &record.info, sizeof(block));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return record.stamp.load(std::memory_order_relaxed) == stamp;
+}
@@ -0,0 +1,162 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+ * Shared ring layout, native endianness and alignment (readers run on the same machine)
+ *
+ * A shared_ring_header_t, then nBlockRecord shared_ring_block_t, then nChannel rows of capacity
+ * float32 samples (channel-major, in uV for the EEG channels). Sample i of channel c is at row c,
+ * column i & (capacity - 1); i counts from the connection of the driver to the board, like the
+ * sample index of the stream server. Block k is described by record k & (nBlockRecord - 1).
+ *
+ * Samples are validated epoch style: the writer moves writing past the samples it is about to
+ * overwrite before touching them, and moves written once they are in place. A reader copies
+ * samples below written, then checks that writing did not come within capacity of them in the
+ * meantime. Block records are seqlocks: their stamp is odd while the record is written, and
+ * 2 * (k + 1) once record k is complete.
+ */
+
+#define SHARED_RING_MAGIC           0x524D424D // "MBMR"
+#define SHARED_RING_VERSION         1
+#define SHARED_RING_DESCRIPTOR_SIZE 4096       // JSON stream descriptor, zero terminated
+#define SHARED_RING_BLOCK_COUNT     1024
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "shared counters must be plain 64 bit words");
+
+		typedef struct
+		{
+			std::atomic<uint32_t> magic; // stored last by the writer, 0 while the segment is set up
+			uint32_t version;
+			uint32_t nChannel;
+			uint32_t capacity; // samples per channel, a power of two
+			uint32_t nBlockRecord;
+			uint32_t sampling;
+			uint64_t blockOffset; // from the start of the segment
+			uint64_t dataOffset;
+			char descriptor[SHARED_RING_DESCRIPTOR_SIZE];
+
+			alignas(64) std::atomic<uint64_t> writing; // samples written or being written
+			alignas(64) std::atomic<uint64_t> written; // samples readable
+			std::atomic<uint64_t> nBlock;              // blocks whose record is complete
+			std::atomic<uint32_t> isWriting;           // 0 once the driver disconnected, readers should map the segment again
+		} shared_ring_header_t;
+
+		typedef struct
+		{
+			uint64_t firstSample;
+			uint64_t time;  // when the block reached the host, in us of the host monotonic clock, 0 if unknown
+			uint32_t nSample;
+			uint32_t flags; // CModularBCISampleBus::EBlockFlag
+		} shared_ring_block_info_t;
+
+		typedef struct
+		{
+			std::atomic<uint64_t> stamp;
+			shared_ring_block_info_t info;
+		} shared_ring_block_t;
+
+		/**
+		 * \class CModularBCISharedMemory
+		 * \brief Named shared memory segment, POSIX shared memory or a Windows file mapping
+		 */
+		class CModularBCISharedMemory final
+		{
+		public:
+
+			~CModularBCISharedMemory() { this->close(); }
+
+			bool create(const std::string& name, size_t size); // replaces a stale POSIX segment of the same name, fails if a Windows one is still mapped
+			bool open(const std::string& name, bool readOnly);
+			void close(); // the creator also removes the name
+
+			bool isOpen() const { return m_data != nullptr; }
+			uint8_t* getData() const { return m_data; }
+			size_t getSize() const { return m_size; }
+
+		protected:
+
+			std::string m_name;
+			uint8_t* m_data    = nullptr;
+			size_t m_size      = 0;
+			bool m_isCreator   = false;
+			uintptr_t m_handle = 0; // file mapping handle on Windows
+		};
+
+		/**
+		 * \class CModularBCISharedRing
+		 * \brief Exports the decoded samples as a ring in shared memory, for readers on the same machine
+		 *
+		 * The driver writes each block into the ring from its acquisition loop, one copy per
+		 * channel and no system call. Readers map the segment read-only with
+		 * CModularBCISharedRingReader and poll it: checking for new samples is a single load.
+		 * A reader that falls more than the ring length behind sees its read fail instead of
+		 * torn data, and never slows the driver down.
+		 */
+		class CModularBCISharedRing final
+		{
+		public:
+
+			~CModularBCISharedRing() { this->destroy(); }
+
+			// capacity is rounded up to a power of two, descriptor is truncated to SHARED_RING_DESCRIPTOR_SIZE - 1
+			bool create(const std::string& name, uint32_t nChannel, uint32_t sampling, size_t capacity, const std::string& descriptor);
+			void destroy();
+			bool isOpen() const { return m_header != nullptr; }
+
+			// appends a channel-major block (nChannel rows of nSample values)
+			void write(const float* samples, uint32_t nSample, uint64_t time, uint32_t flags);
+
+			uint64_t getWrittenCount() const { return m_header != nullptr ? m_header->written.load(std::memory_order_relaxed) : 0; }
+
+		protected:
+
+			CModularBCISharedMemory m_memory;
+			shared_ring_header_t* m_header = nullptr;
+			shared_ring_block_t* m_blocks  = nullptr;
+			float* m_data                  = nullptr;
+		};
+
+		/**
+		 * \class CModularBCISharedRingReader
+		 * \brief Read-only view of a shared ring, meant to be used from another process
+		 */
+		class CModularBCISharedRingReader final
+		{
+		public:
+
+			bool open(const std::string& name); // false while the driver has not set the segment up
+			void close() { m_memory.close(); m_header = nullptr; }
+			bool isOpen() const { return m_header != nullptr; }
+
+			const shared_ring_header_t& getHeader() const { return *m_header; }
+			uint64_t getWrittenCount() const { return m_header->written.load(std::memory_order_acquire); }
+			uint64_t getBlockCount() const { return m_header->nBlock.load(std::memory_order_acquire); }
+			bool isWriting() const { return m_header->isWriting.load(std::memory_order_acquire) != 0; }
+
+			// copies samples [first, first + nSample) as nChannel rows of nSample values, false if they are not written yet or were overwritten
+			bool read(uint64_t first, uint32_t nSample, float* samples) const;
+			bool readBlock(uint64_t index, shared_ring_block_info_t& block) const; // false if not written yet or overwritten
+
+		protected:
+
+			CModularBCISharedMemory m_memory;
+			const shared_ring_header_t* m_header = nullptr;
+			const shared_ring_block_t* m_blocks  = nullptr;
+			const float* m_data                  = nullptr;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
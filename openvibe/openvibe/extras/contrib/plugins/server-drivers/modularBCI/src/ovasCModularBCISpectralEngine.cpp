@@ -0,0 +1,257 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCISpectralEngine.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define MODULARBCI_PI 3.14159265358979323846
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCIFFT::initialize(const size_t size)
+{
+	if (size < 4 || (size & (size - 1)) != 0) { return false; }
+
+	m_size          = size;
+	const size_t n2 = size / 2;
+
+	// bit reversal of the half size complex transform
+	uint32_t nBit = 0;
+	while ((size_t(1) << nBit) < n2) { nBit++; }
+	m_bitReversal.resize(n2);
+	for (size_t i = 0; i < n2; ++i)
+	{
+		uint32_t rev = 0;
+		for (uint32_t b = 0; b < nBit; ++b) { if (i & (size_t(1) << b)) { rev |= 1U << (nBit - 1 - b); } }
+		m_bitReversal[i] = rev;
+	}
+
+	// per stage twiddles, stored contiguously so that each stage reads them linearly
+	m_stageTwiddleReal.resize(n2);
+	m_stageTwiddleImag.resize(n2);
+	for (size_t half = 1; half < n2; half *= 2)
+	{
+		for (size_t k = 0; k < half; ++k)
+		{
+			const double angle               = -MODULARBCI_PI * double(k) / double(half);
+			m_stageTwiddleReal[half - 1 + k] = float(std::cos(angle));
+			m_stageTwiddleImag[half - 1 + k] = float(std::sin(angle));
+		}
+	}
+
+	// twiddles used to split the interleaved even / odd spectra
+	m_splitTwiddleReal.resize(n2 + 1);
+	m_splitTwiddleImag.resize(n2 + 1);
+	for (size_t k = 0; k <= n2; ++k)
+	{
+		const double angle     = -2 * MODULARBCI_PI * double(k) / double(size);
+		m_splitTwiddleReal[k] = float(std::cos(angle));
+		m_splitTwiddleImag[k] = float(std::sin(angle));
+	}
+
+	m_real.assign(n2, 0);
+	m_imag.assign(n2, 0);
+	return true;
+}
+
+void CModularBCIFFT::forward(const float* input, float* outputReal, float* outputImag)
+{
+	const size_t n2 = m_size / 2;
+	float* re       = &m_real[0];
+	float* im       = &m_imag[0];
+
+	// packs even samples as real and odd samples as imaginary part, in bit reversed order
+	for (size_t i = 0; i < n2; ++i)
+	{
+		const uint32_t j = m_bitReversal[i];
+		re[j]            = input[2 * i];
+		im[j]            = input[2 * i + 1];
+	}
+
+	// iterative radix-2 decimation in time
+	for (size_t half = 1; half < n2; half *= 2)
+	{
+		const float* twRe = &m_stageTwiddleReal[half - 1];
+		const float* twIm = &m_stageTwiddleImag[half - 1];
+		for (size_t start = 0; start < n2; start += 2 * half)
+		{
+			float* aRe = re + start;
+			float* aIm = im + start;
+			float* bRe = aRe + half;
+			float* bIm = aIm + half;
+			for (size_t k = 0; k < half; ++k)
+			{
+				const float tRe = bRe[k] * twRe[k] - bIm[k] * twIm[k];
+				const float tIm = bRe[k] * twIm[k] + bIm[k] * twRe[k];
+				bRe[k]          = aRe[k] - tRe;
+				bIm[k]          = aIm[k] - tIm;
+				aRe[k] += tRe;
+				aIm[k] += tIm;
+			}
+		}
+	}
+
+	// splits Z = FFT(even + i odd) into X[k] = E[k] + W^k O[k]
+	for (size_t k = 0; k <= n2; ++k)
+	{
+		const size_t a  = (k == n2 ? 0 : k);
+		const size_t b  = (k == 0 ? 0 : n2 - k);
+		const float eRe = 0.5F * (re[a] + re[b]);
+		const float eIm = 0.5F * (im[a] - im[b]);
+		const float oRe = 0.5F * (im[a] + im[b]);
+		const float oIm = -0.5F * (re[a] - re[b]);
+		outputReal[k]   = eRe + m_splitTwiddleReal[k] * oRe - m_splitTwiddleImag[k] * oIm;
+		outputImag[k]   = eIm + m_splitTwiddleReal[k] * oIm + m_splitTwiddleImag[k] * oRe;
+	}
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+bool CModularBCISpectralEngine::parseBands(const std::string& text, std::vector<band_t>& bands)
+{
+	std::vector<band_t> res;
+	std::istringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, ';'))
+	{
+		if (item.empty()) { continue; }
+		const size_t colon = item.find(':');
+		const size_t dash  = item.find('-', colon == std::string::npos ? 0 : colon + 1);
+		if (colon == std::string::npos || colon == 0 || dash == std::string::npos) { return false; }
+
+		band_t band;
+		band.name = item.substr(0, colon);
+		char* end = nullptr;
+		band.low  = std::strtod(item.c_str() + colon + 1, &end);
+		if (end != item.c_str() + dash) { return false; }
+		band.high = std::strtod(item.c_str() + dash + 1, &end);
+		if (*end != '\0' || band.low < 0 || band.high <= band.low) { return false; }
+		res.push_back(band);
+	}
+	if (res.empty()) { return false; }
+	bands = res;
+	return true;
+}
+
+bool CModularBCISpectralEngine::initialize(const size_t nChannel, const double sampling, const size_t windowSize, const size_t hopSize,
+										   const std::vector<band_t>& bands)
+{
+	this->uninitialize();
+	if (nChannel == 0 || sampling <= 0 || hopSize == 0 || bands.empty()) { return false; }
+	if (!m_fft.initialize(windowSize)) { return false; }
+
+	m_nChannel   = nChannel;
+	m_windowSize = windowSize;
+	m_hopSize    = hopSize;
+	m_sampling   = sampling;
+	m_bands      = bands;
+
+	// Hann taper, power is normalized so that the band power of a sine is half its squared amplitude
+	m_window.resize(windowSize);
+	double windowPower = 0;
+	for (size_t i = 0; i < windowSize; ++i)
+	{
+		m_window[i] = float(0.5 - 0.5 * std::cos(2 * MODULARBCI_PI * double(i) / double(windowSize)));
+		windowPower += double(m_window[i]) * double(m_window[i]);
+	}
+	m_powerScale = float(2.0 / (double(windowSize) * windowPower));
+
+	const double binWidth = sampling / double(windowSize);
+	const size_t nBin     = m_fft.getBinCount();
+	m_bandFirstBin.resize(bands.size());
+	m_bandLastBin.resize(bands.size());
+	for (size_t b = 0; b < bands.size(); ++b)
+	{
+		m_bandFirstBin[b] = uint32_t(std::min(nBin, size_t(std::ceil(bands[b].low / binWidth))));
+		m_bandLastBin[b]  = uint32_t(std::min(nBin, size_t(std::ceil(bands[b].high / binWidth))));
+		// narrow bands (e.g. SSVEP frequencies) get at least their nearest bin
+		if (m_bandLastBin[b] <= m_bandFirstBin[b])
+		{
+			m_bandFirstBin[b] = uint32_t(std::min(nBin - 1, size_t(std::floor((bands[b].low + bands[b].high) / 2 / binWidth + 0.5))));
+			m_bandLastBin[b]  = m_bandFirstBin[b] + 1;
+		}
+	}
+
+	m_history.assign(nChannel * windowSize, 0);
+	m_frame.assign(windowSize, 0);
+	m_spectrumReal.assign(nBin, 0);
+	m_spectrumImag.assign(nBin, 0);
+	m_power.assign(nBin, 0);
+	m_bandPowers.assign(nChannel * bands.size(), 0);
+	return true;
+}
+
+void CModularBCISpectralEngine::uninitialize()
+{
+	m_nChannel        = 0;
+	m_windowSize      = 0;
+	m_hopSize         = 0;
+	m_historyPosition = 0;
+	m_nHistorySample  = 0;
+	m_nSampleSinceHop = 0;
+	m_nSample         = 0;
+	m_nUpdate         = 0;
+	m_bands.clear();
+	m_history.clear();
+	m_bandPowers.clear();
+}
+
+void CModularBCISpectralEngine::push(const float* samples, const size_t nSample)
+{
+	if (m_nChannel == 0) { return; }
+
+	for (size_t i = 0; i < nSample; ++i)
+	{
+		const float* sample = samples + i * m_nChannel;
+		for (size_t c = 0; c < m_nChannel; ++c) { m_history[c * m_windowSize + m_historyPosition] = sample[c]; }
+		m_historyPosition = (m_historyPosition + 1) % m_windowSize;
+		m_nHistorySample  = std::min(m_nHistorySample + 1, m_windowSize);
+		m_nSample++;
+
+		if (++m_nSampleSinceHop >= m_hopSize && m_nHistorySample == m_windowSize)
+		{
+			m_nSampleSinceHop = 0;
+			this->update();
+		}
+	}
+}
+
+void CModularBCISpectralEngine::update()
+{
+	const size_t nBand = m_bands.size();
+	const size_t nBin  = m_fft.getBinCount();
+
+	for (size_t c = 0; c < m_nChannel; ++c)
+	{
+		// unrolls the ring buffer, oldest sample first, and applies the taper
+		const float* history = &m_history[c * m_windowSize];
+		const size_t nFirst  = m_windowSize - m_historyPosition;
+		for (size_t i = 0; i < nFirst; ++i) { m_frame[i] = history[m_historyPosition + i] * m_window[i]; }
+		for (size_t i = nFirst; i < m_windowSize; ++i) { m_frame[i] = history[i - nFirst] * m_window[i]; }
+
+		m_fft.forward(&m_frame[0], &m_spectrumReal[0], &m_spectrumImag[0]);
+		for (size_t k = 0; k < nBin; ++k) { m_power[k] = (m_spectrumReal[k] * m_spectrumReal[k] + m_spectrumImag[k] * m_spectrumImag[k]) * m_powerScale; }
+
+		for (size_t b = 0; b < nBand; ++b)
+		{
+			float sum = 0;
+			for (uint32_t k = m_bandFirstBin[b]; k < m_bandLastBin[b]; ++k) { sum += m_power[k]; }
+			m_bandPowers[c * nBand + b] = sum;
+		}
+	}
+
+	m_nUpdate++;
+	if (m_listener) { m_listener(m_nSample, m_bandPowers); }
+}
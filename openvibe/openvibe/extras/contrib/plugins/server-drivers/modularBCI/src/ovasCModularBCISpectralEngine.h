@@ -0,0 +1,117 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+		/**
+		 * \class CModularBCIFFT
+		 * \brief Real-input radix-2 FFT
+		 *
+		 * A real sequence of N samples is transformed as a complex sequence of N/2 samples (even
+		 * samples as real part, odd samples as imaginary part) and the two interleaved spectra are
+		 * then split. Bit reversal and twiddle factors are computed once by initialize(), real and
+		 * imaginary parts are kept in separate arrays so that the butterflies of one stage run as a
+		 * contiguous, vectorizable loop. forward() does not allocate.
+		 */
+		class CModularBCIFFT final
+		{
+		public:
+
+			bool initialize(size_t size); // size must be a power of two, at least 4
+			size_t getSize() const { return m_size; }
+			size_t getBinCount() const { return m_size / 2 + 1; }
+
+			// transforms size real samples into size/2+1 complex bins
+			void forward(const float* input, float* outputReal, float* outputImag);
+
+		protected:
+
+			size_t m_size = 0;
+			std::vector<uint32_t> m_bitReversal;
+			std::vector<float> m_stageTwiddleReal, m_stageTwiddleImag; // stage with half size h starts at index h-1
+			std::vector<float> m_splitTwiddleReal, m_splitTwiddleImag; // exp(-2 pi i k / size) for k in [0, size/2]
+			std::vector<float> m_real, m_imag;
+		};
+
+		/**
+		 * \class CModularBCISpectralEngine
+		 * \brief Sliding-window band power estimation, the streaming counterpart of matlab/PlotFFT.m
+		 *
+		 * Keeps the last window of samples of every channel in a ring buffer. Every hop samples, each
+		 * window is Hann-tapered and transformed, and the power of each configured band is summed from
+		 * the one-sided power spectral density. Results are published through a listener at the hop
+		 * rate. All buffers are allocated by initialize(), none while streaming.
+		 */
+		class CModularBCISpectralEngine final
+		{
+		public:
+
+			typedef struct
+			{
+				std::string name;
+				double low;  // in Hz, inclusive
+				double high; // in Hz, exclusive
+			} band_t;
+
+			// bandPowers holds getBandCount() values per channel, in uV^2 when fed with uV
+			typedef std::function<void(uint64_t sampleIndex, const std::vector<float>& bandPowers)> listener_t;
+
+			// parses "name:low-high;name:low-high;..." band lists
+			static bool parseBands(const std::string& text, std::vector<band_t>& bands);
+
+			bool initialize(size_t nChannel, double sampling, size_t windowSize, size_t hopSize, const std::vector<band_t>& bands);
+			void uninitialize();
+			bool isInitialized() const { return m_nChannel != 0; }
+
+			void setListener(const listener_t& listener) { m_listener = listener; }
+
+			// pushes a sample-major block (nSample rows of nChannel values)
+			void push(const float* samples, size_t nSample);
+
+			size_t getChannelCount() const { return m_nChannel; }
+			size_t getBandCount() const { return m_bands.size(); }
+			const std::vector<band_t>& getBands() const { return m_bands; }
+			const std::vector<float>& getBandPowers() const { return m_bandPowers; }
+			uint64_t getUpdateCount() const { return m_nUpdate; }
+
+		protected:
+
+			void update();
+
+			size_t m_nChannel   = 0;
+			size_t m_windowSize = 0;
+			size_t m_hopSize    = 0;
+			double m_sampling   = 0;
+			std::vector<band_t> m_bands;
+			std::vector<uint32_t> m_bandFirstBin, m_bandLastBin; // bin range of each band, last excluded
+
+			CModularBCIFFT m_fft;
+			std::vector<float> m_window;   // Hann taper
+			float m_powerScale = 0;        // converts |X|^2 to one-sided power per bin
+			std::vector<float> m_history;  // channel-major ring buffers of m_windowSize samples
+			size_t m_historyPosition  = 0; // next write position in the ring buffers
+			size_t m_nHistorySample   = 0; // number of valid samples, saturates at m_windowSize
+			size_t m_nSampleSinceHop  = 0;
+			uint64_t m_nSample        = 0;
+			uint64_t m_nUpdate        = 0;
+
+			std::vector<float> m_frame, m_spectrumReal, m_spectrumImag, m_power;
+			std::vector<float> m_bandPowers; // channel-major, getBandCount() values per channel
+
+			listener_t m_listener;
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
@@ -0,0 +1,356 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#include "ovasCModularBCIStreamServer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined TARGET_OS_Windows
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#elif defined TARGET_OS_Linux
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define STREAM_MAX_BATCH    8               // blocks per gather write, held together out of the extra blocks of the bus
+#define STREAM_BACKLOG_SIZE (4 * 1024 * 1024) // per client, about 10 s of 32 channels at 1 kHz
+#define STREAM_WAIT_TIMEOUT 20              // in ms, also the latency of accepting a client
+#define INVALID_STREAM_SOCKET uintptr_t(~0)
+
+namespace
+{
+	void closeSocket(const uintptr_t socket)
+	{
+#if defined TARGET_OS_Windows
+		::closesocket(SOCKET(socket));
+#elif defined TARGET_OS_Linux
+		::close(int(socket));
+#else
+		(void)socket;
+#endif
+	}
+
+	bool setNonBlocking(const uintptr_t socket)
+	{
+#if defined TARGET_OS_Windows
+		u_long mode = 1;
+		return ::ioctlsocket(SOCKET(socket), FIONBIO, &mode) == 0;
+#elif defined TARGET_OS_Linux
+		const int flags = ::fcntl(int(socket), F_GETFL, 0);
+		return flags >= 0 && ::fcntl(int(socket), F_SETFL, flags | O_NONBLOCK) == 0;
+#else
+		(void)socket;
+		return false;
+#endif
+	}
+
+	// gather write without blocking, bytes sent or -1 when the connection is lost
+	int64_t sendGather(const uintptr_t socket, const void* const* data, const size_t* sizes, const size_t count)
+	{
+#if defined TARGET_OS_Windows
+		WSABUF buffers[2 * STREAM_MAX_BATCH + 1];
+		for (size_t i = 0; i < count; ++i)
+		{
+			buffers[i].buf = static_cast<char*>(const_cast<void*>(data[i]));
+			buffers[i].len = ULONG(sizes[i]);
+		}
+		DWORD nSent = 0;
+		if (::WSASend(SOCKET(socket), buffers, DWORD(count), &nSent, 0, nullptr, nullptr) != 0)
+		{
+			return ::WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+		}
+		return int64_t(nSent);
+#elif defined TARGET_OS_Linux
+		iovec buffers[2 * STREAM_MAX_BATCH + 1];
+		for (size_t i = 0; i < count; ++i)
+		{
+			buffers[i].iov_base = const_cast<void*>(data[i]);
+			buffers[i].iov_len  = sizes[i];
+		}
+		msghdr message    = {};
+		message.msg_iov    = buffers;
+		message.msg_iovlen = count;
+		const ssize_t res  = ::sendmsg(int(socket), &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (res < 0) { return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1; }
+		return int64_t(res);
+#else
+		(void)socket;
+		(void)data;
+		(void)sizes;
+		(void)count;
+		return -1;
+#endif
+	}
+}  // namespace
+
+bool CModularBCIStreamServer::start(CModularBCISampleBus& bus, const uint16_t port, const bool localOnly, const std::string& descriptor,
+									const size_t maxClient)
+{
+	this->stop();
+
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+#if defined TARGET_OS_Windows
+	WSADATA wsaData;
+	if (::WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) { return false; }
+#endif
+
+	const uintptr_t listener = uintptr_t(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+#if defined TARGET_OS_Linux
+	const bool isValid = int(listener) >= 0;
+#else
+	const bool isValid = listener != uintptr_t(INVALID_SOCKET);
+#endif
+	if (!isValid)
+	{
+#if defined TARGET_OS_Windows
+		::WSACleanup();
+#endif
+		return false;
+	}
+	m_socket = listener;
+
+	const int reuse = 1;
+	::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address     = {};
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons(port);
+	address.sin_addr.s_addr = htonl(localOnly ? INADDR_LOOPBACK : INADDR_ANY);
+	socklen_t size          = sizeof(address);
+	if (::bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(m_socket, int(maxClient)) != 0
+		|| !setNonBlocking(m_socket) || ::getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+	{
+		this->stop();
+		return false;
+	}
+	m_port = ntohs(address.sin_port);
+
+	m_subscriber = bus.subscribe(CModularBCISampleBus::EPolicy::DropOldest);
+	if (m_subscriber == CModularBCISampleBus::INVALID_SUBSCRIBER)
+	{
+		this->stop();
+		return false;
+	}
+	m_bus        = &bus;
+	m_descriptor = descriptor;
+	m_clients.assign(std::max<size_t>(maxClient, 1), client_t());
+	m_headers.resize(STREAM_MAX_BATCH);
+	m_nClient.store(0);
+	m_nAccepted.store(0);
+	m_nSlowClient.store(0);
+	m_nSentBlock.store(0);
+
+	m_stop.store(false);
+	m_thread = std::thread(&CModularBCIStreamServer::run, this);
+	return true;
+#else
+	(void)bus;
+	(void)port;
+	(void)localOnly;
+	(void)descriptor;
+	(void)maxClient;
+	return false;
+#endif
+}
+
+void CModularBCIStreamServer::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_stop.store(true);
+		m_thread.join();
+	}
+	for (auto& client : m_clients) { this->close(client); }
+	m_clients.clear();
+	if (m_bus != nullptr && m_subscriber != CModularBCISampleBus::INVALID_SUBSCRIBER) { m_bus->unsubscribe(m_subscriber); }
+	m_bus        = nullptr;
+	m_subscriber = CModularBCISampleBus::INVALID_SUBSCRIBER;
+
+	if (m_socket != INVALID_STREAM_SOCKET)
+	{
+		closeSocket(m_socket);
+		m_socket = INVALID_STREAM_SOCKET;
+#if defined TARGET_OS_Windows
+		::WSACleanup();
+#endif
+	}
+	m_port = 0;
+}
+
+uint64_t CModularBCIStreamServer::getDroppedBlockCount() const
+{
+	return m_bus != nullptr && m_subscriber != CModularBCISampleBus::INVALID_SUBSCRIBER ? m_bus->getDroppedCount(m_subscriber) : 0;
+}
+
+uint64_t CModularBCIStreamServer::getPendingBlockCount() const
+{
+	return m_bus != nullptr && m_subscriber != CModularBCISampleBus::INVALID_SUBSCRIBER ? m_bus->getPendingCount(m_subscriber) : 0;
+}
+
+//___________________________________________________________________//
+//                                                                   //
+
+void CModularBCIStreamServer::run()
+{
+	const CModularBCISampleBus::CBlock* blocks[STREAM_MAX_BATCH];
+	while (!m_stop.load())
+	{
+		this->accept();
+
+		// everything published since the last pass goes out in one batch
+		size_t nBlock = 0;
+		while (nBlock < STREAM_MAX_BATCH && (blocks[nBlock] = m_bus->read(m_subscriber)) != nullptr) { nBlock++; }
+		if (nBlock == 0)
+		{
+			for (auto& client : m_clients) { if (client.isOpen && client.backlogSize != 0 && !this->flush(client)) { this->close(client); } }
+			m_bus->wait(m_subscriber, STREAM_WAIT_TIMEOUT);
+			continue;
+		}
+
+		for (size_t i = 0; i < nBlock; ++i)
+		{
+			const CModularBCISampleBus::CBlock& block = *blocks[i];
+			block_packet_t& header                    = m_headers[i];
+			header.packet.magic                       = STREAM_MAGIC;
+			header.packet.version                     = STREAM_VERSION;
+			header.packet.type                        = STREAM_PACKET_BLOCK;
+			header.packet.payloadSize                 = uint32_t(sizeof(stream_block_header_t) + sizeof(float) * block.getSampleCount() * block.getChannelCount());
+			header.block.sequence                     = block.getSequence();
+			header.block.firstSample                  = block.getFirstSample();
+			header.block.time                         = block.getTime();
+			header.block.nSample                      = block.getSampleCount();
+			header.block.nChannel                     = block.getChannelCount();
+			header.block.flags                        = block.getFlags();
+			header.block.reserved                     = 0;
+		}
+		for (auto& client : m_clients) { if (client.isOpen) { this->send(client, blocks, nBlock); } }
+
+		for (size_t i = 0; i < nBlock; ++i) { m_bus->release(blocks[i]); }
+		m_nSentBlock += nBlock;
+	}
+}
+
+void CModularBCIStreamServer::accept()
+{
+#if defined TARGET_OS_Windows || defined TARGET_OS_Linux
+	while (true)
+	{
+		const uintptr_t socket = uintptr_t(::accept(m_socket, nullptr, nullptr));
+#if defined TARGET_OS_Linux
+		if (int(socket) < 0) { return; }
+#else
+		if (socket == uintptr_t(INVALID_SOCKET)) { return; }
+#endif
+		auto client = std::find_if(m_clients.begin(), m_clients.end(), [](const client_t& c) { return !c.isOpen; });
+		if (client == m_clients.end() || !setNonBlocking(socket))
+		{
+			closeSocket(socket);
+			continue;
+		}
+
+		const int noDelay = 1;
+		::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+		// the descriptor goes through the backlog, the blocks follow as soon as it is out
+		client->socket = socket;
+		client->isOpen = true;
+		client->backlog.resize(STREAM_BACKLOG_SIZE);
+		stream_packet_header_t header = { STREAM_MAGIC, STREAM_VERSION, STREAM_PACKET_DESCRIPTOR, uint32_t(m_descriptor.size()) };
+		std::memcpy(&client->backlog[0], &header, sizeof(header));
+		std::memcpy(&client->backlog[sizeof(header)], m_descriptor.data(), std::min(m_descriptor.size(), STREAM_BACKLOG_SIZE - sizeof(header)));
+		client->backlogSize = std::min(sizeof(header) + m_descriptor.size(), size_t(STREAM_BACKLOG_SIZE));
+		m_nClient++;
+		m_nAccepted++;
+	}
+#endif
+}
+
+void CModularBCIStreamServer::send(client_t& client, const CModularBCISampleBus::CBlock* const* blocks, const size_t nBlock)
+{
+	if (client.backlogSize != 0 && !this->flush(client))
+	{
+		this->close(client);
+		return;
+	}
+
+	const void* data[2 * STREAM_MAX_BATCH];
+	size_t sizes[2 * STREAM_MAX_BATCH];
+	size_t total = 0;
+	for (size_t i = 0; i < nBlock; ++i)
+	{
+		data[2 * i]      = &m_headers[i];
+		sizes[2 * i]     = sizeof(block_packet_t);
+		data[2 * i + 1]  = blocks[i]->getData();
+		sizes[2 * i + 1] = sizeof(float) * blocks[i]->getSampleCount() * blocks[i]->getChannelCount();
+		total += sizes[2 * i] + sizes[2 * i + 1];
+	}
+
+	// with a backlog pending, the whole batch queues behind it
+	int64_t nSent = 0;
+	if (client.backlogSize == 0)
+	{
+		nSent = sendGather(client.socket, data, sizes, 2 * nBlock);
+		if (nSent < 0)
+		{
+			this->close(client);
+			return;
+		}
+	}
+	if (size_t(nSent) == total) { return; }
+
+	if (client.backlogSize + total - size_t(nSent) > client.backlog.size())
+	{
+		m_nSlowClient++;
+		this->close(client);
+		return;
+	}
+	size_t skip = size_t(nSent);
+	for (size_t i = 0; i < 2 * nBlock; ++i)
+	{
+		if (skip >= sizes[i])
+		{
+			skip -= sizes[i];
+			continue;
+		}
+		std::memcpy(&client.backlog[client.backlogSize], static_cast<const uint8_t*>(data[i]) + skip, sizes[i] - skip);
+		client.backlogSize += sizes[i] - skip;
+		skip = 0;
+	}
+}
+
+bool CModularBCIStreamServer::flush(client_t& client)
+{
+	const void* data   = &client.backlog[0];
+	const size_t size  = client.backlogSize;
+	const int64_t sent = sendGather(client.socket, &data, &size, 1);
+	if (sent < 0) { return false; }
+	if (sent != 0)
+	{
+		std::memmove(&client.backlog[0], &client.backlog[size_t(sent)], client.backlogSize - size_t(sent));
+		client.backlogSize -= size_t(sent);
+	}
+	return true;
+}
+
+void CModularBCIStreamServer::close(client_t& client)
+{
+	if (!client.isOpen) { return; }
+	closeSocket(client.socket);
+	client.isOpen      = false;
+	client.backlogSize = 0;
+	m_nClient--;
+}
@@ -0,0 +1,130 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ */
+#pragma once
+
+#include "ovasCModularBCISampleBus.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Stream protocol, TCP, all values little endian
+ *
+ * The server sends packets, each made of a stream_packet_header_t and its payload. The first
+ * packet of a connection is the descriptor, a JSON object describing the stream (name, sampling
+ * rate, unit, sample format and layout, channel names, time base). Every decoded block of the
+ * driver then follows as a block packet: a stream_block_header_t, then nChannel rows of nSample
+ * float32 values (channel-major, in the units of the descriptor), exactly as they are on the
+ * sample bus. The band power stream has a block of one sample per estimate. The sample
+ * index counts from the connection of the driver to the board, so gaps in it are blocks the
+ * client missed. Clients send nothing.
+ */
+
+#define STREAM_MAGIC            0x5453424D // "MBST"
+#define STREAM_VERSION          1
+#define STREAM_PACKET_DESCRIPTOR 1
+#define STREAM_PACKET_BLOCK      2
+
+namespace OpenViBE
+{
+	namespace AcquisitionServer
+	{
+#pragma pack(push, 1)
+		typedef struct
+		{
+			uint32_t magic;
+			uint16_t version;
+			uint16_t type;
+			uint32_t payloadSize; // in bytes, following this header
+		} stream_packet_header_t;
+
+		typedef struct
+		{
+			uint64_t sequence;    // block sequence on the sample bus
+			uint64_t firstSample; // index of the first sample since the driver was initialized
+			uint64_t time;        // when the block reached the host, in us of the host monotonic clock, 0 if unknown
+			uint32_t nSample;
+			uint32_t nChannel;
+			uint32_t flags;       // CModularBCISampleBus::EBlockFlag
+			uint32_t reserved;
+		} stream_block_header_t;
+#pragma pack(pop)
+
+		/**
+		 * \class CModularBCIStreamServer
+		 * \brief Serves the blocks of the sample bus to TCP clients
+		 *
+		 * One thread reads the bus, accepts clients and sends them everything that was published
+		 * since its last pass in a single gather write per client, straight from the bus blocks.
+		 * A client that can't keep up gets the rest of a batch copied into its backlog, and is
+		 * disconnected when the backlog overflows, so a slow client never delays the others nor
+		 * the acquisition. When the server itself falls behind, the bus drops blocks for it.
+		 */
+		class CModularBCIStreamServer final
+		{
+		public:
+
+			~CModularBCIStreamServer() { this->stop(); }
+
+			// port 0 picks a free port (see getPort()), localOnly binds to the loopback interface only
+			bool start(CModularBCISampleBus& bus, uint16_t port, bool localOnly, const std::string& descriptor, size_t maxClient = 8);
+			void stop();
+			bool isRunning() const { return m_thread.joinable(); }
+			uint16_t getPort() const { return m_port; }
+
+			size_t getClientCount() const { return m_nClient.load(); }
+			uint64_t getAcceptedCount() const { return m_nAccepted.load(); }
+			uint64_t getSlowClientCount() const { return m_nSlowClient.load(); } // clients disconnected as their backlog overflowed
+			uint64_t getSentBlockCount() const { return m_nSentBlock.load(); }
+			uint64_t getDroppedBlockCount() const; // blocks the server missed
+			uint64_t getPendingBlockCount() const; // blocks published and not sent yet
+
+		protected:
+
+#pragma pack(push, 1)
+			typedef struct
+			{
+				stream_packet_header_t packet;
+				stream_block_header_t block;
+			} block_packet_t;
+#pragma pack(pop)
+
+			typedef struct
+			{
+				uintptr_t socket;             // SOCKET or file descriptor
+				std::vector<uint8_t> backlog; // bytes not sent yet, sent before anything else
+				size_t backlogSize = 0;
+				bool isOpen        = false;
+			} client_t;
+
+			void run();
+			void accept();
+			void send(client_t& client, const CModularBCISampleBus::CBlock* const* blocks, size_t nBlock);
+			bool flush(client_t& client);
+			void close(client_t& client);
+
+			CModularBCISampleBus* m_bus = nullptr;
+			size_t m_subscriber         = CModularBCISampleBus::INVALID_SUBSCRIBER;
+			std::string m_descriptor;
+			uint16_t m_port    = 0;
+			uintptr_t m_socket = uintptr_t(~0); // listening socket
+			std::vector<client_t> m_clients;
+			std::vector<block_packet_t> m_headers; // headers of the blocks of the current batch
+
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+			std::atomic<size_t> m_nClient{0};
+			std::atomic<uint64_t> m_nAccepted{0};
+			std::atomic<uint64_t> m_nSlowClient{0};
+			std::atomic<uint64_t> m_nSentBlock{0};
+		};
+	}  // namespace AcquisitionServer
+}  // namespace OpenViBE
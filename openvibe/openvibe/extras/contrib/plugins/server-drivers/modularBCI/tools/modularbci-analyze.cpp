@@ -0,0 +1,631 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Batch spectral analysis of ModularBCI recordings (.mbci) and CSV exports, the offline
+ * counterpart of matlab/main.m, PlotFFT.m and PlotData.m for whole sessions. Every channel of
+ * every file is an independent task: its samples are streamed through the filters and a Welch
+ * estimator, so memory does not grow with the length of the recordings, and the tasks are
+ * spread over a pool of threads. Results go to one binary PSD file per input and a summary CSV.
+ *
+ */
+#include "ovasCModularBCIFilterBank.h"
+#include "ovasCModularBCIRecordingReader.h"
+#include "ovasCModularBCISpectralEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+/*
+ * PSD file layout, all values little endian
+ *
+ * A psd_file_header_t, then nChannel rows of nBin float32 values: the Welch estimate of each
+ * analyzed channel in uV^2/Hz, bin k at k * sampling / windowSize Hz, after the optional filters.
+ */
+#define PSD_MAGIC   "MBCIPSD"
+#define PSD_VERSION 1
+
+#define BUTTERWORTH_Q     0.70710678
+#define STREAM_BLOCK_SIZE 4096 // samples converted at once per task
+
+namespace
+{
+#pragma pack(push, 1)
+	typedef struct
+	{
+		char magic[8]; // PSD_MAGIC, zero terminated
+		uint32_t version;
+		uint32_t nChannel;
+		uint32_t nBin;
+		uint32_t windowSize;
+		float sampling;
+		float overlap;
+		uint64_t nSample;  // samples per channel analyzed
+		uint64_t nSegment; // Welch segments averaged per channel
+	} psd_file_header_t;
+#pragma pack(pop)
+
+	typedef struct
+	{
+		std::vector<std::string> inputs;
+		std::string outputDir = ".";
+		std::vector<uint32_t> channels; // 0-based, empty for all
+		double sampling       = 250;    // CSV files only
+		double notch          = 0;
+		double bandLow        = 0, bandHigh = 0;
+		uint32_t windowSize   = 512;
+		double overlap        = 0.5;
+		std::string bands     = "delta:1-4;theta:4-8;alpha:8-13;beta:13-30;gamma:30-45";
+		uint32_t nThread      = 0;
+		bool writeFiltered    = false;
+	} settings_t;
+
+	// an input file, its format and the columns that hold its channels
+	typedef struct
+	{
+		std::string path, baseName;
+		bool isRecording = false;
+		double sampling  = 0;
+		std::vector<std::string> names; // of the analyzed channels
+		std::vector<uint32_t> channels; // recording channels, or CSV columns
+	} input_t;
+
+	// one analyzed channel, the unit of work of the thread pool
+	typedef struct
+	{
+		size_t input   = 0;
+		size_t channel = 0; // position in input_t::channels
+		std::string error;
+		uint64_t nSample  = 0;
+		uint64_t nSegment = 0;
+		double mean = 0, rms = 0, peakFrequency = 0;
+		std::vector<double> psd;
+	} task_t;
+
+	void usage()
+	{
+		std::printf("Usage: openvibe-modularbci-analyze [options] file1 [file2 ...]\n"
+			"  files             .mbci recordings or CSV exports with Channel1..N or EEG1..N columns\n"
+			"  --output dir      directory of the .psd files and of summary.csv (default: current)\n"
+			"  --channels list   comma separated channels, starting at 1 (default: all)\n"
+			"  --sampling f      sampling rate of the CSV files in Hz (default: 250)\n"
+			"  --notch f         power line notch in Hz (default: none)\n"
+			"  --band low-high   Butterworth band-pass in Hz, 0 for an open end (default: none)\n"
+			"  --window n        Welch segment length in samples, a power of two (default: 512)\n"
+			"  --overlap r       Welch segment overlap in [0, 1) (default: 0.5)\n"
+			"  --bands list      band powers to report, name:low-high;... (default: delta to gamma)\n"
+			"  --threads n       worker threads (default: all cores)\n"
+			"  --filtered yes    also writes the filtered signal of every channel as raw float32\n");
+	}
+
+	bool parseArguments(const int argc, char** argv, settings_t& settings)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string key = argv[i];
+			if (key.compare(0, 2, "--") != 0)
+			{
+				settings.inputs.push_back(key);
+				continue;
+			}
+			if (i + 1 >= argc) { return false; }
+			const std::string value = argv[++i];
+
+			if (key == "--output") { settings.outputDir = value; }
+			else if (key == "--channels")
+			{
+				std::stringstream ss(value);
+				std::string item;
+				while (std::getline(ss, item, ','))
+				{
+					const long channel = std::strtol(item.c_str(), nullptr, 10);
+					if (channel < 1) { return false; }
+					settings.channels.push_back(uint32_t(channel - 1));
+				}
+			}
+			else if (key == "--sampling") { settings.sampling = std::atof(value.c_str()); }
+			else if (key == "--notch") { settings.notch = std::atof(value.c_str()); }
+			else if (key == "--band")
+			{
+				if (std::sscanf(value.c_str(), "%lf-%lf", &settings.bandLow, &settings.bandHigh) != 2) { return false; }
+			}
+			else if (key == "--window") { settings.windowSize = uint32_t(std::atoi(value.c_str())); }
+			else if (key == "--overlap") { settings.overlap = std::atof(value.c_str()); }
+			else if (key == "--bands") { settings.bands = value; }
+			else if (key == "--threads") { settings.nThread = uint32_t(std::atoi(value.c_str())); }
+			else if (key == "--filtered") { settings.writeFiltered = value == "yes" || value == "true" || value == "1"; }
+			else { return false; }
+		}
+		return !settings.inputs.empty() && settings.sampling > 0 && settings.windowSize >= 4 && (settings.windowSize & (settings.windowSize - 1)) == 0
+			   && settings.overlap >= 0 && settings.overlap < 1;
+	}
+
+	// the extension is kept, a session often has a recording and a CSV export of the same name
+	std::string getBaseName(const std::string& path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	// columns of a CSV header line, without quotes
+	std::vector<std::string> splitHeader(const std::string& line)
+	{
+		std::vector<std::string> columns;
+		std::stringstream ss(line);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			item.erase(std::remove(item.begin(), item.end(), '"'), item.end());
+			while (!item.empty() && (item.back() == '\r' || item.back() == ' ')) { item.pop_back(); }
+			while (!item.empty() && item.front() == ' ') { item.erase(item.begin()); }
+			columns.push_back(item);
+		}
+		return columns;
+	}
+
+	// the channel columns of our CSV exports (Channel1..N) and of the Unicorn ones (EEG1..N)
+	bool describeCsv(const settings_t& settings, input_t& input, std::string& error)
+	{
+		std::ifstream file(input.path.c_str());
+		std::string line;
+		if (!file.is_open() || !std::getline(file, line))
+		{
+			error = "can't read the header line";
+			return false;
+		}
+		const std::vector<std::string> columns = splitHeader(line);
+		std::vector<uint32_t> channelColumns;
+		for (const char* prefix : { "Channel", "EEG" })
+		{
+			for (uint32_t n = 1;; ++n)
+			{
+				const auto it = std::find(columns.begin(), columns.end(), prefix + std::to_string(n));
+				if (it == columns.end()) { break; }
+				channelColumns.push_back(uint32_t(it - columns.begin()));
+			}
+			if (!channelColumns.empty()) { break; }
+		}
+		if (channelColumns.empty())
+		{
+			error = "no Channel1..N nor EEG1..N column";
+			return false;
+		}
+
+		input.sampling = settings.sampling;
+		for (uint32_t c = 0; c < channelColumns.size(); ++c)
+		{
+			if (!settings.channels.empty() && std::find(settings.channels.begin(), settings.channels.end(), c) == settings.channels.end()) { continue; }
+			input.channels.push_back(channelColumns[c]);
+			input.names.push_back(columns[channelColumns[c]]);
+		}
+		return true;
+	}
+
+	bool describeRecording(const settings_t& settings, input_t& input, std::string& error)
+	{
+		CModularBCIRecordingReader reader;
+		if (!reader.open(input.path) || reader.isPlainCapture())
+		{
+			error = reader.isOpen() ? "plain captures hold no decoded samples" : reader.getLastError();
+			return false;
+		}
+		// the names of the columns of a converted CSV export, Channel1..N otherwise
+		const recording_header_t& header = reader.getHeader();
+		std::vector<std::string> names;
+		std::stringstream ss(std::string(header.channelNames, strnlen(header.channelNames, sizeof(header.channelNames))));
+		std::string name;
+		while (ss >> name) { names.push_back(name); }
+		if (names.size() != header.nChannel) { names.clear(); }
+
+		input.sampling = header.sampling;
+		for (uint32_t c = 0; c < header.nChannel; ++c)
+		{
+			if (!settings.channels.empty() && std::find(settings.channels.begin(), settings.channels.end(), c) == settings.channels.end()) { continue; }
+			input.channels.push_back(c);
+			input.names.push_back(names.empty() ? "Channel" + std::to_string(c + 1) : names[c]);
+		}
+		return true;
+	}
+
+	//___________________________________________________________________//
+	//                                                                   //
+
+	/**
+	 * \class CChannelAnalysis
+	 * \brief Streaming filters, moments and Welch PSD of one channel
+	 */
+	class CChannelAnalysis final
+	{
+	public:
+
+		bool initialize(const settings_t& settings, const double sampling, const std::string& filteredFilename)
+		{
+			m_filterBank.initialize(1, sampling);
+			if (settings.notch > 0) { m_filterBank.addStage(0, CModularBCIFilterBank::EFilterType::Notch, settings.notch, 30); }
+			if (settings.bandLow > 0) { m_filterBank.addStage(0, CModularBCIFilterBank::EFilterType::HighPass, settings.bandLow, BUTTERWORTH_Q); }
+			if (settings.bandHigh > 0) { m_filterBank.addStage(0, CModularBCIFilterBank::EFilterType::LowPass, settings.bandHigh, BUTTERWORTH_Q); }
+
+			if (!m_fft.initialize(settings.windowSize)) { return false; }
+			m_sampling = sampling;
+			m_hopSize  = std::max<size_t>(1, size_t(std::lround(settings.windowSize * (1 - settings.overlap))));
+			m_window.resize(settings.windowSize);
+			const double pi   = 3.14159265358979323846;
+			double sumSquares = 0;
+			for (size_t i = 0; i < m_window.size(); ++i)
+			{
+				m_window[i] = float(0.5 - 0.5 * std::cos(2 * pi * double(i) / double(m_window.size())));
+				sumSquares += double(m_window[i]) * m_window[i];
+			}
+			m_scale = 1 / (sampling * sumSquares); // |X|^2 to uV^2/Hz
+			m_history.assign(settings.windowSize, 0);
+			m_frame.resize(settings.windowSize);
+			m_real.resize(m_fft.getBinCount());
+			m_imag.resize(m_fft.getBinCount());
+			m_psd.assign(m_fft.getBinCount(), 0);
+
+			if (!filteredFilename.empty())
+			{
+				m_filteredFile = std::fopen(filteredFilename.c_str(), "wb");
+				if (m_filteredFile == nullptr) { return false; }
+			}
+			return true;
+		}
+
+		~CChannelAnalysis() { if (m_filteredFile != nullptr) { std::fclose(m_filteredFile); } }
+
+		// samples in uV, filtered in place
+		void push(float* samples, const size_t nSample)
+		{
+			m_filterBank.process(samples, nSample);
+			if (m_filteredFile != nullptr) { std::fwrite(samples, sizeof(float), nSample, m_filteredFile); }
+
+			const size_t size = m_history.size();
+			for (size_t i = 0; i < nSample; ++i)
+			{
+				m_sum += samples[i];
+				m_sumSquares += double(samples[i]) * samples[i];
+				m_history[m_position] = samples[i];
+				m_position            = (m_position + 1) & (size - 1);
+				m_nSample++;
+				if (m_nSample >= size && ++m_nSinceSegment >= m_hopSize)
+				{
+					m_nSinceSegment = 0;
+					this->segment();
+				}
+			}
+		}
+
+		void finish(task_t& task) const
+		{
+			task.nSample  = m_nSample;
+			task.nSegment = m_nSegment;
+			task.mean     = m_nSample != 0 ? m_sum / double(m_nSample) : 0;
+			task.rms      = m_nSample != 0 ? std::sqrt(m_sumSquares / double(m_nSample)) : 0;
+			task.psd.assign(m_psd.size(), 0);
+			if (m_nSegment == 0) { return; }
+			for (size_t k = 0; k < m_psd.size(); ++k) { task.psd[k] = m_psd[k] / double(m_nSegment); }
+			const size_t peak  = size_t(std::max_element(task.psd.begin() + 1, task.psd.end()) - task.psd.begin());
+			task.peakFrequency = double(peak) * m_sampling / double(m_history.size());
+		}
+
+	protected:
+
+		void segment()
+		{
+			const size_t size = m_history.size();
+			for (size_t i = 0; i < size; ++i) { m_frame[i] = m_history[(m_position + i) & (size - 1)] * m_window[i]; }
+			m_fft.forward(&m_frame[0], &m_real[0], &m_imag[0]);
+			for (size_t k = 0; k < m_psd.size(); ++k)
+			{
+				// one-sided, DC and Nyquist have no negative frequency counterpart
+				const double power = (double(m_real[k]) * m_real[k] + double(m_imag[k]) * m_imag[k]) * m_scale;
+				m_psd[k] += (k == 0 || k == m_psd.size() - 1) ? power : 2 * power;
+			}
+			m_nSegment++;
+		}
+
+		CModularBCIFilterBank m_filterBank;
+		CModularBCIFFT m_fft;
+		double m_sampling = 0;
+		size_t m_hopSize  = 0;
+		double m_scale    = 0;
+		std::vector<float> m_window, m_history, m_frame, m_real, m_imag;
+		std::vector<double> m_psd; // summed over segments
+		size_t m_position      = 0;
+		size_t m_nSinceSegment = 0;
+		uint64_t m_nSample     = 0;
+		uint64_t m_nSegment    = 0;
+		double m_sum = 0, m_sumSquares = 0;
+		FILE* m_filteredFile = nullptr;
+	};
+
+	std::string getFilteredFilename(const settings_t& settings, const input_t& input, const size_t channel)
+	{
+		return settings.writeFiltered ? settings.outputDir + "/" + input.baseName + "." + input.names[channel] + ".f32" : std::string();
+	}
+
+	// streams one channel of a recording, straight from the mapped chunks
+	void analyzeRecording(const settings_t& settings, const input_t& input, task_t& task)
+	{
+		CModularBCIRecordingReader reader;
+		CChannelAnalysis analysis;
+		if (!reader.open(input.path)) { task.error = reader.getLastError(); return; }
+		if (!analysis.initialize(settings, input.sampling, getFilteredFilename(settings, input, task.channel)))
+		{
+			task.error = "can't write the filtered signal";
+			return;
+		}
+
+		const recording_header_t& header = reader.getHeader();
+		const uint32_t channel           = input.channels[task.channel];
+		std::vector<float> block(STREAM_BLOCK_SIZE);
+		uint64_t next = 0;
+		for (const auto& entry : reader.getIndex())
+		{
+			if (entry.type != uint32_t(ERecordingChunkType::Samples) || entry.firstSample + entry.nSample <= next) { continue; }
+
+			// samples lost at recording time are zeros, as in the training tool, so that the time base stays right
+			while (next < entry.firstSample)
+			{
+				const size_t n = size_t(std::min<uint64_t>(entry.firstSample - next, block.size()));
+				std::fill(block.begin(), block.begin() + n, 0.0F);
+				analysis.push(&block[0], n);
+				next += n;
+			}
+			const int32_t* codes = reinterpret_cast<const int32_t*>(reader.getPayload(entry));
+			for (size_t s = size_t(next - entry.firstSample); s < entry.nSample;)
+			{
+				const size_t n = std::min<size_t>(entry.nSample - s, block.size());
+				for (size_t i = 0; i < n; ++i) { block[i] = float(codes[(s + i) * header.nChannel + channel]) * header.unitsToMicroVolts; }
+				analysis.push(&block[0], n);
+				s += n;
+				next += n;
+			}
+		}
+		analysis.finish(task);
+	}
+
+	// a CSV file is parsed once for all its channels, which is where the time goes
+	void analyzeCsv(const settings_t& settings, const input_t& input, std::vector<task_t*>& tasks)
+	{
+		std::vector<CChannelAnalysis> analyses(tasks.size());
+		for (size_t c = 0; c < tasks.size(); ++c)
+		{
+			if (!analyses[c].initialize(settings, input.sampling, getFilteredFilename(settings, input, tasks[c]->channel)))
+			{
+				for (auto* task : tasks) { task->error = "can't write the filtered signal"; }
+				return;
+			}
+		}
+		const uint32_t lastColumn = *std::max_element(input.channels.begin(), input.channels.end());
+
+		std::ifstream file(input.path.c_str());
+		std::string line;
+		std::getline(file, line); // header
+		std::vector<float> values(lastColumn + 1);
+		std::vector<std::vector<float>> blocks(tasks.size(), std::vector<float>(STREAM_BLOCK_SIZE));
+		size_t n = 0;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '\r') { continue; }
+			const char* p = line.c_str();
+			uint32_t column;
+			for (column = 0; column <= lastColumn && *p != '\0'; ++column)
+			{
+				char* end;
+				values[column] = std::strtof(p, &end);
+				p              = std::strchr(end, ',');
+				if (p == nullptr) { break; }
+				p++;
+			}
+			if (column < lastColumn) { continue; } // blank or truncated line
+
+			for (size_t c = 0; c < tasks.size(); ++c) { blocks[c][n] = values[input.channels[tasks[c]->channel]]; }
+			if (++n == STREAM_BLOCK_SIZE)
+			{
+				for (size_t c = 0; c < tasks.size(); ++c) { analyses[c].push(&blocks[c][0], n); }
+				n = 0;
+			}
+		}
+		for (size_t c = 0; c < tasks.size(); ++c)
+		{
+			if (n != 0) { analyses[c].push(&blocks[c][0], n); }
+			analyses[c].finish(*tasks[c]);
+		}
+	}
+
+	//___________________________________________________________________//
+	//                                                                   //
+
+	bool writePsd(const settings_t& settings, const input_t& input, const std::vector<task_t>& tasks, const size_t firstTask)
+	{
+		psd_file_header_t header = {};
+		std::memcpy(header.magic, PSD_MAGIC, sizeof(PSD_MAGIC));
+		header.version    = PSD_VERSION;
+		header.nChannel   = uint32_t(input.channels.size());
+		header.nBin       = settings.windowSize / 2 + 1;
+		header.windowSize = settings.windowSize;
+		header.sampling   = float(input.sampling);
+		header.overlap    = float(settings.overlap);
+		header.nSample    = tasks[firstTask].nSample;
+		header.nSegment   = tasks[firstTask].nSegment;
+
+		FILE* file = std::fopen((settings.outputDir + "/" + input.baseName + ".psd").c_str(), "wb");
+		if (file == nullptr) { return false; }
+		bool res = std::fwrite(&header, sizeof(header), 1, file) == 1;
+		std::vector<float> row(header.nBin);
+		for (size_t c = 0; c < input.channels.size(); ++c)
+		{
+			const task_t& task = tasks[firstTask + c];
+			for (size_t k = 0; k < row.size(); ++k) { row[k] = k < task.psd.size() ? float(task.psd[k]) : 0; }
+			res = res && std::fwrite(&row[0], sizeof(float), row.size(), file) == row.size();
+		}
+		return std::fclose(file) == 0 && res;
+	}
+
+	// power in [low, high) from the PSD, in uV^2
+	double getBandPower(const std::vector<double>& psd, const double binWidth, const double low, const double high)
+	{
+		double power = 0;
+		for (size_t k = 1; k < psd.size(); ++k)
+		{
+			const double f = double(k) * binWidth;
+			if (f >= low && f < high) { power += psd[k] * binWidth; }
+		}
+		return power;
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	settings_t settings;
+	std::vector<CModularBCISpectralEngine::band_t> bands;
+	if (!parseArguments(argc, argv, settings) || !CModularBCISpectralEngine::parseBands(settings.bands, bands))
+	{
+		usage();
+		return 1;
+	}
+
+	// files are described up front, so that a bad one stops the run before hours of work
+	std::vector<input_t> inputs(settings.inputs.size());
+	std::vector<task_t> tasks;
+	std::vector<size_t> firstTasks;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		input_t& input = inputs[i];
+		input.path     = settings.inputs[i];
+		input.baseName = getBaseName(input.path);
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (inputs[j].baseName == input.baseName)
+			{
+				std::fprintf(stderr, "[%s] and [%s] would write the same results, rename one of them\n", inputs[j].path.c_str(), input.path.c_str());
+				return 1;
+			}
+		}
+		const size_t size = input.path.size();
+		input.isRecording = size > 5 && input.path.compare(size - 5, 5, ".mbci") == 0;
+
+		std::string error;
+		if (!(input.isRecording ? describeRecording(settings, input, error) : describeCsv(settings, input, error)) || input.channels.empty())
+		{
+			std::fprintf(stderr, "Can't analyze [%s] (%s)\n", input.path.c_str(), error.empty() ? "none of the selected channels" : error.c_str());
+			return 1;
+		}
+		if (settings.bandHigh >= input.sampling / 2 || settings.notch >= input.sampling / 2)
+		{
+			std::fprintf(stderr, "The filters of [%s] must stay below half its sampling rate (%g Hz)\n", input.path.c_str(), input.sampling / 2);
+			return 1;
+		}
+		firstTasks.push_back(tasks.size());
+		for (size_t c = 0; c < input.channels.size(); ++c)
+		{
+			task_t task;
+			task.input   = i;
+			task.channel = c;
+			tasks.push_back(task);
+		}
+	}
+
+	// the work items are channels of recordings, whole CSV files
+	std::vector<std::vector<size_t>> items;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (inputs[i].isRecording) { for (size_t c = 0; c < inputs[i].channels.size(); ++c) { items.push_back({ firstTasks[i] + c }); } }
+		else
+		{
+			items.push_back({});
+			for (size_t c = 0; c < inputs[i].channels.size(); ++c) { items.back().push_back(firstTasks[i] + c); }
+		}
+	}
+
+	const uint32_t nThread = std::max<uint32_t>(1, std::min<uint32_t>(settings.nThread != 0 ? settings.nThread : std::thread::hardware_concurrency(),
+																		uint32_t(items.size())));
+	std::printf("Analyzing %u channels of %u files with %u threads\n", uint32_t(tasks.size()), uint32_t(inputs.size()), nThread);
+	std::atomic<size_t> nextItem{0}, nDone{0};
+	std::mutex printMutex;
+	auto worker = [&]()
+	{
+		for (size_t item = nextItem++; item < items.size(); item = nextItem++)
+		{
+			const input_t& input = inputs[tasks[items[item][0]].input];
+			if (input.isRecording) { analyzeRecording(settings, input, tasks[items[item][0]]); }
+			else
+			{
+				std::vector<task_t*> csvTasks;
+				for (const auto& t : items[item]) { csvTasks.push_back(&tasks[t]); }
+				analyzeCsv(settings, input, csvTasks);
+			}
+			// counted in channels like the header line, a CSV file completes all its channels at once
+			std::string names;
+			for (const auto& t : items[item]) { names += " " + input.names[tasks[t].channel]; }
+			std::lock_guard<std::mutex> lock(printMutex);
+			nDone += items[item].size();
+			std::printf("  [%u/%u] %s%s\n", uint32_t(nDone), uint32_t(tasks.size()), input.baseName.c_str(), names.c_str());
+			std::fflush(stdout);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < nThread; ++t) { threads.emplace_back(worker); }
+	for (auto& thread : threads) { thread.join(); }
+
+	// results, in the order of the command line
+	FILE* summary = std::fopen((settings.outputDir + "/summary.csv").c_str(), "w");
+	if (summary == nullptr)
+	{
+		std::fprintf(stderr, "Can't write [%s/summary.csv]\n", settings.outputDir.c_str());
+		return 1;
+	}
+	std::fprintf(summary, "file,channel,samples,seconds,segments,mean_uV,rms_uV,peak_Hz,total_uV2");
+	for (const auto& band : bands) { std::fprintf(summary, ",%s_uV2,%s_relative", band.name.c_str(), band.name.c_str()); }
+	std::fprintf(summary, "\n");
+
+	int res = 0;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const input_t& input = inputs[i];
+		bool isValid         = true;
+		for (size_t c = 0; c < input.channels.size(); ++c)
+		{
+			const task_t& task = tasks[firstTasks[i] + c];
+			if (!task.error.empty())
+			{
+				std::fprintf(stderr, "[%s] %s: %s\n", input.path.c_str(), input.names[c].c_str(), task.error.c_str());
+				isValid = false;
+				continue;
+			}
+			const double binWidth = input.sampling / settings.windowSize;
+			const double total    = getBandPower(task.psd, binWidth, 0, input.sampling);
+			std::fprintf(summary, "%s,%s,%llu,%.3f,%llu,%.4f,%.4f,%.3f,%.6g", input.baseName.c_str(), input.names[c].c_str(), (unsigned long long)task.nSample,
+						 double(task.nSample) / input.sampling, (unsigned long long)task.nSegment, task.mean, task.rms, task.peakFrequency, total);
+			for (const auto& band : bands)
+			{
+				const double power = getBandPower(task.psd, binWidth, band.low, band.high);
+				std::fprintf(summary, ",%.6g,%.4f", power, total > 0 ? power / total : 0);
+			}
+			std::fprintf(summary, "\n");
+		}
+		if (!isValid || !writePsd(settings, input, tasks, firstTasks[i]))
+		{
+			std::fprintf(stderr, "Can't write the PSD of [%s]\n", input.path.c_str());
+			res = 1;
+		}
+	}
+	std::fclose(summary);
+	std::printf("Results written to [%s]\n", settings.outputDir.c_str());
+	return res;
+}
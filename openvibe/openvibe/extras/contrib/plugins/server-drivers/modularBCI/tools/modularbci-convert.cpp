@@ -0,0 +1,617 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Converts CSV exports (the files matlab/main.m reads with readtable: Channel1..N columns, or
+ * the EEG1..N columns of the Unicorn exports) to ModularBCI binary recordings (.mbci), so that
+ * the replay mode of the driver and the offline tools can use the archive.
+ *
+ * Both files are memory mapped. The CSV is split into one part per thread at line boundaries;
+ * a first pass counts the rows of every part, which gives each part its first sample index and
+ * the size of the output, then every thread parses its part and writes the ADC codes straight
+ * into their chunk slots of the output. Chunk headers and the index only depend on the sample
+ * count, they are written before the parse.
+ *
+ */
+#include "ovasCModularBCIRecordingFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined TARGET_OS_Windows
+#include <windows.h>
+#elif defined TARGET_OS_Linux
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+// ADS1299 at a gain of 24, the resolution of the board recordings
+#define DEFAULT_GAIN 24.0
+#define DEFAULT_VREF 4.5
+
+#define SAMPLING_PROBE_ROW_COUNT 1000 // rows of the time column the sampling rate is estimated from
+
+namespace
+{
+	typedef struct
+	{
+		std::string input, output;
+		double sampling   = 0; // 0 to detect
+		double resolution = 0; // uV per ADC code, 0 for the ADS1299 one
+		uint32_t nThread  = 0;
+	} settings_t;
+
+	// what the header line says about the columns
+	typedef struct
+	{
+		char delimiter    = ',';
+		char decimalPoint = '.';
+		bool hasHeader    = true;
+		std::vector<uint32_t> channels; // column of each channel
+		std::vector<std::string> names;
+		int timeColumn = -1;
+		int markerColumn = -1; // not converted, the recordings hold no markers
+		uint32_t nColumn = 0;
+	} schema_t;
+
+	// a read-only or a writable mapping of a whole file
+	class CFileMapping final
+	{
+	public:
+
+		~CFileMapping() { this->close(); }
+
+		bool open(const std::string& filename)
+		{
+#if defined TARGET_OS_Windows
+			m_file = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			LARGE_INTEGER size;
+			if (m_file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(m_file, &size) || size.QuadPart == 0) { return false; }
+			m_size    = uint64_t(size.QuadPart);
+			m_mapping = ::CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_mapping != nullptr) { m_data = static_cast<uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)); }
+			return m_data != nullptr;
+#elif defined TARGET_OS_Linux
+			const int file = ::open(filename.c_str(), O_RDONLY);
+			struct stat status;
+			if (file < 0 || ::fstat(file, &status) != 0 || status.st_size == 0)
+			{
+				if (file >= 0) { ::close(file); }
+				return false;
+			}
+			m_size     = uint64_t(status.st_size);
+			void* data = ::mmap(nullptr, size_t(m_size), PROT_READ, MAP_SHARED, file, 0);
+			::close(file);
+			if (data == MAP_FAILED) { return false; }
+			::madvise(data, size_t(m_size), MADV_SEQUENTIAL);
+			m_data = static_cast<uint8_t*>(data);
+			return true;
+#else
+			(void)filename;
+			return false;
+#endif
+		}
+
+		bool create(const std::string& filename, const uint64_t size)
+		{
+#if defined TARGET_OS_Windows
+			m_file = ::CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (m_file == INVALID_HANDLE_VALUE) { return false; }
+			m_size    = size;
+			m_mapping = ::CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), nullptr);
+			if (m_mapping != nullptr) { m_data = static_cast<uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0)); }
+			return m_data != nullptr;
+#elif defined TARGET_OS_Linux
+			const int file = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (file < 0) { return false; }
+			// allocates the blocks up front, a sparse file would fail on a full disk in the middle of the parse with SIGBUS
+			if (::posix_fallocate(file, 0, off_t(size)) != 0)
+			{
+				::close(file);
+				return false;
+			}
+			m_size     = size;
+			void* data = ::mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			::close(file);
+			if (data == MAP_FAILED) { return false; }
+			m_data = static_cast<uint8_t*>(data);
+			return true;
+#else
+			(void)filename;
+			(void)size;
+			return false;
+#endif
+		}
+
+		void close()
+		{
+#if defined TARGET_OS_Windows
+			if (m_data != nullptr) { ::UnmapViewOfFile(m_data); }
+			if (m_mapping != nullptr) { ::CloseHandle(m_mapping); }
+			if (m_file != nullptr && m_file != INVALID_HANDLE_VALUE) { ::CloseHandle(m_file); }
+			m_mapping = nullptr;
+			m_file    = nullptr;
+#elif defined TARGET_OS_Linux
+			if (m_data != nullptr) { ::munmap(m_data, size_t(m_size)); }
+#else
+#endif
+			m_data = nullptr;
+			m_size = 0;
+		}
+
+		uint8_t* getData() const { return m_data; }
+		uint64_t getSize() const { return m_size; }
+
+	protected:
+
+		uint8_t* m_data = nullptr;
+		uint64_t m_size = 0;
+#if defined TARGET_OS_Windows
+		HANDLE m_file    = nullptr;
+		HANDLE m_mapping = nullptr;
+#endif
+	};
+
+	//___________________________________________________________________//
+	//                                                                   //
+
+	// 10^n for the exponents plain decimal numbers use, exact in double up to 10^22
+	const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+									 1e20, 1e21, 1e22 };
+
+	/*
+	 * Parses a decimal number, with optional sign, fraction and exponent, and leaves p after it.
+	 * Digits accumulate into an integer mantissa with a single scaling at the end, instead of a
+	 * floating point multiply per digit, and the format is fixed by the schema instead of the
+	 * locale, so this is an order of magnitude faster than strtod. Anything else (nan, inf,
+	 * hexadecimal) goes to strtod.
+	 */
+	bool parseNumber(const char*& p, const char* end, const char decimalPoint, double& value)
+	{
+		while (p < end && (*p == ' ' || *p == '"')) { ++p; }
+		const char* start = p;
+		const bool isNegative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) { ++p; }
+
+		uint64_t mantissa = 0;
+		int exponent      = 0, nDigit = 0;
+		bool hasDigit     = false;
+		for (; p < end && unsigned(*p - '0') < 10; ++p, hasDigit = true)
+		{
+			if (nDigit < 19) { mantissa = mantissa * 10 + unsigned(*p - '0'); nDigit += mantissa != 0 ? 1 : 0; }
+			else { exponent++; }
+		}
+		if (p < end && *p == decimalPoint)
+		{
+			for (++p; p < end && unsigned(*p - '0') < 10; ++p, hasDigit = true)
+			{
+				if (nDigit < 19)
+				{
+					mantissa = mantissa * 10 + unsigned(*p - '0');
+					nDigit += mantissa != 0 ? 1 : 0;
+					exponent--;
+				}
+			}
+		}
+		if (!hasDigit)
+		{
+			char buffer[64];
+			const size_t size = std::min<size_t>(size_t(end - start), sizeof(buffer) - 1);
+			std::memcpy(buffer, start, size);
+			buffer[size] = '\0';
+			char* last;
+			value = std::strtod(buffer, &last);
+			p     = start + (last - buffer);
+			return last != buffer;
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			const bool isExponentNegative = q < end && *q == '-';
+			if (q < end && (*q == '-' || *q == '+')) { ++q; }
+			int e = 0;
+			for (; q < end && unsigned(*q - '0') < 10; ++q) { e = std::min(e * 10 + (*q - '0'), 10000); }
+			if (q != p + 1 && unsigned(q[-1] - '0') < 10)
+			{
+				exponent += isExponentNegative ? -e : e;
+				p = q;
+			}
+		}
+
+		value = double(mantissa);
+		if (exponent < 0) { value = -exponent <= 22 ? value / POWERS_OF_TEN[-exponent] : value * std::pow(10.0, exponent); }
+		else if (exponent > 0) { value = exponent <= 22 ? value * POWERS_OF_TEN[exponent] : value * std::pow(10.0, exponent); }
+		if (isNegative) { value = -value; }
+		return true;
+	}
+
+	// start of the next line, end if none
+	const char* nextLine(const char* p, const char* end)
+	{
+		const void* newline = std::memchr(p, '\n', size_t(end - p));
+		return newline == nullptr ? end : static_cast<const char*>(newline) + 1;
+	}
+
+	// a line holds a sample if it has anything but blanks
+	bool isRow(const char* p, const char* lineEnd)
+	{
+		for (; p < lineEnd; ++p) { if (*p != '\r' && *p != '\n' && *p != ' ' && *p != '\t') { return true; } }
+		return false;
+	}
+
+	std::string normalizeName(const std::string& name)
+	{
+		std::string res;
+		for (const auto& c : name) { if (c != ' ' && c != '"' && c != '\r' && c != '\'') { res += c; } }
+		return res;
+	}
+
+	bool detectSchema(const char* data, const char* end, schema_t& schema, std::string& error)
+	{
+		const char* lineEnd = nextLine(data, end);
+		const std::string line(data, lineEnd);
+
+		// the most frequent candidate of the first line, a European CSV separates with ; and has decimal commas
+		const char candidates[] = { ',', ';', '\t' };
+		size_t best             = 0;
+		for (const auto& c : candidates)
+		{
+			const size_t n = size_t(std::count(line.begin(), line.end(), c));
+			if (n > best)
+			{
+				best             = n;
+				schema.delimiter = c;
+			}
+		}
+		schema.decimalPoint = schema.delimiter == ';' ? ',' : '.';
+
+		std::vector<std::string> columns;
+		size_t start = 0;
+		while (true)
+		{
+			const size_t stop = line.find(schema.delimiter, start);
+			columns.push_back(normalizeName(line.substr(start, stop == std::string::npos ? std::string::npos : stop - start)));
+			if (stop == std::string::npos) { break; }
+			start = stop + 1;
+		}
+		if (!columns.empty() && columns.back().empty() && columns.size() > 1) { columns.pop_back(); } // trailing delimiter
+		if (!columns.empty() && !columns.back().empty() && columns.back().back() == '\n') { columns.back().pop_back(); }
+		schema.nColumn = uint32_t(columns.size());
+
+		// a first line of numbers is data, every column is then a channel
+		const char* p = data;
+		double value;
+		schema.hasHeader = !parseNumber(p, lineEnd, schema.decimalPoint, value);
+		if (!schema.hasHeader)
+		{
+			for (uint32_t c = 0; c < schema.nColumn; ++c)
+			{
+				schema.channels.push_back(c);
+				schema.names.push_back("Channel" + std::to_string(c + 1));
+			}
+			return true;
+		}
+
+		for (const char* prefix : { "Channel", "EEG" })
+		{
+			for (uint32_t n = 1;; ++n)
+			{
+				const auto it = std::find(columns.begin(), columns.end(), prefix + std::to_string(n));
+				if (it == columns.end()) { break; }
+				schema.channels.push_back(uint32_t(it - columns.begin()));
+				schema.names.push_back(*it);
+			}
+			if (!schema.channels.empty()) { break; }
+		}
+		for (uint32_t c = 0; c < columns.size(); ++c)
+		{
+			std::string name = columns[c];
+			std::transform(name.begin(), name.end(), name.begin(), [](const char ch) { return char(std::tolower(ch)); });
+			if (name.compare(0, 4, "time") == 0 && schema.timeColumn < 0) { schema.timeColumn = int(c); }
+			if (name == "marker" && schema.markerColumn < 0) { schema.markerColumn = int(c); }
+		}
+		if (schema.channels.empty())
+		{
+			error = "no Channel1..N nor EEG1..N column in the header";
+			return false;
+		}
+		if (schema.channels.size() > 32)
+		{
+			error = "more than 32 channels";
+			return false;
+		}
+		return true;
+	}
+
+	// from the median step of the time column, in s or in ms
+	double detectSampling(const char* p, const char* end, const schema_t& schema)
+	{
+		if (schema.timeColumn < 0) { return 0; }
+		std::vector<double> times;
+		while (p < end && times.size() < SAMPLING_PROBE_ROW_COUNT)
+		{
+			const char* lineEnd = nextLine(p, end);
+			const char* q       = p;
+			for (int c = 0; c < schema.timeColumn && q != nullptr; ++c)
+			{
+				q = static_cast<const char*>(std::memchr(q, schema.delimiter, size_t(lineEnd - q)));
+				if (q != nullptr) { ++q; }
+			}
+			double value;
+			if (q != nullptr && isRow(p, lineEnd) && parseNumber(q, lineEnd, schema.decimalPoint, value)) { times.push_back(value); }
+			p = lineEnd;
+		}
+		if (times.size() < 3) { return 0; }
+
+		std::vector<double> steps;
+		for (size_t i = 1; i < times.size(); ++i) { steps.push_back(times[i] - times[i - 1]); }
+		std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+		const double step = steps[steps.size() / 2];
+		if (step <= 0) { return 0; }
+		return std::round(step < 0.5 ? 1 / step : 1000 / step);
+	}
+
+	typedef struct
+	{
+		const char* begin;
+		const char* end;
+		uint64_t firstSample;
+		uint64_t nSample;
+		uint64_t nMalformed; // rows with a missing or unreadable channel value, written as 0
+		uint64_t nClipped;   // values out of the int32 code range
+	} part_t;
+
+	uint64_t countRows(const char* p, const char* end)
+	{
+		uint64_t n = 0;
+		while (p < end)
+		{
+			const char* lineEnd = nextLine(p, end);
+			if (isRow(p, lineEnd)) { n++; }
+			p = lineEnd;
+		}
+		return n;
+	}
+
+	void parsePart(part_t& part, const schema_t& schema, const double codesPerMicroVolt, const uint32_t nSamplePerChunk, uint32_t chunkSize, uint8_t* output)
+	{
+		const uint32_t nChannel = uint32_t(schema.channels.size());
+		const uint32_t last     = *std::max_element(schema.channels.begin(), schema.channels.end());
+		std::vector<int> channelOfColumn(last + 1, -1);
+		for (uint32_t c = 0; c < nChannel; ++c) { channelOfColumn[schema.channels[c]] = int(c); }
+
+		uint64_t sample = part.firstSample;
+		for (const char* p = part.begin; p < part.end;)
+		{
+			const char* lineEnd = nextLine(p, part.end);
+			if (!isRow(p, lineEnd))
+			{
+				p = lineEnd;
+				continue;
+			}
+
+			int32_t* codes = reinterpret_cast<int32_t*>(output + RECORDING_HEADER_SIZE + (sample / nSamplePerChunk) * chunkSize + sizeof(recording_chunk_header_t))
+							 + (sample % nSamplePerChunk) * nChannel;
+			bool isMalformed = false;
+			const char* q    = p;
+			for (uint32_t column = 0; column <= last; ++column)
+			{
+				const int channel = channelOfColumn[column];
+				if (channel >= 0)
+				{
+					double value;
+					if (q == nullptr || !parseNumber(q, lineEnd, schema.decimalPoint, value) || value != value)
+					{
+						codes[channel] = 0;
+						isMalformed    = true;
+					}
+					else
+					{
+						const double code = std::round(value * codesPerMicroVolt);
+						if (code > 2147483647.0 || code < -2147483648.0) { part.nClipped++; }
+						codes[channel] = int32_t(std::max(-2147483648.0, std::min(2147483647.0, code)));
+					}
+				}
+				if (q != nullptr && column != last)
+				{
+					q = static_cast<const char*>(std::memchr(q, schema.delimiter, size_t(lineEnd - q)));
+					if (q != nullptr) { ++q; }
+				}
+			}
+			if (isMalformed) { part.nMalformed++; }
+			sample++;
+			p = lineEnd;
+		}
+	}
+
+	bool parseArguments(const int argc, char** argv, settings_t& settings)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string key = argv[i];
+			if (key.compare(0, 2, "--") != 0)
+			{
+				if (settings.input.empty()) { settings.input = key; }
+				else if (settings.output.empty()) { settings.output = key; }
+				else { return false; }
+				continue;
+			}
+			if (i + 1 >= argc) { return false; }
+			const std::string value = argv[++i];
+			if (key == "--sampling") { settings.sampling = std::atof(value.c_str()); }
+			else if (key == "--resolution") { settings.resolution = std::atof(value.c_str()); }
+			else if (key == "--threads") { settings.nThread = uint32_t(std::atoi(value.c_str())); }
+			else { return false; }
+		}
+		if (settings.output.empty() && !settings.input.empty())
+		{
+			const size_t dot   = settings.input.find_last_of('.');
+			const size_t slash = settings.input.find_last_of("/\\");
+			settings.output    = (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? settings.input.substr(0, dot) : settings.input) + ".mbci";
+		}
+		return !settings.input.empty() && settings.sampling >= 0 && settings.resolution >= 0;
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	settings_t settings;
+	if (!parseArguments(argc, argv, settings))
+	{
+		std::printf("Usage: openvibe-modularbci-convert input.csv [output.mbci] [options]\n"
+			"  --sampling f      sampling rate in Hz (default: from the Time column, else 250)\n"
+			"  --resolution r    uV per stored ADC code (default: %.5f, the ADS1299 at a gain of 24)\n"
+			"  --threads n       parser threads (default: all cores)\n"
+			"The channel values and names are converted, a Marker column is not: the recordings hold no markers.\n", DEFAULT_VREF * 1000000 / (8388607 * DEFAULT_GAIN));
+		return 1;
+	}
+
+	CFileMapping input;
+	if (!input.open(settings.input))
+	{
+		std::fprintf(stderr, "Can't map [%s]\n", settings.input.c_str());
+		return 1;
+	}
+	const char* begin = reinterpret_cast<const char*>(input.getData());
+	const char* end   = begin + input.getSize();
+	if (input.getSize() >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0) { begin += 3; } // UTF-8 byte order mark
+
+	schema_t schema;
+	std::string error;
+	if (!detectSchema(begin, end, schema, error))
+	{
+		std::fprintf(stderr, "Can't convert [%s]: %s\n", settings.input.c_str(), error.c_str());
+		return 1;
+	}
+	const char* dataBegin = schema.hasHeader ? nextLine(begin, end) : begin;
+	double sampling       = settings.sampling;
+	if (sampling == 0) { sampling = detectSampling(dataBegin, end, schema); }
+	if (sampling == 0)
+	{
+		sampling = 250;
+		std::printf("No time column to detect the sampling rate from, assuming %g Hz (see --sampling)\n", sampling);
+	}
+	std::string columns;
+	for (const auto& name : schema.names) { columns += (columns.empty() ? "" : " ") + name; }
+	std::printf("%u channels (%s), '%c' separated, %g Hz%s\n", uint32_t(schema.channels.size()), columns.c_str(), schema.delimiter == '\t' ? 'T' : schema.delimiter,
+				sampling, schema.timeColumn >= 0 && settings.sampling == 0 ? " from the time column" : "");
+	if (schema.markerColumn >= 0) { std::printf("The Marker column is not converted, the recordings hold no markers\n"); }
+
+	// parts cut at line boundaries
+	const uint32_t nThread = std::max<uint32_t>(1, settings.nThread != 0 ? settings.nThread : std::thread::hardware_concurrency());
+	std::vector<part_t> parts;
+	for (const char* p = dataBegin; p < end;)
+	{
+		const size_t remaining = size_t(end - p);
+		const char* stop       = parts.size() + 1 == nThread ? end : nextLine(p + remaining / (nThread - parts.size()), end);
+		parts.push_back({ p, stop, 0, 0, 0, 0 });
+		p = stop;
+	}
+
+	auto runParts = [&](const std::function<void(part_t&)>& function)
+	{
+		std::vector<std::thread> threads;
+		for (auto& part : parts) { threads.emplace_back(function, std::ref(part)); }
+		for (auto& thread : threads) { thread.join(); }
+	};
+	runParts([](part_t& part) { part.nSample = countRows(part.begin, part.end); });
+	uint64_t nSample = 0;
+	for (auto& part : parts)
+	{
+		part.firstSample = nSample;
+		nSample += part.nSample;
+	}
+	if (nSample == 0)
+	{
+		std::fprintf(stderr, "[%s] has no sample\n", settings.input.c_str());
+		return 1;
+	}
+
+	// layout of the recording, all known from the sample count
+	const uint32_t nChannel        = uint32_t(schema.channels.size());
+	const uint32_t chunkSize       = RECORDING_CHUNK_SIZE;
+	const uint32_t nSamplePerChunk = uint32_t((chunkSize - sizeof(recording_chunk_header_t)) / (sizeof(int32_t) * nChannel));
+	const uint64_t nChunk          = (nSample + nSamplePerChunk - 1) / nSamplePerChunk;
+	const uint64_t indexOffset     = RECORDING_HEADER_SIZE + nChunk * chunkSize;
+	CFileMapping output;
+	if (!output.create(settings.output, indexOffset + nChunk * sizeof(recording_index_entry_t)))
+	{
+		std::fprintf(stderr, "Can't create [%s]\n", settings.output.c_str());
+		return 1;
+	}
+	uint8_t* data = output.getData();
+
+	const double resolution = settings.resolution > 0 ? settings.resolution : DEFAULT_VREF * 1000000 / (8388607 * DEFAULT_GAIN);
+	recording_header_t header = {};
+	std::memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+	header.version           = RECORDING_VERSION;
+	header.headerSize        = RECORDING_HEADER_SIZE;
+	header.chunkSize         = chunkSize;
+	header.nChannel          = nChannel;
+	header.sampling          = uint32_t(std::lround(sampling));
+	header.channelMask       = nChannel == 32 ? 0xFFFFFFFF : (1U << nChannel) - 1;
+	header.nDevice           = (nChannel + 7) / 8;
+	header.gain              = float(DEFAULT_GAIN);
+	header.vref              = float(DEFAULT_VREF);
+	header.unitsToMicroVolts = float(resolution);
+	header.nSample           = nSample;
+	header.nChunk            = nChunk;
+	header.indexOffset       = indexOffset;
+	std::snprintf(header.firmware, sizeof(header.firmware), "converted from CSV");
+	std::snprintf(header.configuration, sizeof(header.configuration), "%s; columns %s", settings.input.c_str(), columns.c_str());
+	if (columns.size() < sizeof(header.channelNames)) { std::memcpy(header.channelNames, columns.c_str(), columns.size()); } // else Channel1..N
+	std::memcpy(data, &header, sizeof(header));
+
+	recording_index_entry_t* index = reinterpret_cast<recording_index_entry_t*>(data + indexOffset);
+	for (uint64_t c = 0; c < nChunk; ++c)
+	{
+		recording_chunk_header_t chunk = {};
+		chunk.magic                    = RECORDING_CHUNK_MAGIC;
+		chunk.type                     = uint32_t(ERecordingChunkType::Samples);
+		chunk.firstSample              = c * nSamplePerChunk;
+		chunk.nSample                  = uint32_t(std::min<uint64_t>(nSamplePerChunk, nSample - chunk.firstSample));
+		chunk.payloadSize              = uint32_t(chunk.nSample * nChannel * sizeof(int32_t));
+		chunk.time                     = uint64_t(double(chunk.firstSample) * 1000000 / sampling);
+		std::memcpy(data + RECORDING_HEADER_SIZE + c * chunkSize, &chunk, sizeof(chunk));
+
+		recording_index_entry_t& entry = index[c];
+		entry.firstSample              = chunk.firstSample;
+		entry.time                     = chunk.time;
+		entry.chunk                    = uint32_t(c);
+		entry.type                     = chunk.type;
+		entry.nSample                  = chunk.nSample;
+		entry.payloadSize              = chunk.payloadSize;
+	}
+
+	const double codesPerMicroVolt = 1 / resolution;
+	runParts([&](part_t& part) { parsePart(part, schema, codesPerMicroVolt, nSamplePerChunk, chunkSize, data); });
+
+	uint64_t nMalformed = 0, nClipped = 0;
+	for (const auto& part : parts)
+	{
+		nMalformed += part.nMalformed;
+		nClipped += part.nClipped;
+	}
+	output.close();
+	std::printf("%llu samples (%.1f s) written to [%s] by %u threads\n", (unsigned long long)nSample, double(nSample) / sampling, settings.output.c_str(),
+				uint32_t(parts.size()));
+	if (nMalformed != 0) { std::printf("%llu rows had a missing or unreadable value, stored as 0\n", (unsigned long long)nMalformed); }
+	if (nClipped != 0) { std::printf("%llu values were out of range and clipped, see --resolution\n", (unsigned long long)nClipped); }
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Local stand-in for the drone: receives the commands of the driver's command stage over the
+ * drone link, timestamps and acknowledges them, and keeps a coarse flight state. It prints the
+ * latency of every command from the data ready of the ADS1299 to its reception, the metric the
+ * whole acquisition and decoding chain is judged on.
+ *
+ */
+#include "ovasCModularBCIDroneLink.h"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+namespace
+{
+	volatile std::sig_atomic_t g_stop = 0;
+
+	void onSignal(int /*signal*/) { g_stop = 1; }
+
+	typedef struct
+	{
+		bool isFlying = false;
+		double x = 0, y = 0, z = 0; // in m
+		double yaw = 0;             // in degrees
+	} drone_state_t;
+
+	// applies a command, 0 when accepted, 1 when it makes no sense in the current state
+	uint8_t apply(const EDroneCommand command, drone_state_t& state)
+	{
+		const double step = 0.5, yawStep = 15, pi = 3.14159265358979323846;
+		const double c    = std::cos(state.yaw * pi / 180), s = std::sin(state.yaw * pi / 180);
+
+		if (command == EDroneCommand::Takeoff)
+		{
+			if (state.isFlying) { return 1; }
+			state.isFlying = true;
+			state.z        = 1;
+			return 0;
+		}
+		if (!state.isFlying) { return 1; }
+
+		switch (command)
+		{
+			case EDroneCommand::Land: state.isFlying = false;
+				state.z = 0;
+				break;
+			case EDroneCommand::Forward: state.x += step * c;
+				state.y += step * s;
+				break;
+			case EDroneCommand::Backward: state.x -= step * c;
+				state.y -= step * s;
+				break;
+			case EDroneCommand::Left: state.x -= step * s;
+				state.y += step * c;
+				break;
+			case EDroneCommand::Right: state.x += step * s;
+				state.y -= step * c;
+				break;
+			case EDroneCommand::Up: state.z += step;
+				break;
+			case EDroneCommand::Down: state.z = std::max(0.2, state.z - step);
+				break;
+			case EDroneCommand::YawLeft: state.yaw += yawStep;
+				break;
+			case EDroneCommand::YawRight: state.yaw -= yawStep;
+				break;
+			case EDroneCommand::Hover: break;
+			default: return 1;
+		}
+		return 0;
+	}
+
+	const char* getSourceName(const uint8_t source)
+	{
+		switch (ECommandSource(source))
+		{
+			case ECommandSource::Watchdog: return "watchdog";
+			case ECommandSource::MotorImagery: return "motor imagery";
+			case ECommandSource::SSVEP: return "SSVEP";
+			default: return "unknown";
+		}
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	uint16_t port = DRONE_LINK_DEFAULT_PORT;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) { port = uint16_t(std::atoi(argv[++i])); }
+		else
+		{
+			std::printf("Usage: openvibe-modularbci-drone-sim [--port n]  (default port %d)\n", DRONE_LINK_DEFAULT_PORT);
+			return 1;
+		}
+	}
+
+	CModularBCIUdpSocket socket;
+	if (!socket.open(port))
+	{
+		std::fprintf(stderr, "Can't listen on UDP port %u\n", port);
+		return 1;
+	}
+	std::signal(SIGINT, onSignal);
+	std::printf("Simulated drone listening on UDP port %u, Ctrl+C to stop\n", port);
+
+	drone_state_t state;
+	std::vector<double> latencies;
+	uint8_t buffer[DRONE_LINK_MAX_FRAME_SIZE];
+	uint64_t nInvalid = 0;
+	while (g_stop == 0)
+	{
+		const int size = socket.receive(buffer, sizeof(buffer), 100);
+		if (size <= 0) { continue; }
+		const uint64_t receiveTime = getDroneLinkTime();
+
+		drone_frame_t frame;
+		if (!decodeDroneFrame(buffer, size_t(size), frame) || frame.messageId != uint32_t(EDroneMessage::Command))
+		{
+			nInvalid++;
+			continue;
+		}
+		drone_command_t command;
+		std::memcpy(&command, frame.payload, sizeof(command));
+
+		drone_acknowledge_t acknowledge = {};
+		acknowledge.sendTime            = command.sendTime;
+		acknowledge.receiveTime         = receiveTime;
+		acknowledge.sequence            = frame.sequence;
+		acknowledge.command             = command.command;
+		acknowledge.result              = apply(EDroneCommand(command.command), state);
+
+		uint8_t reply[DRONE_LINK_MAX_FRAME_SIZE];
+		socket.send(reply, encodeDroneFrame(frame.sequence, EDroneMessage::Acknowledge, &acknowledge, uint8_t(sizeof(acknowledge)), reply));
+
+		std::printf("#%3u %-9s from %-13s (confidence %.2f) %s", frame.sequence, getDroneCommandName(EDroneCommand(command.command)),
+					getSourceName(command.source), command.confidence, acknowledge.result == 0 ? "accepted" : "ignored ");
+		if (command.drdyTime != 0 && receiveTime >= command.drdyTime)
+		{
+			const double latency = double(receiveTime - command.drdyTime) / 1000;
+			latencies.push_back(latency);
+			std::printf(" | data ready -> decision %7.1f ms, decision -> drone %5.1f ms, total %7.1f ms", double(command.decisionTime - command.drdyTime) / 1000,
+						double(receiveTime - command.decisionTime) / 1000, latency);
+		}
+		std::printf(" | %s x %.1f y %.1f z %.1f yaw %.0f\n", state.isFlying ? "flying" : "landed", state.x, state.y, state.z, state.yaw);
+		std::fflush(stdout);
+	}
+
+	if (!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		double sum = 0;
+		for (const auto& latency : latencies) { sum += latency; }
+		std::printf("\n%u commands, latency from data ready: mean %.1f ms, median %.1f ms, 95%% %.1f ms, max %.1f ms\n", uint32_t(latencies.size()),
+					sum / double(latencies.size()), latencies[latencies.size() / 2], latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)],
+					latencies.back());
+	}
+	if (nInvalid != 0) { std::printf("%u invalid datagrams ignored\n", uint32_t(nInvalid)); }
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Minimal client of the driver's stream server or shared ring: prints the stream descriptor,
+ * then once per second the blocks and samples received, the sample rate, the gaps in the sample
+ * index and the age of the blocks since they reached the driver. Several instances may run at
+ * once, which is the simplest way to check both exports on a single machine.
+ *
+ */
+#include "ovasCModularBCIStreamServer.h"
+#include "ovasCModularBCISharedRing.h"
+#include "ovasCModularBCIDroneLink.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined TARGET_OS_Windows
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#elif defined TARGET_OS_Linux
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#else
+#endif
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+namespace
+{
+	volatile std::sig_atomic_t g_stop = 0;
+
+	void onSignal(int /*signal*/) { g_stop = 1; }
+
+	// reads exactly size bytes, false when the connection is closed
+	bool receiveAll(const socket_t socket, void* buffer, const size_t size)
+	{
+		size_t n = 0;
+		while (n < size && g_stop == 0)
+		{
+			const int res = int(::recv(socket, static_cast<char*>(buffer) + n, int(size - n), 0));
+			if (res <= 0) { return false; }
+			n += size_t(res);
+		}
+		return n == size;
+	}
+
+	class CStatistics final
+	{
+	public:
+
+		CStatistics() : m_startTime(getDroneLinkTime()), m_reportTime(m_startTime) { }
+
+		void add(const uint64_t firstSample, const uint32_t nSample, const uint64_t time, const uint32_t flags, const uint64_t now)
+		{
+			if (m_nTotalBlock != 0 && firstSample != m_nextSample)
+			{
+				m_nGap++;
+				m_nMissing += firstSample - m_nextSample;
+			}
+			m_nextSample = firstSample + nSample;
+			m_nBlock++;
+			m_nSample += nSample;
+			m_nTotalBlock++;
+			if ((flags & CModularBCISampleBus::BlockFlag_Artifact) != 0) { m_nArtifact++; }
+			if (time != 0 && now > time)
+			{
+				m_maxAge = std::max(m_maxAge, now - time);
+				m_sumAge += now - time;
+			}
+
+			if (now - m_reportTime >= 1000000)
+			{
+				std::printf("%6.1f s: %4u blocks, %6u samples (%7.1f Hz), %u gaps (%u samples missing), %u artifact blocks, age %.3f ms mean %.3f ms max\n",
+							double(now - m_startTime) / 1000000, uint32_t(m_nBlock), uint32_t(m_nSample), double(m_nSample) * 1000000 / double(now - m_reportTime),
+							uint32_t(m_nGap), uint32_t(m_nMissing), uint32_t(m_nArtifact), double(m_sumAge) / double(m_nBlock) / 1000, double(m_maxAge) / 1000);
+				std::fflush(stdout);
+				this->flush();
+				m_reportTime = now;
+			}
+		}
+
+		void flush()
+		{
+			m_nTotalSample += m_nSample;
+			m_nTotalMissing += m_nMissing;
+			m_nBlock = m_nSample = m_nGap = m_nMissing = m_nArtifact = m_maxAge = m_sumAge = 0;
+		}
+
+		bool isOver(const double duration) const { return duration > 0 && getDroneLinkTime() - m_startTime >= uint64_t(duration * 1000000); }
+
+		void print()
+		{
+			this->flush();
+			std::printf("%u blocks, %u samples received, %u samples missing\n", uint32_t(m_nTotalBlock), uint32_t(m_nTotalSample), uint32_t(m_nTotalMissing));
+		}
+
+	protected:
+
+		uint64_t m_startTime  = 0;
+		uint64_t m_reportTime = 0;
+		uint64_t m_nextSample = 0;
+		uint64_t m_nBlock = 0, m_nSample = 0, m_nGap = 0, m_nMissing = 0, m_nArtifact = 0, m_maxAge = 0, m_sumAge = 0;
+		uint64_t m_nTotalBlock = 0, m_nTotalSample = 0, m_nTotalMissing = 0;
+	};
+
+	// polls the shared ring, copying every block as a consumer of the samples would
+	int dumpSharedRing(const std::string& name, const double duration)
+	{
+		CModularBCISharedRingReader reader;
+		if (!reader.open(name))
+		{
+			std::fprintf(stderr, "Can't open the shared memory [%s]\n", name.c_str());
+			return 1;
+		}
+		std::printf("Descriptor: %s\n", reader.getHeader().descriptor);
+
+		CStatistics statistics;
+		std::vector<float> samples(size_t(reader.getHeader().nChannel) * reader.getHeader().capacity);
+		uint64_t next = reader.getBlockCount(), nOverwritten = 0;
+		while (g_stop == 0 && !statistics.isOver(duration) && reader.isWriting())
+		{
+			if (reader.getBlockCount() == next)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				continue;
+			}
+			if (reader.getBlockCount() - next > reader.getHeader().nBlockRecord) { next = reader.getBlockCount() - reader.getHeader().nBlockRecord / 2; }
+
+			shared_ring_block_info_t block;
+			if (!reader.readBlock(next, block) || !reader.read(block.firstSample, block.nSample, &samples[0]))
+			{
+				nOverwritten++;
+				next++;
+				continue;
+			}
+			statistics.add(block.firstSample, block.nSample, block.time, block.flags, getDroneLinkTime());
+			next++;
+		}
+		statistics.print();
+		if (nOverwritten != 0) { std::printf("%u blocks overwritten before they were read\n", uint32_t(nOverwritten)); }
+		return 0;
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	std::string host = "127.0.0.1", sharedMemory;
+	uint16_t port    = 0;
+	double duration  = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--host") == 0 && i + 1 < argc) { host = argv[++i]; }
+		else if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) { sharedMemory = argv[++i]; }
+		else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) { duration = std::atof(argv[++i]); }
+		else if (port == 0 && argv[i][0] != '-') { port = uint16_t(std::atoi(argv[i])); }
+		else
+		{
+			port = 0;
+			sharedMemory.clear();
+			break;
+		}
+	}
+	if (port == 0 && sharedMemory.empty())
+	{
+		std::printf("Usage: openvibe-modularbci-stream-dump port [--host address] [--seconds n]  (default host 127.0.0.1, until Ctrl+C)\n"
+					"       openvibe-modularbci-stream-dump --shm name [--seconds n]\n");
+		return 1;
+	}
+	std::signal(SIGINT, onSignal);
+	if (!sharedMemory.empty()) { return dumpSharedRing(sharedMemory, duration); }
+
+#if defined TARGET_OS_Windows
+	WSADATA wsaData;
+	if (::WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) { return 1; }
+#endif
+	sockaddr_in address = {};
+	address.sin_family  = AF_INET;
+	address.sin_port    = htons(port);
+	const socket_t socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 || ::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		std::fprintf(stderr, "Can't connect to %s:%u\n", host.c_str(), port);
+		return 1;
+	}
+
+	CStatistics statistics;
+	stream_packet_header_t packet;
+	std::vector<uint8_t> payload;
+	while (g_stop == 0 && !statistics.isOver(duration))
+	{
+		if (!receiveAll(socket, &packet, sizeof(packet))) { break; }
+		if (packet.magic != STREAM_MAGIC || packet.version != STREAM_VERSION)
+		{
+			std::fprintf(stderr, "Not a ModularBCI stream (magic %08X, version %u)\n", packet.magic, packet.version);
+			break;
+		}
+		payload.resize(packet.payloadSize);
+		if (packet.payloadSize != 0 && !receiveAll(socket, &payload[0], payload.size())) { break; }
+
+		if (packet.type == STREAM_PACKET_DESCRIPTOR)
+		{
+			std::printf("Descriptor: %s\n", std::string(payload.begin(), payload.end()).c_str());
+			continue;
+		}
+		if (packet.type != STREAM_PACKET_BLOCK || payload.size() < sizeof(stream_block_header_t)) { continue; }
+
+		stream_block_header_t block;
+		std::memcpy(&block, &payload[0], sizeof(block));
+		if (payload.size() != sizeof(block) + sizeof(float) * block.nSample * block.nChannel)
+		{
+			std::fprintf(stderr, "Block %u has %u bytes for %u x %u samples\n", uint32_t(block.sequence), uint32_t(payload.size()), block.nChannel, block.nSample);
+			break;
+		}
+		statistics.add(block.firstSample, block.nSample, block.time, block.flags, getDroneLinkTime());
+	}
+	statistics.print();
+
+#if defined TARGET_OS_Windows
+	::closesocket(socket);
+	::WSACleanup();
+#elif defined TARGET_OS_Linux
+	::close(socket);
+#endif
+	return 0;
+}
@@ -0,0 +1,390 @@
+/*
+ * ModularBCI driver for OpenViBE
+ *
+ * \author Ryan Wüest
+ *
+ * Trains the CSP + LDA model of the motor imagery decoder from a ModularBCI recording (.mbci)
+ * and a list of labelled trials. The samples go through the same causal band-pass as online,
+ * so that the features seen in training and by the driver match.
+ *
+ */
+#include "ovasCModularBCILinearAlgebra.h"
+#include "ovasCModularBCIMotorImagery.h"
+#include "ovasCModularBCIRecordingReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace OpenViBE;
+using namespace /*OpenViBE::*/AcquisitionServer;
+
+#define BUTTERWORTH_Q 0.70710678
+
+namespace
+{
+	typedef struct
+	{
+		std::string recording, labels, output;
+		std::vector<uint32_t> channels; // 0-based, empty for all
+		double bandLow = 8, bandHigh = 30;
+		double windowMs = 2000, offsetMs = 500, trialMs = 0, hopMs = 100;
+		uint32_t nFilter = 6, nFold = 5;
+		double shrinkage = 0.1;
+	} settings_t;
+
+	typedef struct
+	{
+		uint64_t sample;
+		std::string name;
+	} label_t;
+
+	typedef struct
+	{
+		std::vector<double> covariance; // n x n
+		int label;
+		size_t trial;
+	} epoch_t;
+
+	void usage()
+	{
+		std::printf("Usage: openvibe-modularbci-train-mi --recording file.mbci --labels labels.csv --output model.txt [options]\n"
+			"  --labels file     lines of \"sample,class\", the sample index where the trial starts, exactly two classes\n"
+			"  --channels list   comma separated channels, starting at 1 (default: all)\n"
+			"  --band low-high   band-pass in Hz (default: 8-30)\n"
+			"  --window-ms t     length of the decoder window (default: 2000)\n"
+			"  --offset-ms t     start of the first window after the trial start (default: 500)\n"
+			"  --trial-ms t      part of the trial windows are taken from, after the offset (default: one window)\n"
+			"  --hop-ms t        time between two decisions, also between two training windows (default: 100)\n"
+			"  --filters n       even number of CSP filters (default: 6)\n"
+			"  --shrinkage g     LDA covariance shrinkage in [0, 1] (default: 0.1)\n"
+			"  --folds k         cross-validation folds, 0 to skip (default: 5)\n");
+	}
+
+	bool parseArguments(const int argc, char** argv, settings_t& settings)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string key = argv[i];
+			if (i + 1 >= argc) { return false; }
+			const std::string value = argv[++i];
+
+			if (key == "--recording") { settings.recording = value; }
+			else if (key == "--labels") { settings.labels = value; }
+			else if (key == "--output") { settings.output = value; }
+			else if (key == "--channels")
+			{
+				std::stringstream ss(value);
+				std::string item;
+				while (std::getline(ss, item, ','))
+				{
+					const long channel = std::strtol(item.c_str(), nullptr, 10);
+					if (channel < 1) { return false; }
+					settings.channels.push_back(uint32_t(channel - 1));
+				}
+			}
+			else if (key == "--band")
+			{
+				if (std::sscanf(value.c_str(), "%lf-%lf", &settings.bandLow, &settings.bandHigh) != 2) { return false; }
+			}
+			else if (key == "--window-ms") { settings.windowMs = std::atof(value.c_str()); }
+			else if (key == "--offset-ms") { settings.offsetMs = std::atof(value.c_str()); }
+			else if (key == "--trial-ms") { settings.trialMs = std::atof(value.c_str()); }
+			else if (key == "--hop-ms") { settings.hopMs = std::atof(value.c_str()); }
+			else if (key == "--filters") { settings.nFilter = uint32_t(std::atoi(value.c_str())); }
+			else if (key == "--shrinkage") { settings.shrinkage = std::atof(value.c_str()); }
+			else if (key == "--folds") { settings.nFold = uint32_t(std::atoi(value.c_str())); }
+			else { return false; }
+		}
+		return !settings.recording.empty() && !settings.labels.empty() && !settings.output.empty() && settings.nFilter >= 2 && settings.nFilter % 2 == 0
+			   && settings.shrinkage >= 0 && settings.shrinkage <= 1 && settings.nFold != 1;
+	}
+
+	bool loadLabels(const std::string& filename, std::vector<label_t>& labels)
+	{
+		std::ifstream file(filename.c_str());
+		if (!file.is_open()) { return false; }
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+			const size_t comma = line.find(',');
+			if (comma == std::string::npos || line.find_first_not_of("0123456789") != comma) { continue; } // header or blank line
+
+			label_t label;
+			label.sample = std::strtoull(line.c_str(), nullptr, 10);
+			label.name   = line.substr(comma + 1);
+			labels.push_back(label);
+		}
+		return true;
+	}
+
+	// decoded samples of the recording in uV, sample-major, samples lost at recording time are zeros
+	bool loadSamples(const CModularBCIRecordingReader& reader, std::vector<float>& samples, size_t& nSample)
+	{
+		const recording_header_t& header = reader.getHeader();
+		nSample                          = 0;
+		for (const auto& entry : reader.getIndex())
+		{
+			if (entry.type == uint32_t(ERecordingChunkType::Samples)) { nSample = std::max<size_t>(nSample, size_t(entry.firstSample + entry.nSample)); }
+		}
+		if (nSample == 0) { return false; }
+
+		samples.assign(nSample * header.nChannel, 0);
+		for (const auto& entry : reader.getIndex())
+		{
+			if (entry.type != uint32_t(ERecordingChunkType::Samples)) { continue; }
+			const int32_t* codes = reinterpret_cast<const int32_t*>(reader.getPayload(entry));
+			float* output        = &samples[size_t(entry.firstSample) * header.nChannel];
+			for (size_t i = 0; i < size_t(entry.nSample) * header.nChannel; ++i) { output[i] = float(codes[i]) * header.unitsToMicroVolts; }
+		}
+		return true;
+	}
+
+	// covariance of the window ending at sample end, the same sum of products as the online decoder
+	void computeCovariance(const std::vector<float>& filtered, const size_t n, const size_t end, const size_t windowSize, std::vector<double>& covariance)
+	{
+		covariance.assign(n * n, 0);
+		for (size_t s = end - windowSize; s < end; ++s)
+		{
+			const float* sample = &filtered[s * n];
+			for (size_t i = 0; i < n; ++i) { for (size_t j = i; j < n; ++j) { covariance[i * n + j] += double(sample[i]) * sample[j]; } }
+		}
+		for (size_t i = 0; i < n; ++i) { for (size_t j = 0; j < i; ++j) { covariance[i * n + j] = covariance[j * n + i]; } }
+	}
+
+	// fills the filters, weights and bias of the model from the epochs of the training set
+	bool train(const std::vector<epoch_t>& epochs, const std::vector<bool>& isTraining, const double shrinkage, motor_imagery_model_t& model)
+	{
+		const size_t n = model.channels.size();
+
+		// CSP: trace-normalized class covariances, a x = lambda (a + b) x
+		std::vector<double> classCovariance[2] = { std::vector<double>(n * n, 0), std::vector<double>(n * n, 0) };
+		size_t count[2]                        = { 0, 0 };
+		for (size_t e = 0; e < epochs.size(); ++e)
+		{
+			if (!isTraining[e]) { continue; }
+			double trace = 0;
+			for (size_t i = 0; i < n; ++i) { trace += epochs[e].covariance[i * n + i]; }
+			if (trace <= 0) { continue; }
+			for (size_t i = 0; i < n * n; ++i) { classCovariance[epochs[e].label][i] += epochs[e].covariance[i] / trace; }
+			count[epochs[e].label]++;
+		}
+		if (count[0] == 0 || count[1] == 0) { return false; }
+
+		std::vector<double> sum(n * n);
+		for (size_t i = 0; i < n * n; ++i)
+		{
+			classCovariance[0][i] /= double(count[0]);
+			classCovariance[1][i] /= double(count[1]);
+			sum[i] = classCovariance[0][i] + classCovariance[1][i];
+		}
+
+		std::vector<double> values, vectors;
+		if (!ModularBCILinearAlgebra::generalizedEigen(classCovariance[1], sum, n, values, vectors)) { return false; }
+
+		// the first components have the most variance for the second class, the last ones for the first class
+		const size_t nFilter = model.nFilter;
+		model.filters.resize(nFilter * n);
+		for (size_t k = 0; k < nFilter; ++k)
+		{
+			const size_t column = k < nFilter / 2 ? k : n - nFilter + k;
+			for (size_t i = 0; i < n; ++i) { model.filters[k * n + i] = vectors[i * n + column]; }
+		}
+
+		// LDA with a shrunk pooled covariance
+		std::vector<double> features(nFilter), mean[2] = { std::vector<double>(nFilter, 0), std::vector<double>(nFilter, 0) };
+		std::vector<std::vector<double>> trainingFeatures;
+		std::vector<int> trainingLabels;
+		for (size_t e = 0; e < epochs.size(); ++e)
+		{
+			if (!isTraining[e]) { continue; }
+			computeMotorImageryFeatures(model, &epochs[e].covariance[0], &features[0]);
+			for (size_t k = 0; k < nFilter; ++k) { mean[epochs[e].label][k] += features[k] / double(count[epochs[e].label]); }
+			trainingFeatures.push_back(features);
+			trainingLabels.push_back(epochs[e].label);
+		}
+
+		std::vector<double> scatter(nFilter * nFilter, 0);
+		for (size_t e = 0; e < trainingFeatures.size(); ++e)
+		{
+			const std::vector<double>& m = mean[trainingLabels[e]];
+			for (size_t i = 0; i < nFilter; ++i)
+			{
+				for (size_t j = 0; j < nFilter; ++j) { scatter[i * nFilter + j] += (trainingFeatures[e][i] - m[i]) * (trainingFeatures[e][j] - m[j]); }
+			}
+		}
+		double trace = 0;
+		for (size_t i = 0; i < nFilter * nFilter; ++i) { scatter[i] /= double(trainingFeatures.size() > 2 ? trainingFeatures.size() - 2 : 1); }
+		for (size_t i = 0; i < nFilter; ++i) { trace += scatter[i * nFilter + i]; }
+		for (size_t i = 0; i < nFilter * nFilter; ++i) { scatter[i] *= 1 - shrinkage; }
+		for (size_t i = 0; i < nFilter; ++i) { scatter[i * nFilter + i] += shrinkage * trace / double(nFilter) + 1e-12; }
+
+		if (!ModularBCILinearAlgebra::cholesky(scatter, nFilter)) { return false; }
+		model.weights.resize(nFilter);
+		for (size_t k = 0; k < nFilter; ++k) { model.weights[k] = mean[1][k] - mean[0][k]; }
+		ModularBCILinearAlgebra::choleskySolve(scatter, nFilter, &model.weights[0]);
+
+		model.bias = 0;
+		for (size_t k = 0; k < nFilter; ++k) { model.bias -= model.weights[k] * (mean[0][k] + mean[1][k]) / 2; }
+		return true;
+	}
+
+	// ratio of the epochs of the set that the model classifies right
+	double evaluate(const std::vector<epoch_t>& epochs, const std::vector<bool>& isSelected, const motor_imagery_model_t& model)
+	{
+		std::vector<double> features(model.nFilter);
+		size_t nRight = 0, nTotal = 0;
+		for (size_t e = 0; e < epochs.size(); ++e)
+		{
+			if (!isSelected[e]) { continue; }
+			computeMotorImageryFeatures(model, &epochs[e].covariance[0], &features[0]);
+			double score = model.bias;
+			for (size_t k = 0; k < model.nFilter; ++k) { score += model.weights[k] * features[k]; }
+			nRight += ((score > 0 ? 1 : 0) == epochs[e].label) ? 1 : 0;
+			nTotal++;
+		}
+		return nTotal == 0 ? 0 : double(nRight) / double(nTotal);
+	}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	settings_t settings;
+	if (!parseArguments(argc, argv, settings))
+	{
+		usage();
+		return 1;
+	}
+
+	CModularBCIRecordingReader reader;
+	if (!reader.open(settings.recording) || reader.isPlainCapture())
+	{
+		std::fprintf(stderr, "Can't read the decoded samples of [%s] (%s)\n", settings.recording.c_str(),
+					 reader.isOpen() ? "plain captures hold no decoded samples" : reader.getLastError().c_str());
+		return 1;
+	}
+	const recording_header_t& header = reader.getHeader();
+
+	std::vector<float> samples;
+	size_t nSample = 0;
+	if (!loadSamples(reader, samples, nSample))
+	{
+		std::fprintf(stderr, "[%s] holds no decoded samples\n", settings.recording.c_str());
+		return 1;
+	}
+
+	std::vector<label_t> labels;
+	if (!loadLabels(settings.labels, labels) || labels.empty())
+	{
+		std::fprintf(stderr, "Can't read any label from [%s]\n", settings.labels.c_str());
+		return 1;
+	}
+
+	motor_imagery_model_t model;
+	for (const auto& label : labels) { if (std::find(model.classes.begin(), model.classes.end(), label.name) == model.classes.end()) { model.classes.push_back(label.name); } }
+	if (model.classes.size() != 2)
+	{
+		std::fprintf(stderr, "The labels must name exactly two classes, found %u\n", uint32_t(model.classes.size()));
+		return 1;
+	}
+
+	if (settings.channels.empty()) { for (uint32_t i = 0; i < header.nChannel; ++i) { settings.channels.push_back(i); } }
+	const double sampling = double(header.sampling);
+	model.channels        = settings.channels;
+	model.sampling        = sampling;
+	model.bandLow         = settings.bandLow;
+	model.bandHigh        = settings.bandHigh;
+	model.windowSize      = uint32_t(std::lround(settings.windowMs * sampling / 1000));
+	model.hopSize         = std::max<uint32_t>(1, uint32_t(std::lround(settings.hopMs * sampling / 1000)));
+	model.nFilter         = settings.nFilter;
+	model.filters.assign(model.nFilter * model.channels.size(), 0);
+	model.weights.assign(model.nFilter, 0);
+
+	std::string error;
+	if (!checkMotorImageryModel(model, header.nChannel, error) || model.nFilter > model.channels.size())
+	{
+		std::fprintf(stderr, "Invalid settings: %s\n", error.empty() ? "more filters than channels" : error.c_str());
+		return 1;
+	}
+
+	// band-pass of the selected channels, as the decoder does it
+	const size_t n = model.channels.size();
+	std::vector<float> filtered(nSample * n);
+	for (size_t s = 0; s < nSample; ++s) { for (size_t i = 0; i < n; ++i) { filtered[s * n + i] = samples[s * header.nChannel + model.channels[i]]; } }
+	CModularBCIFilterBank filterBank;
+	filterBank.initialize(n, sampling);
+	for (size_t i = 0; i < n; ++i)
+	{
+		filterBank.addStage(i, CModularBCIFilterBank::EFilterType::HighPass, model.bandLow, BUTTERWORTH_Q);
+		filterBank.addStage(i, CModularBCIFilterBank::EFilterType::LowPass, model.bandHigh, BUTTERWORTH_Q);
+	}
+	filterBank.process(&filtered[0], nSample);
+
+	// windows of each trial, one every hop
+	const size_t offset    = size_t(std::lround(settings.offsetMs * sampling / 1000));
+	const size_t trialSize = std::max<size_t>(model.windowSize, size_t(std::lround(settings.trialMs * sampling / 1000)));
+	std::vector<epoch_t> epochs;
+	for (size_t t = 0; t < labels.size(); ++t)
+	{
+		for (size_t end = size_t(labels[t].sample) + offset + model.windowSize; end <= size_t(labels[t].sample) + offset + trialSize; end += model.hopSize)
+		{
+			if (end > nSample) { break; }
+			epoch_t epoch;
+			epoch.label = labels[t].name == model.classes[0] ? 0 : 1;
+			epoch.trial = t;
+			computeCovariance(filtered, n, end, model.windowSize, epoch.covariance);
+			epochs.push_back(epoch);
+		}
+	}
+	if (epochs.empty())
+	{
+		std::fprintf(stderr, "No trial fits in the recording\n");
+		return 1;
+	}
+
+	// cross-validation by trial, so that overlapping windows of one trial never end up on both sides
+	if (settings.nFold > 1)
+	{
+		double accuracy = 0;
+		uint32_t nFold  = 0;
+		for (uint32_t fold = 0; fold < settings.nFold; ++fold)
+		{
+			std::vector<bool> isTraining(epochs.size()), isTest(epochs.size());
+			for (size_t e = 0; e < epochs.size(); ++e)
+			{
+				isTest[e]     = epochs[e].trial % settings.nFold == fold;
+				isTraining[e] = !isTest[e];
+			}
+			motor_imagery_model_t foldModel = model;
+			if (!train(epochs, isTraining, settings.shrinkage, foldModel)) { continue; }
+			accuracy += evaluate(epochs, isTest, foldModel);
+			nFold++;
+		}
+		if (nFold != 0) { std::printf("%u-fold cross-validation accuracy: %.1f%%\n", nFold, 100 * accuracy / nFold); }
+	}
+
+	const std::vector<bool> all(epochs.size(), true);
+	if (!train(epochs, all, settings.shrinkage, model))
+	{
+		std::fprintf(stderr, "Training failed, the class covariances are singular (too few trials or dead channels?)\n");
+		return 1;
+	}
+	std::printf("Training accuracy: %.1f%% over %u windows of %u trials (%s / %s)\n", 100 * evaluate(epochs, all, model), uint32_t(epochs.size()),
+				uint32_t(labels.size()), model.classes[0].c_str(), model.classes[1].c_str());
+
+	if (!saveMotorImageryModel(settings.output, model))
+	{
+		std::fprintf(stderr, "Can't write [%s]\n", settings.output.c_str());
+		return 1;
+	}
+	std::printf("Model written to [%s]\n", settings.output.c_str());
+	return 0;
+}